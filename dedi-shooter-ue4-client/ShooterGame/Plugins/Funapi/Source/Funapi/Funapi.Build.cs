@@ -50,6 +50,15 @@ public class Funapi : ModuleRules
       PublicDefinitions.Add("FUNAPI_HAVE_RPC=1");
     }
 
+    // sendmmsg/recvmmsg for the UDP transport
+    if (Target.Platform == UnrealTargetPlatform.Linux ||
+        Target.Platform == UnrealTargetPlatform.Android) {
+      PublicDefinitions.Add("FUNAPI_HAVE_UDP_MMSG=1");
+    }
+    else {
+      PublicDefinitions.Add("FUNAPI_HAVE_UDP_MMSG=0");
+    }
+
     if (Target.Platform == UnrealTargetPlatform.Win32 ||
         Target.Platform == UnrealTargetPlatform.Win64) {
       PublicDefinitions.Add("FUNAPI_PLATFORM_WINDOWS=1");
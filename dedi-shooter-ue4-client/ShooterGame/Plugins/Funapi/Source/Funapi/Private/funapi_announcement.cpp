@@ -273,6 +273,379 @@ const fun::vector<std::shared_ptr<FunapiExtraImageInfo>>& FunapiAnnouncementInfo
 }
 
 
+////////////////////////////////////////////////////////////////////////////////
+// FunapiAnnouncementCache implementation.
+
+namespace
+{
+
+// Returns the status code of the last response in the headers.
+int GetResponseCode(const fun::vector<fun::string> &headers) {
+  int code = 0;
+  for (auto &h : headers) {
+    if (h.compare(0, 5, "HTTP/") == 0) {
+      size_t pos = h.find(' ');
+      if (pos != fun::string::npos) {
+        code = atoi(h.c_str() + pos + 1);
+      }
+    }
+  }
+  return code;
+}
+
+
+fun::string GetHeaderValue(const fun::vector<fun::string> &headers, const fun::string &name) {
+  for (auto &h : headers) {
+    if (h.length() <= name.length() || h[name.length()] != ':') {
+      continue;
+    }
+
+    bool is_same = true;
+    for (size_t i = 0; i < name.length() && is_same; ++i) {
+      is_same = (tolower(static_cast<unsigned char>(h[i])) == name[i]);
+    }
+    if (!is_same) {
+      continue;
+    }
+
+    size_t begin = h.find_first_not_of(" \t", name.length() + 1);
+    size_t end = h.find_last_not_of(" \t\r\n");
+    if (begin == fun::string::npos || end < begin) {
+      return "";
+    }
+    return h.substr(begin, end - begin + 1);
+  }
+  return "";
+}
+
+
+// Writes a temporary file and renames it, so that a file is never half written.
+bool WriteFileAtomically(const fun::string &path, const void *data, const size_t length) {
+  fun::string temp_path = path + ".tmp";
+  FILE *fp = fopen(temp_path.c_str(), "wb");
+  if (fp == NULL) {
+    return false;
+  }
+
+  bool is_ok = (fwrite(data, 1, length, fp) == length);
+  is_ok = (fclose(fp) == 0) && is_ok;
+
+  remove(path.c_str());
+  if (!is_ok || rename(temp_path.c_str(), path.c_str()) != 0) {
+    remove(temp_path.c_str());
+    return false;
+  }
+
+  return true;
+}
+
+
+bool ReadFileToVector(const fun::string &path, fun::vector<uint8_t> &data) {
+  FILE *fp = fopen(path.c_str(), "rb");
+  if (fp == NULL) {
+    return false;
+  }
+
+  data.clear();
+  uint8_t buffer[16 * 1024];
+  size_t length;
+  while ((length = fread(buffer, 1, sizeof(buffer), fp)) != 0) {
+    data.insert(data.end(), buffer, buffer + length);
+  }
+  fclose(fp);
+
+  return true;
+}
+
+
+fun::vector<fun::string> SplitTabs(const fun::string &line) {
+  fun::vector<fun::string> fields;
+  size_t begin = 0;
+  while (true) {
+    size_t end = line.find('\t', begin);
+    fields.push_back(line.substr(begin, end == fun::string::npos ? fun::string::npos : end - begin));
+    if (end == fun::string::npos) {
+      break;
+    }
+    begin = end + 1;
+  }
+  return fields;
+}
+
+} // unnamed space
+
+
+// Responses cached on disk under <path>.funapi_cache/. A body is stored
+// by its md5, so that an image used by several announcements is fetched
+// once. The validators of each url are kept for conditional requests, and
+// the copies at the announcement file paths are recorded with their stat,
+// so that they are not hashed again. It is used on the _file thread only.
+class FunapiAnnouncementCache : public std::enable_shared_from_this<FunapiAnnouncementCache> {
+ public:
+  struct Entry {
+    fun::string md5;
+    fun::string etag;
+    fun::string last_modified;
+  };
+
+  FunapiAnnouncementCache() = delete;
+  FunapiAnnouncementCache(const fun::string &path);
+  virtual ~FunapiAnnouncementCache() = default;
+
+  void AddConditionalHeaders(const fun::string &url, FunapiHttp::HeaderFields &header);
+  const Entry* Find(const fun::string &url);
+  void Put(const fun::string &url, const fun::vector<fun::string> &headers, const fun::string &md5);
+
+  bool HasObject(const fun::string &md5);
+  bool ReadObject(const fun::string &md5, fun::vector<uint8_t> &body);
+  fun::string PutObject(const fun::vector<uint8_t> &body);
+  fun::string MoveObjectFile(const fun::string &temp_path);
+  bool CopyObjectFile(const fun::string &file_path, const fun::string &md5);
+  bool CopyObject(const fun::string &md5, const fun::string &file_path);
+  fun::string GetTempPath();
+
+  bool IsFileCopied(const fun::string &file_path, const fun::string &md5);
+  void SetFileCopied(const fun::string &file_path, const fun::string &md5);
+
+  void Save();
+
+ private:
+  struct CopiedFile {
+    fun::string md5;
+    uint64_t size = 0;
+    int64_t mtime = 0;
+    uint64_t inode = 0;
+  };
+
+  void Load();
+  fun::string GetObjectPath(const fun::string &md5);
+
+  fun::string dir_;
+  bool loaded_ = false;
+  bool dirty_ = false;
+
+  fun::map<fun::string, Entry> entries_;           // by url
+  fun::map<fun::string, CopiedFile> copied_files_;  // by file path
+};
+
+
+FunapiAnnouncementCache::FunapiAnnouncementCache(const fun::string &path)
+: dir_(path + ".funapi_cache/") {
+}
+
+
+void FunapiAnnouncementCache::Load() {
+  if (loaded_) {
+    return;
+  }
+  loaded_ = true;
+
+  if (!FunapiUtil::IsDirectoryExists(dir_)) {
+    FunapiUtil::CreateDirectory(dir_);
+  }
+
+  fun::vector<uint8_t> data;
+  if (!ReadFileToVector(dir_ + "index", data)) {
+    return;
+  }
+
+  // u url md5 etag last_modified, or f path md5 size mtime inode
+  fun::string text(data.begin(), data.end());
+  size_t pos = 0;
+  while (pos < text.length()) {
+    size_t eol = text.find('\n', pos);
+    if (eol == fun::string::npos) {
+      eol = text.length();
+    }
+    fun::vector<fun::string> fields = SplitTabs(text.substr(pos, eol - pos));
+    pos = eol + 1;
+
+    if (fields.size() == 5 && fields[0] == "u") {
+      Entry &entry = entries_[fields[1]];
+      entry.md5 = fields[2];
+      entry.etag = fields[3];
+      entry.last_modified = fields[4];
+    }
+    else if (fields.size() == 6 && fields[0] == "f") {
+      CopiedFile &file = copied_files_[fields[1]];
+      file.md5 = fields[2];
+      file.size = strtoull(fields[3].c_str(), NULL, 10);
+      file.mtime = strtoll(fields[4].c_str(), NULL, 10);
+      file.inode = strtoull(fields[5].c_str(), NULL, 10);
+    }
+  }
+}
+
+
+void FunapiAnnouncementCache::Save() {
+  if (!dirty_) {
+    return;
+  }
+  dirty_ = false;
+
+  fun::stringstream ss;
+  for (auto &iter : entries_) {
+    const Entry &entry = iter.second;
+    ss << "u\t" << iter.first << "\t" << entry.md5 << "\t"
+       << entry.etag << "\t" << entry.last_modified << "\n";
+  }
+  for (auto &iter : copied_files_) {
+    const CopiedFile &file = iter.second;
+    ss << "f\t" << iter.first << "\t" << file.md5 << "\t" << file.size << "\t"
+       << file.mtime << "\t" << file.inode << "\n";
+  }
+
+  fun::string text = ss.str();
+  WriteFileAtomically(dir_ + "index", text.data(), text.length());
+}
+
+
+fun::string FunapiAnnouncementCache::GetObjectPath(const fun::string &md5) {
+  return dir_ + md5;
+}
+
+
+void FunapiAnnouncementCache::AddConditionalHeaders(const fun::string &url, FunapiHttp::HeaderFields &header) {
+  const Entry *entry = Find(url);
+  if (entry == nullptr || !HasObject(entry->md5)) {
+    return;
+  }
+
+  if (!entry->etag.empty()) {
+    header["If-None-Match"] = entry->etag;
+  }
+  if (!entry->last_modified.empty()) {
+    header["If-Modified-Since"] = entry->last_modified;
+  }
+}
+
+
+const FunapiAnnouncementCache::Entry* FunapiAnnouncementCache::Find(const fun::string &url) {
+  Load();
+
+  auto iter = entries_.find(url);
+  if (iter == entries_.end()) {
+    return nullptr;
+  }
+  return &iter->second;
+}
+
+
+void FunapiAnnouncementCache::Put(const fun::string &url,
+                                  const fun::vector<fun::string> &headers,
+                                  const fun::string &md5) {
+  Load();
+
+  Entry &entry = entries_[url];
+  entry.md5 = md5;
+  entry.etag = GetHeaderValue(headers, "etag");
+  entry.last_modified = GetHeaderValue(headers, "last-modified");
+  dirty_ = true;
+}
+
+
+bool FunapiAnnouncementCache::HasObject(const fun::string &md5) {
+  Load();
+  return !md5.empty() && FunapiUtil::IsFileExists(GetObjectPath(md5));
+}
+
+
+bool FunapiAnnouncementCache::ReadObject(const fun::string &md5, fun::vector<uint8_t> &body) {
+  return HasObject(md5) && ReadFileToVector(GetObjectPath(md5), body);
+}
+
+
+fun::string FunapiAnnouncementCache::PutObject(const fun::vector<uint8_t> &body) {
+  Load();
+
+  FunapiMD5 ctx;
+  ctx.Update(body.data(), body.size());
+  fun::string md5 = ctx.GetHexDigest();
+
+  if (!FunapiUtil::IsFileExists(GetObjectPath(md5)) &&
+      !WriteFileAtomically(GetObjectPath(md5), body.data(), body.size())) {
+    return "";
+  }
+
+  return md5;
+}
+
+
+// Moves a downloaded file into the cache. Returns its md5.
+fun::string FunapiAnnouncementCache::MoveObjectFile(const fun::string &temp_path) {
+  Load();
+
+  fun::string md5;
+  if (!FunapiUtil::MD5File(temp_path, &md5, nullptr)) {
+    return "";
+  }
+
+  if (FunapiUtil::IsFileExists(GetObjectPath(md5))) {
+    remove(temp_path.c_str());
+  }
+  else if (rename(temp_path.c_str(), GetObjectPath(md5).c_str()) != 0) {
+    remove(temp_path.c_str());
+    return "";
+  }
+
+  return md5;
+}
+
+
+bool FunapiAnnouncementCache::CopyObjectFile(const fun::string &file_path, const fun::string &md5) {
+  fun::vector<uint8_t> body;
+  return HasObject(md5) ||
+         (ReadFileToVector(file_path, body) &&
+          WriteFileAtomically(GetObjectPath(md5), body.data(), body.size()));
+}
+
+
+fun::string FunapiAnnouncementCache::GetTempPath() {
+  Load();
+  return dir_ + "download.tmp";
+}
+
+
+bool FunapiAnnouncementCache::CopyObject(const fun::string &md5, const fun::string &file_path) {
+  fun::vector<uint8_t> body;
+  if (!ReadObject(md5, body) || !WriteFileAtomically(file_path, body.data(), body.size())) {
+    return false;
+  }
+
+  SetFileCopied(file_path, md5);
+  return true;
+}
+
+
+bool FunapiAnnouncementCache::IsFileCopied(const fun::string &file_path, const fun::string &md5) {
+  Load();
+
+  auto iter = copied_files_.find(file_path);
+  if (iter == copied_files_.end() || iter->second.md5 != md5) {
+    return false;
+  }
+
+  uint64_t size = 0;
+  int64_t mtime = 0;
+  uint64_t inode = 0;
+  const CopiedFile &file = iter->second;
+  return FunapiUtil::GetFileStat(file_path, size, mtime, inode) &&
+         size == file.size && mtime == file.mtime && inode == file.inode;
+}
+
+
+void FunapiAnnouncementCache::SetFileCopied(const fun::string &file_path, const fun::string &md5) {
+  Load();
+
+  CopiedFile file;
+  file.md5 = md5;
+  if (FunapiUtil::GetFileStat(file_path, file.size, file.mtime, file.inode)) {
+    copied_files_[file_path] = file;
+    dirty_ = true;
+  }
+}
+
+
 ////////////////////////////////////////////////////////////////////////////////
 // FunapiAnnouncement implementation.
 
@@ -291,10 +664,26 @@ class FunapiAnnouncementImpl : public std::enable_shared_from_this<FunapiAnnounc
   static std::shared_ptr<FunapiTasks> GetFunapiTasks();
 
  private:
-  void OnAnnouncementInfoList(const fun::string &json_string);
+  // Decoded list pages, most recently used last. They are shared by the
+  // instances on the _file thread.
+  struct Page {
+    fun::string key;  // url and md5 of the body
+    fun::vector<std::shared_ptr<FunapiAnnouncementInfo>> info_list;
+  };
+
+  static const size_t kMaxPages = 8;
+  static fun::deque<Page>& GetPages();
+  static std::shared_ptr<FunapiAnnouncementCache> GetCache(const fun::string &path);
+
+  void SendListRequest(const fun::string &url, const bool conditional);
+  void OnListResponse(const fun::string &url,
+                      const bool conditional,
+                      const fun::vector<fun::string> &headers,
+                      const fun::vector<uint8_t> &body);
+  void OnAnnouncementInfoList(const fun::string &json_string, const fun::string &page_key);
 
   void DownloadFiles();
-  bool DownloadFile(const fun::string &url, const fun::string &path);
+  bool DownloadFile(const fun::string &url, const fun::string &md5, const fun::string &path);
   bool IsDownloadFile(const fun::string &file_path, const fun::string &md5_str);
   bool MD5Compare(const fun::string &file_path, const fun::string &md5_str);
 
@@ -310,6 +699,7 @@ class FunapiAnnouncementImpl : public std::enable_shared_from_this<FunapiAnnounc
 
   std::shared_ptr<FunapiTasks> tasks_;
   std::shared_ptr<FunapiThread> thread_;
+  std::shared_ptr<FunapiAnnouncementCache> cache_;
 };
 
 
@@ -317,6 +707,7 @@ FunapiAnnouncementImpl::FunapiAnnouncementImpl(const fun::string &url, const fun
 : url_(url), path_(path) {
   tasks_ = FunapiAnnouncementImpl::GetFunapiTasks();
   thread_ = FunapiThread::Get("_file");
+  cache_ = FunapiAnnouncementImpl::GetCache(path);
 }
 
 
@@ -343,7 +734,7 @@ void FunapiAnnouncementImpl::OnCompletion(const FunapiAnnouncement::ResultCode r
 }
 
 
-void FunapiAnnouncementImpl::OnAnnouncementInfoList(const fun::string &json_string) {
+void FunapiAnnouncementImpl::OnAnnouncementInfoList(const fun::string &json_string, const fun::string &page_key) {
   rapidjson::Document document;
   document.Parse<0>(json_string.c_str());
 
@@ -443,6 +834,18 @@ void FunapiAnnouncementImpl::OnAnnouncementInfoList(const fun::string &json_stri
       info_list_.push_back(std::make_shared<FunapiAnnouncementInfo>(date, message, subject, image_md5, image_url, link_url, path, kind, extra_images));
     }
 
+    if (!page_key.empty()) {
+      auto &pages = GetPages();
+      if (pages.size() >= kMaxPages) {
+        pages.pop_front();
+      }
+
+      Page page;
+      page.key = page_key;
+      page.info_list = info_list_;
+      pages.push_back(page);
+    }
+
     DownloadFiles();
   }
 
@@ -469,33 +872,97 @@ void FunapiAnnouncementImpl::RequestList(std::weak_ptr<FunapiAnnouncement> a, in
 
       DebugUtils::Log("RequestList - url = %s", ss_url.str().c_str());
 
-      auto http = FunapiHttp::Create();
-      http->GetRequest
-      (ss_url.str(),
-       FunapiHttp::HeaderFields(),
-       [this]
-       (const int error_code,
-        const fun::string error_string)
-      {
-        fun::stringstream ss_temp;
-        ss_temp << error_code << " " << error_string;
-        DebugUtils::Log ("%s\n", ss_temp.str().c_str());
+      SendListRequest(ss_url.str(), true);
+    }
+
+    return true;
+  });
+}
+
+
+void FunapiAnnouncementImpl::SendListRequest(const fun::string &url, const bool conditional) {
+  FunapiHttp::HeaderFields header;
+  if (conditional) {
+    cache_->AddConditionalHeaders(url, header);
+  }
+
+  auto http = FunapiHttp::Create();
+  http->GetRequest
+  (url,
+   header,
+   [this]
+   (const int error_code,
+    const fun::string error_string)
+  {
+    fun::stringstream ss_temp;
+    ss_temp << error_code << " " << error_string;
+    DebugUtils::Log ("%s\n", ss_temp.str().c_str());
+
+    OnCompletion(FunapiAnnouncement::ResultCode::kInvalidUrl);
+  },
+   [this, url, conditional]
+   (const fun::vector<fun::string> &headers,
+    const fun::vector<uint8_t> &v_recv)
+  {
+    OnListResponse(url, conditional, headers, v_recv);
+  });
+}
+
+
+void FunapiAnnouncementImpl::OnListResponse(const fun::string &url,
+                                            const bool conditional,
+                                            const fun::vector<fun::string> &headers,
+                                            const fun::vector<uint8_t> &body) {
+  int code = GetResponseCode(headers);
+  fun::vector<uint8_t> cached_body;
+  fun::string md5;
+
+  if (code == 304) {
+    // Not modified. The list is in the cache.
+    const FunapiAnnouncementCache::Entry *entry = cache_->Find(url);
+    if (entry) {
+      md5 = entry->md5;
+    }
 
+    if (md5.empty() || !cache_->ReadObject(md5, cached_body)) {
+      if (conditional) {
+        SendListRequest(url, false);
+      }
+      else {
         OnCompletion(FunapiAnnouncement::ResultCode::kInvalidUrl);
-      },
-       [this]
-       (const fun::vector<fun::string> &headers,
-        const fun::vector<uint8_t> &v_recv)
-      {
-        fun::string temp(v_recv.begin(), v_recv.end());
-        DebugUtils::Log ("%s\n", temp.c_str());
+      }
+      return;
+    }
+  }
+  else if (code == 200) {
+    md5 = cache_->PutObject(body);
+    if (!md5.empty()) {
+      cache_->Put(url, headers, md5);
+    }
+  }
+
+  const fun::vector<uint8_t> &list_body = (code == 304) ? cached_body : body;
+  DebugUtils::Log ("%s\n", fun::string(list_body.begin(), list_body.end()).c_str());
+
+  fun::string page_key;
+  if (!md5.empty()) {
+    page_key = path_ + " " + url + " " + md5;
+
+    auto &pages = GetPages();
+    for (auto iter = pages.begin(); iter != pages.end(); ++iter) {
+      if (iter->key == page_key) {
+        Page page = *iter;
+        pages.erase(iter);
+        pages.push_back(page);
 
-        OnAnnouncementInfoList(fun::string(v_recv.begin(), v_recv.end()));
-      });
+        info_list_ = page.info_list;
+        DownloadFiles();
+        return;
+      }
     }
+  }
 
-    return true;
-  });
+  OnAnnouncementInfoList(fun::string(list_body.begin(), list_body.end()), page_key);
 }
 
 
@@ -507,15 +974,12 @@ void FunapiAnnouncementImpl::DownloadFiles() {
 
   for (size_t i=0;i<info_list_.size();++i) {
     auto &info = info_list_[i];
-    // pair url, file path
-    fun::vector<std::pair<fun::string, fun::string>> download_list;
+    // url, md5, file path
+    fun::vector<std::tuple<fun::string, fun::string, fun::string>> download_list;
 
     if (info->GetImageUrl().length() > 0)
     {
-      if (IsDownloadFile(info->GetFilePath(), info->GetImageMd5()))
-      {
-        download_list.push_back(std::pair<fun::string, fun::string>(info->GetImageUrl(), info->GetFilePath()));
-      }
+      download_list.push_back(std::make_tuple(info->GetImageUrl(), info->GetImageMd5(), info->GetFilePath()));
     }
 
     if (info->GetExtraImageInfos().size() > 0)
@@ -523,41 +987,87 @@ void FunapiAnnouncementImpl::DownloadFiles() {
       auto extra_infos = info->GetExtraImageInfos();
       for (auto &extra_info : extra_infos)
       {
-        if (IsDownloadFile(extra_info->GetFilePath(), extra_info->GetImageMd5()))
-        {
-          download_list.push_back(std::pair<fun::string, fun::string>(extra_info->GetImageUrl(), extra_info->GetFilePath()));
-        }
+        download_list.push_back(std::make_tuple(extra_info->GetImageUrl(), extra_info->GetImageMd5(), extra_info->GetFilePath()));
       }
     }
 
     for (auto &d : download_list)
     {
-      if (!DownloadFile(d.first, d.second))
+      if (!DownloadFile(std::get<0>(d), std::get<1>(d), std::get<2>(d)))
       {
+        cache_->Save();
         OnCompletion(fun::FunapiAnnouncement::ResultCode::kExceptionError);
         return;
       }
     }
   }
 
+  cache_->Save();
   OnCompletion(fun::FunapiAnnouncement::ResultCode::kSucceed);
 }
 
 
-bool FunapiAnnouncementImpl::DownloadFile(const fun::string &url, const fun::string &path) {
+bool FunapiAnnouncementImpl::DownloadFile(const fun::string &url, const fun::string &md5, const fun::string &path) {
+  // Copied before and not changed since.
+  if (cache_->IsFileCopied(path, md5)) {
+    return true;
+  }
+
+  // The same image was downloaded for another announcement.
+  if (cache_->HasObject(md5)) {
+    return cache_->CopyObject(md5, path);
+  }
+
+  // Downloaded before the cache.
+  if (!IsDownloadFile(path, md5)) {
+    cache_->CopyObjectFile(path, md5);
+    cache_->SetFileCopied(path, md5);
+    return true;
+  }
+
+  FunapiHttp::HeaderFields header;
+  cache_->AddConditionalHeaders(url, header);
+
   bool is_ok = true;
+  fun::string object_md5;
+  const fun::string temp_path = cache_->GetTempPath();
 
   auto http = FunapiHttp::Create();
-  http->DownloadRequest(url, path, FunapiHttp::HeaderFields(),[&is_ok](const int error_code, const fun::string error_string)
+  http->DownloadRequest(url, temp_path, header, [&is_ok](const int error_code, const fun::string error_string)
   {
     is_ok = false;
   }, [](const fun::string &request_url, const fun::string &target_path, const uint64_t recv_bytes)
   {
-  }, [](const fun::string &request_url, const fun::string &target_path, const fun::vector<fun::string> &headers)
+  }, [this, &is_ok, &object_md5](const fun::string &request_url, const fun::string &target_path, const fun::vector<fun::string> &headers)
   {
+    int code = GetResponseCode(headers);
+    if (code == 304) {
+      remove(target_path.c_str());
+      if (auto entry = cache_->Find(request_url)) {
+        object_md5 = entry->md5;
+      }
+    }
+    else if (code == 200) {
+      object_md5 = cache_->MoveObjectFile(target_path);
+      if (!object_md5.empty()) {
+        cache_->Put(request_url, headers, object_md5);
+      }
+    }
+    else {
+      remove(target_path.c_str());
+      is_ok = false;
+    }
   });
 
-  return is_ok;
+  if (!is_ok || object_md5.empty()) {
+    return false;
+  }
+
+  if (!md5.empty() && md5 != object_md5) {
+    DebugUtils::Log("The md5 of the image is different from the list. url: %s", url.c_str());
+  }
+
+  return cache_->CopyObject(object_md5, path);
 }
 
 
@@ -596,6 +1106,25 @@ std::shared_ptr<FunapiTasks> FunapiAnnouncementImpl::GetFunapiTasks() {
   return tasks;
 }
 
+
+fun::deque<FunapiAnnouncementImpl::Page>& FunapiAnnouncementImpl::GetPages() {
+  static fun::deque<Page> pages;
+  return pages;
+}
+
+
+std::shared_ptr<FunapiAnnouncementCache> FunapiAnnouncementImpl::GetCache(const fun::string &path) {
+  static std::mutex mutex;
+  static fun::map<fun::string, std::shared_ptr<FunapiAnnouncementCache>> caches;
+
+  std::unique_lock<std::mutex> lock(mutex);
+  auto &cache = caches[path];
+  if (!cache) {
+    cache = std::make_shared<FunapiAnnouncementCache>(path);
+  }
+  return cache;
+}
+
 ////////////////////////////////////////////////////////////////////////////////
 // FunapiAnnouncement implementation.
 
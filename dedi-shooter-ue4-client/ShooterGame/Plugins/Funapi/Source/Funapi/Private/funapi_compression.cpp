@@ -43,6 +43,17 @@ class Compressor : public std::enable_shared_from_this<Compressor>
 
   virtual bool Compress(const fun::vector<uint8_t> &in, fun::vector<uint8_t> &out) = 0;
   virtual bool Decompress(const fun::vector<uint8_t> &in, fun::vector<uint8_t> &out) = 0;
+
+  // Dictionary selection. 0 means no dictionary ID (no dictionary or a raw one).
+  virtual uint32_t GetCompressDictId() { return 0; }
+  virtual bool SetCompressDictId(const uint32_t dict_id) { return dict_id == 0; }
+  virtual bool SetDecompressDictId(const uint32_t dict_id) { return dict_id == 0; }
+
+  // Streaming mode. Messages share one compression history until it is reset.
+  virtual bool HasStream() { return false; }
+  virtual bool CompressStream(const fun::vector<uint8_t> &in, fun::vector<uint8_t> &out, bool &new_frame) { return false; }
+  virtual bool DecompressStream(const fun::vector<uint8_t> &in, fun::vector<uint8_t> &out, const bool reset) { return false; }
+  virtual void ResetCompressStream() {}
 };
 
 
@@ -55,7 +66,7 @@ class CompressorZlib : public Compressor
 {
  public:
   CompressorZlib() = default;
-  virtual ~CompressorZlib() = default;
+  virtual ~CompressorZlib();
 
   CompressionType GetCompressionType();
 
@@ -64,14 +75,85 @@ class CompressorZlib : public Compressor
 
  private:
   size_t GetMaximumLength(size_t in_size);
+
+#if FUNAPI_HAVE_ZLIB
+  // NOTE: z_stream 은 한번만 초기화하고 메시지마다 deflateReset/inflateReset 으로
+  // 재사용합니다. 호출하는 쪽(FunapiCompressionImpl)에서 lock 을 잡습니다.
+  bool InitDeflate();
+  bool InitInflate();
+
+  z_stream deflate_stream_;
+  z_stream inflate_stream_;
+  bool deflate_initialized_ = false;
+  bool inflate_initialized_ = false;
+#endif
 };
 
 
+CompressorZlib::~CompressorZlib() {
+#if FUNAPI_HAVE_ZLIB
+  if (deflate_initialized_) {
+    ::deflateEnd(&deflate_stream_);
+    deflate_initialized_ = false;
+  }
+
+  if (inflate_initialized_) {
+    ::inflateEnd(&inflate_stream_);
+    inflate_initialized_ = false;
+  }
+#endif
+}
+
+
 size_t CompressorZlib::GetMaximumLength(size_t in_size) {
   return 18 + in_size + 5 * (in_size / 16383 + 1);
 }
 
 
+#if FUNAPI_HAVE_ZLIB
+bool CompressorZlib::InitDeflate() {
+  if (deflate_initialized_) {
+    return (::deflateReset(&deflate_stream_) == Z_OK);
+  }
+
+  deflate_stream_.zalloc = Z_NULL;
+  deflate_stream_.zfree = Z_NULL;
+  deflate_stream_.opaque = Z_NULL;
+
+  int result = ::deflateInit2(&deflate_stream_, 3, Z_DEFLATED, ZLIB_WS, 9, Z_DEFAULT_STRATEGY);
+  if (result != Z_OK) {
+    DebugUtils::Log("Failed to initialize zlib deflate stream.");
+    return false;
+  }
+
+  deflate_initialized_ = true;
+  return true;
+}
+
+
+bool CompressorZlib::InitInflate() {
+  if (inflate_initialized_) {
+    return (::inflateReset(&inflate_stream_) == Z_OK);
+  }
+
+  inflate_stream_.zalloc = Z_NULL;
+  inflate_stream_.zfree = Z_NULL;
+  inflate_stream_.opaque = Z_NULL;
+  inflate_stream_.next_in = Z_NULL;
+  inflate_stream_.avail_in = 0;
+
+  int result = ::inflateInit2(&inflate_stream_, ZLIB_WS);
+  if (result != Z_OK) {
+    DebugUtils::Log("Failed to initialize zlib stream.");
+    return false;
+  }
+
+  inflate_initialized_ = true;
+  return true;
+}
+#endif
+
+
 CompressionType CompressorZlib::GetCompressionType()
 {
 #if FUNAPI_HAVE_ZLIB
@@ -89,24 +171,18 @@ bool CompressorZlib::Compress(const fun::vector<uint8_t> &in, fun::vector<uint8_
   const size_t max_size = GetMaximumLength(in_size);
   out.resize(max_size);
 
-  z_stream zstr;
-  zstr.zalloc = Z_NULL;
-  zstr.zfree = Z_NULL;
-  zstr.opaque = Z_NULL;
+  if (false == InitDeflate()) {
+    return false;
+  }
 
+  z_stream &zstr = deflate_stream_;
   zstr.next_in = const_cast<uint8_t*>(in.data());
   zstr.avail_in = static_cast<unsigned int>(in_size);
   zstr.next_out = out.data();
   zstr.avail_out = static_cast<unsigned int>(max_size);
 
-  int result = ::deflateInit2(&zstr, 3, Z_DEFLATED, ZLIB_WS, 9, Z_DEFAULT_STRATEGY);
-  if (result != Z_OK) {
-    return false;
-  }
-
-  result = deflate(&zstr, Z_FINISH);
+  int result = ::deflate(&zstr, Z_FINISH);
   if (result != Z_STREAM_END) {
-    deflateEnd(&zstr);
     return false;
   }
 
@@ -116,10 +192,6 @@ bool CompressorZlib::Compress(const fun::vector<uint8_t> &in, fun::vector<uint8_
   }
 
   out.resize(out_size);
-  result = deflateEnd(&zstr);
-  if (result != Z_OK) {
-    return false;
-  }
 #endif
 
   return true;
@@ -129,31 +201,23 @@ bool CompressorZlib::Compress(const fun::vector<uint8_t> &in, fun::vector<uint8_
 bool CompressorZlib::Decompress(const fun::vector<uint8_t> &in, fun::vector<uint8_t> &out)
 {
 #if FUNAPI_HAVE_ZLIB
-  z_stream zstr;
-  zstr.zalloc = Z_NULL;
-  zstr.zfree = Z_NULL;
-  zstr.opaque = Z_NULL;
+  if (false == InitInflate()) {
+    return false;
+  }
 
+  z_stream &zstr = inflate_stream_;
   zstr.next_in = const_cast<uint8_t*>(in.data());
   zstr.avail_in = static_cast<unsigned int>(in.size());
   zstr.next_out = out.data();
   zstr.avail_out = static_cast<unsigned int>(out.size());
 
-  int result = ::inflateInit2(&zstr, ZLIB_WS);
-  if (result != Z_OK) {
-    DebugUtils::Log("Failed to initialize zlib stream.");
-    return false;
-  }
-
-  result = inflate(&zstr, Z_FINISH);
+  int result = ::inflate(&zstr, Z_FINISH);
   if (result != Z_STREAM_END) {
-    ::inflateEnd(&zstr);
     DebugUtils::Log("Failed to compress (zlib).");
     return false;
   }
 
-  result = ::inflateEnd(&zstr);
-  if (result != Z_OK || zstr.avail_out != 0) {
+  if (zstr.avail_out != 0) {
     DebugUtils::Log("Failed to finish compression (zlib).");
     return false;
   }
@@ -176,7 +240,17 @@ class CompressorZstd : public Compressor
   bool Compress(const fun::vector<uint8_t> &in, fun::vector<uint8_t> &out);
   bool Decompress(const fun::vector<uint8_t> &in, fun::vector<uint8_t> &out);
 
+  uint32_t GetCompressDictId();
+  bool SetCompressDictId(const uint32_t dict_id);
+  bool SetDecompressDictId(const uint32_t dict_id);
+
   void SetDictBase64String(const fun::string &zstd_dict_base64string);
+  void AddDictBase64String(const fun::string &zstd_dict_base64string);
+
+  bool HasStream();
+  bool CompressStream(const fun::vector<uint8_t> &in, fun::vector<uint8_t> &out, bool &new_frame);
+  bool DecompressStream(const fun::vector<uint8_t> &in, fun::vector<uint8_t> &out, const bool reset);
+  void ResetCompressStream();
 
  private:
 #if FUNAPI_HAVE_ZSTD
@@ -187,10 +261,34 @@ class CompressorZstd : public Compressor
 #endif
 
   void Cleanup();
+  void CleanupDict();
 
 #if FUNAPI_HAVE_ZSTD
+  // NOTE: ZSTD_CCtx/ZSTD_DCtx 는 처음 사용할 때 생성해서 계속 재사용합니다.
+  // ZSTD_compressBegin*/ZSTD_compressCCtx/ZSTD_decompressBegin* 계열 함수가
+  // 매번 context 를 초기화하기 때문에 별도의 reset 은 필요하지 않습니다.
+  // 호출하는 쪽(FunapiCompressionImpl)에서 lock 을 잡습니다.
+  ::ZSTD_CCtx *cctx_ = NULL;
+  ::ZSTD_DCtx *dctx_ = NULL;
+
+  // 사전은 dictionary ID 별로 보관합니다. cdict_/ddict_ 는 현재 압축/해제에
+  // 사용할 사전을 가리킬 뿐이고 메모리는 dicts_ 가 관리합니다.
+  struct Dictionary {
+    ::ZSTD_CDict *cdict;
+    ::ZSTD_DDict *ddict;
+  };
+  fun::map<uint32_t, Dictionary> dicts_;
+  uint32_t default_dict_id_ = 0;
+  uint32_t cdict_id_ = 0;
+
   ::ZSTD_CDict *cdict_ = NULL;
   ::ZSTD_DDict *ddict_ = NULL;
+
+  // 스트리밍 모드에서는 하나의 frame 을 끝내지 않고 메시지마다 flush 합니다.
+  // 이전 메시지들이 다음 메시지의 match window 가 됩니다.
+  ::ZSTD_CStream *cstream_ = NULL;
+  ::ZSTD_DStream *dstream_ = NULL;
+  bool cstream_started_ = false;
 #endif
 };
 
@@ -199,6 +297,8 @@ class CompressorZstd : public Compressor
 #define kZstdCompressionLevel (1)
 #define kZstdMinBlock (1UL << ZSTD_BLOCKSIZELOG_MAX)
 #define kZstdNoFrameParam {0, 0, 1}
+// frame header (max 18 bytes) + block header (3 bytes)
+#define kZstdStreamHeaderMargin (32)
 #endif
 
 CompressorZstd::~CompressorZstd() {
@@ -208,16 +308,51 @@ CompressorZstd::~CompressorZstd() {
 
 void CompressorZstd::Cleanup() {
 #if FUNAPI_HAVE_ZSTD
-  if (ddict_) {
-    ::ZSTD_freeDDict(ddict_);
-    ddict_ = NULL;
+  if (cctx_) {
+    ::ZSTD_freeCCtx(cctx_);
+    cctx_ = NULL;
   }
 
-  if (cdict_) {
-    ::ZSTD_freeCDict(cdict_);
-    cdict_ = NULL;
+  if (dctx_) {
+    ::ZSTD_freeDCtx(dctx_);
+    dctx_ = NULL;
+  }
+
+  if (cstream_) {
+    ::ZSTD_freeCStream(cstream_);
+    cstream_ = NULL;
+    cstream_started_ = false;
+  }
+
+  if (dstream_) {
+    ::ZSTD_freeDStream(dstream_);
+    dstream_ = NULL;
   }
 #endif
+
+  CleanupDict();
+}
+
+
+void CompressorZstd::CleanupDict() {
+#if FUNAPI_HAVE_ZSTD
+  for (auto &iter : dicts_) {
+    if (iter.second.ddict) {
+      ::ZSTD_freeDDict(iter.second.ddict);
+    }
+
+    if (iter.second.cdict) {
+      ::ZSTD_freeCDict(iter.second.cdict);
+    }
+  }
+
+  dicts_.clear();
+  default_dict_id_ = 0;
+  cdict_id_ = 0;
+  cdict_ = NULL;
+  ddict_ = NULL;
+  cstream_started_ = false;
+#endif
 }
 
 
@@ -325,10 +460,12 @@ CompressionType CompressorZstd::GetCompressionType()
 bool CompressorZstd::Compress(const fun::vector<uint8_t> &in, fun::vector<uint8_t> &out)
 {
 #if FUNAPI_HAVE_ZSTD
-  ::ZSTD_CCtx *ctxt = ::ZSTD_createCCtx();
-  if (!ctxt) {
-    DebugUtils::Log("Cannot allocate ZSTD_CCtx.");
-    return false;
+  if (!cctx_) {
+    cctx_ = ::ZSTD_createCCtx();
+    if (!cctx_) {
+      DebugUtils::Log("Cannot allocate ZSTD_CCtx.");
+      return false;
+    }
   }
 
   const size_t in_size = in.size();
@@ -337,19 +474,18 @@ bool CompressorZstd::Compress(const fun::vector<uint8_t> &in, fun::vector<uint8_
   size_t compressed_size = 0;
 
   if (in_size >= kZstdMinBlock || in_size == 0) {
-    compressed_size = DoCompress(ctxt,
+    compressed_size = DoCompress(cctx_,
                                  in.data(),
                                  in_size,
                                  out.data(),
                                  max_size);
   } else {
-    compressed_size = DoCompressSmall(ctxt,
+    compressed_size = DoCompressSmall(cctx_,
                                       in.data(),
                                       in_size,
                                       out.data(),
                                       max_size);
   }
-  ::ZSTD_freeCCtx(ctxt);
 
   if (in_size < compressed_size || compressed_size == 0) {
     return false;
@@ -368,48 +504,315 @@ bool CompressorZstd::Decompress(const fun::vector<uint8_t> &in, fun::vector<uint
   size_t expected_size = out.size();
 
   size_t out_size = 0;
-  ::ZSTD_DCtx *ctxt = ::ZSTD_createDCtx();
-  if (!ctxt) {
-    DebugUtils::Log("Cannot allocate ZSTD_DCtx");
-    return false;
+  if (!dctx_) {
+    dctx_ = ::ZSTD_createDCtx();
+    if (!dctx_) {
+      DebugUtils::Log("Cannot allocate ZSTD_DCtx");
+      return false;
+    }
   }
 
   if (expected_size == 0 || expected_size >= kZstdMinBlock) {
-    out_size = DoDecompress(ctxt,
+    out_size = DoDecompress(dctx_,
                             out.data(),
                             expected_size,
                             in.data(),
                             in.size());
   } else {
-    out_size = DoDecompressSmall(ctxt,
+    out_size = DoDecompressSmall(dctx_,
                                  out.data(),
                                  expected_size,
                                  in.data(),
                                  in.size());
   }
-  ::ZSTD_freeDCtx(ctxt);
 
-  return (out.size() == expected_size);
+  return (out_size == expected_size);
 #else
   return true;
 #endif
 }
 
 
-void CompressorZstd::SetDictBase64String(const fun::string &zstd_dict_base64string) {
+uint32_t CompressorZstd::GetCompressDictId() {
+#if FUNAPI_HAVE_ZSTD
+  return cdict_id_;
+#else
+  return 0;
+#endif
+}
+
+
+bool CompressorZstd::SetCompressDictId(const uint32_t dict_id) {
+#if FUNAPI_HAVE_ZSTD
+  auto iter = dicts_.find(dict_id);
+  if (iter == dicts_.end()) {
+    return false;
+  }
+
+  if (cdict_id_ != dict_id) {
+    // 사전이 바뀌면 스트림을 처음부터 다시 시작해야 합니다.
+    cstream_started_ = false;
+  }
+
+  cdict_id_ = dict_id;
+  cdict_ = iter->second.cdict;
+#endif
+
+  return true;
+}
+
+
+bool CompressorZstd::SetDecompressDictId(const uint32_t dict_id) {
+#if FUNAPI_HAVE_ZSTD
+  // NOTE: dictionary ID 가 없는 메시지는 이전과 같이 기본 사전으로 해제합니다.
+  uint32_t id = dict_id;
+  if (id == 0 && dicts_.find(0) == dicts_.end()) {
+    id = default_dict_id_;
+  }
+
+  auto iter = dicts_.find(id);
+  if (iter == dicts_.end()) {
+    if (dict_id != 0) {
+      return false;
+    }
+
+    ddict_ = NULL;
+    return true;
+  }
+
+  ddict_ = iter->second.ddict;
+#endif
+
+  return true;
+}
+
+
+bool CompressorZstd::HasStream() {
+#if FUNAPI_HAVE_ZSTD
+  return true;
+#else
+  return false;
+#endif
+}
+
+
+void CompressorZstd::ResetCompressStream() {
+#if FUNAPI_HAVE_ZSTD
+  cstream_started_ = false;
+#endif
+}
+
+
+bool CompressorZstd::CompressStream(const fun::vector<uint8_t> &in, fun::vector<uint8_t> &out, bool &new_frame)
+{
+  new_frame = false;
+
+#if FUNAPI_HAVE_ZSTD
+  if (!cstream_) {
+    cstream_ = ::ZSTD_createCStream();
+    if (!cstream_) {
+      DebugUtils::Log("Cannot allocate ZSTD_CStream.");
+      return false;
+    }
+  }
+
+  size_t rv = 0;
+  if (!cstream_started_) {
+    if (cdict_) {
+      rv = ::ZSTD_initCStream_usingCDict(cstream_, cdict_);
+    }
+    else {
+      rv = ::ZSTD_initCStream(cstream_, kZstdCompressionLevel);
+    }
+
+    if (::ZSTD_isError(rv)) {
+      fun::stringstream ss;
+      ss << __func__ << ": " << ::ZSTD_getErrorName(rv);
+      DebugUtils::Log("%s", ss.str().c_str());
+      return false;
+    }
+
+    cstream_started_ = true;
+    new_frame = true;
+  }
+
+  out.resize(ZSTD_compressBound(in.size()) + kZstdStreamHeaderMargin);
+
+  ::ZSTD_inBuffer input = { in.data(), in.size(), 0 };
+  ::ZSTD_outBuffer output = { out.data(), out.size(), 0 };
+
+  while (input.pos < input.size) {
+    rv = ::ZSTD_compressStream(cstream_, &output, &input);
+    if (::ZSTD_isError(rv)) {
+      break;
+    }
+
+    if (output.pos == output.size) {
+      out.resize(out.size() * 2);
+      output.dst = out.data();
+      output.size = out.size();
+    }
+  }
+
+  while (!::ZSTD_isError(rv)) {
+    rv = ::ZSTD_flushStream(cstream_, &output);
+    if (rv == 0 || ::ZSTD_isError(rv)) {
+      break;
+    }
+
+    out.resize(out.size() * 2);
+    output.dst = out.data();
+    output.size = out.size();
+  }
+
+  if (::ZSTD_isError(rv)) {
+    fun::stringstream ss;
+    ss << __func__ << ": " << ::ZSTD_getErrorName(rv);
+    DebugUtils::Log("%s", ss.str().c_str());
+
+    // 스트림의 상태를 알 수 없으므로 다음 메시지부터 다시 시작합니다.
+    cstream_started_ = false;
+    return false;
+  }
+
+  out.resize(output.pos);
+  return true;
+#else
+  return false;
+#endif
+}
+
+
+bool CompressorZstd::DecompressStream(const fun::vector<uint8_t> &in, fun::vector<uint8_t> &out, const bool reset)
+{
 #if FUNAPI_HAVE_ZSTD
-  fun::vector<uint8_t> dict_buf;
-  if (false == FunapiUtil::DecodeBase64(zstd_dict_base64string, dict_buf)) {
-    DebugUtils::Log("Cannot decode zstd_dict");
+  if (!dstream_) {
+    dstream_ = ::ZSTD_createDStream();
+    if (!dstream_) {
+      DebugUtils::Log("Cannot allocate ZSTD_DStream.");
+      return false;
+    }
+  }
+
+  size_t rv = 0;
+  if (reset) {
+    if (ddict_) {
+      rv = ::ZSTD_initDStream_usingDDict(dstream_, ddict_);
+    }
+    else {
+      rv = ::ZSTD_initDStream(dstream_);
+    }
+
+    if (::ZSTD_isError(rv)) {
+      fun::stringstream ss;
+      ss << __func__ << ": " << ::ZSTD_getErrorName(rv);
+      DebugUtils::Log("%s", ss.str().c_str());
+      return false;
+    }
   }
 
-  cdict_ = ::ZSTD_createCDict(dict_buf.data(), dict_buf.size(), kZstdCompressionLevel);
-  ddict_ = ::ZSTD_createDDict(dict_buf.data(), dict_buf.size());
+  // out 은 원본 길이만큼 잡혀 있습니다.
+  // 입력을 남기면 스트림이 어긋나므로 다 쓸 때까지 out 을 늘려 가며 풉니다.
+  const size_t expected_size = out.size();
+  if (out.empty()) {
+    out.resize(kZstdStreamHeaderMargin);
+  }
 
-  if (cdict_ == NULL || ddict_ == NULL) {
+  ::ZSTD_inBuffer input = { in.data(), in.size(), 0 };
+  ::ZSTD_outBuffer output = { out.data(), out.size(), 0 };
+
+  for (;;) {
+    rv = ::ZSTD_decompressStream(dstream_, &output, &input);
+    if (::ZSTD_isError(rv)) {
+      fun::stringstream ss;
+      ss << __func__ << ": " << ::ZSTD_getErrorName(rv);
+      DebugUtils::Log("%s", ss.str().c_str());
+      return false;
+    }
+
+    // 출력에 여유가 남았으면 디코더에 남은 데이터가 없습니다.
+    if (input.pos == input.size && output.pos < output.size) {
+      break;
+    }
+
+    if (output.pos == output.size) {
+      out.resize(out.size() * 2);
+      output.dst = out.data();
+      output.size = out.size();
+    }
+  }
+
+  out.resize(output.pos);
+
+  if (output.pos != expected_size) {
     fun::stringstream ss;
-    ss << "Failed to load zstd dictionary object.";
+    ss << __func__ << ": decompressed " << output.pos << " bytes, expected " << expected_size;
     DebugUtils::Log("%s", ss.str().c_str());
+    return false;
+  }
+
+  return true;
+#else
+  return false;
+#endif
+}
+
+
+void CompressorZstd::SetDictBase64String(const fun::string &zstd_dict_base64string) {
+  CleanupDict();
+  AddDictBase64String(zstd_dict_base64string);
+}
+
+
+void CompressorZstd::AddDictBase64String(const fun::string &zstd_dict_base64string) {
+#if FUNAPI_HAVE_ZSTD
+  // 여러 버전의 사전을 ',' 로 구분해서 넘길 수 있습니다. 마지막 사전이 기본 사전이 됩니다.
+  size_t begin = 0;
+  while (begin < zstd_dict_base64string.length()) {
+    size_t end = zstd_dict_base64string.find(',', begin);
+    if (end == fun::string::npos) {
+      end = zstd_dict_base64string.length();
+    }
+
+    fun::vector<uint8_t> dict_buf;
+    bool decoded = FunapiUtil::DecodeBase64(zstd_dict_base64string.substr(begin, end - begin), dict_buf);
+    begin = end + 1;
+
+    // 잘못된 사전은 건너뛰고 이전 기본 사전을 유지합니다.
+    if (false == decoded || dict_buf.empty()) {
+      DebugUtils::Log("Cannot decode zstd_dict");
+      continue;
+    }
+
+    Dictionary dict;
+    dict.cdict = ::ZSTD_createCDict(dict_buf.data(), dict_buf.size(), kZstdCompressionLevel);
+    dict.ddict = ::ZSTD_createDDict(dict_buf.data(), dict_buf.size());
+
+    if (dict.cdict == NULL || dict.ddict == NULL) {
+      fun::stringstream ss;
+      ss << "Failed to load zstd dictionary object.";
+      DebugUtils::Log("%s", ss.str().c_str());
+
+      if (dict.cdict) ::ZSTD_freeCDict(dict.cdict);
+      if (dict.ddict) ::ZSTD_freeDDict(dict.ddict);
+      continue;
+    }
+
+    const uint32_t dict_id = ::ZSTD_getDictID_fromDict(dict_buf.data(), dict_buf.size());
+
+    auto iter = dicts_.find(dict_id);
+    if (iter != dicts_.end()) {
+      ::ZSTD_freeCDict(iter->second.cdict);
+      ::ZSTD_freeDDict(iter->second.ddict);
+    }
+    dicts_[dict_id] = dict;
+
+    default_dict_id_ = dict_id;
+  }
+
+  if (false == dicts_.empty()) {
+    SetCompressDictId(default_dict_id_);
+    SetDecompressDictId(0);
   }
 #endif
 }
@@ -447,6 +850,7 @@ class FunapiCompressionImpl : public std::enable_shared_from_this<FunapiCompress
   void SetCompressionType(const CompressionType type);
   void SetThreshold(int threshold);
   void SetZstdDictBase64String(const fun::string &zstd_dict_base64string);
+  void AddZstdDictBase64String(const fun::string &zstd_dict_base64string);
 
   bool Compress(HeaderFields &header_fields, fun::vector<uint8_t> &body);
   bool Decompress(HeaderFields &header_fields, fun::vector<uint8_t> &body);
@@ -456,14 +860,38 @@ class FunapiCompressionImpl : public std::enable_shared_from_this<FunapiCompress
 
   bool HasCompression(const CompressionType type);
 
+  void SetUseZstdStream(const bool use_stream);
+  void ResetStream();
+  void ResetSendStream();
+
  private:
   bool CreateCompressor(const CompressionType type);
   std::shared_ptr<Compressor> GetCompressor(CompressionType type);
+  void UpdateZstdDict(const fun::string &zstd_dict_base64string, bool replace);
 
   fun::map<CompressionType, std::shared_ptr<Compressor>> compressors_;
   std::shared_ptr<Compressor> default_compressor_ = nullptr;
 
   int threshold_ = 128;
+
+  // NOTE: compressor 의 context 와 아래 버퍼는 transport 마다 하나씩 두고 재사용합니다.
+  // 같은 스레드를 쓰는 여러 세션이나 송신/수신 스레드가 다른 경우에도
+  // 안전하도록 압축과 해제를 각각의 mutex 로 보호합니다.
+  std::mutex compress_mutex_;
+  std::mutex decompress_mutex_;
+  fun::vector<uint8_t> compress_buffer_;
+  fun::vector<uint8_t> decompress_buffer_;
+
+  // 상대방이 마지막으로 사용한 dictionary ID. 압축할 때 같은 사전을 사용합니다.
+  // 0 이 아니면 상대방이 "<length>:<dict id>" 형식을 읽을 수 있다는 뜻이기도 합니다.
+  std::atomic<uint32_t> peer_dict_id_{0};
+
+  // Streaming mode (zstd only). The epoch changes whenever the sender starts
+  // a new frame so that the receiver knows when to reset its stream.
+  bool use_stream_ = false;
+  uint32_t send_stream_epoch_ = 0;
+  uint32_t recv_stream_epoch_ = 0;
+  bool has_recv_stream_ = false;
 };
 
 
@@ -509,11 +937,58 @@ bool FunapiCompressionImpl::Decompress(HeaderFields &header_fields,
     HeaderFields::iterator it;
     it = header_fields.find(kProtocolCompressionField);
     if (it != header_fields.end()) {
+      // "<original length>" or "<original length>:<dictionary id>"
       size_t body_length = atoi(it->second.c_str());
+      uint32_t dict_id = 0;
+      size_t pos = it->second.find(':');
+      if (pos != fun::string::npos) {
+        dict_id = static_cast<uint32_t>(strtoul(it->second.c_str() + pos + 1, NULL, 10));
+      }
+
       if (body_length > 0) {
-        fun::vector<uint8_t> in(body.cbegin(), body.cend());
-        body.resize(body_length);
-        return default_compressor_->Decompress(in, body);
+        std::unique_lock<std::mutex> lock(decompress_mutex_);
+        HeaderFields::iterator it_stream = header_fields.find(kProtocolCompressionStreamField);
+        const bool use_stream = (it_stream != header_fields.end());
+        uint32_t stream_epoch = 0;
+        bool new_stream = false;
+        if (use_stream) {
+          stream_epoch = static_cast<uint32_t>(strtoul(it_stream->second.c_str(), NULL, 10));
+          new_stream = (!has_recv_stream_ || stream_epoch != recv_stream_epoch_);
+        }
+
+        if (false == default_compressor_->SetDecompressDictId(dict_id)) {
+          fun::stringstream ss;
+          ss << "Unknown compression dictionary id: " << dict_id;
+          DebugUtils::Log("%s", ss.str().c_str());
+          return false;
+        }
+
+        if (dict_id != 0) {
+          peer_dict_id_ = dict_id;
+        }
+
+        decompress_buffer_.resize(body_length);
+
+        if (use_stream) {
+          if (default_compressor_->DecompressStream(body, decompress_buffer_, new_stream)) {
+            recv_stream_epoch_ = stream_epoch;
+            has_recv_stream_ = true;
+            body.swap(decompress_buffer_);
+            return true;
+          }
+
+          // 다음 frame 이 올 때까지 스트림 메시지는 해제할 수 없습니다.
+          has_recv_stream_ = false;
+          DebugUtils::Log("Failed to decompress the zstd stream message.");
+          return false;
+        }
+
+        if (default_compressor_->Decompress(body, decompress_buffer_)) {
+          body.swap(decompress_buffer_);
+          return true;
+        }
+
+        return false;
       }
     }
   }
@@ -524,11 +999,50 @@ bool FunapiCompressionImpl::Decompress(HeaderFields &header_fields,
 
 bool FunapiCompressionImpl::Compress(HeaderFields &header_fields, fun::vector<uint8_t> &body) {
   if (default_compressor_ && (body.size() >= threshold_)) {
-    fun::vector<uint8_t> in(body.cbegin(), body.cend());
-    if (default_compressor_->Compress(in, body)) {
+    std::unique_lock<std::mutex> lock(compress_mutex_);
+
+    // 서버가 다른 버전의 사전을 쓰기 시작했으면 가지고 있는 경우 따라갑니다.
+    const uint32_t peer_dict_id = peer_dict_id_;
+    if (peer_dict_id != 0 && peer_dict_id != default_compressor_->GetCompressDictId()) {
+      default_compressor_->SetCompressDictId(peer_dict_id);
+    }
+
+    // 스트리밍 모드에서는 압축 결과가 원본보다 커도 그대로 보냅니다.
+    // 이미 스트림 히스토리에 들어갔기 때문에 받는 쪽도 같은 데이터를 거쳐야 합니다.
+    const bool use_stream = use_stream_ && default_compressor_->HasStream();
+    bool new_frame = false;
+    bool compressed = false;
+    if (use_stream) {
+      compressed = default_compressor_->CompressStream(body, compress_buffer_, new_frame);
+      if (new_frame) {
+        ++send_stream_epoch_;
+      }
+    }
+    else {
+      compressed = default_compressor_->Compress(body, compress_buffer_);
+    }
+
+    if (compressed) {
+      body.swap(compress_buffer_);
+      if (use_stream) {
+        fun::stringstream ss;
+        ss << send_stream_epoch_;
+        header_fields[kProtocolCompressionStreamField] = ss.str();
+      }
+
       HeaderFields::iterator it = header_fields.find(kLengthHeaderField);
       if (it != header_fields.end()) {
-        header_fields[kProtocolCompressionField] = it->second.c_str();
+        // ID 는 상대방이 먼저 ID 를 보낸 뒤에만 붙입니다.
+        // 그 전에는 원래 길이만 읽는 서버도 알 수 있도록 길이만 보냅니다.
+        const uint32_t dict_id = default_compressor_->GetCompressDictId();
+        if (dict_id != 0 && peer_dict_id != 0) {
+          fun::stringstream ss;
+          ss << it->second << ":" << dict_id;
+          header_fields[kProtocolCompressionField] = ss.str();
+        }
+        else {
+          header_fields[kProtocolCompressionField] = it->second.c_str();
+        }
       }
 
       fun::stringstream ss;
@@ -536,7 +1050,6 @@ bool FunapiCompressionImpl::Compress(HeaderFields &header_fields, fun::vector<ui
       header_fields[kLengthHeaderField] = ss.str();
     }
     else {
-      body.assign(in.begin(), in.end());
       return false;
     }
   }
@@ -585,6 +1098,16 @@ bool FunapiCompressionImpl::HasCompression(const CompressionType type) {
 
 
 void FunapiCompressionImpl::SetZstdDictBase64String(const fun::string &zstd_dict_base64string) {
+  UpdateZstdDict(zstd_dict_base64string, true);
+}
+
+
+void FunapiCompressionImpl::AddZstdDictBase64String(const fun::string &zstd_dict_base64string) {
+  UpdateZstdDict(zstd_dict_base64string, false);
+}
+
+
+void FunapiCompressionImpl::UpdateZstdDict(const fun::string &zstd_dict_base64string, bool replace) {
 #if FUNAPI_HAVE_ZSTD
   if (zstd_dict_base64string.length() > 0) {
     if (false == HasCompression(CompressionType::kZstd)) {
@@ -594,13 +1117,47 @@ void FunapiCompressionImpl::SetZstdDictBase64String(const fun::string &zstd_dict
     std::shared_ptr<Compressor> c = GetCompressor(CompressionType::kZstd);
     if (c) {
       std::shared_ptr<CompressorZstd> zstd_compressor = std::static_pointer_cast<CompressorZstd>(c);
-      zstd_compressor->SetDictBase64String(zstd_dict_base64string);
+      std::unique_lock<std::mutex> compress_lock(compress_mutex_);
+      std::unique_lock<std::mutex> decompress_lock(decompress_mutex_);
+      if (replace) {
+        zstd_compressor->SetDictBase64String(zstd_dict_base64string);
+        peer_dict_id_ = 0;
+      }
+      else {
+        zstd_compressor->AddDictBase64String(zstd_dict_base64string);
+      }
+
+      // 사전이 바뀌었으므로 진행 중인 스트림은 더 이상 해제할 수 없습니다.
+      zstd_compressor->ResetCompressStream();
+      has_recv_stream_ = false;
     }
   }
 #endif
 }
 
 
+void FunapiCompressionImpl::SetUseZstdStream(const bool use_stream) {
+  std::unique_lock<std::mutex> lock(compress_mutex_);
+  use_stream_ = use_stream;
+}
+
+
+void FunapiCompressionImpl::ResetStream() {
+  ResetSendStream();
+
+  std::unique_lock<std::mutex> lock(decompress_mutex_);
+  has_recv_stream_ = false;
+}
+
+
+void FunapiCompressionImpl::ResetSendStream() {
+  std::unique_lock<std::mutex> lock(compress_mutex_);
+  if (default_compressor_) {
+    default_compressor_->ResetCompressStream();
+  }
+}
+
+
 ////////////////////////////////////////////////////////////////////////////////
 // FunapiCompression implementation.
 
@@ -628,6 +1185,11 @@ void FunapiCompression::SetThreshold(int threshold)
 void FunapiCompression::SetZstdDictBase64String(const fun::string &zstd_dict_base64string) {
   return impl_->SetZstdDictBase64String(zstd_dict_base64string);
 }
+
+
+void FunapiCompression::AddZstdDictBase64String(const fun::string &zstd_dict_base64string) {
+  return impl_->AddZstdDictBase64String(zstd_dict_base64string);
+}
 #endif
 
 
@@ -655,4 +1217,21 @@ bool FunapiCompression::HasCompression(const CompressionType type) {
   return impl_->HasCompression(type);
 }
 
+
+#if FUNAPI_HAVE_ZSTD
+void FunapiCompression::SetUseZstdStream(const bool use_stream) {
+  impl_->SetUseZstdStream(use_stream);
+}
+#endif
+
+
+void FunapiCompression::ResetStream() {
+  impl_->ResetStream();
+}
+
+
+void FunapiCompression::ResetSendStream() {
+  impl_->ResetSendStream();
+}
+
 }  // namespace fun
@@ -188,6 +188,7 @@ class FunapiHttpDownloaderImpl : public std::enable_shared_from_this<FunapiHttpD
 
   void SetTimeoutPerFile(long timeout_in_seconds);
   void SetCACertFilePath(const fun::string &path);
+  void SetMaxConcurrentDownloads(const int max_downloads);
 
   void Start(std::weak_ptr<FunapiHttpDownloader> d);
   void Start(std::weak_ptr<FunapiHttpDownloader> d, const fun::string &inclusive_path);
@@ -196,10 +197,59 @@ class FunapiHttpDownloaderImpl : public std::enable_shared_from_this<FunapiHttpD
   static std::shared_ptr<FunapiTasks> GetFunapiTasks();
 
  private:
+  // A range of a file, downloaded by one request.
+  struct DownloadChunk {
+    uint64_t begin = 0;
+    uint64_t end = 0;   // exclusive
+    uint64_t done = 0;  // bytes written from the beginning
+    bool active = false;
+    int retries = 0;
+  };
+
+  struct DownloadJob {
+    int index = 0;
+    fun::vector<DownloadChunk> chunks;
+    int active = 0;
+    bool finished = false;
+    bool progress_dirty = false;
+    bool journal_dirty = false;
+
+    // The file is hashed while the bytes from its beginning are written.
+    // Bytes written out of order are read back when they become contiguous.
+    std::shared_ptr<FunapiMD5> md5;
+    uint64_t hashed = 0;
+    fun::string md5_front;
+  };
+
+  // Hashes of a verified file, valid while the file is not changed.
+  struct ManifestEntry {
+    uint64_t size = 0;
+    int64_t mtime = 0;
+    uint64_t inode = 0;
+    fun::string md5;
+    fun::string md5_front;
+  };
+
+  enum class RangeSupport : int {
+    kUnknown,
+    kYes,
+    kNo,
+  };
+
   void GetDownloadList(const fun::string &download_url, const fun::string &target_path);
   void OnDownloadInfoList(const fun::string &json_string);
   void DownloadFiles();
-  bool DownloadFile(int index, std::shared_ptr<FunapiDownloadFileInfo> &info);
+  void PrepareJob(DownloadJob &job, const bool resume);
+  void ResetJob(DownloadJob &job);
+  bool StartChunk(DownloadJob &job, const size_t chunk_index);
+  void OnChunkSucceeded(DownloadJob &job, const size_t chunk_index, const bool partial);
+  void OnChunkFailed(DownloadJob &job, const size_t chunk_index, const int error_code);
+  void FinishJob(DownloadJob &job);
+  void HashBytes(DownloadJob &job, const void *data, const size_t length);
+  void CatchUpHash(DownloadJob &job);
+  void ScheduleChunks();
+  void FlushJobs(const bool save_journal);
+  uint64_t GetReceivedBytes(const DownloadJob &job);
   bool IsInclusivePath(fun::string inclusive_path);
   bool IsParticalDownload();
   void ClearParticalOption();
@@ -219,7 +269,9 @@ class FunapiHttpDownloaderImpl : public std::enable_shared_from_this<FunapiHttpD
   fun::vector<std::shared_ptr<FunapiDownloadFileInfo>> info_list_;
 
   bool IsDownloadFile(std::shared_ptr<FunapiDownloadFileInfo> info);
-  bool MD5Compare(std::shared_ptr<FunapiDownloadFileInfo> info);
+  bool IsVerifiedFile(std::shared_ptr<FunapiDownloadFileInfo> info);
+  static bool VerifyFile(std::shared_ptr<FunapiDownloadFileInfo> info, ManifestEntry &entry);
+  void VerifyFiles(const fun::vector<int> &indices, fun::vector<int> &failed_indices);
   bool CheckDirectory(const fun::string& path);
 
   fun::string url_;
@@ -232,6 +284,39 @@ class FunapiHttpDownloaderImpl : public std::enable_shared_from_this<FunapiHttpD
 
   int max_index_;
   long timeout_seconds_ = 30;
+
+  // Progress of a partly downloaded file is kept in <path>.journal, so the
+  // next download resumes it.
+  static fun::string GetJournalPath(const fun::string &path);
+  bool LoadJournal(DownloadJob &job);
+  void SaveJournal(DownloadJob &job);
+
+  // Files larger than twice the chunk size are split into chunks.
+  static const uint64_t kChunkSize = 8 * 1024 * 1024;
+  static const int kMaxRetries = 3;
+  static const int64_t kJournalIntervalMillisecond = 1000;
+
+  int max_concurrent_downloads_ = 4;
+
+  // Hashes of the local files by path, kept in <path>.funapi_manifest, so
+  // that unchanged files are not read again on the next start.
+  fun::string GetManifestPath();
+  void LoadManifest();
+  void SaveManifest();
+  void AddManifestEntry(const fun::string &path, ManifestEntry &entry);
+
+  static const int kMaxVerifyThreads = 4;
+
+  fun::map<fun::string, ManifestEntry> manifest_;
+  bool manifest_dirty_ = false;
+
+  // State of DownloadFiles() on the download thread.
+  std::shared_ptr<FunapiHttpMulti> multi_;
+  fun::vector<DownloadJob> jobs_;  // the smallest file first
+  int active_chunks_ = 0;
+  bool failed_ = false;
+  uint64_t received_bytes_ = 0;
+  RangeSupport range_support_ = RangeSupport::kUnknown;
 };
 
 
@@ -345,35 +430,473 @@ bool FunapiHttpDownloaderImpl::IsInclusivePath(fun::string target_inclusive_path
 }
 
 
-bool FunapiHttpDownloaderImpl::DownloadFile(int index, std::shared_ptr<FunapiDownloadFileInfo> &info)
+fun::string FunapiHttpDownloaderImpl::GetJournalPath(const fun::string &path)
+{
+  return path + ".journal";
+}
+
+
+bool FunapiHttpDownloaderImpl::LoadJournal(DownloadJob &job)
 {
-    if (!CheckDirectory(info->GetPath()))
+  auto &info = info_list_[job.index];
+  const fun::string journal_path = GetJournalPath(info->GetPath());
+
+  if (!FunapiUtil::IsFileExists(journal_path) || !FunapiUtil::IsFileExists(info->GetPath()))
+  {
+    return false;
+  }
+
+  FILE *fp = fopen(journal_path.c_str(), "r");
+  if (fp == NULL)
+  {
+    return false;
+  }
+
+  // size md5 count, then begin end done of each chunk.
+  unsigned long long size = 0;
+  char md5[64] = { 0 };
+  int count = 0;
+  bool is_ok = (fscanf(fp, "%llu %63s %d", &size, md5, &count) == 3) &&
+               size == info->GetSize() &&
+               info->GetHash().compare(md5[0] == '-' ? "" : md5) == 0 &&
+               count > 0;
+
+  fun::vector<DownloadChunk> chunks;
+  for (int i = 0; is_ok && i < count; ++i)
+  {
+    unsigned long long begin = 0, end = 0, done = 0;
+    is_ok = (fscanf(fp, "%llu %llu %llu", &begin, &end, &done) == 3) &&
+            begin <= end && end <= size && done <= end - begin;
+
+    DownloadChunk chunk;
+    chunk.begin = begin;
+    chunk.end = end;
+    chunk.done = done;
+    chunks.push_back(chunk);
+  }
+
+  fclose(fp);
+
+  if (!is_ok)
+  {
+    DebugUtils::Log("Ignores the broken download journal. path: %s", journal_path.c_str());
+    return false;
+  }
+
+  job.chunks.swap(chunks);
+  return true;
+}
+
+
+void FunapiHttpDownloaderImpl::SaveJournal(DownloadJob &job)
+{
+  auto &info = info_list_[job.index];
+  job.journal_dirty = false;
+
+  FILE *fp = fopen(GetJournalPath(info->GetPath()).c_str(), "w");
+  if (fp == NULL)
+  {
+    return;
+  }
+
+  fprintf(fp, "%llu %s %d\n",
+          static_cast<unsigned long long>(info->GetSize()),
+          info->GetHash().empty() ? "-" : info->GetHash().c_str(),
+          static_cast<int>(job.chunks.size()));
+
+  for (auto &chunk : job.chunks)
+  {
+    fprintf(fp, "%llu %llu %llu\n",
+            static_cast<unsigned long long>(chunk.begin),
+            static_cast<unsigned long long>(chunk.end),
+            static_cast<unsigned long long>(chunk.done));
+  }
+
+  fclose(fp);
+}
+
+
+void FunapiHttpDownloaderImpl::PrepareJob(DownloadJob &job, const bool resume)
+{
+  if (resume && LoadJournal(job))
+  {
+    DebugUtils::Log("Resumes the download. path: %s received: %llu",
+                    info_list_[job.index]->GetPath().c_str(),
+                    static_cast<unsigned long long>(GetReceivedBytes(job)));
+
+    job.md5 = std::make_shared<FunapiMD5>();
+    CatchUpHash(job);
+    return;
+  }
+
+  ResetJob(job);
+
+  // Splits a large file only after the server has sent a range.
+  const uint64_t size = info_list_[job.index]->GetSize();
+  if (range_support_ != RangeSupport::kNo && size >= kChunkSize * 2)
+  {
+    job.chunks.clear();
+    for (uint64_t begin = 0; begin < size; begin += kChunkSize)
     {
-        info->SetResultCode(FunapiHttpDownloader::ResultCode::kFailed);
-        return false;
+      DownloadChunk chunk;
+      chunk.begin = begin;
+      chunk.end = std::min<uint64_t>(begin + kChunkSize, size);
+      job.chunks.push_back(chunk);
     }
+  }
+}
 
-    bool is_ok = true;
-    std::shared_ptr<FunapiHttp> http = FunapiHttp::Create(cert_file_path_);
-    http->SetTimeout(timeout_seconds_);
-    http->DownloadRequest(info->GetUrl(), info->GetPath(), FunapiHttp::HeaderFields(),
-        [&is_ok,&info](const int error_code, const fun::string error_string)
-        {
-            DebugUtils::Log("Error from cURL: %d, %s", error_code, error_string.c_str());
-            info->SetResultCode(FunapiHttpDownloader::ResultCode::kFailed);
-            is_ok = false;
-        },
-        [this, index](const fun::string &url, const fun::string &path, const uint64_t recv_bytes)
-        {
-            OnProgress(index, recv_bytes);
-        },
-        [&info](const fun::string &url, const fun::string &path, const fun::vector<fun::string> &headers)
-        {
-            info->SetResultCode(FunapiHttpDownloader::ResultCode::kSucceed);
-        }
-    );
 
-    return is_ok;
+void FunapiHttpDownloaderImpl::ResetJob(DownloadJob &job)
+{
+  auto &info = info_list_[job.index];
+
+  // Truncates the file.
+  FILE *fp = fopen(info->GetPath().c_str(), "wb");
+  if (fp)
+  {
+    fclose(fp);
+  }
+
+  job.chunks.clear();
+
+  DownloadChunk chunk;
+  chunk.end = info->GetSize();
+  job.chunks.push_back(chunk);
+
+  job.md5 = std::make_shared<FunapiMD5>();
+  job.hashed = 0;
+  job.md5_front.clear();
+
+  job.progress_dirty = true;
+  job.journal_dirty = true;
+}
+
+
+uint64_t FunapiHttpDownloaderImpl::GetReceivedBytes(const DownloadJob &job)
+{
+  uint64_t bytes = 0;
+  for (auto &chunk : job.chunks)
+  {
+    bytes += chunk.done;
+  }
+  return bytes;
+}
+
+
+bool FunapiHttpDownloaderImpl::StartChunk(DownloadJob &job, const size_t chunk_index)
+{
+  DownloadChunk &chunk = job.chunks[chunk_index];
+  auto &info = info_list_[job.index];
+
+  // A file of one chunk is requested without a range unless it resumes.
+  uint64_t offset = chunk.begin + chunk.done;
+  uint64_t end = (job.chunks.size() > 1 || offset > 0) ? chunk.end : 0;
+  uint64_t base = chunk.done;
+
+  chunk.active = true;
+  ++job.active;
+  ++active_chunks_;
+
+  DownloadJob *p_job = &job;
+  multi_->DownloadRequest(info->GetUrl(), info->GetPath(), offset, end,
+    [this, p_job, chunk_index](const int error_code, const fun::string error_string)
+    {
+      DebugUtils::Log("Error from cURL: %d, %s", error_code, error_string.c_str());
+      OnChunkFailed(*p_job, chunk_index, error_code);
+    },
+    [this, p_job, chunk_index, base](const void *data, const size_t length, const uint64_t bytes)
+    {
+      DownloadChunk &c = p_job->chunks[chunk_index];
+      if (c.begin + c.done == p_job->hashed)
+      {
+        HashBytes(*p_job, data, length);
+      }
+
+      received_bytes_ += base + bytes - c.done;
+      c.done = base + bytes;
+      p_job->progress_dirty = true;
+      p_job->journal_dirty = true;
+    },
+    [this, p_job, chunk_index](const bool partial)
+    {
+      OnChunkSucceeded(*p_job, chunk_index, partial);
+    });
+
+  return true;
+}
+
+
+void FunapiHttpDownloaderImpl::OnChunkSucceeded(DownloadJob &job, const size_t chunk_index, const bool partial)
+{
+  DownloadChunk &chunk = job.chunks[chunk_index];
+  chunk.active = false;
+  --job.active;
+  --active_chunks_;
+
+  const bool ranged = job.chunks.size() > 1 || chunk.begin > 0;
+  if (partial)
+  {
+    range_support_ = RangeSupport::kYes;
+  }
+  else if (ranged)
+  {
+    // The server sent the whole file for the first chunk.
+    range_support_ = RangeSupport::kNo;
+
+    const uint64_t size = info_list_[job.index]->GetSize();
+    if (chunk.done >= size)
+    {
+      for (auto &c : job.chunks)
+      {
+        c.done = c.end - c.begin;
+      }
+    }
+  }
+
+  if (chunk.done < chunk.end - chunk.begin)
+  {
+    // Short response. Resumes from the received bytes.
+    OnChunkFailed(job, chunk_index, 0);
+    return;
+  }
+
+  job.journal_dirty = true;
+  CatchUpHash(job);
+
+  for (auto &c : job.chunks)
+  {
+    if (c.done < c.end - c.begin)
+    {
+      return;
+    }
+  }
+
+  FinishJob(job);
+}
+
+
+void FunapiHttpDownloaderImpl::OnChunkFailed(DownloadJob &job, const size_t chunk_index, const int error_code)
+{
+  DownloadChunk &chunk = job.chunks[chunk_index];
+  if (chunk.active)
+  {
+    chunk.active = false;
+    --job.active;
+    --active_chunks_;
+  }
+
+  job.journal_dirty = true;
+
+  // The file is downloaded again from the beginning without ranges.
+  if (error_code == FunapiHttpMulti::kErrorRangeIgnored || error_code == 416)
+  {
+    range_support_ = RangeSupport::kNo;
+    return;
+  }
+
+  if (error_code >= 400 || ++chunk.retries > kMaxRetries)
+  {
+    info_list_[job.index]->SetResultCode(FunapiHttpDownloader::ResultCode::kFailed);
+    failed_ = true;
+  }
+}
+
+
+void FunapiHttpDownloaderImpl::FinishJob(DownloadJob &job)
+{
+  auto &info = info_list_[job.index];
+  job.finished = true;
+  job.progress_dirty = true;
+  job.journal_dirty = false;
+
+  remove(GetJournalPath(info->GetPath()).c_str());
+
+  if (static_cast<uint64_t>(FunapiUtil::GetFileSize(info->GetPath())) != info->GetSize())
+  {
+    DebugUtils::Log("Error: The size of the downloaded file is different. path: %s",
+                    info->GetPath().c_str());
+    info->SetResultCode(FunapiHttpDownloader::ResultCode::kFailed);
+    failed_ = true;
+    return;
+  }
+
+  // Verifies the file with the hash of the written bytes.
+  ManifestEntry entry;
+  CatchUpHash(job);
+  if (job.hashed == info->GetSize())
+  {
+    entry.md5 = job.md5->GetHexDigest();
+    entry.md5_front = job.md5_front.empty() ? entry.md5 : job.md5_front;
+  }
+  else
+  {
+    FunapiUtil::MD5File(info->GetPath(), &entry.md5, &entry.md5_front);
+  }
+
+  if ((!info->GetHashFront().empty() || !info->GetHash().empty()) &&
+      info->GetHashFront().compare(entry.md5_front) != 0 &&
+      info->GetHash().compare(entry.md5) != 0)
+  {
+    DebugUtils::Log("Error: The hash of the downloaded file is different. path: %s",
+                    info->GetPath().c_str());
+    info->SetResultCode(FunapiHttpDownloader::ResultCode::kFailed);
+    failed_ = true;
+    return;
+  }
+
+  AddManifestEntry(info->GetPath(), entry);
+  info->SetResultCode(FunapiHttpDownloader::ResultCode::kSucceed);
+}
+
+
+void FunapiHttpDownloaderImpl::HashBytes(DownloadJob &job, const void *data, const size_t length)
+{
+  const uint8_t *p = static_cast<const uint8_t*>(data);
+  size_t n = length;
+
+  // Keeps the hash of the front for md5_front.
+  if (job.hashed < FunapiMD5::kFrontSize)
+  {
+    size_t front = static_cast<size_t>(std::min<uint64_t>(n, FunapiMD5::kFrontSize - job.hashed));
+    job.md5->Update(p, front);
+    job.hashed += front;
+    p += front;
+    n -= front;
+
+    if (job.hashed == FunapiMD5::kFrontSize)
+    {
+      job.md5_front = job.md5->GetHexDigest();
+    }
+  }
+
+  if (n > 0)
+  {
+    job.md5->Update(p, n);
+    job.hashed += n;
+  }
+}
+
+
+void FunapiHttpDownloaderImpl::CatchUpHash(DownloadJob &job)
+{
+  // The end of the bytes written from the beginning of the file.
+  uint64_t written = 0;
+  for (auto &chunk : job.chunks)
+  {
+    if (chunk.begin > written)
+    {
+      break;
+    }
+
+    written = std::max(written, chunk.begin + chunk.done);
+    if (chunk.done < chunk.end - chunk.begin)
+    {
+      break;
+    }
+  }
+
+  if (job.hashed >= written)
+  {
+    return;
+  }
+
+  FILE *fp = fopen(info_list_[job.index]->GetPath().c_str(), "rb");
+  if (fp == NULL || FunapiUtil::SeekFile(fp, job.hashed) != 0)
+  {
+    if (fp)
+    {
+      fclose(fp);
+    }
+    return;
+  }
+
+  fun::vector<uint8_t> buffer(64 * 1024);
+  while (job.hashed < written)
+  {
+    size_t length = static_cast<size_t>(std::min<uint64_t>(buffer.size(), written - job.hashed));
+    length = fread(buffer.data(), 1, length, fp);
+    if (length == 0)
+    {
+      break;
+    }
+
+    HashBytes(job, buffer.data(), length);
+  }
+
+  fclose(fp);
+}
+
+
+void FunapiHttpDownloaderImpl::ScheduleChunks()
+{
+  for (auto &job : jobs_)
+  {
+    if (active_chunks_ >= max_concurrent_downloads_)
+    {
+      return;
+    }
+
+    if (job.finished)
+    {
+      continue;
+    }
+
+    if (range_support_ == RangeSupport::kNo)
+    {
+      if (job.active > 0)
+      {
+        continue;
+      }
+
+      // Written ranges can not be resumed.
+      if (job.chunks.size() > 1 || job.chunks[0].done > 0)
+      {
+        received_bytes_ -= std::min(received_bytes_, GetReceivedBytes(job));
+        ResetJob(job);
+      }
+    }
+
+    for (size_t i = 0; i < job.chunks.size(); ++i)
+    {
+      if (active_chunks_ >= max_concurrent_downloads_)
+      {
+        return;
+      }
+
+      // One request per file until the server is known to send ranges.
+      if (range_support_ != RangeSupport::kYes && job.active > 0)
+      {
+        break;
+      }
+
+      DownloadChunk &chunk = job.chunks[i];
+      if (chunk.active || chunk.done >= chunk.end - chunk.begin)
+      {
+        continue;
+      }
+
+      StartChunk(job, i);
+    }
+  }
+}
+
+
+void FunapiHttpDownloaderImpl::FlushJobs(const bool save_journal)
+{
+  for (auto &job : jobs_)
+  {
+    if (job.progress_dirty)
+    {
+      job.progress_dirty = false;
+      OnProgress(job.index, GetReceivedBytes(job));
+    }
+
+    if (save_journal && job.journal_dirty && !job.finished)
+    {
+      SaveJournal(job);
+    }
+  }
 }
 
 
@@ -385,20 +908,123 @@ void FunapiHttpDownloaderImpl::DownloadFiles() {
 
   OnReady();
 
+  int64_t start_time = FunapiTimerWheel::NowMillisecond();
+
+  jobs_.clear();
+  active_chunks_ = 0;
+  failed_ = false;
+  received_bytes_ = 0;
+  range_support_ = RangeSupport::kUnknown;
+
+  LoadManifest();
+
+  // Files in the manifest are not read. The others are hashed in parallel.
+  fun::vector<int> download_indices;
+  fun::vector<int> verify_indices;
   for (size_t i=0;i<info_list_.size();++i) {
     auto &info = info_list_[i];
     if (IsDownloadFile(info)) {
-      if (DownloadFile(static_cast<int>(i), info) == false) {
-        OnCompletion(FunapiHttpDownloader::ResultCode::kFailed);
-        return;
-      }
+      download_indices.push_back(static_cast<int>(i));
     }
-    else {
+    else if (IsVerifiedFile(info)) {
       info->SetResultCode(FunapiHttpDownloader::ResultCode::kSucceed);
     }
+    else {
+      verify_indices.push_back(static_cast<int>(i));
+    }
+  }
+
+  VerifyFiles(verify_indices, download_indices);
+  SaveManifest();
+
+  DebugUtils::Log("Checked %d files in %lld ms. %d files were read.",
+                  static_cast<int>(info_list_.size()),
+                  static_cast<long long>(FunapiTimerWheel::NowMillisecond() - start_time),
+                  static_cast<int>(verify_indices.size()));
+
+  start_time = FunapiTimerWheel::NowMillisecond();
+
+  std::sort(download_indices.begin(), download_indices.end());
+  for (int i : download_indices) {
+    auto &info = info_list_[i];
+    if (!CheckDirectory(info->GetPath())) {
+      info->SetResultCode(FunapiHttpDownloader::ResultCode::kFailed);
+      OnCompletion(FunapiHttpDownloader::ResultCode::kFailed);
+      return;
+    }
+
+    manifest_.erase(info->GetPath());
+
+    DownloadJob job;
+    job.index = i;
+    jobs_.push_back(job);
   }
 
-  OnCompletion(FunapiHttpDownloader::ResultCode::kSucceed);
+  // Small files first, so that more files are ready early.
+  std::stable_sort(jobs_.begin(), jobs_.end(), [this](const DownloadJob &a, const DownloadJob &b) {
+    return info_list_[a.index]->GetSize() < info_list_[b.index]->GetSize();
+  });
+
+  // The jobs do not move from here on. The requests keep pointers to them.
+  for (auto &job : jobs_) {
+    PrepareJob(job, true);
+    received_bytes_ += GetReceivedBytes(job);
+
+    // An empty file, or a journal left after the last range.
+    if (GetReceivedBytes(job) >= info_list_[job.index]->GetSize()) {
+      FinishJob(job);
+    }
+  }
+  uint64_t resumed_bytes = received_bytes_;
+
+  multi_ = FunapiHttpMulti::Create(cert_file_path_);
+  multi_->SetTimeout(timeout_seconds_);
+
+  int64_t journal_time = start_time;
+  while (true) {
+    if (!failed_) {
+      ScheduleChunks();
+    }
+
+    if (active_chunks_ == 0 || failed_) {
+      break;
+    }
+
+    multi_->Perform(100);
+
+    int64_t now = FunapiTimerWheel::NowMillisecond();
+    bool save_journal = (now - journal_time >= kJournalIntervalMillisecond);
+    if (save_journal) {
+      journal_time = now;
+    }
+
+    FlushJobs(save_journal);
+  }
+
+  // Keeps the progress of the unfinished files for the next download.
+  multi_->Cancel();
+  multi_ = nullptr;
+  for (auto &job : jobs_) {
+    for (auto &chunk : job.chunks) {
+      chunk.active = false;
+    }
+    job.active = 0;
+  }
+  active_chunks_ = 0;
+  FlushJobs(true);
+
+  int64_t elapsed = std::max<int64_t>(1, FunapiTimerWheel::NowMillisecond() - start_time);
+  uint64_t bytes = received_bytes_ - std::min(received_bytes_, resumed_bytes);
+  DebugUtils::Log("Downloaded %llu bytes in %lld ms (%.2f MB/s).",
+                  static_cast<unsigned long long>(bytes),
+                  static_cast<long long>(elapsed),
+                  static_cast<double>(bytes) / 1024 / 1024 * 1000 / elapsed);
+
+  jobs_.clear();
+  SaveManifest();
+
+  OnCompletion(failed_ ? FunapiHttpDownloader::ResultCode::kFailed :
+                         FunapiHttpDownloader::ResultCode::kSucceed);
 }
 
 
@@ -493,11 +1119,12 @@ bool FunapiHttpDownloaderImpl::IsDownloadFile(std::shared_ptr<FunapiDownloadFile
     return true;
   }
 
-  if (FunapiUtil::GetFileSize(info->GetPath()) != info->GetSize()) {
+  // Partly downloaded.
+  if (FunapiUtil::IsFileExists(GetJournalPath(info->GetPath()))) {
     return true;
   }
 
-  if (!MD5Compare(info)) {
+  if (static_cast<uint64_t>(FunapiUtil::GetFileSize(info->GetPath())) != info->GetSize()) {
     return true;
   }
 
@@ -505,17 +1132,45 @@ bool FunapiHttpDownloaderImpl::IsDownloadFile(std::shared_ptr<FunapiDownloadFile
 }
 
 
-bool FunapiHttpDownloaderImpl::MD5Compare(std::shared_ptr<FunapiDownloadFileInfo> info) {
+bool FunapiHttpDownloaderImpl::IsVerifiedFile(std::shared_ptr<FunapiDownloadFileInfo> info) {
+  auto iter = manifest_.find(info->GetPath());
+  if (iter == manifest_.end()) {
+    return false;
+  }
+
+  uint64_t size = 0;
+  int64_t mtime = 0;
+  uint64_t inode = 0;
+  const ManifestEntry &entry = iter->second;
+  if (!FunapiUtil::GetFileStat(info->GetPath(), size, mtime, inode) ||
+      size != entry.size || mtime != entry.mtime || inode != entry.inode) {
+    return false;
+  }
+
+  if (info->GetHashFront().length() > 0 && info->GetHashFront().compare(entry.md5_front) == 0) {
+    return true;
+  }
+
+  if (info->GetHash().length() > 0 && info->GetHash().compare(entry.md5) == 0) {
+    return true;
+  }
+
+  return false;
+}
+
+
+// It is called on the verification threads.
+bool FunapiHttpDownloaderImpl::VerifyFile(std::shared_ptr<FunapiDownloadFileInfo> info, ManifestEntry &entry) {
   if (info->GetHashFront().length() > 0) {
-    fun::string md5_string = FunapiUtil::MD5String(info->GetPath(), true);
-    if (info->GetHashFront().compare(md5_string) == 0) {
+    if (FunapiUtil::MD5File(info->GetPath(), nullptr, &entry.md5_front) &&
+        info->GetHashFront().compare(entry.md5_front) == 0) {
       return true;
     }
   }
 
   if (info->GetHash().length() > 0) {
-    fun::string md5_string = FunapiUtil::MD5String(info->GetPath(), false);
-    if (info->GetHash().compare(md5_string) == 0) {
+    if (FunapiUtil::MD5File(info->GetPath(), &entry.md5, &entry.md5_front) &&
+        info->GetHash().compare(entry.md5) == 0) {
       return true;
     }
   }
@@ -524,6 +1179,143 @@ bool FunapiHttpDownloaderImpl::MD5Compare(std::shared_ptr<FunapiDownloadFileInfo
 }
 
 
+void FunapiHttpDownloaderImpl::VerifyFiles(const fun::vector<int> &indices, fun::vector<int> &failed_indices) {
+  if (indices.empty()) {
+    return;
+  }
+
+  fun::vector<ManifestEntry> entries(indices.size());
+  fun::vector<char> results(indices.size(), 0);
+  std::atomic<size_t> next(0);
+
+  auto verify = [this, &indices, &entries, &results, &next]() {
+    size_t k;
+    while ((k = next++) < indices.size()) {
+      results[k] = VerifyFile(info_list_[indices[k]], entries[k]);
+    }
+  };
+
+  size_t num_threads = std::min<size_t>(indices.size(), kMaxVerifyThreads);
+  num_threads = std::min<size_t>(num_threads, std::max(1u, std::thread::hardware_concurrency()));
+
+  fun::vector<std::thread> threads;
+  for (size_t i = 1; i < num_threads; ++i) {
+    threads.push_back(std::thread(verify));
+  }
+  verify();
+  for (auto &t : threads) {
+    t.join();
+  }
+
+  for (size_t k = 0; k < indices.size(); ++k) {
+    if (results[k]) {
+      info_list_[indices[k]]->SetResultCode(FunapiHttpDownloader::ResultCode::kSucceed);
+      AddManifestEntry(info_list_[indices[k]]->GetPath(), entries[k]);
+    }
+    else {
+      failed_indices.push_back(indices[k]);
+    }
+  }
+}
+
+
+fun::string FunapiHttpDownloaderImpl::GetManifestPath() {
+  return path_ + ".funapi_manifest";
+}
+
+
+void FunapiHttpDownloaderImpl::LoadManifest() {
+  manifest_.clear();
+  manifest_dirty_ = false;
+
+  FILE *fp = fopen(GetManifestPath().c_str(), "rb");
+  if (fp == NULL) {
+    return;
+  }
+
+  fun::string text;
+  char buffer[4096];
+  size_t length;
+  while ((length = fread(buffer, 1, sizeof(buffer), fp)) != 0) {
+    text.append(buffer, length);
+  }
+  fclose(fp);
+
+  // size mtime inode md5 md5_front path
+  size_t pos = 0;
+  while (pos < text.length()) {
+    size_t eol = text.find('\n', pos);
+    if (eol == fun::string::npos) {
+      eol = text.length();
+    }
+    fun::string line = text.substr(pos, eol - pos);
+    pos = eol + 1;
+
+    unsigned long long size = 0, inode = 0;
+    long long mtime = 0;
+    char md5[64] = { 0 };
+    char md5_front[64] = { 0 };
+    int path_offset = 0;
+    if (sscanf(line.c_str(), "%llu %lld %llu %63s %63s %n",
+               &size, &mtime, &inode, md5, md5_front, &path_offset) != 5 ||
+        path_offset <= 0 || static_cast<size_t>(path_offset) >= line.length()) {
+      continue;
+    }
+
+    ManifestEntry entry;
+    entry.size = size;
+    entry.mtime = mtime;
+    entry.inode = inode;
+    entry.md5 = (md5[0] == '-') ? "" : md5;
+    entry.md5_front = (md5_front[0] == '-') ? "" : md5_front;
+    manifest_[line.substr(path_offset)] = entry;
+  }
+}
+
+
+void FunapiHttpDownloaderImpl::SaveManifest() {
+  if (!manifest_dirty_) {
+    return;
+  }
+  manifest_dirty_ = false;
+
+  // Replaces the manifest at once, so that it is never half written.
+  fun::string path = GetManifestPath();
+  fun::string temp_path = path + ".tmp";
+  FILE *fp = fopen(temp_path.c_str(), "wb");
+  if (fp == NULL) {
+    return;
+  }
+
+  for (auto &iter : manifest_) {
+    const ManifestEntry &entry = iter.second;
+    fprintf(fp, "%llu %lld %llu %s %s %s\n",
+            static_cast<unsigned long long>(entry.size),
+            static_cast<long long>(entry.mtime),
+            static_cast<unsigned long long>(entry.inode),
+            entry.md5.empty() ? "-" : entry.md5.c_str(),
+            entry.md5_front.empty() ? "-" : entry.md5_front.c_str(),
+            iter.first.c_str());
+  }
+
+  bool is_ok = (fclose(fp) == 0);
+  remove(path.c_str());
+  if (!is_ok || rename(temp_path.c_str(), path.c_str()) != 0) {
+    remove(temp_path.c_str());
+  }
+}
+
+
+void FunapiHttpDownloaderImpl::AddManifestEntry(const fun::string &path, ManifestEntry &entry) {
+  if (!FunapiUtil::GetFileStat(path, entry.size, entry.mtime, entry.inode)) {
+    return;
+  }
+
+  manifest_[path] = entry;
+  manifest_dirty_ = true;
+}
+
+
 void FunapiHttpDownloaderImpl::AddReadyCallback(const ReadyHandler &handler) {
   on_ready_ += handler;
 }
@@ -551,6 +1343,12 @@ void FunapiHttpDownloaderImpl::SetCACertFilePath(const fun::string &path)
 }
 
 
+void FunapiHttpDownloaderImpl::SetMaxConcurrentDownloads(const int max_downloads)
+{
+  max_concurrent_downloads_ = std::max(1, max_downloads);
+}
+
+
 void FunapiHttpDownloaderImpl::OnReady() {
   std::weak_ptr<FunapiHttpDownloaderImpl> weak = shared_from_this();
   tasks_->Push([weak, this]()->bool {
@@ -648,6 +1446,12 @@ void FunapiHttpDownloader::SetCACertFilePath(const fun::string &path)
   impl_->SetCACertFilePath(path);
 }
 
+
+void FunapiHttpDownloader::SetMaxConcurrentDownloads(const int max_downloads)
+{
+  impl_->SetMaxConcurrentDownloads(max_downloads);
+}
+
 void FunapiHttpDownloader::Start() {
   return impl_->Start(shared_from_this());
 }
@@ -18,6 +18,10 @@
 
 #include<iomanip>
 
+#ifndef FUNAPI_PLATFORM_WINDOWS
+#include <poll.h>
+#endif // FUNAPI_PLATFORM_WINDOWS
+
 static const fun::string err_msg_empty_root_cert =
     "A server certificate will not be verified. To verify "
     "the server certificate, set root certficate path"
@@ -29,6 +33,688 @@ static const fun::string warn_msg_server_cert_verification_disabled =
 
 namespace fun
 {
+////////////////////////////////////////////////////////////////////////////////
+// FunapiHttpMultiImpl implementation.
+
+// Runs requests on one curl multi handle. The multi handle keeps the
+// connections alive and reuses them per host, and multiplexes requests on
+// one connection with HTTP/2 over TLS if libcurl supports it.
+// Get() returns the instance of FunapiHttp::PostRequestAsync, driven by
+// FunapiSocket::Poll on the network thread. The other instances are driven
+// by FunapiHttpMulti::Perform. An instance is used on one thread only.
+class FunapiHttpMultiImpl : public std::enable_shared_from_this<FunapiHttpMultiImpl> {
+ public:
+  typedef FunapiHttp::ErrorHandler ErrorHandler;
+  typedef FunapiHttp::CompletionHandler CompletionHandler;
+  typedef FunapiHttp::HeaderFields HeaderFields;
+  typedef FunapiHttpMulti::ProgressHandler ProgressHandler;
+  typedef FunapiHttpMulti::DownloadCompletionHandler DownloadCompletionHandler;
+
+  FunapiHttpMultiImpl() = delete;
+  FunapiHttpMultiImpl(const bool use_poll);
+  virtual ~FunapiHttpMultiImpl();
+
+  static FunapiHttpMultiImpl& Get();
+
+  void Post(const fun::string &url,
+            const HeaderFields &header,
+            const fun::vector<uint8_t> &body,
+            const fun::string &cert_file_path,
+            const long timeout_seconds,
+            const ErrorHandler &error_handler,
+            const CompletionHandler &completion_handler);
+
+  void Download(const fun::string &url,
+                const fun::string &path,
+                const uint64_t offset,
+                const uint64_t end,
+                const ErrorHandler &error_handler,
+                const ProgressHandler &progress_handler,
+                const DownloadCompletionHandler &completion_handler);
+
+  int Perform(const int timeout_millisecond);
+  void Cancel();
+
+  void SetCACertFilePath(const fun::string &path);
+  void SetTimeout(const long seconds);
+
+#ifdef FUNAPI_PLATFORM_WINDOWS
+  void Perform();
+#else // FUNAPI_PLATFORM_WINDOWS
+  int GetPollFds(struct pollfd *pollfds, const int max_pollfds);
+  void OnPoll(const struct pollfd *pollfds, const int num_pollfds);
+#endif // FUNAPI_PLATFORM_WINDOWS
+
+ private:
+  struct Request {
+    CURL *curl = NULL;
+    struct curl_slist *header = NULL;
+    fun::vector<uint8_t> body;
+    fun::vector<fun::string> header_receiving;
+    fun::vector<uint8_t> body_receiving;
+    ErrorHandler error_handler;
+    CompletionHandler completion_handler;
+
+    // Downloads
+    FILE *fp = NULL;
+    uint64_t offset = 0;
+    uint64_t received = 0;
+    bool checked = false;
+    bool writable = false;
+    bool partial = false;
+    bool range_ignored = false;
+    ProgressHandler progress_handler;
+    DownloadCompletionHandler download_completion_handler;
+  };
+
+  bool Init();
+  CURL* GetEasyHandle();
+  void ReleaseEasyHandle(CURL *curl);
+  void SetRequestOptions(CURL *curl,
+                         Request *request,
+                         const fun::string &url,
+                         const fun::string &cert_file_path,
+                         const long timeout_seconds);
+  bool AddRequest(CURL *curl, std::shared_ptr<Request> request);
+  void FreeRequest(CURL *curl, Request *request);
+  void CheckCompletion();
+
+  static size_t OnHeader(char *data, size_t size, size_t count, void *userp);
+  static size_t OnBody(char *data, size_t size, size_t count, void *userp);
+#ifndef FUNAPI_PLATFORM_WINDOWS
+  static int OnSocket(CURL *curl, curl_socket_t s, int what, void *userp, void *socketp);
+  static int OnTimer(CURLM *multi, long timeout_ms, void *userp);
+#endif // FUNAPI_PLATFORM_WINDOWS
+
+  // Connections kept in the pool, and opened to one host at the same time.
+  // Requests over the limit wait for a connection in the multi handle.
+  static const long kMaxConnects = 16;
+  static const long kMaxHostConnections = 8;
+  static const size_t kMaxIdleHandles = 16;
+  static const int kMaxTimerRounds = 4;
+
+  CURLM *multi_ = NULL;
+  bool use_poll_ = false;
+  bool use_http2_ = false;
+  int running_ = 0;
+  bool posted_ = false;
+
+  fun::map<CURL*, std::shared_ptr<Request>> requests_;
+  fun::vector<CURL*> idle_handles_;
+
+  fun::string cert_file_path_;
+  long timeout_seconds_ = 30;
+
+#ifndef FUNAPI_PLATFORM_WINDOWS
+  // Sockets of the multi handle and the poll events they wait for.
+  fun::map<curl_socket_t, short> sockets_;
+  int64_t timeout_millisecond_ = -1;
+#endif // FUNAPI_PLATFORM_WINDOWS
+};
+
+
+FunapiHttpMultiImpl::FunapiHttpMultiImpl(const bool use_poll) : use_poll_(use_poll) {
+}
+
+
+FunapiHttpMultiImpl::~FunapiHttpMultiImpl() {
+  Cancel();
+
+  for (auto curl : idle_handles_) {
+    curl_easy_cleanup(curl);
+  }
+  idle_handles_.clear();
+
+  if (multi_) {
+    curl_multi_cleanup(multi_);
+  }
+}
+
+
+FunapiHttpMultiImpl& FunapiHttpMultiImpl::Get() {
+#ifdef FUNAPI_PLATFORM_WINDOWS
+  static FunapiHttpMultiImpl instance(false);
+#else // FUNAPI_PLATFORM_WINDOWS
+  static FunapiHttpMultiImpl instance(true);
+#endif // FUNAPI_PLATFORM_WINDOWS
+  return instance;
+}
+
+
+bool FunapiHttpMultiImpl::Init() {
+  if (multi_) {
+    return true;
+  }
+
+  multi_ = curl_multi_init();
+  if (multi_ == NULL) {
+    DebugUtils::Log("%s", curl_easy_strerror(CURLE_FAILED_INIT));
+    return false;
+  }
+
+  curl_multi_setopt(multi_, CURLMOPT_MAXCONNECTS, kMaxConnects);
+  curl_multi_setopt(multi_, CURLMOPT_MAX_HOST_CONNECTIONS, kMaxHostConnections);
+
+#if LIBCURL_VERSION_NUM >= 0x072f00 // 7.47.0
+  curl_version_info_data *info = curl_version_info(CURLVERSION_NOW);
+  use_http2_ = info && (info->features & CURL_VERSION_HTTP2);
+  if (use_http2_) {
+    curl_multi_setopt(multi_, CURLMOPT_PIPELINING, CURLPIPE_MULTIPLEX);
+  }
+#endif
+
+#ifndef FUNAPI_PLATFORM_WINDOWS
+  if (use_poll_) {
+    curl_multi_setopt(multi_, CURLMOPT_SOCKETFUNCTION, &FunapiHttpMultiImpl::OnSocket);
+    curl_multi_setopt(multi_, CURLMOPT_SOCKETDATA, this);
+    curl_multi_setopt(multi_, CURLMOPT_TIMERFUNCTION, &FunapiHttpMultiImpl::OnTimer);
+    curl_multi_setopt(multi_, CURLMOPT_TIMERDATA, this);
+  }
+#endif // FUNAPI_PLATFORM_WINDOWS
+
+  return true;
+}
+
+
+CURL* FunapiHttpMultiImpl::GetEasyHandle() {
+  if (idle_handles_.empty()) {
+    return curl_easy_init();
+  }
+
+  CURL *curl = idle_handles_.back();
+  idle_handles_.pop_back();
+  return curl;
+}
+
+
+void FunapiHttpMultiImpl::ReleaseEasyHandle(CURL *curl) {
+  if (idle_handles_.size() < kMaxIdleHandles) {
+    curl_easy_reset(curl);
+    idle_handles_.push_back(curl);
+  }
+  else {
+    curl_easy_cleanup(curl);
+  }
+}
+
+
+void FunapiHttpMultiImpl::SetRequestOptions(CURL *curl,
+                                            Request *request,
+                                            const fun::string &url,
+                                            const fun::string &cert_file_path,
+                                            const long timeout_seconds) {
+  request->curl = curl;
+
+  curl_easy_setopt(curl, CURLOPT_URL, url.c_str());
+  curl_easy_setopt(curl, CURLOPT_TIMEOUT, timeout_seconds);
+  curl_easy_setopt(curl, CURLOPT_NOSIGNAL, 1L);
+
+  curl_easy_setopt(curl, CURLOPT_TCP_KEEPALIVE, 1L);
+  curl_easy_setopt(curl, CURLOPT_TCP_KEEPIDLE, 120L);
+  curl_easy_setopt(curl, CURLOPT_TCP_KEEPINTVL, 60L);
+
+  curl_easy_setopt(curl, CURLOPT_HEADERFUNCTION, &FunapiHttpMultiImpl::OnHeader);
+  curl_easy_setopt(curl, CURLOPT_HEADERDATA, request);
+  curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, &FunapiHttpMultiImpl::OnBody);
+  curl_easy_setopt(curl, CURLOPT_WRITEDATA, request);
+
+#if LIBCURL_VERSION_NUM >= 0x072f00 // 7.47.0
+  if (use_http2_) {
+    // HTTP/2 for https and HTTP/1.1 for http. Waits for a connection
+    // that can be multiplexed rather than opening a new one.
+    curl_easy_setopt(curl, CURLOPT_HTTP_VERSION, CURL_HTTP_VERSION_2TLS);
+    curl_easy_setopt(curl, CURLOPT_PIPEWAIT, 1L);
+  }
+#endif
+
+  bool verify_cert = true;
+  if (url.find("https") == std::string::npos)
+  {
+    verify_cert = false;
+  }
+  else
+  {
+#if FUNAPI_TLS_VERIFY_SERVER_CERTIFICATE
+    if (cert_file_path.empty())
+    {
+      verify_cert = false;
+      DebugUtils::Log("%s", err_msg_empty_root_cert.c_str());
+    }
+#else  // FUNAPI_TLS_VERIFY_SERVER_CERTIFICATE
+    verify_cert = false;
+    DebugUtils::Log(warn_msg_server_cert_verification_disabled.c_str());
+#endif // FUNAPI_TLS_VERIFY_SERVER_CERTIFICATE
+  }
+
+  if (verify_cert)
+  {
+    curl_easy_setopt(curl, CURLOPT_SSL_VERIFYPEER, 1L);
+    curl_easy_setopt(curl, CURLOPT_SSL_VERIFYHOST, 2L);
+    curl_easy_setopt(curl, CURLOPT_CAINFO, cert_file_path.c_str());
+  }
+  else
+  {
+    curl_easy_setopt(curl, CURLOPT_SSL_VERIFYPEER, 0L);
+    curl_easy_setopt(curl, CURLOPT_SSL_VERIFYHOST, 0L);
+  }
+}
+
+
+bool FunapiHttpMultiImpl::AddRequest(CURL *curl, std::shared_ptr<Request> request) {
+  CURLMcode code = curl_multi_add_handle(multi_, curl);
+  if (code != CURLM_OK) {
+    FreeRequest(curl, request.get());
+    request->error_handler(code, curl_multi_strerror(code));
+    return false;
+  }
+
+  requests_[curl] = request;
+  posted_ = true;
+  return true;
+}
+
+
+void FunapiHttpMultiImpl::FreeRequest(CURL *curl, Request *request) {
+  ReleaseEasyHandle(curl);
+
+  if (request->header) {
+    curl_slist_free_all(request->header);
+    request->header = NULL;
+  }
+
+  if (request->fp) {
+    fclose(request->fp);
+    request->fp = NULL;
+  }
+}
+
+
+void FunapiHttpMultiImpl::Post(const fun::string &url,
+                               const HeaderFields &header,
+                               const fun::vector<uint8_t> &body,
+                               const fun::string &cert_file_path,
+                               const long timeout_seconds,
+                               const ErrorHandler &error_handler,
+                               const CompletionHandler &completion_handler) {
+  CURL *curl = NULL;
+  if (Init()) {
+    curl = GetEasyHandle();
+  }
+
+  if (curl == NULL) {
+    error_handler(CURLE_FAILED_INIT, curl_easy_strerror(CURLE_FAILED_INIT));
+    return;
+  }
+
+  auto request = std::make_shared<Request>();
+  request->body = body;
+  request->error_handler = error_handler;
+  request->completion_handler = completion_handler;
+
+  fun::string field;
+  for (const auto &it : header) {
+    field.assign(it.first).append(": ").append(it.second);
+    request->header = curl_slist_append(request->header, field.c_str());
+  }
+  if (request->header) {
+    curl_easy_setopt(curl, CURLOPT_HTTPHEADER, request->header);
+  }
+
+  SetRequestOptions(curl, request.get(), url, cert_file_path, timeout_seconds);
+
+  // The body is not copied by libcurl. It is kept in the request.
+  static const char empty_body[] = "";
+  curl_easy_setopt(curl, CURLOPT_POST, 1L);
+  curl_easy_setopt(curl, CURLOPT_POSTFIELDS,
+                   request->body.empty() ? empty_body : reinterpret_cast<char*>(request->body.data()));
+  curl_easy_setopt(curl, CURLOPT_POSTFIELDSIZE, static_cast<long>(request->body.size()));
+
+  AddRequest(curl, request);
+}
+
+
+void FunapiHttpMultiImpl::Download(const fun::string &url,
+                                   const fun::string &path,
+                                   const uint64_t offset,
+                                   const uint64_t end,
+                                   const ErrorHandler &error_handler,
+                                   const ProgressHandler &progress_handler,
+                                   const DownloadCompletionHandler &completion_handler) {
+  if (url.empty())
+  {
+    error_handler(EINVAL, strerror(EINVAL));
+    return;
+  }
+
+  CURL *curl = NULL;
+  if (Init()) {
+    curl = GetEasyHandle();
+  }
+
+  if (curl == NULL) {
+    error_handler(CURLE_FAILED_INIT, curl_easy_strerror(CURLE_FAILED_INIT));
+    return;
+  }
+
+  // Keeps the bytes written by the other requests of the file.
+  FILE *fp = fopen(path.c_str(), "r+b");
+  if (fp == NULL) {
+    fp = fopen(path.c_str(), "w+b");
+  }
+
+  if (fp == NULL || FunapiUtil::SeekFile(fp, offset) != 0) {
+    int error_code = errno;
+    if (fp) {
+      fclose(fp);
+    }
+    ReleaseEasyHandle(curl);
+
+    error_handler(error_code, strerror(error_code));
+    return;
+  }
+
+  // Unbuffered, so the bytes are in the file when the progress is reported.
+  setvbuf(fp, NULL, _IONBF, 0);
+
+  auto request = std::make_shared<Request>();
+  request->fp = fp;
+  request->offset = offset;
+  request->error_handler = error_handler;
+  request->progress_handler = progress_handler;
+  request->download_completion_handler = completion_handler;
+
+  SetRequestOptions(curl, request.get(), url, cert_file_path_, timeout_seconds_);
+
+  if (offset > 0 || end > 0) {
+    fun::stringstream ss;
+    ss << offset << "-";
+    if (end > 0) {
+      ss << (end - 1);
+    }
+    curl_easy_setopt(curl, CURLOPT_RANGE, ss.str().c_str());
+  }
+
+  AddRequest(curl, request);
+}
+
+
+void FunapiHttpMultiImpl::Cancel() {
+  for (auto &it : requests_) {
+    curl_multi_remove_handle(multi_, it.first);
+    FreeRequest(it.first, it.second.get());
+  }
+  requests_.clear();
+}
+
+
+void FunapiHttpMultiImpl::CheckCompletion() {
+  CURLMsg *msg = NULL;
+  int msgs_left = 0;
+
+  while ((msg = curl_multi_info_read(multi_, &msgs_left)) != NULL) {
+    if (msg->msg != CURLMSG_DONE) {
+      continue;
+    }
+
+    // The message is freed by curl_multi_remove_handle().
+    CURL *curl = msg->easy_handle;
+    CURLcode res = msg->data.result;
+
+    auto it = requests_.find(curl);
+    if (it == requests_.end()) {
+      continue;
+    }
+
+    std::shared_ptr<Request> request = it->second;
+    requests_.erase(it);
+
+    long response_code = 0;
+    if (res == CURLE_OK) {
+      curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &response_code);
+    }
+
+    curl_multi_remove_handle(multi_, curl);
+    FreeRequest(curl, request.get());
+
+    bool is_download = static_cast<bool>(request->download_completion_handler);
+
+    // The handlers may add the next requests.
+    if (request->range_ignored) {
+      request->error_handler(FunapiHttpMulti::kErrorRangeIgnored,
+                             "The server sent the whole file for a range request.");
+    }
+    else if (res != CURLE_OK) {
+      request->error_handler(res, curl_easy_strerror(res));
+    }
+    else if (response_code == 200 || (is_download && response_code == 206)) {
+      if (is_download) {
+        request->download_completion_handler(request->partial);
+      }
+      else {
+        request->completion_handler(request->header_receiving, request->body_receiving);
+      }
+    }
+    else {
+      fun::stringstream ss;
+      ss << "http response code " << response_code;
+      request->error_handler(static_cast<int>(response_code), ss.str());
+    }
+  }
+}
+
+
+size_t FunapiHttpMultiImpl::OnHeader(char *data, size_t size, size_t count, void *userp) {
+  Request *request = static_cast<Request*>(userp);
+  size_t len = size * count;
+  if (request->fp == NULL) {
+    request->header_receiving.push_back(fun::string(data, data + len));
+  }
+  return len;
+}
+
+
+size_t FunapiHttpMultiImpl::OnBody(char *data, size_t size, size_t count, void *userp) {
+  Request *request = static_cast<Request*>(userp);
+  size_t len = size * count;
+
+  if (request->fp == NULL) {
+    request->body_receiving.insert(request->body_receiving.end(),
+                                   reinterpret_cast<uint8_t*>(data),
+                                   reinterpret_cast<uint8_t*>(data) + len);
+    return len;
+  }
+
+  if (!request->checked) {
+    request->checked = true;
+
+    long response_code = 0;
+    curl_easy_getinfo(request->curl, CURLINFO_RESPONSE_CODE, &response_code);
+
+    // A whole file must not be written from the middle of the file.
+    if (response_code == 200 && request->offset > 0) {
+      request->range_ignored = true;
+      return 0;
+    }
+
+    request->partial = (response_code == 206);
+    request->writable = (response_code == 200 || response_code == 206);
+  }
+
+  // Error pages are not written to the file.
+  if (!request->writable) {
+    return len;
+  }
+
+  if (fwrite(data, 1, len, request->fp) != len) {
+    return 0;
+  }
+
+  request->received += len;
+  if (request->progress_handler) {
+    request->progress_handler(data, len, request->received);
+  }
+
+  return len;
+}
+
+
+int FunapiHttpMultiImpl::Perform(const int timeout_millisecond) {
+  if (multi_ == NULL || requests_.empty()) {
+    return 0;
+  }
+
+  int numfds = 0;
+  curl_multi_wait(multi_, NULL, 0, timeout_millisecond, &numfds);
+
+  // The requests added by the handlers start here without waiting.
+  for (int i = 0; i < kMaxTimerRounds; ++i) {
+    posted_ = false;
+
+    curl_multi_perform(multi_, &running_);
+    CheckCompletion();
+
+    if (!posted_) {
+      break;
+    }
+  }
+
+  return static_cast<int>(requests_.size());
+}
+
+
+void FunapiHttpMultiImpl::SetCACertFilePath(const fun::string &path) {
+  cert_file_path_ = path;
+}
+
+
+void FunapiHttpMultiImpl::SetTimeout(const long seconds) {
+  timeout_seconds_ = seconds;
+}
+
+
+#ifdef FUNAPI_PLATFORM_WINDOWS
+void FunapiHttpMultiImpl::Perform() {
+  if (multi_ == NULL || requests_.empty()) {
+    return;
+  }
+
+  // The requests posted by the handlers start here without waiting for
+  // the next poll.
+  for (int i = 0; i < kMaxTimerRounds; ++i) {
+    posted_ = false;
+
+    curl_multi_perform(multi_, &running_);
+    CheckCompletion();
+
+    if (!posted_) {
+      break;
+    }
+  }
+}
+#else // FUNAPI_PLATFORM_WINDOWS
+int FunapiHttpMultiImpl::OnSocket(CURL *curl, curl_socket_t s, int what, void *userp, void *socketp) {
+  FunapiHttpMultiImpl *multi = static_cast<FunapiHttpMultiImpl*>(userp);
+
+  if (what == CURL_POLL_REMOVE) {
+    multi->sockets_.erase(s);
+  }
+  else {
+    short events = 0;
+    if (what & CURL_POLL_IN) events |= POLLIN | POLLPRI;
+    if (what & CURL_POLL_OUT) events |= POLLOUT;
+    multi->sockets_[s] = events;
+  }
+
+  return 0;
+}
+
+
+int FunapiHttpMultiImpl::OnTimer(CURLM *multi, long timeout_ms, void *userp) {
+  FunapiHttpMultiImpl *self = static_cast<FunapiHttpMultiImpl*>(userp);
+
+  if (timeout_ms < 0) {
+    self->timeout_millisecond_ = -1;
+  }
+  else {
+    self->timeout_millisecond_ = FunapiTimerWheel::NowMillisecond() + timeout_ms;
+  }
+
+  return 0;
+}
+
+
+int FunapiHttpMultiImpl::GetPollFds(struct pollfd *pollfds, const int max_pollfds) {
+  int num_pollfds = 0;
+
+  for (const auto &it : sockets_) {
+    if (num_pollfds >= max_pollfds) {
+      break;
+    }
+
+    pollfds[num_pollfds].fd = it.first;
+    pollfds[num_pollfds].events = it.second;
+    pollfds[num_pollfds].revents = 0;
+    ++num_pollfds;
+  }
+
+  return num_pollfds;
+}
+
+
+void FunapiHttpMultiImpl::OnPoll(const struct pollfd *pollfds, const int num_pollfds) {
+  if (multi_ == NULL) {
+    return;
+  }
+
+  for (int i = 0; i < num_pollfds; ++i) {
+    short revents = pollfds[i].revents;
+    if (revents == 0) {
+      continue;
+    }
+
+    int mask = 0;
+    if (revents & (POLLIN | POLLPRI | POLLHUP)) mask |= CURL_CSELECT_IN;
+    if (revents & POLLOUT) mask |= CURL_CSELECT_OUT;
+    if (revents & (POLLERR | POLLNVAL)) mask |= CURL_CSELECT_ERR;
+
+    curl_multi_socket_action(multi_, pollfds[i].fd, mask, &running_);
+  }
+
+  CheckCompletion();
+
+  // Runs the due timers. The requests posted by the handlers start here
+  // without waiting for the next poll.
+  for (int i = 0; i < kMaxTimerRounds; ++i) {
+    if (timeout_millisecond_ < 0 ||
+        timeout_millisecond_ > FunapiTimerWheel::NowMillisecond()) {
+      break;
+    }
+
+    timeout_millisecond_ = -1;
+    curl_multi_socket_action(multi_, CURL_SOCKET_TIMEOUT, 0, &running_);
+    CheckCompletion();
+  }
+}
+#endif // FUNAPI_PLATFORM_WINDOWS
+
+
+// Called by FunapiSocket::Poll on the network thread.
+#ifdef FUNAPI_PLATFORM_WINDOWS
+void OnHttpTicked() {
+  FunapiHttpMultiImpl::Get().Perform();
+}
+#else // FUNAPI_PLATFORM_WINDOWS
+int GetHttpPollFds(struct pollfd *pollfds, const int max_pollfds) {
+  return FunapiHttpMultiImpl::Get().GetPollFds(pollfds, max_pollfds);
+}
+
+
+void OnHttpPolled(const struct pollfd *pollfds, const int num_pollfds) {
+  FunapiHttpMultiImpl::Get().OnPoll(pollfds, num_pollfds);
+}
+#endif // FUNAPI_PLATFORM_WINDOWS
+
+
 ////////////////////////////////////////////////////////////////////////////////
 // FunapiHttpImpl implementation.
 
@@ -51,6 +737,12 @@ class FunapiHttpImpl : public std::enable_shared_from_this<FunapiHttpImpl> {
                    const ErrorHandler &error_handler,
                    const CompletionHandler &completion_handler);
 
+  void PostRequestAsync(const fun::string &url,
+                        const HeaderFields &header,
+                        const fun::vector<uint8_t> &body,
+                        const ErrorHandler &error_handler,
+                        const CompletionHandler &completion_handler);
+
   void GetRequest(const fun::string &url,
                   const HeaderFields &header,
                   const ErrorHandler &error_handler,
@@ -448,6 +1140,16 @@ void FunapiHttpImpl::PostRequest(const fun::string &url,
 }
 
 
+void FunapiHttpImpl::PostRequestAsync(const fun::string &url,
+                                      const HeaderFields &header,
+                                      const fun::vector<uint8_t> &body,
+                                      const ErrorHandler &error_handler,
+                                      const CompletionHandler &completion_handler) {
+  FunapiHttpMultiImpl::Get().Post(url, header, body, cert_file_path_, timeout_seconds_,
+                                  error_handler, completion_handler);
+}
+
+
 void FunapiHttpImpl::OnResponseHeader(void *data, const size_t len, fun::vector<fun::string> &headers) {
   headers.push_back(fun::string((char*)data, (char*)data+len));
 }
@@ -516,6 +1218,15 @@ void FunapiHttp::PostRequest(const fun::string &url,
 }
 
 
+void FunapiHttp::PostRequestAsync(const fun::string &url,
+                                  const HeaderFields &header,
+                                  const fun::vector<uint8_t> &body,
+                                  const ErrorHandler &error_handler,
+                                  const CompletionHandler &completion_handler) {
+  impl_->PostRequestAsync(url, header, body, error_handler, completion_handler);
+}
+
+
 void FunapiHttp::GetRequest(const fun::string &url,
                 const HeaderFields &header,
                 const ErrorHandler &error_handler,
@@ -539,6 +1250,59 @@ void FunapiHttp::SetTimeout(const long seconds)
     impl_->SetTimeout(seconds);
 }
 
+
+////////////////////////////////////////////////////////////////////////////////
+// FunapiHttpMulti implementation.
+
+FunapiHttpMulti::FunapiHttpMulti() : impl_(std::make_shared<FunapiHttpMultiImpl>(false)) {
+}
+
+
+FunapiHttpMulti::FunapiHttpMulti(const fun::string &path)
+: impl_(std::make_shared<FunapiHttpMultiImpl>(false)) {
+  impl_->SetCACertFilePath(path);
+}
+
+
+FunapiHttpMulti::~FunapiHttpMulti() {
+}
+
+
+std::shared_ptr<FunapiHttpMulti> FunapiHttpMulti::Create() {
+  return std::make_shared<FunapiHttpMulti>();
+}
+
+
+std::shared_ptr<FunapiHttpMulti> FunapiHttpMulti::Create(const fun::string &path) {
+  return std::make_shared<FunapiHttpMulti>(path);
+}
+
+
+void FunapiHttpMulti::DownloadRequest(const fun::string &url,
+                                      const fun::string &path,
+                                      const uint64_t offset,
+                                      const uint64_t end,
+                                      const ErrorHandler &error_handler,
+                                      const ProgressHandler &progress_handler,
+                                      const DownloadCompletionHandler &completion_handler) {
+  impl_->Download(url, path, offset, end, error_handler, progress_handler, completion_handler);
+}
+
+
+int FunapiHttpMulti::Perform(const int timeout_millisecond) {
+  return impl_->Perform(timeout_millisecond);
+}
+
+
+void FunapiHttpMulti::Cancel() {
+  impl_->Cancel();
+}
+
+
+void FunapiHttpMulti::SetTimeout(const long seconds) {
+  impl_->SetTimeout(seconds);
+}
+
 }  // namespace fun
 
 #endif
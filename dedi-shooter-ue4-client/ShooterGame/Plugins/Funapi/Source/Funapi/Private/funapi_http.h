@@ -43,6 +43,15 @@ class FunapiHttp : public std::enable_shared_from_this<FunapiHttp> {
                    const ErrorHandler &error_handler,
                    const CompletionHandler &completion_handler);
 
+  // Sends the request without blocking. The transfer runs on the network
+  // thread with pooled keep-alive connections, and the handlers are called
+  // there. It has to be called on the network thread.
+  void PostRequestAsync(const fun::string &url,
+                        const HeaderFields &header,
+                        const fun::vector<uint8_t> &body,
+                        const ErrorHandler &error_handler,
+                        const CompletionHandler &completion_handler);
+
   void GetRequest(const fun::string &url,
                   const HeaderFields &header,
                   const ErrorHandler &error_handler,
@@ -61,6 +70,62 @@ class FunapiHttp : public std::enable_shared_from_this<FunapiHttp> {
   std::shared_ptr<FunapiHttpImpl> impl_;
 };
 
+
+class FunapiHttpMultiImpl;
+// Runs several downloads at the same time over pooled keep-alive
+// connections. Perform() runs the transfers and calls the handlers on the
+// calling thread.
+class FunapiHttpMulti : public std::enable_shared_from_this<FunapiHttpMulti> {
+ public:
+  typedef FunapiHttp::ErrorHandler ErrorHandler;
+
+  // Called with the bytes just written and the total written by the
+  // request so far. It is called while receiving, so it must not add or
+  // cancel requests.
+  typedef std::function<void(const void *data,
+                             const size_t length,
+                             const uint64_t received)> ProgressHandler;
+
+  // partial is false if the server sent the whole file (200) instead of
+  // the requested range (206).
+  typedef std::function<void(const bool partial)> DownloadCompletionHandler;
+
+  // Error code of a range request from the middle of a file which the
+  // server answered with the whole file. Nothing is written to the file.
+  static const int kErrorRangeIgnored = -1;
+
+  FunapiHttpMulti();
+  FunapiHttpMulti(const fun::string &path);
+  virtual ~FunapiHttpMulti();
+
+  static std::shared_ptr<FunapiHttpMulti> Create();
+  static std::shared_ptr<FunapiHttpMulti> Create(const fun::string &path);
+
+  // Writes the body to the file from the offset, keeping the rest of the
+  // file. Requests the range [offset, end) unless both are 0. An end of 0
+  // means the end of the file.
+  void DownloadRequest(const fun::string &url,
+                       const fun::string &path,
+                       const uint64_t offset,
+                       const uint64_t end,
+                       const ErrorHandler &error_handler,
+                       const ProgressHandler &progress_handler,
+                       const DownloadCompletionHandler &completion_handler);
+
+  // Waits up to the timeout for the transfers and calls the handlers.
+  // Returns the number of requests not finished.
+  int Perform(const int timeout_millisecond);
+
+  // Stops every request without calling the handlers.
+  void Cancel();
+
+  // Maximum time of a request.
+  void SetTimeout(const long seconds);
+
+ private:
+  std::shared_ptr<FunapiHttpMultiImpl> impl_;
+};
+
 }  // namespace fun
 
 #endif  // SRC_FUNAPI_HTTP_H_
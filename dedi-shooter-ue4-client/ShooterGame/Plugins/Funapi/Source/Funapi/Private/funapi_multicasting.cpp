@@ -26,6 +26,26 @@
 
 namespace fun {
 
+namespace {
+
+// Pushes the value and drops the oldest ones over the limit. 0 means no
+// limit. Returns the number of values dropped.
+template <typename T>
+size_t PushDropOldest(fun::deque<T> &queue, const T &value, const size_t max_size) {
+  queue.push_back(value);
+
+  size_t dropped = 0;
+  while (max_size > 0 && queue.size() > max_size) {
+    queue.pop_front();
+    ++dropped;
+  }
+
+  return dropped;
+}
+
+}  // namespace
+
+
 ////////////////////////////////////////////////////////////////////////////////
 // FunapiMulticastImpl implementation.
 
@@ -79,7 +99,10 @@ class FunapiMulticastImpl : public std::enable_shared_from_this<FunapiMulticastI
 
   bool RequestChannelList();
 
+  void SetChannelSendLimit(const int max_messages_per_second, const int max_queued_messages);
+
   void Update();
+  static void UpdateAll();
 
   FunEncoding GetEncoding();
 
@@ -91,10 +114,26 @@ class FunapiMulticastImpl : public std::enable_shared_from_this<FunapiMulticastI
   void InitSessionCallback();
 
  private:
+  struct Channel;
+
   void OnReceived(const fun::string &json_string);
   void OnReceived(const FunMessage &message);
   bool OnReceived(const fun::string &channel_id, const fun::string &sender, const bool join, const bool leave, const int error_code);
 
+  // Returns the index of the channel in channels_, adding it if it is new.
+  // channels_mutex_ has to be locked.
+  int InternChannel(const fun::string &channel_id);
+  std::shared_ptr<Channel> FindChannel(const fun::string &channel_id) const;
+
+  // Sends the queued messages of the channels within the rate limit.
+  void Flush();
+  void Flush(const std::shared_ptr<Channel> &channel);
+  void OnPushed(Channel &channel, const size_t dropped);
+
+  // Puts the multicast on the ready list so that the next UpdateAll
+  // flushes it.
+  void MarkReady();
+
 
   std::shared_ptr<fun::FunapiSession> session_ = nullptr;
   std::weak_ptr<fun::FunapiMulticast> multicast_;
@@ -117,18 +156,52 @@ class FunapiMulticastImpl : public std::enable_shared_from_this<FunapiMulticastI
   void OnError(const fun::string &channel_id, const int error);
 
   void OnChannelList(const rapidjson::Document &msg);
-  void OnChannelList(FunMulticastMessage *msg);
+  void OnChannelList(const FunMulticastMessage *msg);
   void OnChannelList(const fun::map<fun::string, int> &cl);
 
-  fun::unordered_set<fun::string> channels_;
-  fun::unordered_map<fun::string, FunapiEvent<JsonChannelMessageHandler>> json_channel_handlers_;
-  fun::unordered_map<fun::string, FunapiEvent<ProtobufChannelMessageHandler>> protobuf_channel_handlers_;
+  // Channel ids are interned to indices of channels_. A channel keeps its
+  // index after leaving, so the table only grows.
+  fun::unordered_map<fun::string, int> channel_indices_;
+  fun::vector<std::shared_ptr<Channel>> channels_;
+  // Indices of the channels with queued messages.
+  fun::vector<int> pending_channels_;
   mutable std::mutex channels_mutex_;
 
+  int max_messages_per_second_ = 0;
+  int max_queued_messages_ = 0;
+
+  std::atomic<bool> ready_{false};
+  static fun::vector<std::weak_ptr<FunapiMulticastImpl>> ready_multicasts_;
+  static std::mutex ready_multicasts_mutex_;
+
   void SendLeaveMessage(const fun::string &channel_id);
 };
 
 
+struct FunapiMulticastImpl::Channel {
+  fun::string channel_id;
+  int index = 0;
+  bool joined = false;
+
+  FunapiEvent<JsonChannelMessageHandler> json_handlers;
+  FunapiEvent<ProtobufChannelMessageHandler> protobuf_handlers;
+
+  // Messages sent since the last flush or held back by the rate limit.
+  // Only the queue of the multicast's encoding is used.
+  fun::deque<fun::string> json_queue;
+  fun::deque<FunMessage> protobuf_queue;
+  bool pending = false;
+
+  // Token bucket of the rate limit. It holds up to one second of messages.
+  double tokens = 0;
+  int64_t refill_time = 0;
+};
+
+
+fun::vector<std::weak_ptr<FunapiMulticastImpl>> FunapiMulticastImpl::ready_multicasts_;
+std::mutex FunapiMulticastImpl::ready_multicasts_mutex_;
+
+
 FunapiMulticastImpl::FunapiMulticastImpl(const char* sender,
                                          const char* hostname_or_ip,
                                          const uint16_t port,
@@ -235,9 +308,11 @@ void FunapiMulticastImpl::OnLeft(const fun::string &channel_id,
 
 
 void FunapiMulticastImpl::OnError(const fun::string &channel_id, const int error) {
-  {
+  if (auto c = FindChannel(channel_id)) {
     std::unique_lock<std::mutex> lock(channels_mutex_);
-    channels_.erase(channel_id);
+    c->joined = false;
+    c->json_queue.clear();
+    c->protobuf_queue.clear();
   }
 
   if (auto m = multicast_.lock()) {
@@ -253,7 +328,7 @@ void FunapiMulticastImpl::OnChannelList(const fun::map<fun::string, int> &cl) {
 }
 
 
-void FunapiMulticastImpl::OnChannelList(FunMulticastMessage *msg) {
+void FunapiMulticastImpl::OnChannelList(const FunMulticastMessage *msg) {
   fun::map<fun::string, int> cl;
 
   for (int i=0;i<msg->channels_size();++i) {
@@ -293,7 +368,8 @@ bool FunapiMulticastImpl::IsConnected() const {
 
 bool FunapiMulticastImpl::IsInChannel(const fun::string &channel_id) const {
   std::unique_lock<std::mutex> lock(channels_mutex_);
-  if (channels_.find(channel_id) != channels_.end()) {
+  auto iter = channel_indices_.find(channel_id);
+  if (iter != channel_indices_.end() && channels_[iter->second]->joined) {
     return true;
   }
 
@@ -301,6 +377,34 @@ bool FunapiMulticastImpl::IsInChannel(const fun::string &channel_id) const {
 }
 
 
+int FunapiMulticastImpl::InternChannel(const fun::string &channel_id) {
+  auto iter = channel_indices_.find(channel_id);
+  if (iter != channel_indices_.end()) {
+    return iter->second;
+  }
+
+  int index = static_cast<int>(channels_.size());
+  auto channel = std::make_shared<Channel>();
+  channel->channel_id = channel_id;
+  channel->index = index;
+  channels_.push_back(channel);
+  channel_indices_[channel_id] = index;
+
+  return index;
+}
+
+
+std::shared_ptr<FunapiMulticastImpl::Channel> FunapiMulticastImpl::FindChannel(const fun::string &channel_id) const {
+  std::unique_lock<std::mutex> lock(channels_mutex_);
+  auto iter = channel_indices_.find(channel_id);
+  if (iter == channel_indices_.end()) {
+    return nullptr;
+  }
+
+  return channels_[iter->second];
+}
+
+
 bool FunapiMulticastImpl::JoinChannel(const fun::string &channel_id, const fun::string &token) {
   if (!IsConnected()) {
     DebugUtils::Log("Not connected. First connect before join a multicast channel.");
@@ -314,7 +418,7 @@ bool FunapiMulticastImpl::JoinChannel(const fun::string &channel_id, const fun::
 
   {
     std::unique_lock<std::mutex> lock(channels_mutex_);
-    channels_.insert(channel_id);
+    channels_[InternChannel(channel_id)]->joined = true;
   }
 
   if (encoding_ == FunEncoding::kJson) {
@@ -387,8 +491,9 @@ bool FunapiMulticastImpl::JoinChannel(const fun::string &channel_id, const JsonC
 
   {
     std::unique_lock<std::mutex> lock(channels_mutex_);
-    channels_.insert(channel_id);
-    json_channel_handlers_[channel_id] += handler;
+    auto &channel = channels_[InternChannel(channel_id)];
+    channel->joined = true;
+    channel->json_handlers += handler;
   }
 
   // Send Join message
@@ -442,8 +547,9 @@ bool FunapiMulticastImpl::JoinChannel(const fun::string &channel_id, const Proto
 
   {
     std::unique_lock<std::mutex> lock(channels_mutex_);
-    channels_.insert(channel_id);
-    protobuf_channel_handlers_[channel_id] += handler;
+    auto &channel = channels_[InternChannel(channel_id)];
+    channel->joined = true;
+    channel->protobuf_handlers += handler;
   }
 
   // Send Join message
@@ -478,24 +584,38 @@ bool FunapiMulticastImpl::LeaveChannel(const fun::string &channel_id) {
     return false;
   }
 
+  auto channel = FindChannel(channel_id);
+
+  // The messages sent before leaving are not held back by the rate limit.
+  Flush(channel);
+
   SendLeaveMessage(channel_id);
   OnLeft(channel_id, sender_);
 
   {
     std::unique_lock<std::mutex> lock(channels_mutex_);
-    channels_.erase(channel_id);
+    channel->joined = false;
   }
 
-  json_channel_handlers_.erase(channel_id);
-  protobuf_channel_handlers_.erase(channel_id);
+  channel->json_handlers.clear();
+  channel->protobuf_handlers.clear();
 
   return true;
 }
 
 
 bool FunapiMulticastImpl::LeaveAllChannels() {
-  auto channels_set(channels_);
-  for (auto c : channels_set) {
+  fun::vector<fun::string> joined;
+  {
+    std::unique_lock<std::mutex> lock(channels_mutex_);
+    for (auto &c : channels_) {
+      if (c->joined) {
+        joined.push_back(c->channel_id);
+      }
+    }
+  }
+
+  for (auto &c : joined) {
     LeaveChannel(c);
   }
 
@@ -516,7 +636,11 @@ bool FunapiMulticastImpl::SendToChannel(const fun::string &channel_id, FunMessag
 
   msg.set_msgtype(kMulticastMsgType);
 
-  session_->SendMessage(msg, protocol_);
+  // Sent with the other messages of this tick by the next flush.
+  if (auto c = FindChannel(channel_id)) {
+    std::unique_lock<std::mutex> lock(channels_mutex_);
+    OnPushed(*c, PushDropOldest(c->protobuf_queue, msg, max_queued_messages_));
+  }
 
   return true;
 }
@@ -551,12 +675,135 @@ bool FunapiMulticastImpl::SendToChannel(const fun::string &channel_id, fun::stri
   msg.Accept(writer);
   fun::string send_json_string = buffer.GetString();
 
-  session_->SendMessage(kMulticastMsgType, send_json_string, protocol_);
+  // Sent with the other messages of this tick by the next flush.
+  if (auto c = FindChannel(channel_id)) {
+    std::unique_lock<std::mutex> lock(channels_mutex_);
+    OnPushed(*c, PushDropOldest(c->json_queue, send_json_string, max_queued_messages_));
+  }
 
   return true;
 }
 
 
+// channels_mutex_ has to be locked.
+void FunapiMulticastImpl::OnPushed(Channel &channel, const size_t dropped) {
+  if (dropped > 0) {
+    DebugUtils::Log("%d message(s) to the '%s' channel dropped. The send queue is full.",
+                    static_cast<int>(dropped), channel.channel_id.c_str());
+  }
+
+  if (!channel.pending) {
+    channel.pending = true;
+    pending_channels_.push_back(channel.index);
+  }
+
+  MarkReady();
+}
+
+
+void FunapiMulticastImpl::MarkReady() {
+  if (ready_.exchange(true))
+    return;
+
+  std::unique_lock<std::mutex> lock(ready_multicasts_mutex_);
+  ready_multicasts_.push_back(shared_from_this());
+}
+
+
+void FunapiMulticastImpl::Flush() {
+  fun::vector<fun::string> json_strings;
+  fun::vector<FunMessage> messages;
+  bool has_pending = false;
+
+  {
+    std::unique_lock<std::mutex> lock(channels_mutex_);
+    if (pending_channels_.empty()) {
+      return;
+    }
+
+    int64_t now = FunapiTimerWheel::NowMillisecond();
+    fun::vector<int> still_pending;
+
+    for (int index : pending_channels_) {
+      Channel &c = *channels_[index];
+      size_t queued = c.json_queue.size() + c.protobuf_queue.size();
+      size_t count = queued;
+
+      if (max_messages_per_second_ > 0) {
+        if (c.refill_time == 0) {
+          c.tokens = max_messages_per_second_;
+        }
+        else {
+          c.tokens = std::min<double>(max_messages_per_second_,
+                                      c.tokens + (now - c.refill_time) * max_messages_per_second_ / 1000.0);
+        }
+        c.refill_time = now;
+
+        count = std::min(count, static_cast<size_t>(c.tokens));
+        c.tokens -= count;
+      }
+
+      for (size_t i = 0; i < count && !c.json_queue.empty(); ++i) {
+        json_strings.push_back(fun::string());
+        json_strings.back().swap(c.json_queue.front());
+        c.json_queue.pop_front();
+      }
+
+      for (size_t i = 0; i < count && !c.protobuf_queue.empty(); ++i) {
+        messages.push_back(FunMessage());
+        messages.back().Swap(&c.protobuf_queue.front());
+        c.protobuf_queue.pop_front();
+      }
+
+      if (count < queued) {
+        still_pending.push_back(index);
+      }
+      else {
+        c.pending = false;
+      }
+    }
+
+    pending_channels_.swap(still_pending);
+    has_pending = !pending_channels_.empty();
+  }
+
+  // The messages are pushed to the transport together, and the network
+  // thread writes them in one send.
+  for (auto &json_string : json_strings) {
+    session_->SendMessage(kMulticastMsgType, json_string, protocol_);
+  }
+
+  for (auto &msg : messages) {
+    session_->SendMessage(msg, protocol_);
+  }
+
+  // Messages held back by the rate limit are sent in a later tick.
+  if (has_pending) {
+    MarkReady();
+  }
+}
+
+
+void FunapiMulticastImpl::Flush(const std::shared_ptr<Channel> &channel) {
+  fun::deque<fun::string> json_queue;
+  fun::deque<FunMessage> protobuf_queue;
+
+  {
+    std::unique_lock<std::mutex> lock(channels_mutex_);
+    json_queue.swap(channel->json_queue);
+    protobuf_queue.swap(channel->protobuf_queue);
+  }
+
+  for (auto &json_string : json_queue) {
+    session_->SendMessage(kMulticastMsgType, json_string, protocol_);
+  }
+
+  for (auto &msg : protobuf_queue) {
+    session_->SendMessage(msg, protocol_);
+  }
+}
+
+
 void FunapiMulticastImpl::SendLeaveMessage(const fun::string &channel_id) {
   if (encoding_ == FunEncoding::kJson) {
     rapidjson::Document msg;
@@ -637,9 +884,9 @@ void FunapiMulticastImpl::OnReceived(const fun::string &json_string) {
   }
 
   if (OnReceived(channel_id, sender, join, leave, error_code) == false) {
-    if (json_channel_handlers_.find(channel_id) != json_channel_handlers_.end()) {
+    if (auto c = FindChannel(channel_id)) {
       if (auto m = multicast_.lock()) {
-        json_channel_handlers_[channel_id](m, channel_id, sender, json_string);
+        c->json_handlers(m, channel_id, sender, json_string);
       }
     }
   }
@@ -653,7 +900,7 @@ void FunapiMulticastImpl::OnReceived(const FunMessage &message) {
   bool leave = false;
   int error_code = 0;
 
-  FunMulticastMessage mcast_msg = message.GetExtension(multicast);
+  const FunMulticastMessage &mcast_msg = message.GetExtension(multicast);
 
   channel_id = mcast_msg.channel();
 
@@ -679,9 +926,9 @@ void FunapiMulticastImpl::OnReceived(const FunMessage &message) {
   }
 
   if (OnReceived(channel_id, sender, join, leave, error_code) == false) {
-    if (protobuf_channel_handlers_.find(channel_id) != protobuf_channel_handlers_.end()) {
+    if (auto c = FindChannel(channel_id)) {
       if (auto m = multicast_.lock()) {
-        protobuf_channel_handlers_[channel_id](m, channel_id, sender, message);
+        c->protobuf_handlers(m, channel_id, sender, message);
       }
     }
   }
@@ -740,13 +987,43 @@ bool FunapiMulticastImpl::RequestChannelList() {
 }
 
 
+void FunapiMulticastImpl::SetChannelSendLimit(const int max_messages_per_second, const int max_queued_messages) {
+  std::unique_lock<std::mutex> lock(channels_mutex_);
+  max_messages_per_second_ = std::max(0, max_messages_per_second);
+  max_queued_messages_ = std::max(0, max_queued_messages);
+}
+
+
 void FunapiMulticastImpl::Update() {
+  Flush();
+
   if (session_) {
     session_->Update();
   }
 }
 
 
+void FunapiMulticastImpl::UpdateAll() {
+  fun::vector<std::weak_ptr<FunapiMulticastImpl>> v_ready;
+  {
+    std::unique_lock<std::mutex> lock(ready_multicasts_mutex_);
+    if (ready_multicasts_.empty())
+      return;
+
+    v_ready.swap(ready_multicasts_);
+  }
+
+  for (auto &i : v_ready) {
+    if (auto m = i.lock()) {
+      // Cleared before flushing so that the messages held back put the
+      // multicast on the list again.
+      m->ready_ = false;
+      m->Flush();
+    }
+  }
+}
+
+
 FunEncoding FunapiMulticastImpl::GetEncoding() {
   return encoding_;
 }
@@ -824,13 +1101,15 @@ void FunapiMulticastImpl::Close() {
 
 void FunapiMulticastImpl::AddProtobufChannelMessageCallback(const fun::string &channel_id,
                                                         const ProtobufChannelMessageHandler &handler) {
-  protobuf_channel_handlers_[channel_id] += handler;
+  std::unique_lock<std::mutex> lock(channels_mutex_);
+  channels_[InternChannel(channel_id)]->protobuf_handlers += handler;
 }
 
 
 void FunapiMulticastImpl::AddJsonChannelMessageCallback(const fun::string &channel_id,
                                                     const JsonChannelMessageHandler &handler) {
-  json_channel_handlers_[channel_id] += handler;
+  std::unique_lock<std::mutex> lock(channels_mutex_);
+  channels_[InternChannel(channel_id)]->json_handlers += handler;
 }
 
 
@@ -865,10 +1144,21 @@ FunapiMulticast::~FunapiMulticast() {
 }
 
 
+// Multicast goes over Tcp and Websocket only.
+static bool IsMulticastProtocol(const TransportProtocol protocol) {
+#if FUNAPI_HAVE_WEBSOCKET
+  if (protocol == TransportProtocol::kWebsocket) {
+    return true;
+  }
+#endif // FUNAPI_HAVE_WEBSOCKET
+
+  return protocol == TransportProtocol::kTcp;
+}
+
+
 std::shared_ptr<FunapiMulticast> FunapiMulticast::Create(const char* sender, const char* hostname_or_ip, const uint16_t port,
                                                          const FunEncoding encoding, const bool reliability, const TransportProtocol protocol) {
-  if (protocol != TransportProtocol::kTcp &&
-      protocol != TransportProtocol::kWebsocket)
+  if (!IsMulticastProtocol(protocol))
   {
     DebugUtils::Log("FunapiMulticast only supports Tcp and Websocket Transport.");
     return nullptr;
@@ -880,8 +1170,7 @@ std::shared_ptr<FunapiMulticast> FunapiMulticast::Create(const char* sender, con
 
 std::shared_ptr<FunapiMulticast> FunapiMulticast::Create(const char* sender, const std::shared_ptr<FunapiSession> &session,
                                                          const TransportProtocol protocol) {
-  if (protocol != TransportProtocol::kTcp &&
-      protocol != TransportProtocol::kWebsocket)
+  if (!IsMulticastProtocol(protocol))
   {
     DebugUtils::Log("FunapiMulticast only supports Tcp and Websocket Transport.");
     return nullptr;
@@ -905,8 +1194,7 @@ std::shared_ptr<FunapiMulticast> FunapiMulticast::Create(const char* sender,
                                                          const std::shared_ptr<FunapiTransportOption> &transport_opt,
                                                          const std::shared_ptr<FunapiSessionOption> &session_opt)
 {
-  if (protocol != TransportProtocol::kTcp &&
-    protocol != TransportProtocol::kWebsocket)
+  if (!IsMulticastProtocol(protocol))
   {
     DebugUtils::Log("FunapiMulticast only supports Tcp and Websocket Transport.");
     return nullptr;
@@ -971,11 +1259,21 @@ bool FunapiMulticast::RequestChannelList() {
 }
 
 
+void FunapiMulticast::SetChannelSendLimit(const int max_messages_per_second, const int max_queued_messages) {
+  impl_->SetChannelSendLimit(max_messages_per_second, max_queued_messages);
+}
+
+
 void FunapiMulticast::Update() {
   impl_->Update();
 }
 
 
+void FunapiMulticast::UpdateAll() {
+  FunapiMulticastImpl::UpdateAll();
+}
+
+
 FunEncoding FunapiMulticast::GetEncoding() {
   return impl_->GetEncoding();
 }
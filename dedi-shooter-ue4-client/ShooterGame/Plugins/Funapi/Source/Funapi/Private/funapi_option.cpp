@@ -98,6 +98,10 @@ fun::string FunapiErrorImpl::GetErrorTypeString() {
       ret = "Websocket";
       break;
 
+    case ErrorType::kRetransmit:
+      ret = "Retransmit";
+      break;
+
     default:
       ret = "None";
   }
@@ -178,9 +182,13 @@ class FunapiTransportOptionImpl : public std::enable_shared_from_this<FunapiTran
   void SetZstdDictBase64String(const fun::string &zstd_dict_base64string);
   fun::string GetZstdDictBase64String();
 
+  void SetUseZstdStream(const bool use_stream);
+  bool GetUseZstdStream();
+
  private:
   fun::vector<CompressionType> compression_types_;
   fun::string zstd_dict_base64string_;
+  bool use_zstd_stream_ = false;
 };
 
 
@@ -204,6 +212,16 @@ fun::string FunapiTransportOptionImpl::GetZstdDictBase64String() {
 }
 
 
+void FunapiTransportOptionImpl::SetUseZstdStream(const bool use_stream) {
+  use_zstd_stream_ = use_stream;
+}
+
+
+bool FunapiTransportOptionImpl::GetUseZstdStream() {
+  return use_zstd_stream_;
+}
+
+
 ////////////////////////////////////////////////////////////////////////////////
 // FunapiTcpTransportOptionImpl implementation.
 
@@ -236,6 +254,9 @@ class FunapiTcpTransportOptionImpl : public FunapiTransportOptionImpl {
   void SetUseTLS(const bool use_tls);
   bool GetUseTLS();
 
+  void SetUseTLSSessionResumption(const bool use);
+  bool GetUseTLSSessionResumption();
+
   void SetCACertFilePath(const fun::string &path);
   const fun::string& GetCACertFilePath();
 
@@ -248,6 +269,7 @@ class FunapiTcpTransportOptionImpl : public FunapiTransportOptionImpl {
   fun::vector<EncryptionType> encryption_types_;
   fun::unordered_map<int32_t, fun::string> pubilc_keys_;
   bool use_tls_ = false;
+  bool use_tls_session_resumption_ = true;
   fun::string cert_file_path_;
 };
 
@@ -338,6 +360,16 @@ bool FunapiTcpTransportOptionImpl::GetUseTLS() {
 }
 
 
+void FunapiTcpTransportOptionImpl::SetUseTLSSessionResumption(const bool use) {
+  use_tls_session_resumption_ = use;
+}
+
+
+bool FunapiTcpTransportOptionImpl::GetUseTLSSessionResumption() {
+  return use_tls_session_resumption_;
+}
+
+
 void FunapiTcpTransportOptionImpl::SetCACertFilePath(const fun::string &path) {
   cert_file_path_ = path;
 }
@@ -358,8 +390,20 @@ class FunapiUdpTransportOptionImpl : public FunapiTransportOptionImpl {
   void SetEncryptionType(const EncryptionType type);
   EncryptionType GetEncryptionType();
 
+  void SetSegmentOffload(const bool enable);
+  bool GetSegmentOffload();
+
+  void SetEnablePing(const bool enable_ping);
+  bool GetEnablePing();
+
+  void AddChannel(const int channel, const UdpChannelType type);
+  const fun::map<int, UdpChannelType>& GetChannels();
+
  private:
   EncryptionType encryption_type_ = static_cast<EncryptionType>(0);
+  bool segment_offload_ = false;
+  bool enable_ping_ = false;
+  fun::map<int, UdpChannelType> channels_;
 };
 
 
@@ -373,6 +417,41 @@ EncryptionType FunapiUdpTransportOptionImpl::GetEncryptionType() {
 }
 
 
+void FunapiUdpTransportOptionImpl::SetSegmentOffload(const bool enable) {
+  segment_offload_ = enable;
+}
+
+
+bool FunapiUdpTransportOptionImpl::GetSegmentOffload() {
+  return segment_offload_;
+}
+
+
+void FunapiUdpTransportOptionImpl::SetEnablePing(const bool enable_ping) {
+  enable_ping_ = enable_ping;
+}
+
+
+bool FunapiUdpTransportOptionImpl::GetEnablePing() {
+  return enable_ping_;
+}
+
+
+void FunapiUdpTransportOptionImpl::AddChannel(const int channel, const UdpChannelType type) {
+  if (channel <= 0) {
+    DebugUtils::Log("UDP channel id has to be greater than 0: %d", channel);
+    return;
+  }
+
+  channels_[channel] = type;
+}
+
+
+const fun::map<int, UdpChannelType>& FunapiUdpTransportOptionImpl::GetChannels() {
+  return channels_;
+}
+
+
 ////////////////////////////////////////////////////////////////////////////////
 // FunapiHttpTransportOptionImpl implementation.
 
@@ -396,12 +475,16 @@ class FunapiHttpTransportOptionImpl : public FunapiTransportOptionImpl {
   void SetCACertFilePath(const fun::string &path);
   const fun::string& GetCACertFilePath();
 
+  void SetMaxInflightRequests(const int max_requests);
+  int GetMaxInflightRequests();
+
  private:
   bool sequence_number_validation_ = false;
   bool use_https_ = false;
   EncryptionType encryption_type_ = EncryptionType::kNoneEncryption;
   fun::string cert_file_path_;
   time_t timeout_seconds_ = 5;
+  int max_inflight_requests_ = 1;
 };
 
 
@@ -455,6 +538,16 @@ const fun::string& FunapiHttpTransportOptionImpl::GetCACertFilePath() {
 }
 
 
+void FunapiHttpTransportOptionImpl::SetMaxInflightRequests(const int max_requests) {
+  max_inflight_requests_ = max_requests;
+}
+
+
+int FunapiHttpTransportOptionImpl::GetMaxInflightRequests() {
+  return max_inflight_requests_;
+}
+
+
 ////////////////////////////////////////////////////////////////////////////////
 // FunapiWebsocketTransportOptionImpl implementation.
 
@@ -466,8 +559,16 @@ public:
   void SetUseWss(const bool use_wss);
   bool GetUseWss();
 
+  void SetUsePerMessageDeflate(const bool use_deflate);
+  bool GetUsePerMessageDeflate();
+
+  void SetUseMessageBatching(const bool use_batching);
+  bool GetUseMessageBatching();
+
 private:
   bool use_wss_ = false;
+  bool use_per_message_deflate_ = false;
+  bool use_message_batching_ = false;
 };
 
 
@@ -481,6 +582,26 @@ bool FunapiWebsocketTransportOptionImpl::GetUseWss() {
 }
 
 
+void FunapiWebsocketTransportOptionImpl::SetUsePerMessageDeflate(const bool use_deflate) {
+  use_per_message_deflate_ = use_deflate;
+}
+
+
+bool FunapiWebsocketTransportOptionImpl::GetUsePerMessageDeflate() {
+  return use_per_message_deflate_;
+}
+
+
+void FunapiWebsocketTransportOptionImpl::SetUseMessageBatching(const bool use_batching) {
+  use_message_batching_ = use_batching;
+}
+
+
+bool FunapiWebsocketTransportOptionImpl::GetUseMessageBatching() {
+  return use_message_batching_;
+}
+
+
 ////////////////////////////////////////////////////////////////////////////////
 // FunapiTcpTransportOption implementation.
 
@@ -570,6 +691,11 @@ fun::string FunapiTcpTransportOption::GetPublicKey(const EncryptionType type) {
 void FunapiTcpTransportOption::SetUseTLS(const bool use_tls) {
   impl_->SetUseTLS(use_tls);
 }
+
+
+void FunapiTcpTransportOption::SetUseTLSSessionResumption(const bool use) {
+  impl_->SetUseTLSSessionResumption(use);
+}
 #endif
 
 
@@ -578,6 +704,11 @@ bool FunapiTcpTransportOption::GetUseTLS() {
 }
 
 
+bool FunapiTcpTransportOption::GetUseTLSSessionResumption() {
+  return impl_->GetUseTLSSessionResumption();
+}
+
+
 #ifdef FUNAPI_UE4_PLATFORM_PS4
 void FunapiTcpTransportOption::SetCACert(const fun::string &cert) {
   impl_->SetCACertFilePath(cert);
@@ -613,6 +744,16 @@ fun::vector<CompressionType> FunapiTcpTransportOption::GetCompressionTypes() {
 fun::string FunapiTcpTransportOption::GetZstdDictBase64String() {
   return impl_->GetZstdDictBase64String();
 }
+
+
+void FunapiTcpTransportOption::SetUseZstdStream(const bool use_stream) {
+  impl_->SetUseZstdStream(use_stream);
+}
+
+
+bool FunapiTcpTransportOption::GetUseZstdStream() {
+  return impl_->GetUseZstdStream();
+}
 #endif
 
 
@@ -661,6 +802,36 @@ fun::string FunapiUdpTransportOption::GetZstdDictBase64String() {
 #endif
 
 
+void FunapiUdpTransportOption::SetSegmentOffload(const bool enable) {
+  impl_->SetSegmentOffload(enable);
+}
+
+
+bool FunapiUdpTransportOption::GetSegmentOffload() {
+  return impl_->GetSegmentOffload();
+}
+
+
+void FunapiUdpTransportOption::SetEnablePing(const bool enable_ping) {
+  impl_->SetEnablePing(enable_ping);
+}
+
+
+bool FunapiUdpTransportOption::GetEnablePing() {
+  return impl_->GetEnablePing();
+}
+
+
+void FunapiUdpTransportOption::AddChannel(const int channel, const UdpChannelType type) {
+  impl_->AddChannel(channel, type);
+}
+
+
+const fun::map<int, UdpChannelType>& FunapiUdpTransportOption::GetChannels() {
+  return impl_->GetChannels();
+}
+
+
 ////////////////////////////////////////////////////////////////////////////////
 // FunapiHttpTransportOption implementation.
 
@@ -730,6 +901,16 @@ time_t FunapiHttpTransportOption::GetConnectTimeout() {
 }
 
 
+void FunapiHttpTransportOption::SetMaxInflightRequests(const int max_requests) {
+  impl_->SetMaxInflightRequests(max_requests);
+}
+
+
+int FunapiHttpTransportOption::GetMaxInflightRequests() {
+  return impl_->GetMaxInflightRequests();
+}
+
+
 void FunapiHttpTransportOption::SetCompressionType(const CompressionType type) {
   impl_->SetCompressionType(type);
 }
@@ -787,6 +968,26 @@ fun::vector<CompressionType> FunapiWebsocketTransportOption::GetCompressionTypes
 }
 
 
+void FunapiWebsocketTransportOption::SetUsePerMessageDeflate(const bool use_deflate) {
+  impl_->SetUsePerMessageDeflate(use_deflate);
+}
+
+
+bool FunapiWebsocketTransportOption::GetUsePerMessageDeflate() {
+  return impl_->GetUsePerMessageDeflate();
+}
+
+
+void FunapiWebsocketTransportOption::SetUseMessageBatching(const bool use_batching) {
+  impl_->SetUseMessageBatching(use_batching);
+}
+
+
+bool FunapiWebsocketTransportOption::GetUseMessageBatching() {
+  return impl_->GetUseMessageBatching();
+}
+
+
 #if FUNAPI_HAVE_ZSTD
 //void FunapiWebsocketTransportOption::SetZstdDictBase64String(const fun::string &zstd_dict_base64string) {
 //  impl_->SetZstdDictBase64String(zstd_dict_base64string);
@@ -796,6 +997,16 @@ fun::vector<CompressionType> FunapiWebsocketTransportOption::GetCompressionTypes
 fun::string FunapiWebsocketTransportOption::GetZstdDictBase64String() {
   return impl_->GetZstdDictBase64String();
 }
+
+
+void FunapiWebsocketTransportOption::SetUseZstdStream(const bool use_stream) {
+  impl_->SetUseZstdStream(use_stream);
+}
+
+
+bool FunapiWebsocketTransportOption::GetUseZstdStream() {
+  return impl_->GetUseZstdStream();
+}
 #endif
 
 
@@ -820,11 +1031,34 @@ public:
     void SetDelayedAckIntervalMillisecond(const int millisecond);
     int GetDelayedAckIntervalMillisecond();
 
+    void SetTaskTimeBudgetMicrosecond(const int microsecond);
+    int GetTaskTimeBudgetMicrosecond();
+
+    void SetJsonInsituParsing(const bool insitu);
+    bool GetJsonInsituParsing();
+
+    void SetRetransmitQueueLimit(const int max_messages, const int max_bytes);
+    int GetRetransmitQueueMaxMessages();
+    int GetRetransmitQueueMaxBytes();
+
+    void SetRetransmitOverflowPolicy(const FunapiSessionOption::RetransmitOverflowPolicy policy);
+    FunapiSessionOption::RetransmitOverflowPolicy GetRetransmitOverflowPolicy();
+
+    void SetUseRedirectPreconnect(const bool use);
+    bool GetUseRedirectPreconnect();
+
 private:
     bool use_session_reliability_ = false;
     bool use_send_session_id_only_once_ = false;
     bool use_redirect_message_queue_ = false;
     int delayed_ack_interval_millisecond_ = 0;
+    int task_time_budget_microsecond_ = 0;
+    bool use_json_insitu_parsing_ = false;
+    int retransmit_queue_max_messages_ = 0;
+    int retransmit_queue_max_bytes_ = 0;
+    FunapiSessionOption::RetransmitOverflowPolicy retransmit_overflow_policy_ =
+        FunapiSessionOption::RetransmitOverflowPolicy::kStopTransport;
+    bool use_redirect_preconnect_ = false;
 };
 
 
@@ -881,6 +1115,73 @@ int FunapiSessionOptionImpl::GetDelayedAckIntervalMillisecond()
 }
 
 
+void FunapiSessionOptionImpl::SetTaskTimeBudgetMicrosecond(const int microsecond)
+{
+    task_time_budget_microsecond_ = microsecond;
+}
+
+
+int FunapiSessionOptionImpl::GetTaskTimeBudgetMicrosecond()
+{
+    return task_time_budget_microsecond_;
+}
+
+
+void FunapiSessionOptionImpl::SetJsonInsituParsing(const bool insitu)
+{
+    use_json_insitu_parsing_ = insitu;
+}
+
+
+bool FunapiSessionOptionImpl::GetJsonInsituParsing()
+{
+    return use_json_insitu_parsing_;
+}
+
+
+void FunapiSessionOptionImpl::SetRetransmitQueueLimit(const int max_messages, const int max_bytes)
+{
+    retransmit_queue_max_messages_ = max_messages;
+    retransmit_queue_max_bytes_ = max_bytes;
+}
+
+
+int FunapiSessionOptionImpl::GetRetransmitQueueMaxMessages()
+{
+    return retransmit_queue_max_messages_;
+}
+
+
+int FunapiSessionOptionImpl::GetRetransmitQueueMaxBytes()
+{
+    return retransmit_queue_max_bytes_;
+}
+
+
+void FunapiSessionOptionImpl::SetRetransmitOverflowPolicy(const FunapiSessionOption::RetransmitOverflowPolicy policy)
+{
+    retransmit_overflow_policy_ = policy;
+}
+
+
+FunapiSessionOption::RetransmitOverflowPolicy FunapiSessionOptionImpl::GetRetransmitOverflowPolicy()
+{
+    return retransmit_overflow_policy_;
+}
+
+
+void FunapiSessionOptionImpl::SetUseRedirectPreconnect(const bool use)
+{
+    use_redirect_preconnect_ = use;
+}
+
+
+bool FunapiSessionOptionImpl::GetUseRedirectPreconnect()
+{
+    return use_redirect_preconnect_;
+}
+
+
 ////////////////////////////////////////////////////////////////////////////////
 // FunapiSessionOption implementation.
 
@@ -945,4 +1246,70 @@ int FunapiSessionOption::GetDelayedAckIntervalMillisecond()
     return impl_->GetDelayedAckIntervalMillisecond();
 }
 
+
+void FunapiSessionOption::SetTaskTimeBudgetMicrosecond(const int microsecond)
+{
+    impl_->SetTaskTimeBudgetMicrosecond(microsecond);
+}
+
+
+int FunapiSessionOption::GetTaskTimeBudgetMicrosecond()
+{
+    return impl_->GetTaskTimeBudgetMicrosecond();
+}
+
+
+void FunapiSessionOption::SetJsonInsituParsing(const bool insitu)
+{
+    impl_->SetJsonInsituParsing(insitu);
+}
+
+
+bool FunapiSessionOption::GetJsonInsituParsing()
+{
+    return impl_->GetJsonInsituParsing();
+}
+
+
+void FunapiSessionOption::SetRetransmitQueueLimit(const int max_messages, const int max_bytes)
+{
+    impl_->SetRetransmitQueueLimit(max_messages, max_bytes);
+}
+
+
+int FunapiSessionOption::GetRetransmitQueueMaxMessages()
+{
+    return impl_->GetRetransmitQueueMaxMessages();
+}
+
+
+int FunapiSessionOption::GetRetransmitQueueMaxBytes()
+{
+    return impl_->GetRetransmitQueueMaxBytes();
+}
+
+
+void FunapiSessionOption::SetRetransmitOverflowPolicy(const RetransmitOverflowPolicy policy)
+{
+    impl_->SetRetransmitOverflowPolicy(policy);
+}
+
+
+FunapiSessionOption::RetransmitOverflowPolicy FunapiSessionOption::GetRetransmitOverflowPolicy()
+{
+    return impl_->GetRetransmitOverflowPolicy();
+}
+
+
+void FunapiSessionOption::SetUseRedirectPreconnect(const bool use)
+{
+    impl_->SetUseRedirectPreconnect(use);
+}
+
+
+bool FunapiSessionOption::GetUseRedirectPreconnect()
+{
+    return impl_->GetUseRedirectPreconnect();
+}
+
 }  // namespace fun
@@ -15,6 +15,7 @@
 #include "funapi_utils.h"
 #include "funapi_tasks.h"
 #include "funapi_socket.h"
+#include "funapi_send_flag_manager.h"
 
 #define kRpcAddMessageType "_sys_ds_add_server"
 #define kRpcDelMessageType "_sys_ds_del_server"
@@ -27,13 +28,13 @@ namespace fun {
 ////////////////////////////////////////////////////////////////////////////////
 // FunapiRpcMessage
 
+// A received message. It is parsed in place and shared by the handlers, so
+// it is never copied.
 class FunapiRpcMessage : public std::enable_shared_from_this<FunapiRpcMessage> {
  public:
   FunapiRpcMessage() = default;
-  FunapiRpcMessage(const FunDedicatedServerRpcMessage &msg);
   virtual ~FunapiRpcMessage();
 
-  void SetMessage(const FunDedicatedServerRpcMessage &msg);
   FunDedicatedServerRpcMessage& GetMessage();
 
  private:
@@ -41,20 +42,11 @@ class FunapiRpcMessage : public std::enable_shared_from_this<FunapiRpcMessage> {
 };
 
 
-FunapiRpcMessage::FunapiRpcMessage(const FunDedicatedServerRpcMessage &msg) : protobuf_(msg) {
-}
-
-
 FunapiRpcMessage::~FunapiRpcMessage() {
   // DebugUtils::Log("%s", __FUNCTION__);
 }
 
 
-void FunapiRpcMessage::SetMessage(const FunDedicatedServerRpcMessage &msg) {
-  protobuf_ = msg;
-}
-
-
 FunDedicatedServerRpcMessage& FunapiRpcMessage::GetMessage() {
   return protobuf_;
 }
@@ -70,6 +62,9 @@ class FunapiRpcImpl : public std::enable_shared_from_this<FunapiRpcImpl> {
   typedef FunapiRpc::EventHandler EventHandler;
   typedef FunapiRpc::ResponseHandler ResponseHandler;
   typedef FunapiRpc::RpcHandler RpcHandler;
+  typedef FunapiRpc::CallResult CallResult;
+  typedef FunapiRpc::CallId CallId;
+  typedef FunapiRpc::CallHandler CallHandler;
 
   typedef std::function<void(std::shared_ptr<FunapiRpcPeer> peer,
                              const fun::string &type,
@@ -85,7 +80,14 @@ class FunapiRpcImpl : public std::enable_shared_from_this<FunapiRpcImpl> {
   void SetSystemHandler(const fun::string &type, const RpcSystemHandler &handler);
   void Update();
 
+  CallId Call(const fun::string &type,
+              const FunDedicatedServerRpcMessage &request_message,
+              const CallHandler &handler,
+              const int timeout_millisecond);
+  bool Cancel(const CallId id);
+
   void OnHandler(std::shared_ptr<FunapiRpcPeer> peer, std::shared_ptr<FunapiRpcMessage> msg);
+  void OnPeerDisconnected(std::shared_ptr<FunapiRpcPeer> peer);
   std::shared_ptr<FunapiTasks> GetTasksQueue();
   std::shared_ptr<FunapiRpcOption> GetRpcOption();
 
@@ -100,9 +102,33 @@ class FunapiRpcImpl : public std::enable_shared_from_this<FunapiRpcImpl> {
   void Connect(const int index);
   void InitSystemHandlers();
   void SetPeerEventHanderReconnect(const fun::string &peer_id, std::shared_ptr<FunapiRpcPeer> peer);
+  void SetPoolPeerEventHandler(const fun::string &peer_id, std::shared_ptr<FunapiRpcPeer> peer);
   void CallMasterMessage();
 
+  // Opens the missing extra connections of the pool of the peer.
+  void ConnectPool(const fun::string &peer_id, const fun::string &hostname_or_ip, const int port);
+  void ClosePool(const fun::string &peer_id);
+  bool IsPoolPeer(std::shared_ptr<FunapiRpcPeer> peer);
+
+  // peer_map_mutex_ has to be held.
+  void AddToRing(const fun::string &peer_id);
+  void RemoveFromRing(const fun::string &peer_id);
+  std::shared_ptr<FunapiRpcPeer> PickPeer(const fun::string &type);
+
+  fun::string MakeXid(const CallId id);
+  void OnCallCompleted(const fun::string &xid,
+                       const CallResult result,
+                       const FunDedicatedServerRpcMessage &response_message);
+
  private:
+  struct Transaction {
+    CallHandler handler;
+    std::weak_ptr<FunapiRpcPeer> peer;
+    FunapiTimerWheel::TimerId timer_id = FunapiTimerWheel::kInvalidTimerId;
+  };
+
+  static const int kVirtualNodes = 64;
+
   std::shared_ptr<FunapiTasks> tasks_;
 
   fun::unordered_set<std::shared_ptr<FunapiRpcPeer>> peer_set_;
@@ -111,6 +137,19 @@ class FunapiRpcImpl : public std::enable_shared_from_this<FunapiRpcImpl> {
   fun::unordered_map<fun::string, std::shared_ptr<FunapiRpcPeer>> peer_map_;
   std::mutex peer_map_mutex_;
 
+  // Extra connections of the peers in peer_map_, and the hash ring of the
+  // peer ids. Both are guarded by peer_map_mutex_.
+  fun::unordered_map<fun::string, fun::vector<std::shared_ptr<FunapiRpcPeer>>> pool_map_;
+  fun::map<uint32_t, fun::string> ring_;
+
+  // In-flight calls by xid.
+  fun::unordered_map<fun::string, std::shared_ptr<Transaction>> transactions_;
+  std::mutex transactions_mutex_;
+  std::atomic<CallId> last_call_id_;
+  fun::string xid_prefix_;
+
+  std::shared_ptr<FunapiTimerWheel> timer_wheel_;
+
   fun::unordered_map<fun::string, std::shared_ptr<RpcHandler>> handler_map_;
   std::mutex handler_map_mutex_;
 
@@ -156,13 +195,20 @@ class FunapiRpcPeer : public std::enable_shared_from_this<FunapiRpcPeer> {
   void SetEventCallback(const EventHandler &handler);
   void SetRpcImpl(std::weak_ptr<FunapiRpcImpl> weak);
   void SetPeerId(const fun::string &id);
+  const fun::string& GetHostname();
+  int GetPort();
 
-  void Call(std::shared_ptr<FunapiRpcMessage> message);
+  void Call(const FunDedicatedServerRpcMessage &message);
+  void Call(const FunDedicatedServerRpcMessage &header, const FunDedicatedServerRpcMessage &body);
+
+  // Number of calls sent on the connection and not answered yet.
+  int GetInFlight();
+  void AddInFlight(const int count);
 
  protected:
   void SetState(const State s);
-  void PushNetworkThread(const FunapiThread::TaskHandler &handler);
-  void PushTaskQueue(const FunapiTasks::TaskHandler &task);
+  template <typename F> void PushNetworkThread(const F &handler);
+  template <typename F> void PushTaskQueue(const F &task);
   void OnConnect(fun::string hostname_or_ip, int port);
   void OnClose();
   void OnEvent(const EventType type);
@@ -176,10 +222,10 @@ class FunapiRpcPeer : public std::enable_shared_from_this<FunapiRpcPeer> {
   void OnDisconnecting();
   void OnDisconnect();
   bool EmptySendQueue();
-  void PushSendQueue(const FunDedicatedServerRpcMessage &message);
-  void PushSendQueue(std::shared_ptr<FunapiRpcMessage> message);
+  void PushSendQueue(const FunDedicatedServerRpcMessage *header, const FunDedicatedServerRpcMessage &body);
   void ClearSendQueue();
   void PushConnectThread();
+  void PushConnectTask();
 
  private:
   State state_ = State::kDisconnected;
@@ -193,21 +239,23 @@ class FunapiRpcPeer : public std::enable_shared_from_this<FunapiRpcPeer> {
   std::shared_ptr<FunapiTcp> tcp_ = nullptr;
 
   fun::vector<uint8_t> recv_buffer_;
-  uint32_t proto_length_ = 0;
 
   fun::string hostname_or_ip_;
   int port_ = 0;
 
-  fun::deque<std::shared_ptr<FunapiRpcMessage>> send_queue_;
+  // Framed messages waiting to be sent.
+  fun::vector<uint8_t> send_queue_;
   std::mutex send_queue_mutex_;
 
+  std::atomic<int> in_flight_;
+
   std::weak_ptr<FunapiRpcImpl> rpc_impl_;
 
   fun::string peer_id_;
 };
 
 
-FunapiRpcPeer::FunapiRpcPeer() {
+FunapiRpcPeer::FunapiRpcPeer() : in_flight_(0) {
   network_thread_ = FunapiThread::Get("_network");
 }
 
@@ -219,28 +267,9 @@ FunapiRpcPeer::~FunapiRpcPeer() {
 
 void FunapiRpcPeer::OnSend() {
   fun::vector<uint8_t> buffer;
-  int offset = 0;
-
-  fun::deque<std::shared_ptr<FunapiRpcMessage>> temp_queue;
   {
     std::unique_lock<std::mutex> lock(send_queue_mutex_);
-    temp_queue.swap(send_queue_);
-  }
-
-  for (auto message : temp_queue) {
-    buffer.resize(offset + 4 + message->GetMessage().ByteSize());
-
-    uint8_t *data = buffer.data() + offset;
-
-    uint32_t length = htonl(message->GetMessage().ByteSize());
-    memcpy(data, &length, 4);
-    message->GetMessage().SerializeToArray(data+4, message->GetMessage().ByteSize());
-
-    offset += 4 + message->GetMessage().ByteSize();
-
-#ifdef DEBUG_LOG
-    DebugUtils::Log("[RPC:C->S] %s", message->GetMessage().ShortDebugString().c_str());
-#endif
+    buffer.swap(send_queue_);
   }
 
   if (!buffer.empty()) {
@@ -270,49 +299,40 @@ void FunapiRpcPeer::OnSend() {
 void FunapiRpcPeer::OnRecv(const int read_length, const fun::vector<uint8_t> &receiving) {
   recv_buffer_.insert(recv_buffer_.end(), receiving.cbegin(), receiving.cbegin() + read_length);
 
-  while (true) {
-    if (proto_length_ == 0) {
-      if (recv_buffer_.size() >= 4) {
-        uint32_t length;
-        memcpy(&length, recv_buffer_.data(), 4);
-        proto_length_ = ntohl(length);
-      }
-      else {
-        return;
-      }
+  // Parses every complete message and then drops them from the buffer at
+  // once, so pipelined responses are not moved once per message.
+  size_t offset = 0;
+  while (recv_buffer_.size() - offset >= 4) {
+    uint32_t length;
+    memcpy(&length, recv_buffer_.data() + offset, 4);
+    uint32_t proto_length = ntohl(length);
+
+    if (recv_buffer_.size() - offset - 4 < proto_length) {
+      break;
     }
 
-    if (proto_length_ > 0)
-    {
-      if (recv_buffer_.size() >= (4+proto_length_)) {
-        FunDedicatedServerRpcMessage protobuf_message;
-        protobuf_message.ParseFromArray(recv_buffer_.data()+4, proto_length_);
+    auto recv_funapi_rpc_message = std::make_shared<FunapiRpcMessage>();
+    recv_funapi_rpc_message->GetMessage().ParseFromArray(recv_buffer_.data() + offset + 4, proto_length);
 
 #ifdef DEBUG_LOG
-        DebugUtils::Log("[RPC:S->C] %s", protobuf_message.ShortDebugString().c_str());
+    DebugUtils::Log("[RPC:S->C] %s", recv_funapi_rpc_message->GetMessage().ShortDebugString().c_str());
 #endif
 
-        auto recv_funapi_rpc_message = std::make_shared<FunapiRpcMessage>(protobuf_message);
-        std::weak_ptr<FunapiRpcPeer> weak = shared_from_this();
-        PushTaskQueue([this, weak, recv_funapi_rpc_message]()->bool {
-          if (auto peer = weak.lock()) {
-            if (auto impl = rpc_impl_.lock()) {
-              impl->OnHandler(peer, recv_funapi_rpc_message);
-            }
-          }
-          return true;
-        });
+    std::weak_ptr<FunapiRpcPeer> weak = shared_from_this();
+    PushTaskQueue([this, weak, recv_funapi_rpc_message]()->bool {
+      if (auto peer = weak.lock()) {
+        if (auto impl = rpc_impl_.lock()) {
+          impl->OnHandler(peer, recv_funapi_rpc_message);
+        }
+      }
+      return true;
+    });
 
-        uint32_t new_length = static_cast<uint32_t>(recv_buffer_.size()) - proto_length_ - 4;
-        recv_buffer_.erase(recv_buffer_.begin(), recv_buffer_.begin() + proto_length_ + 4);
-        recv_buffer_.resize(new_length);
+    offset += 4 + proto_length;
+  }
 
-        proto_length_ = 0;
-      }
-      else {
-        return;
-      }
-    }
+  if (offset > 0) {
+    recv_buffer_.erase(recv_buffer_.begin(), recv_buffer_.begin() + offset);
   }
 }
 
@@ -367,6 +387,19 @@ void FunapiRpcPeer::PushConnectThread() {
   tcp_ = FunapiTcp::Create();
   std::weak_ptr<FunapiRpcPeer> weak = shared_from_this();
 
+  // The host is resolved before the connect task is queued, so a slow
+  // lookup does not hold up the other connects on the thread.
+  FunapiResolver::Resolve(hostname_or_ip_, port_, SOCK_STREAM, [this, weak]() {
+    if (auto peer = weak.lock()) {
+      PushConnectTask();
+    }
+  });
+}
+
+
+void FunapiRpcPeer::PushConnectTask() {
+  std::weak_ptr<FunapiRpcPeer> weak = shared_from_this();
+
   if (auto ct = FunapiThread::Get("_connect")) {
     ct->Push([this, weak](){
       if (auto peer = weak.lock()) {
@@ -426,9 +459,11 @@ void FunapiRpcPeer::OnConnect(fun::string hostname_or_ip, int port) {
 
 
 void FunapiRpcPeer::Connect(const fun::string &hostname_or_ip, const int port) {
+  // The task queue is shared by the peers. Returning false would drop the
+  // tasks after this one, such as the connects of the rest of the pool.
   PushTaskQueue([this, hostname_or_ip, port]()->bool {
     OnConnect(hostname_or_ip, port);
-    return false;
+    return true;
   });
 }
 
@@ -445,6 +480,15 @@ void FunapiRpcPeer::OnDisconnecting() {
     PushNetworkThread([this]()->bool {
       tcp_ = nullptr;
       SetState(State::kDisconnected);
+
+      // The calls in flight on the connection will not be answered.
+      PushTaskQueue([this]()->bool {
+        if (auto impl = rpc_impl_.lock()) {
+          impl->OnPeerDisconnected(shared_from_this());
+        }
+        return true;
+      });
+
       OnEvent(EventType::kDisconnected);
       return true;
     });
@@ -466,7 +510,7 @@ void FunapiRpcPeer::OnClose() {
 void FunapiRpcPeer::Close() {
   PushTaskQueue([this]()->bool {
     OnClose();
-    return false;
+    return true;
   });
 }
 
@@ -497,13 +541,13 @@ void FunapiRpcPeer::SetRpcImpl(std::weak_ptr<FunapiRpcImpl> weak) {
 }
 
 
-void FunapiRpcPeer::PushNetworkThread(const FunapiThread::TaskHandler &handler) {
+template <typename F>
+void FunapiRpcPeer::PushNetworkThread(const F &handler) {
   if (network_thread_) {
     std::weak_ptr<FunapiRpcPeer> weak = shared_from_this();
-    auto handler_ptr = std::make_shared<FunapiThread::TaskHandler>(handler);
-    network_thread_->Push([weak, this, handler_ptr]()->bool{
+    network_thread_->Push([weak, this, handler]()->bool{
       if (auto s = weak.lock()) {
-        return (*handler_ptr)();
+        return handler();
       }
 
       return true;
@@ -512,14 +556,14 @@ void FunapiRpcPeer::PushNetworkThread(const FunapiThread::TaskHandler &handler)
 }
 
 
-void FunapiRpcPeer::PushTaskQueue(const FunapiTasks::TaskHandler &task) {
+template <typename F>
+void FunapiRpcPeer::PushTaskQueue(const F &task) {
   if (tasks_)
   {
     std::weak_ptr<FunapiRpcPeer> weak = shared_from_this();
-    auto handler_ptr = std::make_shared<FunapiTasks::TaskHandler>(task);
-    tasks_->Push([weak, handler_ptr]()->bool {
+    tasks_->Push([weak, task]()->bool {
       if (auto s = weak.lock()) {
-        return (*handler_ptr)();
+        return task();
       }
 
       return true;
@@ -551,15 +595,36 @@ bool FunapiRpcPeer::EmptySendQueue() {
 }
 
 
-void FunapiRpcPeer::PushSendQueue(const FunDedicatedServerRpcMessage &message) {
-  std::unique_lock<std::mutex> lock(send_queue_mutex_);
-  send_queue_.push_back(std::make_shared<FunapiRpcMessage>(message));
-}
+// Serializes the message into the send queue with its length. A header is
+// written after the body in the same frame. Parsing merges the two, so the
+// header fields replace the body's without copying the body.
+void FunapiRpcPeer::PushSendQueue(const FunDedicatedServerRpcMessage *header,
+                                  const FunDedicatedServerRpcMessage &body) {
+  const int body_length = body.ByteSize();
+  const int header_length = header ? header->ByteSize() : 0;
 
+#ifdef DEBUG_LOG
+  DebugUtils::Log("[RPC:C->S] %s %s",
+                  body.ShortDebugString().c_str(),
+                  header ? header->ShortDebugString().c_str() : "");
+#endif
 
-void FunapiRpcPeer::PushSendQueue(std::shared_ptr<FunapiRpcMessage> message) {
-  std::unique_lock<std::mutex> lock(send_queue_mutex_);
-  send_queue_.push_back(message);
+  {
+    std::unique_lock<std::mutex> lock(send_queue_mutex_);
+    size_t offset = send_queue_.size();
+    send_queue_.resize(offset + 4 + body_length + header_length);
+
+    uint8_t *data = send_queue_.data() + offset;
+
+    uint32_t length = htonl(body_length + header_length);
+    memcpy(data, &length, 4);
+    body.SerializeWithCachedSizesToArray(data + 4);
+    if (header) {
+      header->SerializeWithCachedSizesToArray(data + 4 + body_length);
+    }
+  }
+
+  FunapiSendFlagManager::Get().WakeUp();
 }
 
 
@@ -569,11 +634,24 @@ void FunapiRpcPeer::ClearSendQueue() {
 }
 
 
-void FunapiRpcPeer::Call(std::shared_ptr<FunapiRpcMessage> message) {
-  PushTaskQueue([this, message]()->bool {
-    PushSendQueue(message);
-    return true;
-  });
+void FunapiRpcPeer::Call(const FunDedicatedServerRpcMessage &message) {
+  PushSendQueue(nullptr, message);
+}
+
+
+void FunapiRpcPeer::Call(const FunDedicatedServerRpcMessage &header,
+                         const FunDedicatedServerRpcMessage &body) {
+  PushSendQueue(&header, body);
+}
+
+
+int FunapiRpcPeer::GetInFlight() {
+  return in_flight_;
+}
+
+
+void FunapiRpcPeer::AddInFlight(const int count) {
+  in_flight_ += count;
 }
 
 
@@ -583,12 +661,32 @@ void FunapiRpcPeer::SetPeerId(const fun::string &id) {
 }
 
 
+const fun::string& FunapiRpcPeer::GetHostname() {
+  return hostname_or_ip_;
+}
+
+
+int FunapiRpcPeer::GetPort() {
+  return port_;
+}
+
+
 ////////////////////////////////////////////////////////////////////////////////
 // FunapiRpcImpl implementation.
 
 
-FunapiRpcImpl::FunapiRpcImpl() {
+FunapiRpcImpl::FunapiRpcImpl() : last_call_id_(0) {
   tasks_ = FunapiTasks::Create();
+  timer_wheel_ = FunapiTimerWheel::Create();
+
+  // The xids of the calls only have to differ from the other clients of
+  // the same server while they are in flight.
+  fun::stringstream ss_xid;
+  std::random_device rd;
+  std::default_random_engine re(rd());
+  std::uniform_int_distribution<int> dist(1,0xffff);
+  ss_xid << dist(re) << "-" << dist(re) << "-";
+  xid_prefix_ = ss_xid.str();
 }
 
 
@@ -605,7 +703,7 @@ void FunapiRpcImpl::CallMasterMessage() {
   }
 
   if (master_peer) {
-    auto master_message = std::make_shared<FunapiRpcMessage>();
+    FunDedicatedServerRpcMessage master_message;
 
     fun::stringstream ss_xid;
     std::random_device rd;
@@ -613,9 +711,9 @@ void FunapiRpcImpl::CallMasterMessage() {
     std::uniform_int_distribution<int> dist(1,0xffff);
     ss_xid << dist(re) << "-" << dist(re);
 
-    master_message->GetMessage().set_xid(ss_xid.str());
-    master_message->GetMessage().set_is_request(true);
-    master_message->GetMessage().set_type(kRpcMasterMessageType);
+    master_message.set_xid(ss_xid.str());
+    master_message.set_is_request(true);
+    master_message.set_type(kRpcMasterMessageType);
 
     master_peer->Call(master_message);
   }
@@ -643,7 +741,12 @@ void FunapiRpcImpl::InitSystemHandlers() {
       response_handler(response_message);
     }
 
-    FunDedicatedServerRpcSystemMessage sys_message = request_message.GetExtension(ds_rpc_sys);
+    // The extra connections of a pool get the info as well.
+    if (IsPoolPeer(peer)) {
+      return;
+    }
+
+    const FunDedicatedServerRpcSystemMessage &sys_message = request_message.GetExtension(ds_rpc_sys);
 
     rapidjson::Document json_document;
     json_document.Parse<0>(sys_message.data().c_str());
@@ -658,6 +761,7 @@ void FunapiRpcImpl::InitSystemHandlers() {
       {
         std::unique_lock<std::mutex> lock(peer_map_mutex_);
         peer_map_[peer_id] = peer;
+        AddToRing(peer_id);
       }
       {
         std::unique_lock<std::mutex> lock(peer_set_mutex_);
@@ -666,6 +770,7 @@ void FunapiRpcImpl::InitSystemHandlers() {
 
       SetPeerEventHanderReconnect(peer_id, peer);
       peer->SetPeerId(peer_id);
+      ConnectPool(peer_id, peer->GetHostname(), peer->GetPort());
 
       std::shared_ptr<FunapiRpcPeer> master_peer = nullptr;
       {
@@ -693,7 +798,7 @@ void FunapiRpcImpl::InitSystemHandlers() {
     FunDedicatedServerRpcMessage response_message;
     response_handler(response_message);
 
-    FunDedicatedServerRpcSystemMessage sys_message = request_message.GetExtension(ds_rpc_sys);
+    const FunDedicatedServerRpcSystemMessage &sys_message = request_message.GetExtension(ds_rpc_sys);
 
     rapidjson::Document json_document;
     json_document.Parse<0>(sys_message.data().c_str());
@@ -723,7 +828,7 @@ void FunapiRpcImpl::InitSystemHandlers() {
     FunDedicatedServerRpcMessage response_message;
     response_handler(response_message);
 
-    FunDedicatedServerRpcSystemMessage sys_message = request_message.GetExtension(ds_rpc_sys);
+    const FunDedicatedServerRpcSystemMessage &sys_message = request_message.GetExtension(ds_rpc_sys);
 
     rapidjson::Document json_document;
     json_document.Parse<0>(sys_message.data().c_str());
@@ -740,9 +845,12 @@ void FunapiRpcImpl::InitSystemHandlers() {
           if (peer_map_.find(peer_id) != peer_map_.end()) {
             del_peer = peer_map_[peer_id];
             peer_map_.erase(peer_id);
+            RemoveFromRing(peer_id);
           }
         }
 
+        ClosePool(peer_id);
+
         std::shared_ptr<FunapiRpcPeer> master_peer = nullptr;
         {
           std::unique_lock<std::mutex> lock(master_peer_mutex_);
@@ -872,11 +980,14 @@ void FunapiRpcImpl::SetPeerEventHanderReconnect(const fun::string &peer_id, std:
             {
               std::unique_lock<std::mutex> lock(peer_map_mutex_);
               peer_map_.erase(peer_id);
+              RemoveFromRing(peer_id);
               if (!peer_map_.empty()) {
                 new_master_peer = peer_map_.cbegin()->second;
               }
             }
 
+            ClosePool(peer_id);
+
             if (new_master_peer)
             {
               {
@@ -942,12 +1053,333 @@ void FunapiRpcImpl::Connect(const fun::string &peer_id, const fun::string &hostn
   {
     std::unique_lock<std::mutex> lock(peer_map_mutex_);
     peer_map_[peer_id] = peer;
+    AddToRing(peer_id);
   }
 
   SetPeerEventHanderReconnect(peer_id, peer);
 
   peer->SetRpcImpl(shared_from_this());
   peer->Connect(hostname_or_ip, port);
+
+  ConnectPool(peer_id, hostname_or_ip, port);
+}
+
+
+void FunapiRpcImpl::SetPoolPeerEventHandler(const fun::string &peer_id, std::shared_ptr<FunapiRpcPeer> peer) {
+  std::weak_ptr<FunapiRpcPeer> peer_weak = peer;
+  std::weak_ptr<FunapiRpcImpl> weak = shared_from_this();
+  auto new_handler = [this, peer_id, weak, peer_weak](const EventType type,
+                                                      const fun::string &peer_hostname_or_ip,
+                                                      const int peer_port,
+                                                      const fun::string &peer_id_empty)
+  {
+    if (auto impl = weak.lock()) {
+      // The extra connections are not reported to the event handler.
+      DebugUtils::Log("RPC pool connection event: '%s' %s:%d %s",
+                      peer_id.c_str(), peer_hostname_or_ip.c_str(), peer_port,
+                      EventTypeToString(type).c_str());
+
+      if (type == EventType::kDisconnected || type == EventType::kConnectionFailed || type == EventType::kConnectionTimedOut) {
+        bool reconnect = false;
+        {
+          std::unique_lock<std::mutex> lock(peer_map_mutex_);
+          auto iter = pool_map_.find(peer_id);
+          if (iter != pool_map_.end()) {
+            auto &pool = iter->second;
+            auto pool_iter = std::find(pool.begin(), pool.end(), peer_weak.lock());
+            if (pool_iter != pool.end()) {
+              pool.erase(pool_iter);
+              reconnect = peer_map_.find(peer_id) != peer_map_.end();
+            }
+          }
+        }
+
+        if (reconnect) {
+          if (type == EventType::kConnectionFailed) {
+            if (auto ct = FunapiThread::Get("_connect")) {
+              auto option = rpc_option_;
+              ct->Push([option]()->bool {
+                std::this_thread::sleep_for(std::chrono::seconds(option->GetConnectTimeout()));
+                return true;
+              });
+            }
+          }
+
+          ConnectPool(peer_id, peer_hostname_or_ip, peer_port);
+        }
+      }
+    }
+  };
+
+  peer->SetEventCallback(new_handler);
+}
+
+
+void FunapiRpcImpl::ConnectPool(const fun::string &peer_id, const fun::string &hostname_or_ip, const int port) {
+  size_t extra_connections = 0;
+  if (rpc_option_->GetConnectionsPerPeer() > 1) {
+    extra_connections = rpc_option_->GetConnectionsPerPeer() - 1;
+  }
+
+  fun::vector<std::shared_ptr<FunapiRpcPeer>> new_peers;
+  {
+    std::unique_lock<std::mutex> lock(peer_map_mutex_);
+    if (peer_map_.find(peer_id) == peer_map_.end()) {
+      return;
+    }
+
+    auto &pool = pool_map_[peer_id];
+    while (pool.size() < extra_connections) {
+      auto peer = std::make_shared<FunapiRpcPeer>();
+      pool.push_back(peer);
+      new_peers.push_back(peer);
+    }
+  }
+
+  for (auto &peer : new_peers) {
+    SetPoolPeerEventHandler(peer_id, peer);
+    peer->SetRpcImpl(shared_from_this());
+    peer->Connect(hostname_or_ip, port);
+  }
+}
+
+
+void FunapiRpcImpl::ClosePool(const fun::string &peer_id) {
+  fun::vector<std::shared_ptr<FunapiRpcPeer>> pool;
+  {
+    std::unique_lock<std::mutex> lock(peer_map_mutex_);
+    auto iter = pool_map_.find(peer_id);
+    if (iter != pool_map_.end()) {
+      pool.swap(iter->second);
+      pool_map_.erase(iter);
+    }
+  }
+
+  for (auto &peer : pool) {
+    peer->Close();
+  }
+}
+
+
+bool FunapiRpcImpl::IsPoolPeer(std::shared_ptr<FunapiRpcPeer> peer) {
+  std::unique_lock<std::mutex> lock(peer_map_mutex_);
+  for (auto &i : pool_map_) {
+    if (std::find(i.second.cbegin(), i.second.cend(), peer) != i.second.cend()) {
+      return true;
+    }
+  }
+
+  return false;
+}
+
+
+namespace {
+
+// FNV-1a
+uint32_t RingHash(const char *data, const size_t length) {
+  uint32_t hash = 2166136261u;
+  for (size_t i = 0; i < length; ++i) {
+    hash ^= static_cast<uint8_t>(data[i]);
+    hash *= 16777619u;
+  }
+
+  return hash;
+}
+
+}  // namespace
+
+
+void FunapiRpcImpl::AddToRing(const fun::string &peer_id) {
+  for (int i = 0; i < kVirtualNodes; ++i) {
+    fun::stringstream ss;
+    ss << peer_id << "#" << i;
+    fun::string node = ss.str();
+    ring_[RingHash(node.c_str(), node.length())] = peer_id;
+  }
+}
+
+
+void FunapiRpcImpl::RemoveFromRing(const fun::string &peer_id) {
+  for (auto iter = ring_.begin(); iter != ring_.end();) {
+    if (iter->second == peer_id) {
+      iter = ring_.erase(iter);
+    }
+    else {
+      ++iter;
+    }
+  }
+}
+
+
+// Picks the server of the type on the ring, or the next one if it has no
+// connection up. Among the connections of the server, the one with the
+// fewest calls in flight is picked.
+std::shared_ptr<FunapiRpcPeer> FunapiRpcImpl::PickPeer(const fun::string &type) {
+  std::unique_lock<std::mutex> lock(peer_map_mutex_);
+  if (ring_.empty()) {
+    return nullptr;
+  }
+
+  auto iter = ring_.lower_bound(RingHash(type.c_str(), type.length()));
+  fun::unordered_set<fun::string> tried;
+
+  for (size_t i = 0; i < ring_.size() && tried.size() < peer_map_.size(); ++i, ++iter) {
+    if (iter == ring_.end()) {
+      iter = ring_.begin();
+    }
+
+    const fun::string &peer_id = iter->second;
+    if (!tried.insert(peer_id).second) {
+      continue;
+    }
+
+    std::shared_ptr<FunapiRpcPeer> picked = nullptr;
+    auto pick = [&picked](const std::shared_ptr<FunapiRpcPeer> &peer) {
+      if (peer->GetState() == FunapiRpcPeer::State::kConnected) {
+        if (picked == nullptr || peer->GetInFlight() < picked->GetInFlight()) {
+          picked = peer;
+        }
+      }
+    };
+
+    auto peer_iter = peer_map_.find(peer_id);
+    if (peer_iter != peer_map_.end()) {
+      pick(peer_iter->second);
+    }
+
+    auto pool_iter = pool_map_.find(peer_id);
+    if (pool_iter != pool_map_.end()) {
+      for (auto &peer : pool_iter->second) {
+        pick(peer);
+      }
+    }
+
+    if (picked) {
+      return picked;
+    }
+  }
+
+  return nullptr;
+}
+
+
+fun::string FunapiRpcImpl::MakeXid(const CallId id) {
+  fun::stringstream ss;
+  ss << xid_prefix_ << id;
+  return ss.str();
+}
+
+
+FunapiRpcImpl::CallId FunapiRpcImpl::Call(const fun::string &type,
+                                          const FunDedicatedServerRpcMessage &request_message,
+                                          const CallHandler &handler,
+                                          const int timeout_millisecond) {
+  CallId id = ++last_call_id_;
+  fun::string xid = MakeXid(id);
+
+  auto peer = PickPeer(type);
+  if (peer == nullptr) {
+    DebugUtils::Log("[RPC] no peer for '%s'", type.c_str());
+    tasks_->Push([handler]()->bool {
+      handler(CallResult::kNoPeer, FunDedicatedServerRpcMessage::default_instance());
+      return true;
+    });
+    return id;
+  }
+
+  auto transaction = std::make_shared<Transaction>();
+  transaction->handler = handler;
+  transaction->peer = peer;
+
+  {
+    std::unique_lock<std::mutex> lock(transactions_mutex_);
+    transactions_[xid] = transaction;
+
+    // The timer is set under the lock so the completion always sees it.
+    if (timeout_millisecond > 0) {
+      std::weak_ptr<FunapiRpcImpl> weak = shared_from_this();
+      transaction->timer_id = timer_wheel_->Schedule(timeout_millisecond, [this, weak, xid]() {
+        if (auto impl = weak.lock()) {
+          OnCallCompleted(xid, CallResult::kTimedOut, FunDedicatedServerRpcMessage::default_instance());
+        }
+      });
+    }
+  }
+
+  peer->AddInFlight(1);
+
+  FunDedicatedServerRpcMessage header;
+  header.set_xid(xid);
+  header.set_type(type);
+  header.set_is_request(true);
+  peer->Call(header, request_message);
+
+  return id;
+}
+
+
+bool FunapiRpcImpl::Cancel(const CallId id) {
+  fun::string xid = MakeXid(id);
+  {
+    std::unique_lock<std::mutex> lock(transactions_mutex_);
+    if (transactions_.find(xid) == transactions_.end()) {
+      return false;
+    }
+  }
+
+  std::weak_ptr<FunapiRpcImpl> weak = shared_from_this();
+  tasks_->Push([this, weak, xid]()->bool {
+    if (auto impl = weak.lock()) {
+      OnCallCompleted(xid, CallResult::kCanceled, FunDedicatedServerRpcMessage::default_instance());
+    }
+    return true;
+  });
+
+  return true;
+}
+
+
+void FunapiRpcImpl::OnCallCompleted(const fun::string &xid,
+                                    const CallResult result,
+                                    const FunDedicatedServerRpcMessage &response_message) {
+  std::shared_ptr<Transaction> transaction = nullptr;
+  {
+    std::unique_lock<std::mutex> lock(transactions_mutex_);
+    auto iter = transactions_.find(xid);
+    if (iter == transactions_.end()) {
+      return;
+    }
+
+    transaction = iter->second;
+    transactions_.erase(iter);
+  }
+
+  if (transaction->timer_id != FunapiTimerWheel::kInvalidTimerId) {
+    timer_wheel_->Cancel(transaction->timer_id);
+  }
+
+  if (auto peer = transaction->peer.lock()) {
+    peer->AddInFlight(-1);
+  }
+
+  transaction->handler(result, response_message);
+}
+
+
+void FunapiRpcImpl::OnPeerDisconnected(std::shared_ptr<FunapiRpcPeer> peer) {
+  fun::vector<fun::string> xids;
+  {
+    std::unique_lock<std::mutex> lock(transactions_mutex_);
+    for (auto &i : transactions_) {
+      if (i.second->peer.lock() == peer) {
+        xids.push_back(i.first);
+      }
+    }
+  }
+
+  for (auto &xid : xids) {
+    OnCallCompleted(xid, CallResult::kDisconnected, FunDedicatedServerRpcMessage::default_instance());
+  }
 }
 
 
@@ -974,6 +1406,8 @@ void FunapiRpcImpl::Update() {
     tasks_->Update();
   }
 
+  timer_wheel_->Advance();
+
   if (auto nt = FunapiThread::Get("_network")) {
     if (nt->Size() == 0) {
       nt->Push([]()->bool {
@@ -1052,11 +1486,11 @@ void FunapiRpcImpl::OnHandler(std::shared_ptr<FunapiRpcPeer> peer,
     }
 
     auto response_handler = [peer, request_message](const FunDedicatedServerRpcMessage &msg) {
-      auto response_msg = std::make_shared<FunapiRpcMessage>(msg);
-      response_msg->GetMessage().set_type(request_message->GetMessage().type());
-      response_msg->GetMessage().set_xid(request_message->GetMessage().xid());
-      response_msg->GetMessage().set_is_request(false);
-      peer->Call(response_msg);
+      FunDedicatedServerRpcMessage header;
+      header.set_type(request_message->GetMessage().type());
+      header.set_xid(request_message->GetMessage().xid());
+      header.set_is_request(false);
+      peer->Call(header, msg);
     };
 
     if (handler) {
@@ -1069,6 +1503,11 @@ void FunapiRpcImpl::OnHandler(std::shared_ptr<FunapiRpcPeer> peer,
       DebugUtils::Log("[RPC] handler not found '%s'", type.c_str());
     }
   }
+  else {
+    OnCallCompleted(request_message->GetMessage().xid(),
+                    CallResult::kSucceed,
+                    request_message->GetMessage());
+  }
 }
 
 
@@ -1098,9 +1537,8 @@ void FunapiRpcImpl::DebugCall(const FunDedicatedServerRpcMessage &debug_request)
     }
   }
 
-  auto request_message = std::make_shared<FunapiRpcMessage>(debug_request);
   for (auto p : v_peer) {
-    p->Call(request_message);
+    p->Call(debug_request);
   }
 }
 
@@ -1112,9 +1550,8 @@ void FunapiRpcImpl::DebugMasterCall(const FunDedicatedServerRpcMessage &debug_re
     p = master_peer_.lock();
   }
 
-  auto request_message = std::make_shared<FunapiRpcMessage>(debug_request);
   if (p) {
-    p->Call(request_message);
+    p->Call(debug_request);
   }
 }
 
@@ -1158,6 +1595,19 @@ void FunapiRpc::Update() {
   impl_->Update();
 }
 
+
+FunapiRpc::CallId FunapiRpc::Call(const fun::string &type,
+                                  const FunDedicatedServerRpcMessage &request_message,
+                                  const CallHandler &handler,
+                                  const int timeout_millisecond) {
+  return impl_->Call(type, request_message, handler, timeout_millisecond);
+}
+
+
+bool FunapiRpc::Cancel(const CallId id) {
+  return impl_->Cancel(id);
+}
+
 /*
 void FunapiRpc::DebugCall(const FunDedicatedServerRpcMessage &debug_request) {
   impl_->DebugCall(debug_request);
@@ -1189,11 +1639,15 @@ class FunapiRpcOptionImpl : public std::enable_shared_from_this<FunapiRpcOptionI
   void SetTag(const fun::string &tag);
   fun::string GetTag();
 
+  void SetConnectionsPerPeer(const int connections);
+  int GetConnectionsPerPeer();
+
  private:
   fun::vector<std::tuple<fun::string, int>> initializers_;
   bool disable_nagle_ = true;
   int timeout_seconds_ = 5;
   fun::string tag_;
+  int connections_per_peer_ = 1;
 };
 
 
@@ -1237,6 +1691,16 @@ fun::string FunapiRpcOptionImpl::GetTag() {
 }
 
 
+void FunapiRpcOptionImpl::SetConnectionsPerPeer(const int connections) {
+  connections_per_peer_ = connections;
+}
+
+
+int FunapiRpcOptionImpl::GetConnectionsPerPeer() {
+  return connections_per_peer_;
+}
+
+
 ////////////////////////////////////////////////////////////////////////////////
 // FunapiRpcOption implementation.
 
@@ -1288,6 +1752,16 @@ fun::string FunapiRpcOption::GetTag() {
   return impl_->GetTag();
 }
 
+
+void FunapiRpcOption::SetConnectionsPerPeer(const int connections) {
+  impl_->SetConnectionsPerPeer(connections);
+}
+
+
+int FunapiRpcOption::GetConnectionsPerPeer() {
+  return impl_->GetConnectionsPerPeer();
+}
+
 }  // namespace fun
 
 #endif
@@ -19,6 +19,7 @@
 #include "funapi_encryption.h"
 #include "funapi_compression.h"
 #include "funapi_version.h"
+#include "funapi_stats.h"
 #include "funapi/network/ping_message.pb.h"
 #include "funapi/service/redirect_message.pb.h"
 
@@ -27,6 +28,12 @@
 #define kVersionHeaderField "VER"
 #define kPluginVersionHeaderField "PVER"
 
+// udp channel header
+#define kChannelHeaderField "CH"
+#define kChannelSeqHeaderField "CSEQ"
+#define kChannelAckHeaderField "CACK"
+#define kChannelAckBitsHeaderField "CACKB"
+
 #define kMessageTypeAttributeName "_msgtype"
 #define kSessionIdAttributeName "_sid"
 #define kSeqNumAttributeName "_seq"
@@ -183,6 +190,9 @@ fun::string TransportProtocolToString(TransportProtocol protocol) {
 
 ////////////////////////////////////////////////////////////////////////////////
 // FunapiQueue implementation.
+
+// NOTE: 게임 스레드(또는 여러 스레드)에서 PushBack 하고 _network 스레드에서만
+// Front/PopFront 하는 큐입니다. Empty 는 어느 스레드에서도 호출할 수 있습니다.
 class FunapiMessage;
 class FunapiQueue : public std::enable_shared_from_this<FunapiQueue> {
  public:
@@ -197,8 +207,7 @@ class FunapiQueue : public std::enable_shared_from_this<FunapiQueue> {
   void PopFront();
 
  private:
-  fun::deque<std::shared_ptr<FunapiMessage>> queue_;
-  std::mutex mutex_;
+  FunapiMpscQueue<std::shared_ptr<FunapiMessage>> queue_;
 };
 
 
@@ -208,6 +217,7 @@ FunapiQueue::FunapiQueue() {
 
 FunapiQueue::~FunapiQueue() {
   // DebugUtils::Log("%s", __FUNCTION__);
+  FunapiStats::Add(FunapiStats::Counter::kSendQueueDepth, -static_cast<int64_t>(queue_.Size()));
 }
 
 
@@ -217,26 +227,24 @@ std::shared_ptr<FunapiQueue> FunapiQueue::Create() {
 
 
 bool FunapiQueue::Empty() {
-  std::unique_lock<std::mutex> lock(mutex_);
-  return queue_.empty();
+  return queue_.Empty();
 }
 
 
 std::shared_ptr<FunapiMessage> FunapiQueue::Front() {
-  std::unique_lock<std::mutex> lock(mutex_);
-  return queue_.front();
+  return queue_.Front();
 }
 
 
 void FunapiQueue::PushBack(std::shared_ptr<FunapiMessage> msg) {
-  std::unique_lock<std::mutex> lock(mutex_);
-  queue_.push_back(msg);
+  queue_.Push(std::move(msg));
+  FunapiStats::Add(FunapiStats::Counter::kSendQueueDepth, 1);
 }
 
 
 void FunapiQueue::PopFront() {
-  std::unique_lock<std::mutex> lock(mutex_);
-  queue_.pop_front();
+  queue_.PopFront();
+  FunapiStats::Add(FunapiStats::Counter::kSendQueueDepth, -1);
 }
 
 
@@ -267,8 +275,10 @@ public:
     void Clear();
 
 private:
-    fun::deque<std::shared_ptr<FunapiUnsentMessage>> queue_;
-    std::mutex mutex_;
+    // Pushed while redirecting and drained by SendUnsentQueueMessages.
+    FunapiMpscQueue<std::shared_ptr<FunapiUnsentMessage>> queue_;
+    // Consumer only. Passed to RedirectQueueHandler.
+    fun::deque<std::shared_ptr<FunapiUnsentMessage>> pending_;
 };
 
 
@@ -280,22 +290,26 @@ std::shared_ptr<FunapiUnsentQueue> FunapiUnsentQueue::Create()
 
 void FunapiUnsentQueue::PushBack(std::shared_ptr<FunapiUnsentMessage> msg)
 {
-    std::unique_lock<std::mutex> lock(mutex_);
-    queue_.push_back(msg);
+    queue_.Push(std::move(msg));
 }
 
 
 std::shared_ptr<FunapiUnsentMessage> FunapiUnsentQueue::PopFront()
 {
-    std::unique_lock<std::mutex> lock(mutex_);
+    if (!pending_.empty())
+    {
+        auto message = pending_.front();
+        pending_.pop_front();
+        return message;
+    }
 
-    if (queue_.empty())
+    if (queue_.Empty())
     {
         return nullptr;
     }
 
-    auto message = queue_.front();
-    queue_.pop_front();
+    auto message = queue_.Front();
+    queue_.PopFront();
     return message;
 }
 
@@ -305,29 +319,27 @@ void FunapiUnsentQueue::UserVerification(const TransportProtocol protocol,
                                          const fun::vector<fun::string> &target_tags,
                                          const RedirectQueueHandler &handler)
 {
-    std::unique_lock<std::mutex> lock(mutex_);
-    handler(protocol, cur_tags, target_tags, queue_);
+    queue_.Drain(pending_);
+    handler(protocol, cur_tags, target_tags, pending_);
 }
 
 
 int FunapiUnsentQueue::Size()
 {
-    std::unique_lock<std::mutex> lock(mutex_);
-    return queue_.size();
+    return static_cast<int>(pending_.size() + queue_.Size());
 }
 
 
 bool FunapiUnsentQueue::Empty()
 {
-    std::unique_lock<std::mutex> lock(mutex_);
-    return queue_.empty();
+    return pending_.empty() && queue_.Empty();
 }
 
 
 void FunapiUnsentQueue::Clear()
 {
-    std::unique_lock<std::mutex> lock(mutex_);
-    queue_.clear();
+    pending_.clear();
+    queue_.Clear();
 }
 
 
@@ -393,14 +405,14 @@ void FunapiSessionId::Set(const fun::string &session_id, const FunEncoding encod
 ////////////////////////////////////////////////////////////////////////////////
 // FunapiMessage implementation.
 
+// NOTE: FunapiMessage 는 메세지를 보내거나 받을 때마다 만들어지므로
+// FunapiMessage::Create 는 FunapiMessagePool 에서 객체를 재사용한다.
+// json document 는 객체 안의 버퍼를 쓰는 allocator 로 만들어지고
+// protobuf 메세지와 body 버퍼도 Clear 후 다시 쓰기 때문에
+// 작은 메세지(ack, ping 등)는 힙 할당 없이 만들어진다.
 class FunapiMessage : public std::enable_shared_from_this<FunapiMessage> {
 public:
-    FunapiMessage() = delete;
-    FunapiMessage(const rapidjson::Document &json, const EncryptionType type);
-    FunapiMessage(const FunMessage &pbuf, const EncryptionType type);
-    FunapiMessage(const fun::vector<uint8_t> &body, const EncryptionType type);
-    FunapiMessage(const FunEncoding encoding, const fun::vector<uint8_t> &body, const EncryptionType type);
-
+    FunapiMessage();
     virtual ~FunapiMessage() = default;
 
     static std::shared_ptr<FunapiMessage> Create(const FunEncoding encoding, const fun::vector<uint8_t> &body);
@@ -409,11 +421,28 @@ public:
     static std::shared_ptr<FunapiMessage> Create(const fun::vector<uint8_t> &body, const EncryptionType type);
     static std::shared_ptr<FunapiMessage> Create(const FunEncoding encoding, const fun::vector<uint8_t> &body,
                                                  const EncryptionType type);
+    // Creates a received message. body has to be null-terminated.
+    // With parse_insitu, json strings point into a copy of the body
+    // owned by the message instead of being copied one by one.
+    // keep_received_body keeps the json body as it was for GetReceivedBody().
+    static std::shared_ptr<FunapiMessage> Create(const FunEncoding encoding, const fun::vector<uint8_t> &body,
+                                                 const EncryptionType type, const bool parse_insitu,
+                                                 const bool keep_received_body);
+    // Creates an empty json object or protobuf message.
+    // The caller fills GetJsonDocumenet() or GetProtobufMessage() in place.
+    static std::shared_ptr<FunapiMessage> Create(const FunEncoding encoding, const EncryptionType type);
 
     std::shared_ptr<rapidjson::Document> GetJsonDocumenet();
     std::shared_ptr<FunMessage> GetProtobufMessage();
     fun::vector<uint8_t>& GetBody();
 
+    // The received json body as it was (with the trailing '\0').
+    // Empty unless the message was created with keep_received_body.
+    const fun::vector<uint8_t>& GetReceivedBody() const;
+
+    // Size of the last encoded body. Does not encode the message again.
+    size_t GetBodySize() const;
+
     const fun::string& GetMsgType();
     int32_t GetMsgType2();
 
@@ -426,58 +455,304 @@ public:
     uint32_t GetSeq();
     void SetSeq(const uint32_t seq);
 
+    // UDP channel of the message. 0 is no channel.
+    int GetChannel() const;
+    void SetChannel(const int channel);
+
+    bool HasChannelSeq() const;
+    uint32_t GetChannelSeq() const;
+    void SetChannelSeq(const uint32_t seq);
+
     FunEncoding GetEncoding();
     EncryptionType GetEncryptionType();
 
     bool IsInitialized();
     void SetInitialized(bool initialized);
 
+    void Reset();
+
 private:
+    friend class FunapiMessagePool;
+
+    // Output stream for rapidjson::Writer that writes into body_ directly.
+    class BodyStream {
+    public:
+        typedef char Ch;
+        explicit BodyStream(fun::vector<uint8_t> &body) : body_(body) {}
+        void Put(Ch c) { body_.push_back(static_cast<uint8_t>(c)); }
+        void Flush() {}
+
+    private:
+        fun::vector<uint8_t> &body_;
+    };
+
+    void Assign(const rapidjson::Document &json, const EncryptionType type);
+    void Assign(const FunMessage &message, const EncryptionType type);
+    void Assign(const fun::vector<uint8_t> &body, const EncryptionType type);
+    void Assign(const FunEncoding encoding, const fun::vector<uint8_t> &body, const EncryptionType type,
+                const bool parse_insitu = false, const bool keep_received_body = false);
+    void Assign(const FunEncoding encoding, const EncryptionType type);
+
+    static const size_t kJsonBufferSize = 1024;
+    static const size_t kJsonChunkSize = 4096;
+    // Receive buffers larger than this are freed when the message is pooled.
+    static const size_t kMaxPooledBufferSize = 64 * 1024;
+
     bool initialized_ = false;
     bool use_sent_queue_ = false;
     bool use_seq_ = false;
     uint32_t seq_ = 0;
+    int channel_ = 0;
+    bool has_channel_seq_ = false;
+    uint32_t channel_seq_ = 0;
     fun::string msg_type_;
     int32_t msg_type2_ = 0;
     FunEncoding encoding_ = FunEncoding::kNone;
     fun::vector<uint8_t> body_;
-    std::shared_ptr<rapidjson::Document> json_document_ = nullptr;
-    std::shared_ptr<FunMessage> protobuf_message_ = nullptr;
+    uint64_t json_buffer_[kJsonBufferSize / sizeof(uint64_t)];
+    rapidjson::MemoryPoolAllocator<> json_allocator_;
+    rapidjson::Document json_document_;
+    FunMessage protobuf_message_;
+    bool has_protobuf_message_ = false;
     EncryptionType encryption_type_ = EncryptionType::kNoneEncryption;
+    fun::vector<uint8_t> received_body_;
+    fun::vector<char> insitu_buffer_;  // Strings of json_document_ may point here.
+};
+
+
+////////////////////////////////////////////////////////////////////////////////
+// FunapiMessagePool implementation.
+
+class FunapiMessagePool : public std::enable_shared_from_this<FunapiMessagePool> {
+public:
+    FunapiMessagePool() = default;
+    virtual ~FunapiMessagePool();
+
+    static std::shared_ptr<FunapiMessagePool> Get();
+
+    std::shared_ptr<FunapiMessage> Acquire();
+
+private:
+    // Allocates the shared_ptr control blocks of pooled messages from the pool.
+    template <typename T>
+    class BlockAllocator {
+    public:
+        typedef T value_type;
+
+        explicit BlockAllocator(const std::shared_ptr<FunapiMessagePool> &pool) : pool_(pool) {}
+        template <typename U>
+        BlockAllocator(const BlockAllocator<U> &other) : pool_(other.pool_) {}
+
+        T* allocate(size_t n) { return static_cast<T*>(pool_->AllocateBlock(n * sizeof(T))); }
+        void deallocate(T* p, size_t n) { pool_->FreeBlock(p, n * sizeof(T)); }
+
+        template <typename U>
+        bool operator==(const BlockAllocator<U> &other) const { return pool_ == other.pool_; }
+        template <typename U>
+        bool operator!=(const BlockAllocator<U> &other) const { return pool_ != other.pool_; }
+
+        // The control block keeps the pool alive until the message is released.
+        std::shared_ptr<FunapiMessagePool> pool_;
+    };
+
+    void Release(FunapiMessage *message);
+    void* AllocateBlock(const size_t size);
+    void FreeBlock(void *block, const size_t size);
+
+    static const size_t kMaxPooledMessages = 256;
+    static const size_t kBlockSize = 128;
+
+    std::mutex mutex_;
+    fun::vector<FunapiMessage*> messages_;
+    fun::vector<void*> blocks_;
 };
 
 
-FunapiMessage::FunapiMessage(const rapidjson::Document &json, const EncryptionType type)
-    : encoding_(FunEncoding::kJson), json_document_(std::make_shared<rapidjson::Document>()), encryption_type_(type)
+FunapiMessagePool::~FunapiMessagePool()
+{
+    for (auto m : messages_)
+        delete m;
+
+    for (auto b : blocks_)
+        ::operator delete(b);
+}
+
+
+std::shared_ptr<FunapiMessagePool> FunapiMessagePool::Get()
+{
+    static std::shared_ptr<FunapiMessagePool> pool = std::make_shared<FunapiMessagePool>();
+    return pool;
+}
+
+
+std::shared_ptr<FunapiMessage> FunapiMessagePool::Acquire()
+{
+    FunapiMessage *message = nullptr;
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        if (!messages_.empty())
+        {
+            message = messages_.back();
+            messages_.pop_back();
+        }
+    }
+
+    if (message == nullptr)
+        message = new FunapiMessage();
+
+    auto self = shared_from_this();
+    return std::shared_ptr<FunapiMessage>(message,
+                                          [self](FunapiMessage *m) { self->Release(m); },
+                                          BlockAllocator<FunapiMessage>(self));
+}
+
+
+void FunapiMessagePool::Release(FunapiMessage *message)
+{
+    message->Reset();
+
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        if (messages_.size() < kMaxPooledMessages)
+        {
+            messages_.push_back(message);
+            return;
+        }
+    }
+
+    delete message;
+}
+
+
+void* FunapiMessagePool::AllocateBlock(const size_t size)
+{
+    if (size <= kBlockSize)
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        if (!blocks_.empty())
+        {
+            void *block = blocks_.back();
+            blocks_.pop_back();
+            return block;
+        }
+
+        return ::operator new(kBlockSize);
+    }
+
+    return ::operator new(size);
+}
+
+
+void FunapiMessagePool::FreeBlock(void *block, const size_t size)
+{
+    if (size <= kBlockSize)
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        if (blocks_.size() < kMaxPooledMessages)
+        {
+            blocks_.push_back(block);
+            return;
+        }
+    }
+
+    ::operator delete(block);
+}
+
+
+FunapiMessage::FunapiMessage()
+    : json_allocator_(json_buffer_, sizeof(json_buffer_), kJsonChunkSize), json_document_(&json_allocator_)
+{
+}
+
+
+void FunapiMessage::Reset()
+{
+    initialized_ = false;
+    use_sent_queue_ = false;
+    use_seq_ = false;
+    seq_ = 0;
+    channel_ = 0;
+    has_channel_seq_ = false;
+    channel_seq_ = 0;
+    msg_type_.clear();
+    msg_type2_ = 0;
+    encoding_ = FunEncoding::kNone;
+    body_.clear();
+    encryption_type_ = EncryptionType::kNoneEncryption;
+
+    // Values of the document live in json_allocator_.
+    json_document_.SetNull();
+    json_allocator_.Clear();
+
+    if (received_body_.capacity() > kMaxPooledBufferSize)
+        fun::vector<uint8_t>().swap(received_body_);
+    else
+        received_body_.clear();
+
+    if (insitu_buffer_.capacity() > kMaxPooledBufferSize)
+        fun::vector<char>().swap(insitu_buffer_);
+    else
+        insitu_buffer_.clear();
+
+    if (has_protobuf_message_)
+    {
+        protobuf_message_.Clear();
+        has_protobuf_message_ = false;
+    }
+}
+
+
+void FunapiMessage::Assign(const rapidjson::Document &json, const EncryptionType type)
 {
-    json_document_->CopyFrom(json, json_document_->GetAllocator());
+    encoding_ = FunEncoding::kJson;
+    encryption_type_ = type;
+    json_document_.CopyFrom(json, json_document_.GetAllocator());
 }
 
 
-FunapiMessage::FunapiMessage(const FunMessage &message, const EncryptionType type)
-    : encoding_(FunEncoding::kProtobuf), protobuf_message_(std::make_shared<FunMessage>(message)), encryption_type_(type)
+void FunapiMessage::Assign(const FunMessage &message, const EncryptionType type)
 {
+    encoding_ = FunEncoding::kProtobuf;
+    encryption_type_ = type;
+    protobuf_message_.CopyFrom(message);
+    has_protobuf_message_ = true;
 }
 
 
-FunapiMessage::FunapiMessage(const fun::vector<uint8_t> &body, const EncryptionType type)
-    : encoding_(FunEncoding::kNone), body_(body), encryption_type_(type)
+void FunapiMessage::Assign(const fun::vector<uint8_t> &body, const EncryptionType type)
 {
+    encoding_ = FunEncoding::kNone;
+    encryption_type_ = type;
+    body_.assign(body.cbegin(), body.cend());
 }
 
 
-FunapiMessage::FunapiMessage(const FunEncoding encoding, const fun::vector<uint8_t> &body, const EncryptionType type)
-    : encoding_(encoding), encryption_type_(type)
+void FunapiMessage::Assign(const FunEncoding encoding, const fun::vector<uint8_t> &body, const EncryptionType type,
+                           const bool parse_insitu, const bool keep_received_body)
 {
+    encoding_ = encoding;
+    encryption_type_ = type;
+
     if (encoding_ == FunEncoding::kJson)
     {
-        json_document_ = std::make_shared<rapidjson::Document>();
-        json_document_->Parse<0>(reinterpret_cast<char*>(const_cast<uint8_t*>(body.data())));
+        // The raw body is only copied for a JsonValueRecv handler.
+        // ParseInsitu rewrites its buffer, so it has to be taken before parsing.
+        if (keep_received_body)
+            received_body_.assign(body.cbegin(), body.cend());
+
+        if (parse_insitu)
+        {
+            insitu_buffer_.assign(body.cbegin(), body.cend());
+            json_document_.ParseInsitu<0>(insitu_buffer_.data());
+        }
+        else
+        {
+            // Parse copies the strings, so the transport buffer will do.
+            json_document_.Parse<0>(reinterpret_cast<const char*>(body.data()));
+        }
     }
     else if (encoding_ == FunEncoding::kProtobuf)
     {
-        std::shared_ptr<FunMessage> protobuf_message = std::make_shared<FunMessage>();
-
         int body_size = static_cast<int>(body.size());
         if (body.back() == '\0')
         {
@@ -490,40 +765,74 @@ FunapiMessage::FunapiMessage(const FunEncoding encoding, const fun::vector<uint8
           body_size -= 1;
         }
 
-        if (protobuf_message->ParseFromArray(body.data(), body_size))
-        {
-          protobuf_message_ = protobuf_message;
-        }
+        // NOTE: 파싱에 실패하면 GetProtobufMessage() 가 nullptr 를 돌려준다.
+        has_protobuf_message_ = protobuf_message_.ParseFromArray(body.data(), body_size);
+        if (!has_protobuf_message_)
+          protobuf_message_.Clear();
     }
     else
     {
-        body_ = body;
+        body_.assign(body.cbegin(), body.cend());
+    }
+}
+
+
+void FunapiMessage::Assign(const FunEncoding encoding, const EncryptionType type)
+{
+    encoding_ = encoding;
+    encryption_type_ = type;
+
+    if (encoding_ == FunEncoding::kJson)
+    {
+        json_document_.SetObject();
+    }
+    else if (encoding_ == FunEncoding::kProtobuf)
+    {
+        has_protobuf_message_ = true;
     }
 }
 
 
 std::shared_ptr<FunapiMessage> FunapiMessage::Create(const rapidjson::Document &json, const EncryptionType type)
 {
-    return std::make_shared<FunapiMessage>(json, type);
+    auto message = FunapiMessagePool::Get()->Acquire();
+    message->Assign(json, type);
+    return message;
 }
 
 
 std::shared_ptr<FunapiMessage> FunapiMessage::Create(const FunMessage &message, const EncryptionType type)
 {
-    return std::make_shared<FunapiMessage>(message, type);
+    auto funapi_message = FunapiMessagePool::Get()->Acquire();
+    funapi_message->Assign(message, type);
+    return funapi_message;
 }
 
 
 std::shared_ptr<FunapiMessage> FunapiMessage::Create(const fun::vector<uint8_t>  &body, const EncryptionType type)
 {
-    return std::make_shared<FunapiMessage>(body, type);
+    auto message = FunapiMessagePool::Get()->Acquire();
+    message->Assign(body, type);
+    return message;
 }
 
 
 std::shared_ptr<FunapiMessage> FunapiMessage::Create(const FunEncoding encoding, const fun::vector<uint8_t>  &body,
                                                      const EncryptionType type)
 {
-    return std::make_shared<FunapiMessage>(encoding, body, type);
+    auto message = FunapiMessagePool::Get()->Acquire();
+    message->Assign(encoding, body, type);
+    return message;
+}
+
+
+std::shared_ptr<FunapiMessage> FunapiMessage::Create(const FunEncoding encoding, const fun::vector<uint8_t> &body,
+                                                     const EncryptionType type, const bool parse_insitu,
+                                                     const bool keep_received_body)
+{
+    auto message = FunapiMessagePool::Get()->Acquire();
+    message->Assign(encoding, body, type, parse_insitu, keep_received_body);
+    return message;
 }
 
 
@@ -533,6 +842,14 @@ std::shared_ptr<FunapiMessage> FunapiMessage::Create(const FunEncoding encoding,
 }
 
 
+std::shared_ptr<FunapiMessage> FunapiMessage::Create(const FunEncoding encoding, const EncryptionType type)
+{
+    auto message = FunapiMessagePool::Get()->Acquire();
+    message->Assign(encoding, type);
+    return message;
+}
+
+
 bool FunapiMessage::UseSentQueue()
 {
     return use_sent_queue_;
@@ -569,15 +886,53 @@ void FunapiMessage::SetSeq(const uint32_t seq)
 }
 
 
+int FunapiMessage::GetChannel() const
+{
+    return channel_;
+}
+
+
+void FunapiMessage::SetChannel(const int channel)
+{
+    channel_ = channel;
+}
+
+
+bool FunapiMessage::HasChannelSeq() const
+{
+    return has_channel_seq_;
+}
+
+
+uint32_t FunapiMessage::GetChannelSeq() const
+{
+    return channel_seq_;
+}
+
+
+void FunapiMessage::SetChannelSeq(const uint32_t seq)
+{
+    channel_seq_ = seq;
+    has_channel_seq_ = true;
+}
+
+
+// The returned pointers share the ownership of the message.
 std::shared_ptr<rapidjson::Document> FunapiMessage::GetJsonDocumenet()
 {
-    return json_document_;
+    if (encoding_ != FunEncoding::kJson)
+        return nullptr;
+
+    return std::shared_ptr<rapidjson::Document>(shared_from_this(), &json_document_);
 }
 
 
 std::shared_ptr<FunMessage> FunapiMessage::GetProtobufMessage()
 {
-    return protobuf_message_;
+    if (!has_protobuf_message_)
+        return nullptr;
+
+    return std::shared_ptr<FunMessage>(shared_from_this(), &protobuf_message_);
 }
 
 
@@ -609,41 +964,53 @@ fun::vector<uint8_t>& FunapiMessage::GetBody()
 {
     if (encoding_ == FunEncoding::kProtobuf)
     {
-        body_.resize(protobuf_message_->ByteSize());
-        protobuf_message_->SerializeToArray(body_.data(), protobuf_message_->ByteSize());
+        int size = protobuf_message_.ByteSize();
+        body_.resize(size);
+        protobuf_message_.SerializeWithCachedSizesToArray(body_.data());
     }
     else if (encoding_ == FunEncoding::kJson)
     {
-        rapidjson::StringBuffer buffer;
-        rapidjson::Writer<rapidjson::StringBuffer> writer(buffer);
-        json_document_->Accept(writer);
-
-        fun::string temp_string = buffer.GetString();
-        body_ = fun::vector<uint8_t>(temp_string.cbegin(), temp_string.cend());
+        // body_ keeps its capacity, so re-encoding does not allocate.
+        body_.clear();
+        BodyStream stream(body_);
+        rapidjson::Writer<BodyStream> writer(stream);
+        json_document_.Accept(writer);
     }
 
     return body_;
 }
 
 
+const fun::vector<uint8_t>& FunapiMessage::GetReceivedBody() const
+{
+    return received_body_;
+}
+
+
+size_t FunapiMessage::GetBodySize() const
+{
+    return body_.size();
+}
+
+
 const fun::string& FunapiMessage::GetMsgType()
 {
     if (msg_type_.empty())
     {
         if (encoding_ == FunEncoding::kJson)
         {
-            if (json_document_->HasMember(kMessageTypeAttributeName))
+            if (json_document_.HasMember(kMessageTypeAttributeName))
             {
-                const rapidjson::Value &msg_type_node = (*json_document_)[kMessageTypeAttributeName];
+                const rapidjson::Value &msg_type_node = json_document_[kMessageTypeAttributeName];
                 assert(msg_type_node.IsString());
                 msg_type_ = msg_type_node.GetString();
             }
         }
         else if (encoding_ == FunEncoding::kProtobuf)
         {
-            if (protobuf_message_->has_msgtype())
+            if (protobuf_message_.has_msgtype())
             {
-                msg_type_ = protobuf_message_->msgtype();
+                msg_type_ = protobuf_message_.msgtype();
             }
         }
     }
@@ -658,9 +1025,9 @@ int32_t FunapiMessage::GetMsgType2()
     {
         if (encoding_ == FunEncoding::kProtobuf)
         {
-            if (protobuf_message_->has_msgtype2())
+            if (protobuf_message_.has_msgtype2())
             {
-                msg_type2_ = protobuf_message_->msgtype2();
+                msg_type2_ = protobuf_message_.msgtype2();
             }
         }
     }
@@ -739,107 +1106,739 @@ bool FunapiUnsentMessageImpl::GetDiscard()
 
 
 ////////////////////////////////////////////////////////////////////////////////
-// FunapiSessionImpl declaration.
+// FunapiMessageTypeTable implementation.
+
+// Interns message type strings into dense ids starting from 1.
+// Find() looks up a type by pointer and length, so received message types
+// are matched without making a string. 0 means an unknown type.
+// Protobuf msgtype2 values are mapped onto the same ids with Alias().
+// Types are interned when handlers are registered, before any lookup.
+class FunapiMessageTypeTable
+{
+public:
+    typedef uint32_t TypeId;
+    static const TypeId kUnknownType = 0;
 
-class FunapiTransport;
-class FunapiSessionImpl : public std::enable_shared_from_this<FunapiSessionImpl> {
- public:
-  typedef fun::map<fun::string, fun::string> HeaderFields;
-  typedef std::function<void(const TransportProtocol,
-    const fun::string &,
-    const fun::vector<uint8_t> &,
-    const std::shared_ptr<FunapiMessage>)> MessageEventHandler;
-  typedef std::function<void()> NotifyHandler;
+    FunapiMessageTypeTable();
 
-  typedef std::function<void(const TransportProtocol,
-    const FunEncoding,
-    const HeaderFields &,
-    const fun::vector<uint8_t> &,
-    const std::shared_ptr<FunapiMessage>)> TransportReceivedHandler;
+    TypeId Intern(const fun::string &msg_type);
+    void Alias(const TypeId id, const int32_t msg_type2);
+    TypeId Find(const char *data, const size_t length) const;
+    TypeId Find(const int32_t msg_type2) const;
+    const fun::string& GetName(const TypeId id) const;
+    size_t Size() const;
 
-  typedef FunapiSession::TransportEventHandler TransportEventHandler;
-  typedef FunapiSession::SessionEventHandler SessionEventHandler;
-  typedef FunapiSession::ProtobufRecvHandler ProtobufRecvHandler;
-  typedef FunapiSession::JsonRecvHandler JsonRecvHandler;
-  typedef FunapiSession::RecvTimeoutHandler RecvTimeoutHandler;
-  typedef FunapiSession::RecvTimeoutIntHandler RecvTimeoutIntHandler;
-  typedef FunapiSession::SessionOptionHandler SessionOptionHandler;
-  typedef FunapiSession::TransportOptionHandler TransportOptionHandler;
-  typedef FunapiSession::RedirectQueueHandler RedirectQueueHandler;
+private:
+    struct Slot
+    {
+        uint32_t hash = 0;
+        TypeId id = kUnknownType;
+    };
 
-  FunapiSessionImpl() = delete;
-  FunapiSessionImpl(const char* hostname_or_ip, std::shared_ptr<FunapiSessionOption> option);
-  virtual ~FunapiSessionImpl();
+    static uint32_t Hash(const char *data, const size_t length);
+    void Rehash(const size_t capacity);
 
-  void Connect(const std::weak_ptr<FunapiSession>& session, const TransportProtocol protocol, int port, FunEncoding encoding, std::shared_ptr<FunapiTransportOption> option = nullptr);
-  void Connect(const TransportProtocol protocol);
-  void Close();
-  void Close(const TransportProtocol protocol);
+    fun::vector<Slot> slots_;  // Open addressing. The size is a power of 2.
+    fun::vector<fun::string> names_;  // names_[id - 1]
+    fun::unordered_map<int32_t, TypeId> msg_type2_ids_;
+};
 
-  void Update();
-  void UpdateTasks();
-  void UpdateTrasnports();
-  static void UpdateAll();
 
-  void SendMessage(const fun::string &msg_type,
-                   const fun::string &json_string,
-                   const TransportProtocol protocol,
-                   const EncryptionType encryption_type = EncryptionType::kDefaultEncryption);
+FunapiMessageTypeTable::FunapiMessageTypeTable()
+{
+    slots_.resize(16);
+}
 
-  void SendMessage(const FunMessage& message,
-                   const TransportProtocol protocol,
-                   const EncryptionType encryption_type = EncryptionType::kDefaultEncryption);
 
-  void AddSessionEventCallback(const SessionEventHandler &handler);
-  void AddTransportEventCallback(const TransportEventHandler &handler);
-  void AddProtobufRecvCallback(const ProtobufRecvHandler &handler);
-  void AddJsonRecvCallback(const JsonRecvHandler &handler);
-  void AddRecvTimeoutCallback(const RecvTimeoutHandler &handler);
-  void AddRecvTimeoutCallback(const RecvTimeoutIntHandler &handler);
+FunapiMessageTypeTable::TypeId FunapiMessageTypeTable::Intern(const fun::string &msg_type)
+{
+    TypeId id = Find(msg_type.data(), msg_type.length());
+    if (id != kUnknownType)
+        return id;
 
-  void SetSessionOptionCallback(const SessionOptionHandler &handler);
-  void SetTransportOptionCallback(const TransportOptionHandler &handler);
-  void SetRedirectQueueCallback(const RedirectQueueHandler &handler);
+    // Keeps the load factor under 1/2.
+    if ((names_.size() + 1) * 2 > slots_.size())
+        Rehash(slots_.size() * 2);
 
-  void RemoveSessionEventCallback();
-  void RemoveTransportEventCallback();
-  void RemoveProtobufRecvCallback();
-  void RemoveJsonRecvCallback();
-  void RemoveRecvTimeoutCallback();
-  void RemoveRecvTimeoutIntCallback();
-  void RemoveSessionOptionCallback();
-  void RemoveTransportOptionCallback();
-  void RemoveRedirectQueueCallback();
+    names_.push_back(msg_type);
+    id = static_cast<TypeId>(names_.size());
 
-  void RemoveAllCallbacks();
+    uint32_t hash = Hash(msg_type.data(), msg_type.length());
+    size_t mask = slots_.size() - 1;
+    size_t i = hash & mask;
+    while (slots_[i].id != kUnknownType)
+        i = (i + 1) & mask;
 
-  bool IsConnected(const TransportProtocol protocol) const;
-  bool IsConnected() const;
-  bool IsReliableSession() const;
+    slots_[i].hash = hash;
+    slots_[i].id = id;
 
-  std::shared_ptr<FunapiTransport> GetTransport(const TransportProtocol protocol) const;
-  bool HasTransport(const TransportProtocol protocol) const;
+    return id;
+}
 
-  TransportProtocol GetDefaultProtocol() const;
-  void SetDefaultProtocol(const TransportProtocol protocol);
 
-  FunEncoding GetEncoding(const TransportProtocol protocol) const;
-  int64_t GetPingTime();
+FunapiMessageTypeTable::TypeId FunapiMessageTypeTable::Find(const char *data, const size_t length) const
+{
+    uint32_t hash = Hash(data, length);
+    size_t mask = slots_.size() - 1;
 
-  void SetRecvTimeout(const fun::string &msg_type, const int seconds);
-  void SetRecvTimeout(const int32_t msg_type, const int seconds);
-  void EraseRecvTimeout(const fun::string &msg_type);
-  void EraseRecvTimeout(const int32_t msg_type);
+    for (size_t i = hash & mask; slots_[i].id != kUnknownType; i = (i + 1) & mask)
+    {
+        const Slot &slot = slots_[i];
+        if (slot.hash != hash)
+            continue;
 
-  static void Add(std::shared_ptr<FunapiSessionImpl> s);
-  static fun::vector<std::shared_ptr<FunapiSessionImpl>> GetSessionImpls();
+        const fun::string &name = names_[slot.id - 1];
+        if (name.length() == length && name.compare(0, length, data, length) == 0)
+            return slot.id;
+    }
 
-  void OnTransportReceived(const TransportProtocol protocol,
+    return kUnknownType;
+}
+
+
+void FunapiMessageTypeTable::Alias(const TypeId id, const int32_t msg_type2)
+{
+    if (id != kUnknownType && msg_type2 != 0)
+        msg_type2_ids_[msg_type2] = id;
+}
+
+
+FunapiMessageTypeTable::TypeId FunapiMessageTypeTable::Find(const int32_t msg_type2) const
+{
+    auto iter = msg_type2_ids_.find(msg_type2);
+    if (iter == msg_type2_ids_.end())
+        return kUnknownType;
+
+    return iter->second;
+}
+
+
+const fun::string& FunapiMessageTypeTable::GetName(const TypeId id) const
+{
+    return names_[id - 1];
+}
+
+
+size_t FunapiMessageTypeTable::Size() const
+{
+    return names_.size();
+}
+
+
+// FNV-1a
+uint32_t FunapiMessageTypeTable::Hash(const char *data, const size_t length)
+{
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < length; ++i)
+    {
+        hash ^= static_cast<uint8_t>(data[i]);
+        hash *= 16777619u;
+    }
+
+    return hash;
+}
+
+
+void FunapiMessageTypeTable::Rehash(const size_t capacity)
+{
+    fun::vector<Slot> slots(capacity);
+    size_t mask = capacity - 1;
+
+    for (const auto &slot : slots_)
+    {
+        if (slot.id == kUnknownType)
+            continue;
+
+        size_t i = slot.hash & mask;
+        while (slots[i].id != kUnknownType)
+            i = (i + 1) & mask;
+
+        slots[i] = slot;
+    }
+
+    slots_.swap(slots);
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+// FunapiRetransmitLog implementation.
+
+// Sent messages of a reliable session kept until the server acks them.
+// It is a ring in sequence number order, so an ack drops the acked messages
+// from the front without searching. Retransmission walks the ring with a
+// cursor and the messages stay in the log until they are acked again.
+// Used only on the network thread.
+class FunapiRetransmitLog
+{
+public:
+    FunapiRetransmitLog();
+    ~FunapiRetransmitLog();
+
+    // 0 means no limit.
+    void SetLimit(const size_t max_messages, const size_t max_bytes);
+
+    // Returns false if the message does not fit in the limit.
+    bool Push(const std::shared_ptr<FunapiMessage> &message);
+
+    // Drops the messages whose sequence numbers are less than ack.
+    void Trim(const uint32_t ack);
+    void Clear();
+
+    bool Empty() const;
+
+    void StartRetransmit();
+    bool IsRetransmitting() const;
+    const std::shared_ptr<FunapiMessage>& GetRetransmitMessage();
+    void NextRetransmit();
+
+private:
+    struct Entry
+    {
+        std::shared_ptr<FunapiMessage> message;
+        uint32_t seq = 0;
+        size_t bytes = 0;
+    };
+
+    Entry& At(const size_t index);
+    void PopFront(const size_t count);
+    void Grow();
+
+    fun::vector<Entry> entries_;  // The size is a power of 2.
+    size_t head_ = 0;
+    size_t size_ = 0;
+    size_t bytes_ = 0;
+    size_t max_messages_ = 0;
+    size_t max_bytes_ = 0;
+
+    bool retransmitting_ = false;
+    size_t retransmit_index_ = 0;  // Offset from the front.
+};
+
+
+FunapiRetransmitLog::FunapiRetransmitLog()
+{
+    entries_.resize(64);
+}
+
+
+FunapiRetransmitLog::~FunapiRetransmitLog()
+{
+    FunapiStats::Add(FunapiStats::Counter::kSentQueueDepth, -static_cast<int64_t>(size_));
+}
+
+
+void FunapiRetransmitLog::SetLimit(const size_t max_messages, const size_t max_bytes)
+{
+    max_messages_ = max_messages;
+    max_bytes_ = max_bytes;
+}
+
+
+bool FunapiRetransmitLog::Push(const std::shared_ptr<FunapiMessage> &message)
+{
+    size_t bytes = message->GetBodySize();
+
+    if (max_messages_ > 0 && size_ >= max_messages_)
+        return false;
+
+    if (max_bytes_ > 0 && size_ > 0 && bytes_ + bytes > max_bytes_)
+        return false;
+
+    if (size_ == entries_.size())
+        Grow();
+
+    Entry &entry = At(size_);
+    entry.message = message;
+    entry.seq = message->GetSeq();
+    entry.bytes = bytes;
+
+    ++size_;
+    bytes_ += bytes;
+    FunapiStats::Add(FunapiStats::Counter::kSentQueueDepth, 1);
+    return true;
+}
+
+
+void FunapiRetransmitLog::Trim(const uint32_t ack)
+{
+    if (size_ == 0 || !FunapiUtil::SeqLess(At(0).seq, ack))
+        return;
+
+    // Sequence numbers in the log are consecutive,
+    // so the number of acked messages is known from the front.
+    size_t count = static_cast<uint32_t>(ack - At(0).seq);
+    if (count > size_ || At(count - 1).seq != ack - 1)
+    {
+        count = 0;
+        while (count < size_ && FunapiUtil::SeqLess(At(count).seq, ack))
+            ++count;
+    }
+
+    PopFront(count);
+}
+
+
+void FunapiRetransmitLog::Clear()
+{
+    PopFront(size_);
+    retransmitting_ = false;
+}
+
+
+bool FunapiRetransmitLog::Empty() const
+{
+    return size_ == 0;
+}
+
+
+void FunapiRetransmitLog::StartRetransmit()
+{
+    retransmitting_ = (size_ > 0);
+    retransmit_index_ = 0;
+}
+
+
+bool FunapiRetransmitLog::IsRetransmitting() const
+{
+    return retransmitting_;
+}
+
+
+const std::shared_ptr<FunapiMessage>& FunapiRetransmitLog::GetRetransmitMessage()
+{
+    return At(retransmit_index_).message;
+}
+
+
+void FunapiRetransmitLog::NextRetransmit()
+{
+    if (++retransmit_index_ >= size_)
+        retransmitting_ = false;
+}
+
+
+FunapiRetransmitLog::Entry& FunapiRetransmitLog::At(const size_t index)
+{
+    return entries_[(head_ + index) & (entries_.size() - 1)];
+}
+
+
+void FunapiRetransmitLog::PopFront(const size_t count)
+{
+    for (size_t i = 0; i < count; ++i)
+    {
+        Entry &entry = At(i);
+        bytes_ -= entry.bytes;
+        entry.message = nullptr;
+    }
+
+    head_ = (head_ + count) & (entries_.size() - 1);
+    size_ -= count;
+    FunapiStats::Add(FunapiStats::Counter::kSentQueueDepth, -static_cast<int64_t>(count));
+
+    retransmit_index_ = (retransmit_index_ > count) ? retransmit_index_ - count : 0;
+    if (retransmit_index_ >= size_)
+        retransmitting_ = false;
+}
+
+
+void FunapiRetransmitLog::Grow()
+{
+    fun::vector<Entry> entries(entries_.size() * 2);
+    for (size_t i = 0; i < size_; ++i)
+        entries[i] = std::move(At(i));
+
+    entries_.swap(entries);
+    head_ = 0;
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+// FunapiRtt implementation.
+
+// Round trip time estimate. (RFC 6298)
+// Used for the UDP channel retransmissions and the client pings.
+class FunapiRtt
+{
+ public:
+  void Reset();
+  void OnSample(const int64_t rtt_millisecond);
+
+  bool HasSample() const;
+  double GetSrtt() const;
+  double GetRttVar() const;
+
+  // Retransmission timeout in milliseconds.
+  int64_t GetRto() const;
+
+ private:
+  static const int64_t kInitialRto = 200;
+  static const int64_t kMinRto = 20;
+  static const int64_t kMaxRto = 2000;
+
+  bool has_sample_ = false;
+  double srtt_ = 0;
+  double rttvar_ = 0;
+  int64_t rto_ = kInitialRto;
+};
+
+
+void FunapiRtt::Reset()
+{
+  has_sample_ = false;
+  srtt_ = 0;
+  rttvar_ = 0;
+  rto_ = kInitialRto;
+}
+
+
+void FunapiRtt::OnSample(const int64_t rtt_millisecond)
+{
+  double rtt = static_cast<double>(std::max<int64_t>(rtt_millisecond, 0));
+
+  if (!has_sample_)
+  {
+    srtt_ = rtt;
+    rttvar_ = rtt / 2;
+    has_sample_ = true;
+  }
+  else
+  {
+    rttvar_ = rttvar_ * 0.75 + std::abs(srtt_ - rtt) * 0.25;
+    srtt_ = srtt_ * 0.875 + rtt * 0.125;
+  }
+
+  // The constants are copied so that std::min/max do not take their address.
+  int64_t rto = static_cast<int64_t>(srtt_ + std::max(1.0, rttvar_ * 4));
+  rto_ = std::min<int64_t>(std::max<int64_t>(rto, int64_t(kMinRto)), int64_t(kMaxRto));
+}
+
+
+bool FunapiRtt::HasSample() const
+{
+  return has_sample_;
+}
+
+
+double FunapiRtt::GetSrtt() const
+{
+  return srtt_;
+}
+
+
+double FunapiRtt::GetRttVar() const
+{
+  return rttvar_;
+}
+
+
+int64_t FunapiRtt::GetRto() const
+{
+  return rto_;
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+// FunapiRttEstimator implementation.
+
+// RTT, jitter and loss of the client pings of a transport.
+// Pings are sent and received on the network thread. The stats can be
+// read on any thread.
+class FunapiRttEstimator
+{
+ public:
+  void Reset();
+
+  // timestamp is the monotonic millisecond stamped on the ping.
+  void OnPingSent(const int64_t timestamp);
+
+  // Returns false if the ping is not waiting for a reply.
+  bool OnPingReceived(const int64_t timestamp, const int64_t now);
+
+  // Milliseconds to the next ping. Pings are sent more often on a fast
+  // network and less often on a slow one, up to max_interval.
+  int64_t GetPingInterval(const int64_t max_interval);
+
+  FunapiRttStats GetStats();
+
+ private:
+  static const size_t kSampleWindow = 128;  // RTT samples for the percentiles.
+  static const size_t kLossWindow = 64;     // Pings for the loss rate.
+  static const int64_t kMinPingInterval = 500;
+  static const int64_t kPingIntervalPerRto = 10;
+  static const int64_t kMinLossTimeout = 1000;
+
+  // Counts the pings not replied within the loss timeout as lost.
+  void ExpirePings(const int64_t now);
+  void AddPingResult(const bool lost);
+
+  std::mutex mutex_;
+  FunapiRtt rtt_;
+  int64_t last_rtt_ = 0;
+
+  fun::deque<int64_t> pending_pings_;
+  fun::vector<int64_t> samples_;  // Ring buffer of kSampleWindow.
+  size_t next_sample_ = 0;
+  fun::deque<bool> ping_results_;
+  int lost_count_ = 0;
+};
+
+
+void FunapiRttEstimator::Reset()
+{
+  std::unique_lock<std::mutex> lock(mutex_);
+  rtt_.Reset();
+  last_rtt_ = 0;
+  pending_pings_.clear();
+  samples_.clear();
+  next_sample_ = 0;
+  ping_results_.clear();
+  lost_count_ = 0;
+}
+
+
+void FunapiRttEstimator::OnPingSent(const int64_t timestamp)
+{
+  std::unique_lock<std::mutex> lock(mutex_);
+  ExpirePings(timestamp);
+  pending_pings_.push_back(timestamp);
+}
+
+
+bool FunapiRttEstimator::OnPingReceived(const int64_t timestamp, const int64_t now)
+{
+  std::unique_lock<std::mutex> lock(mutex_);
+
+  auto iter = std::find(pending_pings_.begin(), pending_pings_.end(), timestamp);
+  if (iter == pending_pings_.end())
+    return false;
+
+  pending_pings_.erase(iter);
+
+  last_rtt_ = std::max<int64_t>(now - timestamp, 0);
+  rtt_.OnSample(last_rtt_);
+
+  if (samples_.size() < kSampleWindow) {
+    samples_.push_back(last_rtt_);
+  }
+  else {
+    samples_[next_sample_] = last_rtt_;
+  }
+  next_sample_ = (next_sample_ + 1) % kSampleWindow;
+
+  AddPingResult(false);
+  return true;
+}
+
+
+int64_t FunapiRttEstimator::GetPingInterval(const int64_t max_interval)
+{
+  std::unique_lock<std::mutex> lock(mutex_);
+  if (!rtt_.HasSample())
+    return max_interval;
+
+  int64_t interval = rtt_.GetRto() * kPingIntervalPerRto;
+  return std::min<int64_t>(std::max<int64_t>(interval, int64_t(kMinPingInterval)), max_interval);
+}
+
+
+FunapiRttStats FunapiRttEstimator::GetStats()
+{
+  std::unique_lock<std::mutex> lock(mutex_);
+  ExpirePings(FunapiTimerWheel::NowMillisecond());
+
+  FunapiRttStats stats;
+  stats.rtt = last_rtt_;
+  stats.srtt = static_cast<int64_t>(rtt_.GetSrtt() + 0.5);
+  stats.jitter = static_cast<int64_t>(rtt_.GetRttVar() + 0.5);
+  stats.samples = static_cast<int>(samples_.size());
+
+  if (!ping_results_.empty()) {
+    stats.loss_rate = static_cast<float>(lost_count_) / ping_results_.size();
+  }
+
+  if (!samples_.empty()) {
+    fun::vector<int64_t> sorted(samples_);
+    std::sort(sorted.begin(), sorted.end());
+
+    auto percentile = [&sorted](const size_t p) {
+      return sorted[(sorted.size() - 1) * p / 100];
+    };
+
+    stats.min_rtt = sorted.front();
+    stats.max_rtt = sorted.back();
+    stats.p50 = percentile(50);
+    stats.p90 = percentile(90);
+    stats.p99 = percentile(99);
+  }
+
+  return stats;
+}
+
+
+void FunapiRttEstimator::ExpirePings(const int64_t now)
+{
+  int64_t timeout = std::max<int64_t>(int64_t(kMinLossTimeout), rtt_.GetRto() * 2);
+
+  while (!pending_pings_.empty() && now - pending_pings_.front() > timeout) {
+    pending_pings_.pop_front();
+    AddPingResult(true);
+  }
+}
+
+
+void FunapiRttEstimator::AddPingResult(const bool lost)
+{
+  ping_results_.push_back(lost);
+  if (lost)
+    ++lost_count_;
+
+  if (ping_results_.size() > kLossWindow) {
+    if (ping_results_.front())
+      --lost_count_;
+    ping_results_.pop_front();
+  }
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+// FunapiSessionImpl declaration.
+
+class FunapiTransport;
+class FunapiSessionImpl : public std::enable_shared_from_this<FunapiSessionImpl> {
+ public:
+  typedef fun::map<fun::string, fun::string> HeaderFields;
+  typedef std::function<void(const TransportProtocol,
+    const fun::string &,
+    const fun::vector<uint8_t> &,
+    const std::shared_ptr<FunapiMessage>)> MessageEventHandler;
+  typedef std::function<void()> NotifyHandler;
+
+  typedef std::function<void(const TransportProtocol,
+    const FunEncoding,
+    const HeaderFields &,
+    const fun::vector<uint8_t> &,
+    const std::shared_ptr<FunapiMessage>)> TransportReceivedHandler;
+
+  typedef FunapiSession::TransportEventHandler TransportEventHandler;
+  typedef FunapiSession::SessionEventHandler SessionEventHandler;
+  typedef FunapiSession::ProtobufRecvHandler ProtobufRecvHandler;
+  typedef FunapiSession::JsonRecvHandler JsonRecvHandler;
+  typedef FunapiSession::JsonValueRecvHandler JsonValueRecvHandler;
+  typedef FunapiSession::RecvTimeoutHandler RecvTimeoutHandler;
+  typedef FunapiSession::RecvTimeoutIntHandler RecvTimeoutIntHandler;
+  typedef FunapiSession::SessionOptionHandler SessionOptionHandler;
+  typedef FunapiSession::TransportOptionHandler TransportOptionHandler;
+  typedef FunapiSession::RedirectQueueHandler RedirectQueueHandler;
+  typedef FunapiSession::RecvCaptureHandler RecvCaptureHandler;
+  typedef FunapiSession::RttStatsHandler RttStatsHandler;
+
+  FunapiSessionImpl() = delete;
+  FunapiSessionImpl(const char* hostname_or_ip, std::shared_ptr<FunapiSessionOption> option);
+  virtual ~FunapiSessionImpl();
+
+  void Connect(const std::weak_ptr<FunapiSession>& session, const TransportProtocol protocol, int port, FunEncoding encoding, std::shared_ptr<FunapiTransportOption> option = nullptr);
+  void Connect(const TransportProtocol protocol);
+  void Close();
+  void Close(const TransportProtocol protocol);
+
+  void Update();
+  void UpdateTasks();
+  void UpdateTrasnports();
+  static void UpdateAll();
+
+  // Timer wheel shared by every session and transport.
+  // Advanced on the network thread by OnSessionTicked().
+  static std::shared_ptr<FunapiTimerWheel> GetTimerWheel();
+
+  // Puts the session on the ready list so that the next UpdateAll updates it.
+  // Called when a task is pushed or a transport has something to do.
+  void MarkReady();
+
+  void SendMessage(const fun::string &msg_type,
+                   const fun::string &json_string,
+                   const TransportProtocol protocol,
+                   const EncryptionType encryption_type = EncryptionType::kDefaultEncryption);
+
+  void SendMessage(const FunMessage& message,
+                   const TransportProtocol protocol,
+                   const EncryptionType encryption_type = EncryptionType::kDefaultEncryption);
+
+  void SendChannelMessage(const int channel,
+                          const fun::string &msg_type,
+                          const fun::string &json_string,
+                          const EncryptionType encryption_type = EncryptionType::kDefaultEncryption);
+
+  void SendChannelMessage(const int channel,
+                          const FunMessage& message,
+                          const EncryptionType encryption_type = EncryptionType::kDefaultEncryption);
+
+  void AddSessionEventCallback(const SessionEventHandler &handler);
+  void AddTransportEventCallback(const TransportEventHandler &handler);
+  void AddProtobufRecvCallback(const ProtobufRecvHandler &handler);
+  void AddJsonRecvCallback(const JsonRecvHandler &handler);
+  void AddJsonValueRecvCallback(const JsonValueRecvHandler &handler);
+  void AddRecvTimeoutCallback(const RecvTimeoutHandler &handler);
+  void AddRecvTimeoutCallback(const RecvTimeoutIntHandler &handler);
+  void AddRttStatsCallback(const RttStatsHandler &handler);
+
+  void SetSessionOptionCallback(const SessionOptionHandler &handler);
+  void SetTransportOptionCallback(const TransportOptionHandler &handler);
+  void SetRedirectQueueCallback(const RedirectQueueHandler &handler);
+  void SetRecvCaptureCallback(const RecvCaptureHandler &handler);
+
+  void RemoveSessionEventCallback();
+  void RemoveTransportEventCallback();
+  void RemoveProtobufRecvCallback();
+  void RemoveJsonRecvCallback();
+  void RemoveJsonValueRecvCallback();
+  void RemoveRecvTimeoutCallback();
+  void RemoveRecvTimeoutIntCallback();
+  void RemoveRttStatsCallback();
+  void RemoveSessionOptionCallback();
+  void RemoveTransportOptionCallback();
+  void RemoveRedirectQueueCallback();
+  void RemoveRecvCaptureCallback();
+
+  void RemoveAllCallbacks();
+
+  bool IsConnected(const TransportProtocol protocol) const;
+  bool IsConnected() const;
+  bool IsReliableSession() const;
+
+  std::shared_ptr<FunapiTransport> GetTransport(const TransportProtocol protocol) const;
+  bool HasTransport(const TransportProtocol protocol) const;
+
+  TransportProtocol GetDefaultProtocol() const;
+  void SetDefaultProtocol(const TransportProtocol protocol);
+
+  FunEncoding GetEncoding(const TransportProtocol protocol) const;
+  int64_t GetPingTime();
+  FunapiRttStats GetRttStats(const TransportProtocol protocol);
+
+  bool IsTLSSessionResumed();
+  int64_t GetTLSHandshakeTime();
+  float GetTLSResumptionRate();
+
+  int64_t GetRedirectGapTime();
+
+  void SetRecvTimeout(const fun::string &msg_type, const int seconds);
+  void SetRecvTimeout(const int32_t msg_type, const int seconds);
+  void EraseRecvTimeout(const fun::string &msg_type);
+  void EraseRecvTimeout(const int32_t msg_type);
+
+  static void Add(std::shared_ptr<FunapiSessionImpl> s);
+  static fun::vector<std::shared_ptr<FunapiSessionImpl>> GetSessionImpls();
+
+  void OnTransportReceived(const TransportProtocol protocol,
                            const FunEncoding encoding,
                            const HeaderFields &header,
                            const fun::vector<uint8_t> &body,
                            const std::shared_ptr<FunapiMessage> message);
 
+  // Whether received json bodies have to be kept for OnJsonValueRecv.
+  bool HasJsonValueRecvCallback();
+
   void SendAck(const TransportProtocol protocol,
                const uint32_t ack,
                const EncryptionType encryption_type = EncryptionType::kDefaultEncryption);
@@ -861,8 +1860,10 @@ class FunapiSessionImpl : public std::enable_shared_from_this<FunapiSessionImpl>
   bool SendClientPingMessage(const TransportProtocol protocol,
                              const EncryptionType encryption_type = EncryptionType::kDefaultEncryption);
 
-  void PushNetworkThreadTask(const FunapiThread::TaskHandler &handler);
-  void PushTaskQueue(const std::function<bool()> &task);
+  // Templates so that the task is stored in FunapiTask without
+  // being wrapped by std::function.
+  template <typename F> void PushNetworkThreadTask(const F &handler);
+  template <typename F> void PushTaskQueue(const F &task);
 
   void CheckRedirect();
 
@@ -879,7 +1880,9 @@ class FunapiSessionImpl : public std::enable_shared_from_this<FunapiSessionImpl>
   bool IsRedirecting() const;
   bool UseRedirectQueue() const;
 
-  void RegisterHandler(const fun::string &msg_type, const MessageEventHandler &handler);
+  // msg_type2 is the protobuf msgtype2 of the same message, if it has one.
+  void RegisterHandler(const fun::string &msg_type, const MessageEventHandler &handler,
+                       const int32_t msg_type2 = 0);
 
   void SetSessionId(const fun::string &session_id, const FunEncoding encoding);
 
@@ -896,6 +1899,7 @@ class FunapiSessionImpl : public std::enable_shared_from_this<FunapiSessionImpl>
   void OnProtobufRecv(const TransportProtocol protocol, const FunMessage &message);
 
   void OnJsonRecv(const TransportProtocol protocol, const fun::string &msg_type, const fun::string &json_string);
+  void OnJsonValueRecv(const TransportProtocol protocol, const std::shared_ptr<FunapiMessage> &message);
 
   void OnSessionEvent(const TransportProtocol protocol, const FunEncoding encoding,
                       const SessionEventType type, const fun::string &session_id,
@@ -935,13 +1939,15 @@ class FunapiSessionImpl : public std::enable_shared_from_this<FunapiSessionImpl>
   mutable std::mutex transports_mutex_;
   TransportProtocol default_protocol_ = TransportProtocol::kDefault;
 
-  typedef fun::unordered_map<fun::string, MessageEventHandler> MessageHandlerMap;
-  MessageHandlerMap message_handlers_;
+  // Handlers are indexed by the interned message type id.
+  FunapiMessageTypeTable message_types_;
+  fun::vector<MessageEventHandler> message_handlers_;
 
   std::shared_ptr<FunapiTasks> tasks_;
 
   FunapiEvent<ProtobufRecvHandler> on_protobuf_recv_;
   FunapiEvent<JsonRecvHandler> on_json_recv_;
+  FunapiEvent<JsonValueRecvHandler> on_json_value_recv_;
 
   FunapiEvent<SessionEventHandler> on_session_event_;
   FunapiEvent<TransportEventHandler> on_transport_event_;
@@ -949,6 +1955,8 @@ class FunapiSessionImpl : public std::enable_shared_from_this<FunapiSessionImpl>
   FunapiEvent<RecvTimeoutHandler> on_recv_timeout_;
   FunapiEvent<RecvTimeoutIntHandler> on_recv_timeout_int_;
 
+  FunapiEvent<RttStatsHandler> on_rtt_stats_;
+
   fun::string hostname_or_ip_;
   std::weak_ptr<FunapiSession> session_;
 
@@ -961,11 +1969,32 @@ class FunapiSessionImpl : public std::enable_shared_from_this<FunapiSessionImpl>
     TransportProtocol::kUdp
   };
 
-  fun::unordered_map<fun::string, std::shared_ptr<FunapiTimer>> m_recv_timeout_;
-  fun::unordered_map<int32_t, std::shared_ptr<FunapiTimer>> m_recv_timeout_int_;
+  // Receive timeouts are timers on the shared timer wheel.
+  // serial tells a fired timer from the one that replaced it.
+  struct RecvTimeoutTimer {
+    FunapiTimerWheel::TimerId id = FunapiTimerWheel::kInvalidTimerId;
+    uint64_t serial = 0;
+  };
+
+  fun::unordered_map<fun::string, RecvTimeoutTimer> m_recv_timeout_;
+  fun::unordered_map<int32_t, RecvTimeoutTimer> m_recv_timeout_int_;
+  uint64_t recv_timeout_serial_ = 0;
+  std::atomic<size_t> recv_timeout_count_{0};  // Size of the two maps.
   std::mutex m_recv_timeout_mutex_;
 
-  void CheckRecvTimeout();
+  // Delay before checking a receive timeout again while redirecting.
+  static const int64_t kRecvTimeoutRedirectWaitMillisecond = 100;
+
+  fun::unordered_map<fun::string, RecvTimeoutTimer>& GetRecvTimeouts(const fun::string &msg_type);
+  fun::unordered_map<int32_t, RecvTimeoutTimer>& GetRecvTimeouts(const int32_t msg_type);
+
+  template <typename K>
+  void ScheduleRecvTimeout(const K &msg_type, const int64_t millisecond);
+  template <typename K>
+  void CancelRecvTimeout(const K &msg_type);
+  template <typename K>
+  void OnRecvTimeoutExpired(const K &msg_type, const uint64_t serial);
+
   void OnRecvTimeout(const fun::string &msg_type);
   void OnRecvTimeout(const int32_t msg_type);
 
@@ -980,12 +2009,21 @@ class FunapiSessionImpl : public std::enable_shared_from_this<FunapiSessionImpl>
   TransportOptionHandler transport_option_handler_ = nullptr;
   RedirectQueueHandler redirect_queue_handler_ = nullptr;
   std::mutex redirect_queue_handler_mutex_;
+  RecvCaptureHandler recv_capture_handler_ = nullptr;
+  std::mutex recv_capture_handler_mutex_;
 
   std::shared_ptr<FunapiSessionId> session_id_ = nullptr;
 
   static fun::vector<std::weak_ptr<FunapiSessionImpl>> vec_sessions_;
   static std::mutex vec_sessions_mutex_;
 
+  // Sessions that have work for UpdateAll. Idle sessions are not visited.
+  bool NeedsUpdate();
+  static fun::vector<std::weak_ptr<FunapiSessionImpl>> ready_sessions_;
+  static std::mutex ready_sessions_mutex_;
+  std::atomic<bool> ready_{false};
+  std::weak_ptr<FunapiSessionImpl> weak_self_;  // Set by Add().
+
   std::shared_ptr<FunapiThread> network_thread_ = nullptr;
 
   std::shared_ptr<FunapiSessionOption> session_option_ = nullptr;
@@ -1004,6 +2042,39 @@ class FunapiSessionImpl : public std::enable_shared_from_this<FunapiSessionImpl>
   void AddMessageToRedirectQueue(const TransportProtocol protocol,
                                  const std::shared_ptr<FunapiMessage> message);
   void SendUnsentQueueMessages();
+
+  void ParseRedirectMessage(fun::string &flavor,
+                            fun::vector<RedirectServerPortInfo> &server_ports_info);
+  void ConnectRedirectPorts(const std::shared_ptr<FunapiSessionImpl> &target,
+                            const fun::string &flavor,
+                            const fun::vector<RedirectServerPortInfo> &server_ports_info);
+
+  // Redirect with pre-connect. Another session impl connects to the target
+  // while this one keeps the current transports. Its transports are moved
+  // here once the target accepts the redirect token.
+  bool StartPreconnect();
+  std::shared_ptr<FunapiSessionImpl> GetPreconnectSession();
+  void CheckPreconnect(const std::shared_ptr<FunapiSessionImpl> &preconnect);
+  void OnPreconnected(const std::shared_ptr<FunapiSessionImpl> &preconnect);
+  void CancelPreconnect(const std::shared_ptr<FunapiSessionImpl> &preconnect,
+                        const TransportProtocol protocol,
+                        std::shared_ptr<FunapiError> error);
+
+  std::shared_ptr<FunapiSessionImpl> preconnect_session_ = nullptr;
+  std::mutex preconnect_mutex_;
+  fun::string preconnect_hostname_or_ip_;  // Restored if the pre-connect fails.
+
+  // Set on the pre-connecting session.
+  std::weak_ptr<FunapiSessionImpl> redirect_parent_;
+  bool redirect_connect_acked_ = false;
+  TransportProtocol redirect_connect_protocol_ = TransportProtocol::kDefault;
+
+  // The redirect gap is the time from the last message of the current
+  // server (or the redirect message) to the redirect success.
+  void UpdateRedirectGapTime(const bool preconnected);
+  int64_t redirect_started_time_ = 0;
+  std::atomic<int64_t> redirect_last_received_time_{0};
+  std::atomic<int64_t> redirect_gap_time_{0};
 };
 
 
@@ -1049,26 +2120,46 @@ class FunapiTransport : public std::enable_shared_from_this<FunapiTransport> {
 
   void SetCompressionType(CompressionType type);
   void SetZstdDictBase64String(const fun::string &zstd_dict_base64string);
+  void SetUseZstdStream(const bool use_stream);
 
   void SetState(TransportState state);
   TransportState GetState();
 
   virtual void Send(bool send_all = false);
   virtual void Update();
+  // Returns true while Update() has to be called every frame.
+  virtual bool NeedsUpdate();
 
   void SetSendSessionIdOnlyOnce(const bool once);
   void SetUseFirstSessionId(const bool use);
   void SetDelayedAckInterval(const int millisecond);
+  void SetJsonInsituParsing(const bool insitu);
+  void SetRetransmitQueueLimit(const size_t max_messages, const size_t max_bytes,
+                               const FunapiSessionOption::RetransmitOverflowPolicy policy);
 
   void SetReceivedRedirectionEvent(bool received_event);
 
+  FunapiRttEstimator& GetRttEstimator() { return rtt_estimator_; }
+
+  // Moves a pre-connected transport to the session it is redirected for.
+  // Called on the network thread before the session can reach the transport.
+  void SetSessionImpl(std::weak_ptr<FunapiSessionImpl> session);
+
+  // Stops forwarding messages and events to the session. Used for the
+  // transports left behind by a pre-connected redirect.
+  void Detach();
+
  protected:
-  void PushNetworkThreadTask(const FunapiThread::TaskHandler &handler);
+  template <typename F> void PushNetworkThreadTask(const F &handler);
 
-  void OnReceived(const TransportProtocol protocol,
-                  const FunEncoding encoding,
-                  const HeaderFields &header,
-                  const fun::vector<uint8_t> &body);
+  virtual void OnReceived(const TransportProtocol protocol,
+                          const FunEncoding encoding,
+                          const HeaderFields &header,
+                          const fun::vector<uint8_t> &body);
+  virtual void OnEmptyMessageReceived(const HeaderFields &header) {}
+
+  // Adds transport specific fields to the header of a message to send.
+  virtual void AddHeaderFields(std::shared_ptr<FunapiMessage> message, HeaderFields &header_fields) {}
 
   bool OnAckReceived(const uint32_t ack);
   bool OnSeqReceived(const uint32_t seq);
@@ -1110,7 +2201,13 @@ class FunapiTransport : public std::enable_shared_from_this<FunapiTransport> {
   std::shared_ptr<FunapiQueue> send_queue_;
   std::shared_ptr<FunapiQueue> send_priority_queue_;
   std::shared_ptr<FunapiQueue> send_handshake_queue_;
-  std::shared_ptr<FunapiQueue> sent_queue_;
+  FunapiRetransmitLog retransmit_log_;
+  FunapiSessionOption::RetransmitOverflowPolicy retransmit_overflow_policy_ =
+      FunapiSessionOption::RetransmitOverflowPolicy::kStopTransport;
+
+  // Returns false if the message could not be kept for retransmission.
+  bool PushRetransmit(const std::shared_ptr<FunapiMessage> &message);
+  void StartRetransmit();
 
   // Encoding-serializer-releated member variables.
   FunEncoding encoding_ = FunEncoding::kNone;
@@ -1133,11 +2230,13 @@ class FunapiTransport : public std::enable_shared_from_this<FunapiTransport> {
   bool IsDelayedAckSendTime();
   double delayed_ack_interval_ = 0;
   int64_t ack_sent_time_ = 0;
+  FunapiTimerWheel::TimerId delayed_ack_timer_ = FunapiTimerWheel::kInvalidTimerId;
 
   std::shared_ptr<FunapiEncryption> encrytion_;
   bool sequence_number_validation_ = false;
 
   std::shared_ptr<FunapiCompression> compression_;
+  fun::vector<uint8_t> body_buffer_;
 
   std::weak_ptr<FunapiSessionImpl> session_impl_;
 
@@ -1168,6 +2267,9 @@ class FunapiTransport : public std::enable_shared_from_this<FunapiTransport> {
   HeaderFields header_fields_;
 
   bool received_redirection_event_ = false;
+  std::atomic<bool> detached_{false};
+
+  FunapiRttEstimator rtt_estimator_;
 
  private:
   TransportState state_ = TransportState::kDisconnected;
@@ -1179,6 +2281,7 @@ class FunapiTransport : public std::enable_shared_from_this<FunapiTransport> {
   std::shared_ptr<FunapiSessionId> session_id_ = nullptr;
 
   bool use_send_session_id_only_once_ = false;
+  bool use_json_insitu_parsing_ = false;
 };
 
 
@@ -1207,7 +2310,6 @@ FunapiTransport::FunapiTransport(std::weak_ptr<FunapiSessionImpl> session,
 
   send_priority_queue_ = FunapiQueue::Create();
   send_handshake_queue_ = FunapiQueue::Create();
-  sent_queue_ = FunapiQueue::Create();
 }
 
 
@@ -1219,6 +2321,7 @@ FunapiTransport::~FunapiTransport() {
 bool FunapiTransport::EncodeMessage(std::shared_ptr<FunapiMessage> message,
                                     fun::vector<uint8_t> &body,
                                     const EncryptionType encryption_type) {
+  FunapiStats::ScopedTimer encode_timer(FunapiStats::Counter::kEncodeNanoseconds);
 
   if (body.size() > kMaxPayloadSize)
   {
@@ -1231,11 +2334,21 @@ bool FunapiTransport::EncodeMessage(std::shared_ptr<FunapiMessage> message,
 
   HeaderFields header_fields;
   MakeHeaderFields(header_fields, body);
+  AddHeaderFields(message, header_fields);
 
-  compression_->Compress(header_fields, body);
+  {
+    FunapiStats::ScopedTimer compress_timer(FunapiStats::Counter::kCompressNanoseconds);
+    compression_->Compress(header_fields, body);
+  }
 
-  if (false == encrytion_->Encrypt(header_fields, body, encryption_type))
-    return false;
+  {
+    FunapiStats::ScopedTimer encrypt_timer(FunapiStats::Counter::kEncryptNanoseconds);
+    if (false == encrytion_->Encrypt(header_fields, body, encryption_type))
+      return false;
+  }
+
+  FunapiStats::Add(GetProtocol(), FunapiStats::TransportCounter::kMessagesSent, 1);
+  FunapiStats::Add(GetProtocol(), FunapiStats::TransportCounter::kBytesSent, body.size());
 
   fun::string header_string;
   MakeHeaderString(header_string, header_fields);
@@ -1428,11 +2541,34 @@ void FunapiTransport::SetDelayedAckInterval(const int millisecond) {
 }
 
 
+void FunapiTransport::SetJsonInsituParsing(const bool insitu) {
+  use_json_insitu_parsing_ = insitu;
+}
+
+
+void FunapiTransport::SetRetransmitQueueLimit(const size_t max_messages, const size_t max_bytes,
+                                              const FunapiSessionOption::RetransmitOverflowPolicy policy) {
+  retransmit_log_.SetLimit(max_messages, max_bytes);
+  retransmit_overflow_policy_ = policy;
+}
+
+
 void FunapiTransport::SetReceivedRedirectionEvent(bool received_event) {
   received_redirection_event_ = received_event;
 }
 
 
+void FunapiTransport::SetSessionImpl(std::weak_ptr<FunapiSessionImpl> session) {
+  session_impl_ = session;
+}
+
+
+void FunapiTransport::Detach() {
+  received_redirection_event_ = true;
+  detached_ = true;
+}
+
+
 int FunapiTransport::GetDelayedAckInterval() const {
   return delayed_ack_interval_;
 }
@@ -1581,6 +2717,9 @@ bool FunapiTransport::TryToDecodeBody(fun::vector<uint8_t> &receiving,
 
   fun::vector<EncryptionType> encryption_types;
 
+  FunapiStats::Add(GetProtocol(), FunapiStats::TransportCounter::kMessagesReceived, 1);
+  FunapiStats::Add(GetProtocol(), FunapiStats::TransportCounter::kBytesReceived, body_length);
+
 #ifdef DEBUG_LOG
   if (body_length == 0)
   {
@@ -1600,12 +2739,18 @@ bool FunapiTransport::TryToDecodeBody(fun::vector<uint8_t> &receiving,
 
   if (body_length > 0)
   {
-    fun::vector<uint8_t> v(receiving.begin() + next_decoding_offset, receiving.begin() + next_decoding_offset + body_length);
+    // Reuses the body buffer so that decoding a message does not allocate.
+    fun::vector<uint8_t> &v = body_buffer_;
+    v.assign(receiving.begin() + next_decoding_offset, receiving.begin() + next_decoding_offset + body_length);
+
+    {
+      FunapiStats::ScopedTimer decode_timer(FunapiStats::Counter::kDecodeNanoseconds);
 
-    // TODO(sungjin): 복호화에 실패 했을때 압축해제 하지 않고 에러로 처리.
-    encrytion_->Decrypt(header_fields, v, encryption_types);
+      // TODO(sungjin): 복호화에 실패 했을때 압축해제 하지 않고 에러로 처리.
+      encrytion_->Decrypt(header_fields, v, encryption_types);
 
-    compression_->Decompress(header_fields, v);
+      compression_->Decompress(header_fields, v);
+    }
     v.push_back('\0');
 
     // Moves the read offset.
@@ -1624,16 +2769,14 @@ bool FunapiTransport::TryToDecodeBody(fun::vector<uint8_t> &receiving,
     // init encrytion
     encrytion_->Decrypt(header_fields, receiving, encryption_types);
 
+    OnEmptyMessageReceived(header_fields);
+
     // 다음 조건을 만족하는 경우는 다음과 같습니다.
     // 서버가 시퀀스 정보를 받지 못했고 클라이언트가 재접속을 시도하는 경우.
     if (IsReliableSession() && ack_receiving_ == false)
     {
       // 서버가 받지 못한 메세지들을 다시 재전송 한다.
-      while (!sent_queue_->Empty()) {
-        auto msg = sent_queue_->Front();
-        sent_queue_->PopFront();
-        send_priority_queue_->PushBack(msg);
-      }
+      StartRetransmit();
     }
   }
 
@@ -1733,6 +2876,12 @@ void FunapiTransport::PushSendQueue(std::shared_ptr<FunapiMessage> message,
   else {
     send_queue_->PushBack(message);
   }
+
+  if (NeedsUpdate()) {
+    if (auto s = session_impl_.lock()) {
+      s->MarkReady();
+    }
+  }
 }
 
 
@@ -1761,6 +2910,9 @@ void FunapiTransport::SetConnectTimeout(const time_t timeout) {
 
 
 void FunapiTransport::OnTransportStarted(const TransportProtocol protocol, std::shared_ptr<FunapiError> error) {
+  if (detached_)
+    return;
+
   if (auto s = session_impl_.lock()) {
     s->OnTransportStarted(protocol, error);
   }
@@ -1768,6 +2920,9 @@ void FunapiTransport::OnTransportStarted(const TransportProtocol protocol, std::
 
 
 void FunapiTransport::OnTransportClosed(const TransportProtocol protocol, std::shared_ptr<FunapiError> error) {
+  if (detached_)
+    return;
+
   if (auto s = session_impl_.lock()) {
     s->OnTransportClosed(protocol, error);
   }
@@ -1775,6 +2930,9 @@ void FunapiTransport::OnTransportClosed(const TransportProtocol protocol, std::s
 
 
 void FunapiTransport::OnTransportReconnecting(const TransportProtocol protocol, std::shared_ptr<FunapiError> error) {
+  if (detached_)
+    return;
+
   if (auto s = session_impl_.lock()) {
     s->OnTransportReconnecting(protocol, error);
   }
@@ -1782,6 +2940,9 @@ void FunapiTransport::OnTransportReconnecting(const TransportProtocol protocol,
 
 
 void FunapiTransport::OnTransportConnectFailed(const TransportProtocol protocol, std::shared_ptr<FunapiError> error) {
+  if (detached_)
+    return;
+
   if (auto s = session_impl_.lock()) {
     s->OnTransportConnectFailed(protocol, error);
   }
@@ -1789,6 +2950,9 @@ void FunapiTransport::OnTransportConnectFailed(const TransportProtocol protocol,
 
 
 void FunapiTransport::OnTransportConnectTimeout(const TransportProtocol protocol, std::shared_ptr<FunapiError> error) {
+  if (detached_)
+    return;
+
   if (auto s = session_impl_.lock()) {
     s->OnTransportConnectTimeout(protocol, error);
   }
@@ -1796,6 +2960,9 @@ void FunapiTransport::OnTransportConnectTimeout(const TransportProtocol protocol
 
 
 void FunapiTransport::OnTransportDisconnected(const TransportProtocol protocol, std::shared_ptr<FunapiError> error) {
+  if (detached_)
+    return;
+
   if (auto s = session_impl_.lock()) {
     s->OnTransportDisconnected(protocol, error);
   }
@@ -1838,18 +3005,17 @@ void FunapiTransport::SetZstdDictBase64String(const fun::string &zstd_dict_base6
 }
 
 
+void FunapiTransport::SetUseZstdStream(const bool use_stream) {
+#if FUNAPI_HAVE_ZSTD
+  compression_->SetUseZstdStream(use_stream);
+#endif
+}
+
+
 bool FunapiTransport::OnAckReceived(const uint32_t ack) {
   ack_receiving_ = true;
 
-  while (!sent_queue_->Empty()) {
-    auto msg = sent_queue_->Front();
-    if (FunapiUtil::SeqLess(msg->GetSeq(), ack)) {
-      sent_queue_->PopFront();
-    }
-    else {
-      break;
-    }
-  }
+  retransmit_log_.Trim(ack);
 
   if (reconnect_first_ack_receiving_) {
     reconnect_first_ack_receiving_ = false;
@@ -1862,7 +3028,7 @@ bool FunapiTransport::OnAckReceived(const uint32_t ack) {
 
 bool FunapiTransport::IsDelayedAckSendTime() {
   if (IsDelayedAckInterval()) {
-    auto time_now = std::chrono::system_clock::now().time_since_epoch().count() / 1000;
+    auto time_now = FunapiTimerWheel::NowMillisecond();
     auto diff = time_now - ack_sent_time_;
 
     if (diff >= delayed_ack_interval_) {
@@ -1887,7 +3053,21 @@ bool FunapiTransport::IsDelayedAckInterval() const {
 void FunapiTransport::OnSendAck(const TransportProtocol protocol, const uint32_t seq) {
   if (IsDelayedAckInterval()) {
     ack_send_ = seq;
-    has_ack_send_ = true;
+
+    if (!has_ack_send_) {
+      has_ack_send_ = true;
+
+      // Wakes up the send loop when the pending ack is due,
+      // so that the ack is sent even if there is no message to send.
+      auto wait = static_cast<int64_t>(delayed_ack_interval_) -
+                  (FunapiTimerWheel::NowMillisecond() - ack_sent_time_);
+
+      auto wheel = FunapiSessionImpl::GetTimerWheel();
+      wheel->Cancel(delayed_ack_timer_);
+      delayed_ack_timer_ = wheel->Schedule(wait, []() {
+        FunapiSendFlagManager::Get().WakeUp();
+      });
+    }
   }
   else if (auto s = session_impl_.lock()) {
     s->SendAck(protocol, seq);
@@ -1921,11 +3101,51 @@ bool FunapiTransport::OnSeqReceived(const uint32_t seq) {
 
 
 void FunapiTransport::PushUnsent(const uint32_t ack) {
-  while (!sent_queue_->Empty()) {
-    auto msg = sent_queue_->Front();
-    sent_queue_->PopFront();
-    send_priority_queue_->PushBack(msg);
+  StartRetransmit();
+}
+
+
+void FunapiTransport::StartRetransmit() {
+  // 재전송하는 메시지는 새 압축 스트림으로 보냅니다.
+  compression_->ResetSendStream();
+
+  // Messages are sent again from the log over several send cycles.
+  retransmit_log_.StartRetransmit();
+  if (retransmit_log_.IsRetransmitting()) {
+    FunapiSendFlagManager::Get().WakeUp();
+  }
+}
+
+
+bool FunapiTransport::PushRetransmit(const std::shared_ptr<FunapiMessage> &message) {
+  if (retransmit_log_.Push(message))
+    return true;
+
+  fun::stringstream ss;
+  ss << "Retransmit queue is full. Stopping the transport.";
+
+  if (retransmit_overflow_policy_ == FunapiSessionOption::RetransmitOverflowPolicy::kResync) {
+    // The server can not be given the lost messages any more.
+    // Starts over with a new session id on the next connection.
+    ss << " A new session will be opened.";
+
+    retransmit_log_.Clear();
+    seq_receiving_ = false;
+    ack_receiving_ = false;
+    reconnect_first_ack_receiving_ = false;
+    session_id_->Set("", FunEncoding::kJson);
+
+    DebugUtils::Log("%s", ss.str().c_str());
+    Stop(true, FunapiError::Create(FunapiError::ErrorType::kRetransmit, 0, ss.str()));
+  }
+  else {
+    retransmit_log_.Clear();
+
+    DebugUtils::Log("%s", ss.str().c_str());
+    Stop(true, FunapiError::Create(FunapiError::ErrorType::kRetransmit, 0, ss.str()), true);
   }
+
+  return false;
 }
 
 
@@ -1934,6 +3154,9 @@ void FunapiTransport::OnTransportReceived(const TransportProtocol protocol,
                                           const HeaderFields &header,
                                           const fun::vector<uint8_t> &body,
                                           const std::shared_ptr<FunapiMessage> message) {
+  if (detached_)
+    return;
+
   if (auto s = session_impl_.lock()) {
     s->OnTransportReceived(protocol, encoding, header, body, message);
   }
@@ -1944,9 +3167,17 @@ void FunapiTransport::OnReceived(const TransportProtocol protocol,
                                  const FunEncoding encoding,
                                  const HeaderFields &header,
                                  const fun::vector<uint8_t> &body) {
-  auto message = FunapiMessage::Create(encoding, body, EncryptionType::kDefaultEncryption);
+  bool keep_received_body = false;
+  if (encoding == FunEncoding::kJson) {
+    if (auto s = session_impl_.lock()) {
+      keep_received_body = s->HasJsonValueRecvCallback();
+    }
+  }
+
+  auto message = FunapiMessage::Create(encoding, body, EncryptionType::kDefaultEncryption,
+                                       use_json_insitu_parsing_, keep_received_body);
 
-  fun::string msg_type;
+  bool is_client_ping = false;
   uint32_t ack = 0;
   uint32_t seq = 0;
   bool hasAck = false;
@@ -1963,7 +3194,7 @@ void FunapiTransport::OnReceived(const TransportProtocol protocol,
     if (json->HasMember(kMessageTypeAttributeName)) {
       const rapidjson::Value &msg_type_node = (*json)[kMessageTypeAttributeName];
       assert(msg_type_node.IsString());
-      msg_type = msg_type_node.GetString();
+      is_client_ping = (strcmp(msg_type_node.GetString(), kClientPingMessageType) == 0);
     }
 
     hasAck = json->HasMember(kAckNumAttributeName);
@@ -1983,7 +3214,7 @@ void FunapiTransport::OnReceived(const TransportProtocol protocol,
       return;
     }
 
-    msg_type = proto->msgtype();
+    is_client_ping = (proto->msgtype().compare(kClientPingMessageType) == 0);
 
     hasAck = proto->has_ack();
     ack = proto->ack();
@@ -2003,7 +3234,7 @@ void FunapiTransport::OnReceived(const TransportProtocol protocol,
     }
   }
 
-  if (msg_type.compare(kClientPingMessageType) == 0) {
+  if (is_client_ping) {
     ResetClientPingTimeout();
   }
 
@@ -2018,6 +3249,9 @@ void FunapiTransport::OnDisconnecting(std::shared_ptr<FunapiError> error,
 
   OnTransportClosed(GetProtocol(), error);
 
+  if (detached_)
+    return;
+
   if (auto s = session_impl_.lock()) {
     s->CheckRedirect();
   }
@@ -2028,7 +3262,8 @@ void FunapiTransport::ResetClientPingTimeout() {
 }
 
 
-void FunapiTransport::PushNetworkThreadTask(const FunapiThread::TaskHandler &handler) {
+template <typename F>
+void FunapiTransport::PushNetworkThreadTask(const F &handler) {
   if (auto s = session_impl_.lock()) {
     std::weak_ptr<FunapiTransport> weak = shared_from_this();
     s->PushNetworkThreadTask([weak, this, handler]()->bool{
@@ -2043,8 +3278,14 @@ void FunapiTransport::PushNetworkThreadTask(const FunapiThread::TaskHandler &han
 
 
 void FunapiTransport::SetState(TransportState state) {
-  std::unique_lock<std::mutex> lock(state_mutex_);
-  state_ = state;
+  {
+    std::unique_lock<std::mutex> lock(state_mutex_);
+    state_ = state;
+  }
+
+  if (auto s = session_impl_.lock()) {
+    s->MarkReady();
+  }
 }
 
 
@@ -2056,6 +3297,10 @@ TransportState FunapiTransport::GetState() {
 
 void FunapiTransport::Start() {
   SetReceivedRedirectionEvent(false);
+  rtt_estimator_.Reset();
+
+  // 새 연결에서는 양쪽 모두 압축 스트림을 처음부터 시작합니다.
+  compression_->ResetStream();
 }
 
 
@@ -2079,6 +3324,11 @@ void FunapiTransport::Stop(bool use_force, std::shared_ptr<FunapiError> error, b
 void FunapiTransport::Update() {
 }
 
+
+bool FunapiTransport::NeedsUpdate() {
+  return false;
+}
+
 ////////////////////////////////////////////////////////////////////////////////
 // FunapiTcpTransport implementation.
 
@@ -2101,12 +3351,16 @@ class FunapiTcpTransport : public FunapiTransport {
   void SetSequenceNumberValidation(const bool validation);
   void SetEnablePing(const bool enable_ping);
   void SetUseTLS(const bool use_tls);
+  void SetUseTLSSessionResumption(const bool use);
   void SetCACertFilePath(const fun::string &path);
   void ResetClientPingTimeout();
 
+  bool IsTLSSessionResumed() const;
+  int64_t GetTLSHandshakeTime() const;
+  float GetTLSResumptionRate() const;
+
   bool UseSodium();
 
-  void Update();
   void Send(bool send_all = false);
 
  protected:
@@ -2126,25 +3380,26 @@ class FunapiTcpTransport : public FunapiTransport {
 
  private:
   // Ping message-related constants.
-  static const time_t kPingIntervalSecond = 3;
+  // The ping interval gets shorter as the RTT gets shorter. (FunapiRttEstimator)
+  static const int64_t kMaxPingIntervalMillisecond = 3000;
   static const time_t kPingTimeoutSeconds = 20;
 
-  enum class UpdateState : int {
-    kNone = 0,
-    kPing,
-    kWaitForAutoReconnect,
-  };
-  UpdateState update_state_ = UpdateState::kNone;
-  std::mutex update_state_mutex_;
+  typedef void (FunapiTcpTransport::*TimerHandler)();
 
-  void SetUpdateState(FunapiTcpTransport::UpdateState state);
-  FunapiTcpTransport::UpdateState GetUpdateState();
+  // Replaces the timer in timer_id. Pass 0 milliseconds to only cancel it.
+  void SetTimer(FunapiTimerWheel::TimerId &timer_id,
+                const int64_t millisecond,
+                const TimerHandler handler);
+  void CancelTimers();
 
-  void Ping();
-  void WaitForAutoReconnect();
+  void OnPingSendTimer();
+  void StartPingTimers();
+  void OnClientPingTimeout();
+  void OnReconnectWaitTimer();
   void StartReconnect();
 
-  FunapiTimer reconnect_wait_timer_;
+  std::mutex timer_mutex_;
+  FunapiTimerWheel::TimerId reconnect_wait_timer_ = FunapiTimerWheel::kInvalidTimerId;
   time_t reconnect_wait_seconds_ = 1;
 
   int offset_ = 0;
@@ -2155,10 +3410,17 @@ class FunapiTcpTransport : public FunapiTransport {
   bool enable_ping_ = false;
 
   bool use_tls_ = false;
+  bool use_tls_session_resumption_ = true;
   fun::string cert_file_path_;
 
-  FunapiTimer client_ping_timeout_timer_;
-  FunapiTimer ping_send_timer_;
+  // Written on the network thread when a TLS connect succeeds.
+  std::atomic<bool> tls_session_resumed_{false};
+  std::atomic<int64_t> tls_handshake_time_{0};
+  std::atomic<int> tls_handshake_count_{0};
+  std::atomic<int> tls_resumed_count_{0};
+
+  FunapiTimerWheel::TimerId client_ping_timeout_timer_ = FunapiTimerWheel::kInvalidTimerId;
+  FunapiTimerWheel::TimerId ping_send_timer_ = FunapiTimerWheel::kInvalidTimerId;
 
   std::function<bool(const TransportProtocol protocol)> send_client_ping_message_handler_;
 
@@ -2196,15 +3458,30 @@ TransportProtocol FunapiTcpTransport::GetProtocol() {
 }
 
 
-void FunapiTcpTransport::SetUpdateState(FunapiTcpTransport::UpdateState state) {
-  std::unique_lock<std::mutex> lock(update_state_mutex_);
-  update_state_ = state;
+void FunapiTcpTransport::SetTimer(FunapiTimerWheel::TimerId &timer_id,
+                                  const int64_t millisecond,
+                                  const TimerHandler handler) {
+  auto wheel = FunapiSessionImpl::GetTimerWheel();
+
+  std::unique_lock<std::mutex> lock(timer_mutex_);
+  wheel->Cancel(timer_id);
+  timer_id = FunapiTimerWheel::kInvalidTimerId;
+
+  if (millisecond > 0) {
+    std::weak_ptr<FunapiTransport> weak = shared_from_this();
+    timer_id = wheel->Schedule(millisecond, [weak, this, handler]() {
+      if (auto t = weak.lock()) {
+        (this->*handler)();
+      }
+    });
+  }
 }
 
 
-FunapiTcpTransport::UpdateState FunapiTcpTransport::GetUpdateState() {
-  std::unique_lock<std::mutex> lock(update_state_mutex_);
-  return update_state_;
+void FunapiTcpTransport::CancelTimers() {
+  SetTimer(ping_send_timer_, 0, nullptr);
+  SetTimer(client_ping_timeout_timer_, 0, nullptr);
+  SetTimer(reconnect_wait_timer_, 0, nullptr);
 }
 
 
@@ -2213,13 +3490,21 @@ void FunapiTcpTransport::Start() {
     return;
 
   SetState(TransportState::kConnecting);
-  SetUpdateState(UpdateState::kNone);
+  CancelTimers();
 
-  PushNetworkThreadTask([this]()->bool {
-
-    Connect();
+  // Resolves the host first, so that a slow DNS server does not stall
+  // the network thread.
+  std::weak_ptr<FunapiTransport> weak = shared_from_this();
+  FunapiResolver::Resolve(hostname_or_ip_, port_, SOCK_STREAM, [weak, this]() {
+    if (auto t = weak.lock()) {
+      PushNetworkThreadTask([this]()->bool {
+        if (GetState() == TransportState::kConnecting) {
+          Connect();
+        }
 
-    return true;
+        return true;
+      });
+    }
   });
 
   FunapiTransport::Start();
@@ -2230,6 +3515,7 @@ void FunapiTcpTransport::OnDisconnecting(std::shared_ptr<FunapiError> error,
                                          bool user_did)
 {
   tcp_ = nullptr;
+  CancelTimers();
 
   if (ack_receiving_)
   {
@@ -2247,34 +3533,39 @@ void FunapiTcpTransport::OnDisconnecting(std::shared_ptr<FunapiError> error,
 }
 
 
-void FunapiTcpTransport::Ping() {
-  if (enable_ping_ && GetState() == TransportState::kConnected) {
-    if (ping_send_timer_.IsExpired()){
-      ping_send_timer_.SetTimer(kPingIntervalSecond);
+void FunapiTcpTransport::OnPingSendTimer() {
+  if (!enable_ping_ || GetState() != TransportState::kConnected)
+    return;
 
-      if (auto s = session_impl_.lock()) {
-        s->SendClientPingMessage(GetProtocol());
-      }
-    }
+  SetTimer(ping_send_timer_,
+           rtt_estimator_.GetPingInterval(kMaxPingIntervalMillisecond),
+           &FunapiTcpTransport::OnPingSendTimer);
 
-    if (client_ping_timeout_timer_.IsExpired()) {
-      // DebugUtils::Log("Network seems disabled. Stopping the transport.");
-      Stop(true, FunapiError::Create(FunapiError::ErrorType::kPing, 0, "Network seems disabled. Stopping the transport."));
-      return;
-    }
+  if (auto s = session_impl_.lock()) {
+    s->SendClientPingMessage(GetProtocol());
   }
 }
 
 
-void FunapiTcpTransport::WaitForAutoReconnect() {
-  if (reconnect_wait_timer_.IsExpired()) {
-    reconnect_wait_seconds_ *= 2;
+void FunapiTcpTransport::StartPingTimers() {
+  SetTimer(client_ping_timeout_timer_, kMaxPingIntervalMillisecond + kPingTimeoutSeconds * 1000, &FunapiTcpTransport::OnClientPingTimeout);
+  SetTimer(ping_send_timer_, kMaxPingIntervalMillisecond, &FunapiTcpTransport::OnPingSendTimer);
+}
 
-    if (auto s = session_impl_.lock()) {
-      s->Connect(GetProtocol());
-    }
 
-    SetUpdateState(UpdateState::kNone);
+void FunapiTcpTransport::OnClientPingTimeout() {
+  if (enable_ping_ && GetState() == TransportState::kConnected) {
+    // DebugUtils::Log("Network seems disabled. Stopping the transport.");
+    Stop(true, FunapiError::Create(FunapiError::ErrorType::kPing, 0, "Network seems disabled. Stopping the transport."));
+  }
+}
+
+
+void FunapiTcpTransport::OnReconnectWaitTimer() {
+  reconnect_wait_seconds_ *= 2;
+
+  if (auto s = session_impl_.lock()) {
+    s->Connect(GetProtocol());
   }
 }
 
@@ -2282,9 +3573,8 @@ void FunapiTcpTransport::StartReconnect() {
   // auto reconnect 의 실행 조건은 다음과 같다.
   // connection_timeout 보다 reconnect_wait_second 보다 작아야한다.
   if (reconnect_wait_seconds_ < connect_timeout_seconds_) {
-    reconnect_wait_timer_.SetTimer(reconnect_wait_seconds_);
+    SetTimer(reconnect_wait_timer_, static_cast<int64_t>(reconnect_wait_seconds_) * 1000, &FunapiTcpTransport::OnReconnectWaitTimer);
 
-    SetUpdateState(UpdateState::kWaitForAutoReconnect);
     OnTransportReconnecting(GetProtocol());
 
     DebugUtils::Log("Wait %d seconds for connect to Tcp transport.", static_cast<int>(reconnect_wait_seconds_));
@@ -2298,23 +3588,59 @@ void FunapiTcpTransport::StartReconnect() {
 }
 
 
-void FunapiTcpTransport::SetDisableNagle(const bool disable_nagle) {
-  disable_nagle_ = disable_nagle;
+void FunapiTcpTransport::SetDisableNagle(const bool disable_nagle) {
+  disable_nagle_ = disable_nagle;
+}
+
+
+void FunapiTcpTransport::SetAutoReconnect(const bool auto_reconnect) {
+  auto_reconnect_ = auto_reconnect;
+}
+
+
+void FunapiTcpTransport::SetEnablePing(const bool enable_ping) {
+  enable_ping_ = enable_ping;
+
+  // The timers are only armed while ping is on.
+  if (GetState() == TransportState::kConnected) {
+    if (enable_ping) {
+      StartPingTimers();
+    }
+    else {
+      SetTimer(ping_send_timer_, 0, nullptr);
+      SetTimer(client_ping_timeout_timer_, 0, nullptr);
+    }
+  }
+}
+
+
+void FunapiTcpTransport::SetUseTLS(const bool use_tls) {
+  use_tls_ = use_tls;
 }
 
 
-void FunapiTcpTransport::SetAutoReconnect(const bool auto_reconnect) {
-  auto_reconnect_ = auto_reconnect;
+void FunapiTcpTransport::SetUseTLSSessionResumption(const bool use) {
+  use_tls_session_resumption_ = use;
 }
 
 
-void FunapiTcpTransport::SetEnablePing(const bool enable_ping) {
-  enable_ping_ = enable_ping;
+bool FunapiTcpTransport::IsTLSSessionResumed() const {
+  return tls_session_resumed_;
 }
 
 
-void FunapiTcpTransport::SetUseTLS(const bool use_tls) {
-  use_tls_ = use_tls;
+int64_t FunapiTcpTransport::GetTLSHandshakeTime() const {
+  return tls_handshake_time_;
+}
+
+
+float FunapiTcpTransport::GetTLSResumptionRate() const {
+  int count = tls_handshake_count_;
+  if (count == 0) {
+    return 0;
+  }
+
+  return static_cast<float>(tls_resumed_count_) / count;
 }
 
 
@@ -2324,7 +3650,7 @@ void FunapiTcpTransport::SetCACertFilePath(const fun::string &path) {
 
 
 void FunapiTcpTransport::ResetClientPingTimeout() {
-  client_ping_timeout_timer_.SetTimer(kPingTimeoutSeconds);
+  SetTimer(client_ping_timeout_timer_, kPingTimeoutSeconds * 1000, &FunapiTcpTransport::OnClientPingTimeout);
 }
 
 
@@ -2350,7 +3676,7 @@ void FunapiTcpTransport::OnConnectCompletion(const bool isFailed,
   fun::string hostname_or_ip = addrinfo_res->GetString();
 
   if (isFailed) {
-    SetUpdateState(UpdateState::kNone);
+    CancelTimers();
     SetState(TransportState::kDisconnected);
 
     if (auto_reconnect_)
@@ -2382,20 +3708,36 @@ void FunapiTcpTransport::OnConnectCompletion(const bool isFailed,
   }
   else
   {
-    client_ping_timeout_timer_.SetTimer(kPingIntervalSecond + kPingTimeoutSeconds);
-    ping_send_timer_.SetTimer(kPingIntervalSecond);
     reconnect_wait_seconds_ = 1;
 
-    SetUpdateState(UpdateState::kPing);
+    // Updated before the started event, so that the handler can read them.
+    if (use_tls_ && tcp_) {
+      bool resumed = tcp_->IsTLSSessionResumed();
+      tls_session_resumed_ = resumed;
+      tls_handshake_time_ = tcp_->GetTLSHandshakeTime();
+      ++tls_handshake_count_;
+      if (resumed) {
+        ++tls_resumed_count_;
+      }
+
+      DebugUtils::Log("TLS handshake: %lld ms (%s)",
+                      static_cast<long long>(tcp_->GetTLSHandshakeTime()),
+                      resumed ? "resumed" : "full");
+    }
+
     SetState(TransportState::kConnected);
 
+    if (enable_ping_) {
+      StartPingTimers();
+    }
+
     OnTransportStarted(TransportProtocol::kTcp);
   }
 }
 
 
 void FunapiTcpTransport::Connect() {
-  SetUpdateState(UpdateState::kNone);
+  CancelTimers();
   SetState(TransportState::kConnecting);
 
   // Tries to connect.
@@ -2409,6 +3751,8 @@ void FunapiTcpTransport::Connect() {
   }
 
   tcp_ = FunapiTcp::Create();
+  tcp_->SetUseTLSSessionResumption(use_tls_session_resumption_);
+
   std::weak_ptr<FunapiTransport> weak = shared_from_this();
   tcp_->Connect(hostname_or_ip_.c_str(),
                 port_,
@@ -2479,17 +3823,6 @@ void FunapiTcpTransport::Connect(std::shared_ptr<FunapiAddrInfo> addrinfo_res) {
 }
 
 
-void FunapiTcpTransport::Update() {
-  auto state = GetUpdateState();
-  if (state == UpdateState::kPing) {
-    Ping();
-  }
-  else if (state == UpdateState::kWaitForAutoReconnect) {
-    WaitForAutoReconnect();
-  }
-}
-
-
 void FunapiTcpTransport::SetSequenceNumberValidation(const bool validation) {
   sequence_number_validation_ = validation;
 }
@@ -2543,6 +3876,31 @@ void FunapiTcpTransport::Send(bool send_all)
       }
     }
   }
+  else if (retransmit_log_.IsRetransmitting())
+  {
+    // 이후 메시지를 처리하기 위해서 다시 Send 플레그를 올려준다.
+    FunapiSendFlagManager::Get().WakeUp();
+    if (false == encrytion_->IsHandShakeCompleted())
+    {
+      return;
+    }
+
+    // Sends up to kMaxSend messages per cycle instead of all at once.
+    size_t send_count = 0;
+    while (retransmit_log_.IsRetransmitting())
+    {
+      if (!FunapiTransport::EncodeThenSendMessage(retransmit_log_.GetRetransmitMessage()))
+      {
+        return;
+      }
+
+      retransmit_log_.NextRetransmit();
+
+      ++send_count;
+      if (send_count >= kMaxSend && send_all == false)
+        break;
+    }
+  }
   else
   {
     if (!GetSessionId().empty() &&
@@ -2564,7 +3922,8 @@ void FunapiTcpTransport::Send(bool send_all)
         {
           send_queue_->PopFront();
           if (msg->UseSentQueue()) {
-            sent_queue_->PushBack(msg);
+            if (!PushRetransmit(msg))
+              return;
           }
         } else
         {
@@ -2580,76 +3939,441 @@ void FunapiTcpTransport::Send(bool send_all)
       {
         if (has_ack_send_)
         {
-          std::shared_ptr<FunapiMessage> message;
+          auto message = FunapiMessage::Create(GetEncoding(), EncryptionType::kDefaultEncryption);
 
           if (GetEncoding() == FunEncoding::kJson)
           {
-            rapidjson::Document msg_json;
-            msg_json.SetObject();
-            rapidjson::Value key(kAckNumAttributeName, msg_json.GetAllocator());
+            auto msg_json = message->GetJsonDocumenet();
             rapidjson::Value ack_node(rapidjson::kNumberType);
             ack_node.SetUint(ack_send_);
-            msg_json.AddMember(key, ack_node, msg_json.GetAllocator());
-
-            message = FunapiMessage::Create(msg_json, EncryptionType::kDefaultEncryption);
+            msg_json->AddMember(rapidjson::StringRef(kAckNumAttributeName), ack_node, msg_json->GetAllocator());
           }
           else if (GetEncoding() == FunEncoding::kProtobuf)
           {
-            FunMessage msg_protobuf;
-            msg_protobuf.set_ack(ack_send_);
+            message->GetProtobufMessage()->set_ack(ack_send_);
+          }
+
+          message->SetUseSentQueue(false);
+          message->SetUseSeq(false);
+
+          if (FunapiTransport::EncodeThenSendMessage(message))
+          {
+            has_ack_send_ = false;
+          }
+        }
+      }
+    }
+  }
 
-            message = FunapiMessage::Create(msg_protobuf, EncryptionType::kDefaultEncryption);
+  if (!send_buffer_.empty())
+  {
+    std::weak_ptr<FunapiTransport> weak = shared_from_this();
+    tcp_->Send(send_buffer_,
+               [weak, this](const bool is_failed,
+                            const int error_code,
+                            const fun::string &error_string,
+                            const int sent_length)
+    {
+      if (auto t = weak.lock())
+      {
+        if (is_failed)
+        {
+          /*
+          if (error_code != 0) {
+            DebugUtils::Log("Tcp send error: (%d) %s", error_code, error_string.c_str());
+          }
+          */
+          auto error = FunapiError::Create(FunapiError::ErrorType::kSocket, error_code, error_string);
+          if (!auto_reconnect_)
+          {
+            OnTransportDisconnected(TransportProtocol::kTcp, error);
           }
+          Stop(true, error);
+        }
+        else
+        {
+          // DebugUtils::Log("Sent %d bytes", sent_length);
+        }
+
+        if (GetState() == TransportState::kDisconnecting && send_queue_->Empty())
+        {
+          OnDisconnecting();
+        }
+      }
+    });
+  }
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+// FunapiUdpChannel implementation.
+
+// State of a UDP channel. Used only on the network thread.
+//
+// A reliable-ordered channel sends a datagram again until it is acked.
+// The ack is the next sequence number expected in order and a bitfield of
+// the 32 datagrams after it that have arrived, so one lost datagram does
+// not hold back the acks of the datagrams behind it. Datagrams that arrive
+// early are kept until the missing ones come and handed over in order.
+//
+// An unreliable-sequenced channel never sends a datagram again and drops
+// the ones older than the last one handed over.
+class FunapiUdpChannel
+{
+ public:
+  typedef fun::map<fun::string, fun::string> HeaderFields;
+
+  enum class ReceiveResult : int {
+    kDeliver,
+    kBuffered,
+    kDrop,
+  };
+
+  struct Received
+  {
+    HeaderFields header;
+    fun::vector<uint8_t> body;
+  };
+
+  explicit FunapiUdpChannel(const UdpChannelType type);
+
+  bool IsReliable() const;
+  void Reset();
+
+  // Messages waiting for the send window.
+  fun::deque<std::shared_ptr<FunapiMessage>>& GetSendQueue();
+  bool CanSend() const;
+
+  // Sequence number of the next datagram. OnSent() moves to the next one.
+  uint32_t GetSendSeq() const;
+  void OnSent(const fun::vector<uint8_t> &datagram, const int64_t now);
+
+  void OnAck(const uint32_t next_seq, const uint32_t bits, const int64_t now, FunapiRtt &rtt);
+
+  // Appends the datagrams to send again. Returns false if a datagram has
+  // been sent too many times.
+  bool GetRetransmits(const int64_t now, const int64_t rto,
+                      fun::vector<const fun::vector<uint8_t>*> &datagrams);
+
+  // Returns 0 if no datagram is waiting for an ack.
+  int64_t GetNextRetransmitTime(const int64_t rto) const;
+
+  ReceiveResult Receive(const uint32_t seq, const HeaderFields &header, const fun::vector<uint8_t> &body);
+
+  // Takes the next kept datagram that is now in order.
+  bool PopReceived(Received &received);
+
+  bool HasAckToSend() const;
+  void GetAck(uint32_t &next_seq, uint32_t &bits);
+
+ private:
+  static const size_t kMaxInFlight = 128;
+  static const size_t kReceiveWindow = 256;  // power of 2
+  static const size_t kMaxFreeBuffers = 32;
+  static const uint32_t kFastRetransmitThreshold = 3;
+  static const int kMaxTransmissions = 16;
+  static const int64_t kMaxBackoff = 4000;
+
+  struct InFlight
+  {
+    uint32_t seq = 0;
+    fun::vector<uint8_t> datagram;
+    int64_t sent_time = 0;
+    int transmissions = 0;
+    bool acked = false;
+    bool fast_retransmit = false;
+    bool retransmit_now = false;
+  };
+
+  static int64_t GetRetransmitTime(const InFlight &f, const int64_t rto);
+  void OnAcked(InFlight &f, const int64_t now, FunapiRtt &rtt);
+
+  UdpChannelType type_;
+
+  fun::deque<std::shared_ptr<FunapiMessage>> send_queue_;
+  uint32_t send_seq_ = 0;
+  fun::deque<InFlight> in_flight_;
+  fun::vector<fun::vector<uint8_t>> free_buffers_;
+
+  uint32_t recv_seq_ = 0;
+  bool has_received_ = false;
+  fun::vector<Received> recv_buffer_;
+  fun::vector<bool> recv_present_;
+  bool ack_pending_ = false;
+};
+
+
+FunapiUdpChannel::FunapiUdpChannel(const UdpChannelType type)
+  : type_(type)
+{
+  if (IsReliable())
+  {
+    recv_buffer_.resize(kReceiveWindow);
+    recv_present_.resize(kReceiveWindow, false);
+  }
+}
+
+
+bool FunapiUdpChannel::IsReliable() const
+{
+  return type_ == UdpChannelType::kReliableOrdered;
+}
+
+
+void FunapiUdpChannel::Reset()
+{
+  send_queue_.clear();
+  send_seq_ = 0;
+  in_flight_.clear();
+
+  recv_seq_ = 0;
+  has_received_ = false;
+  std::fill(recv_present_.begin(), recv_present_.end(), false);
+  ack_pending_ = false;
+}
+
+
+fun::deque<std::shared_ptr<FunapiMessage>>& FunapiUdpChannel::GetSendQueue()
+{
+  return send_queue_;
+}
+
+
+bool FunapiUdpChannel::CanSend() const
+{
+  return !IsReliable() || in_flight_.size() < kMaxInFlight;
+}
+
+
+uint32_t FunapiUdpChannel::GetSendSeq() const
+{
+  return send_seq_;
+}
+
+
+void FunapiUdpChannel::OnSent(const fun::vector<uint8_t> &datagram, const int64_t now)
+{
+  if (IsReliable())
+  {
+    in_flight_.emplace_back();
+    InFlight &f = in_flight_.back();
+    f.seq = send_seq_;
+    if (!free_buffers_.empty())
+    {
+      f.datagram.swap(free_buffers_.back());
+      free_buffers_.pop_back();
+    }
+    f.datagram.assign(datagram.cbegin(), datagram.cend());
+    f.sent_time = now;
+    f.transmissions = 1;
+  }
+
+  ++send_seq_;
+}
+
+
+void FunapiUdpChannel::OnAcked(InFlight &f, const int64_t now, FunapiRtt &rtt)
+{
+  if (f.acked)
+    return;
+
+  f.acked = true;
+
+  // Karn's algorithm. A datagram sent more than once gives no sample.
+  if (f.transmissions == 1)
+    rtt.OnSample(now - f.sent_time);
+}
+
+
+void FunapiUdpChannel::OnAck(const uint32_t next_seq, const uint32_t bits,
+                             const int64_t now, FunapiRtt &rtt)
+{
+  // Every datagram before next_seq has arrived.
+  while (!in_flight_.empty() && FunapiUtil::SeqLess(in_flight_.front().seq, next_seq))
+  {
+    InFlight &f = in_flight_.front();
+    OnAcked(f, now, rtt);
+
+    if (free_buffers_.size() < kMaxFreeBuffers)
+    {
+      free_buffers_.emplace_back();
+      free_buffers_.back().swap(f.datagram);
+      free_buffers_.back().clear();
+    }
+
+    in_flight_.pop_front();
+  }
+
+  if (in_flight_.empty() || bits == 0)
+    return;
+
+  uint32_t front_seq = in_flight_.front().seq;
+  uint32_t highest = 0;
+  bool has_highest = false;
+
+  for (uint32_t i = 0; i < 32; ++i)
+  {
+    if ((bits & (1u << i)) == 0)
+      continue;
+
+    uint32_t seq = next_seq + 1 + i;
+    size_t index = static_cast<uint32_t>(seq - front_seq);
+    if (FunapiUtil::SeqLess(seq, front_seq) || index >= in_flight_.size())
+      continue;
+
+    OnAcked(in_flight_[index], now, rtt);
+    highest = seq;
+    has_highest = true;
+  }
+
+  if (!has_highest)
+    return;
+
+  // Sends at once the ones that later datagrams have passed.
+  for (auto &f : in_flight_)
+  {
+    if (!FunapiUtil::SeqLess(f.seq, highest))
+      break;
+
+    if (!f.acked && !f.fast_retransmit &&
+        static_cast<uint32_t>(highest - f.seq) >= kFastRetransmitThreshold)
+    {
+      f.fast_retransmit = true;
+      f.retransmit_now = true;
+    }
+  }
+}
+
+
+int64_t FunapiUdpChannel::GetRetransmitTime(const InFlight &f, const int64_t rto)
+{
+  if (f.retransmit_now)
+    return f.sent_time;
+
+  int shift = std::min(f.transmissions - 1, 5);
+  return f.sent_time + std::min(rto << shift, kMaxBackoff);
+}
+
+
+bool FunapiUdpChannel::GetRetransmits(const int64_t now, const int64_t rto,
+                                      fun::vector<const fun::vector<uint8_t>*> &datagrams)
+{
+  for (auto &f : in_flight_)
+  {
+    if (f.acked || GetRetransmitTime(f, rto) > now)
+      continue;
+
+    if (f.transmissions >= kMaxTransmissions)
+      return false;
+
+    ++f.transmissions;
+    f.sent_time = now;
+    f.retransmit_now = false;
+    datagrams.push_back(&f.datagram);
+  }
+
+  return true;
+}
+
+
+int64_t FunapiUdpChannel::GetNextRetransmitTime(const int64_t rto) const
+{
+  int64_t next_time = 0;
+
+  for (const auto &f : in_flight_)
+  {
+    if (f.acked)
+      continue;
+
+    int64_t t = GetRetransmitTime(f, rto);
+    if (next_time == 0 || t < next_time)
+      next_time = t;
+  }
+
+  return next_time;
+}
+
+
+FunapiUdpChannel::ReceiveResult FunapiUdpChannel::Receive(const uint32_t seq,
+                                                          const HeaderFields &header,
+                                                          const fun::vector<uint8_t> &body)
+{
+  if (!IsReliable())
+  {
+    if (has_received_ && !FunapiUtil::SeqLess(recv_seq_, seq))
+      return ReceiveResult::kDrop;
+
+    recv_seq_ = seq;
+    has_received_ = true;
+    return ReceiveResult::kDeliver;
+  }
+
+  // Acks again even for a duplicate, since the last ack may have been lost.
+  ack_pending_ = true;
+
+  if (FunapiUtil::SeqLess(seq, recv_seq_))
+    return ReceiveResult::kDrop;
+
+  uint32_t offset = seq - recv_seq_;
+  if (offset >= kReceiveWindow)
+    return ReceiveResult::kDrop;  // The sender will send it again.
+
+  if (offset == 0)
+  {
+    ++recv_seq_;
+    return ReceiveResult::kDeliver;
+  }
+
+  size_t index = seq & (kReceiveWindow - 1);
+  if (recv_present_[index])
+    return ReceiveResult::kDrop;
+
+  Received &r = recv_buffer_[index];
+  r.header = header;
+  r.body.assign(body.cbegin(), body.cend());
+  recv_present_[index] = true;
+
+  return ReceiveResult::kBuffered;
+}
+
+
+bool FunapiUdpChannel::PopReceived(Received &received)
+{
+  if (!IsReliable())
+    return false;
+
+  size_t index = recv_seq_ & (kReceiveWindow - 1);
+  if (!recv_present_[index])
+    return false;
+
+  std::swap(received.header, recv_buffer_[index].header);
+  received.body.swap(recv_buffer_[index].body);
+  recv_present_[index] = false;
+  ++recv_seq_;
+
+  return true;
+}
+
+
+bool FunapiUdpChannel::HasAckToSend() const
+{
+  return ack_pending_;
+}
 
-          message->SetUseSentQueue(false);
-          message->SetUseSeq(false);
 
-          if (FunapiTransport::EncodeThenSendMessage(message))
-          {
-            has_ack_send_ = false;
-          }
-        }
-      }
-    }
-  }
+void FunapiUdpChannel::GetAck(uint32_t &next_seq, uint32_t &bits)
+{
+  next_seq = recv_seq_;
+  bits = 0;
 
-  if (!send_buffer_.empty())
+  for (uint32_t i = 0; i < 32; ++i)
   {
-    std::weak_ptr<FunapiTransport> weak = shared_from_this();
-    tcp_->Send(send_buffer_,
-               [weak, this](const bool is_failed,
-                            const int error_code,
-                            const fun::string &error_string,
-                            const int sent_length)
-    {
-      if (auto t = weak.lock())
-      {
-        if (is_failed)
-        {
-          /*
-          if (error_code != 0) {
-            DebugUtils::Log("Tcp send error: (%d) %s", error_code, error_string.c_str());
-          }
-          */
-          auto error = FunapiError::Create(FunapiError::ErrorType::kSocket, error_code, error_string);
-          if (!auto_reconnect_)
-          {
-            OnTransportDisconnected(TransportProtocol::kTcp, error);
-          }
-          Stop(true, error);
-        }
-        else
-        {
-          // DebugUtils::Log("Sent %d bytes", sent_length);
-        }
-
-        if (GetState() == TransportState::kDisconnecting && send_queue_->Empty())
-        {
-          OnDisconnecting();
-        }
-      }
-    });
+    size_t index = (recv_seq_ + 1 + i) & (kReceiveWindow - 1);
+    if (recv_present_[index])
+      bits |= (1u << i);
   }
+
+  ack_pending_ = false;
 }
 
 
@@ -2673,15 +4397,57 @@ class FunapiUdpTransport : public FunapiTransport {
   void Start();
   void Send(bool send_all = false);
 
+  void SetSegmentOffload(const bool enable);
+  void AddChannel(const int channel, const UdpChannelType type);
+  void SetEnablePing(const bool enable_ping);
+
  protected:
+  void CreateSocket();
+
   bool EncodeThenSendMessage(std::shared_ptr<FunapiMessage> message,
                              fun::vector<uint8_t> &body,
                              const EncryptionType encryption_type);
   void OnDisconnecting(std::shared_ptr<FunapiError> error = nullptr,
                        bool use_did = false);
 
+  void OnReceived(const TransportProtocol protocol,
+                  const FunEncoding encoding,
+                  const HeaderFields &header,
+                  const fun::vector<uint8_t> &body);
+  void OnEmptyMessageReceived(const HeaderFields &header);
+  void AddHeaderFields(std::shared_ptr<FunapiMessage> message, HeaderFields &header_fields);
+
  private:
+  // Sends the datagrams queued in this send cycle at once.
+  void FlushSend();
+
+  FunapiUdpChannel* GetChannel(const int channel);
+  FunapiUdpChannel* GetChannel(const HeaderFields &header);
+  void ResetChannels();
+  bool SendChannels(bool send_all);
+  void SendChannelAck(const int channel);
+  void OnChannelAckReceived(FunapiUdpChannel &channel, const HeaderFields &header);
+  void UpdateRetransmitTimer();
+  void CancelRetransmitTimer();
+
+  // Pings are not replied if lost, so they also give the loss rate.
+  static const int64_t kMaxPingIntervalMillisecond = 3000;
+  void SchedulePing(const int64_t millisecond);
+  void CancelPing();
+  void OnPingSendTimer();
+
   std::shared_ptr<FunapiUdp> udp_;
+  bool segment_offload_ = false;
+  bool enable_ping_ = false;
+  FunapiTimerWheel::TimerId ping_send_timer_ = FunapiTimerWheel::kInvalidTimerId;
+
+  // Used only on the network thread after the transport starts.
+  fun::map<int, std::unique_ptr<FunapiUdpChannel>> channels_;
+  FunapiRtt rtt_;
+  FunapiTimerWheel::TimerId retransmit_timer_ = FunapiTimerWheel::kInvalidTimerId;
+  int64_t retransmit_timer_time_ = 0;
+  fun::vector<const fun::vector<uint8_t>*> retransmits_;
+  FunapiUdpChannel::Received received_;
 };
 
 
@@ -2716,6 +4482,58 @@ TransportProtocol FunapiUdpTransport::GetProtocol() {
 }
 
 
+void FunapiUdpTransport::SetSegmentOffload(const bool enable) {
+  segment_offload_ = enable;
+}
+
+
+void FunapiUdpTransport::AddChannel(const int channel, const UdpChannelType type) {
+  channels_[channel].reset(new FunapiUdpChannel(type));
+}
+
+
+void FunapiUdpTransport::SetEnablePing(const bool enable_ping) {
+  enable_ping_ = enable_ping;
+}
+
+
+FunapiUdpChannel* FunapiUdpTransport::GetChannel(const int channel) {
+  auto iter = channels_.find(channel);
+  if (iter == channels_.end()) {
+    return nullptr;
+  }
+
+  return iter->second.get();
+}
+
+
+FunapiUdpChannel* FunapiUdpTransport::GetChannel(const HeaderFields &header) {
+  auto iter = header.find(kChannelHeaderField);
+  if (iter == header.end()) {
+    return nullptr;
+  }
+
+  int channel = atoi(iter->second.c_str());
+  FunapiUdpChannel *ret = GetChannel(channel);
+  if (!ret) {
+    DebugUtils::Log("Received a message on unknown UDP channel %d. Dropped.", channel);
+  }
+
+  return ret;
+}
+
+
+void FunapiUdpTransport::ResetChannels() {
+  CancelRetransmitTimer();
+
+  for (auto &iter : channels_) {
+    iter.second->Reset();
+  }
+
+  rtt_.Reset();
+}
+
+
 void FunapiUdpTransport::Start() {
   if (GetState() != TransportState::kDisconnected)
     return;
@@ -2723,63 +4541,83 @@ void FunapiUdpTransport::Start() {
   SetState(TransportState::kConnecting);
 
   std::weak_ptr<FunapiTransport> weak = shared_from_this();
-  PushNetworkThreadTask([weak, this]()->bool {
-    if (auto t = weak.lock())
-    {
-      SetUseFirstSessionId(true);
-      udp_ = FunapiUdp::Create
-      (hostname_or_ip_.c_str(),
-       port_,
-       [weak, this]
-       (const bool isFailed,
-        const int error_code,
-        const fun::string &error_string)
-       {
-         if (auto t2 = weak.lock()) {
-           if (isFailed) {
-             // DebugUtils::Log("Udp socket failed: (%d) %s", error_code, error_string.c_str());
-             Stop(true, FunapiError::Create(FunapiError::ErrorType::kSocket, error_code, error_string));
-           }
-           else {
-             SetState(TransportState::kConnected);
-             OnTransportStarted(TransportProtocol::kUdp);
-           }
-         }
-       }, [weak, this]()
-       {
-         if (auto t2 = weak.lock()) {
-           Send();
-         }
-       },[weak, this]
-       (const bool isFailed,
-        const int error_code,
-        const fun::string &error_string,
-        const int read_length,
-        fun::vector<uint8_t> &receiving)
-       {
-         if (auto t2 = weak.lock()) {
-           if (isFailed) {
-             // DebugUtils::Log("Udp recvfrom error : (%d) %s", error_code, error_string.c_str());
-             Stop(true, FunapiError::Create(FunapiError::ErrorType::kSocket, error_code, error_string));
-           }
-           else {
-             DecodeMessage(read_length, receiving);
-           }
-         }
-       });
-    }
+  FunapiResolver::Resolve(hostname_or_ip_, port_, SOCK_DGRAM, [weak, this]() {
+    if (auto t = weak.lock()) {
+      PushNetworkThreadTask([this]()->bool {
+        if (GetState() == TransportState::kConnecting) {
+          CreateSocket();
+        }
 
-    return true;
+        return true;
+      });
+    }
   });
 
   FunapiTransport::Start();
 }
 
 
+void FunapiUdpTransport::CreateSocket() {
+  std::weak_ptr<FunapiTransport> weak = shared_from_this();
+
+  SetUseFirstSessionId(true);
+  ResetChannels();
+
+  udp_ = FunapiUdp::Create
+  (hostname_or_ip_.c_str(),
+   port_,
+   [weak, this]
+   (const bool isFailed,
+    const int error_code,
+    const fun::string &error_string)
+   {
+     if (auto t2 = weak.lock()) {
+       if (isFailed) {
+         // DebugUtils::Log("Udp socket failed: (%d) %s", error_code, error_string.c_str());
+         Stop(true, FunapiError::Create(FunapiError::ErrorType::kSocket, error_code, error_string));
+       }
+       else {
+         SetState(TransportState::kConnected);
+         OnTransportStarted(TransportProtocol::kUdp);
+
+         if (enable_ping_) {
+           SchedulePing(kMaxPingIntervalMillisecond);
+         }
+       }
+     }
+   }, [weak, this]()
+   {
+     if (auto t2 = weak.lock()) {
+       Send();
+     }
+   },[weak, this]
+   (const bool isFailed,
+    const int error_code,
+    const fun::string &error_string,
+    const int read_length,
+    fun::vector<uint8_t> &receiving)
+   {
+     if (auto t2 = weak.lock()) {
+       if (isFailed) {
+         // DebugUtils::Log("Udp recvfrom error : (%d) %s", error_code, error_string.c_str());
+         Stop(true, FunapiError::Create(FunapiError::ErrorType::kSocket, error_code, error_string));
+       }
+       else {
+         DecodeMessage(read_length, receiving);
+       }
+     }
+   });
+
+  udp_->SetSegmentOffload(segment_offload_);
+}
+
+
 void FunapiUdpTransport::OnDisconnecting(std::shared_ptr<FunapiError> error,
                                          bool user_did)
 {
   udp_ = nullptr;
+  CancelRetransmitTimer();
+  CancelPing();
 
   FunapiTransport::OnDisconnecting(error, user_did);
 }
@@ -2792,12 +4630,273 @@ bool FunapiUdpTransport::EncodeThenSendMessage(std::shared_ptr<FunapiMessage> me
     return false;
   }
 
-  bool bRet = false;
+  if (!udp_) {
+    return false;
+  }
+
+  // Sent by FlushSend() at the end of the send cycle.
+  udp_->PushSend(body);
+
+  if (message->HasChannelSeq()) {
+    if (auto channel = GetChannel(message->GetChannel())) {
+      channel->OnSent(body, FunapiTimerWheel::NowMillisecond());
+    }
+  }
+
+  return true;
+}
+
+
+void FunapiUdpTransport::AddHeaderFields(std::shared_ptr<FunapiMessage> message,
+                                         HeaderFields &header_fields) {
+  if (message->GetChannel() == 0) {
+    return;
+  }
+
+  FunapiUdpChannel *channel = GetChannel(message->GetChannel());
+  if (!channel) {
+    return;
+  }
+
+  char value[16];
+  snprintf(value, sizeof(value), "%d", message->GetChannel());
+  header_fields[kChannelHeaderField] = value;
+
+  if (message->HasChannelSeq()) {
+    snprintf(value, sizeof(value), "%u", message->GetChannelSeq());
+    header_fields[kChannelSeqHeaderField] = value;
+  }
+
+  // Acks ride on the messages of the same channel.
+  if (channel->HasAckToSend()) {
+    uint32_t next_seq = 0;
+    uint32_t bits = 0;
+    channel->GetAck(next_seq, bits);
+
+    snprintf(value, sizeof(value), "%u", next_seq);
+    header_fields[kChannelAckHeaderField] = value;
+    snprintf(value, sizeof(value), "%u", bits);
+    header_fields[kChannelAckBitsHeaderField] = value;
+  }
+}
+
+
+void FunapiUdpTransport::OnReceived(const TransportProtocol protocol,
+                                    const FunEncoding encoding,
+                                    const HeaderFields &header,
+                                    const fun::vector<uint8_t> &body) {
+  if (header.find(kChannelHeaderField) == header.end()) {
+    FunapiTransport::OnReceived(protocol, encoding, header, body);
+    return;
+  }
+
+  FunapiUdpChannel *channel = GetChannel(header);
+  if (!channel) {
+    return;
+  }
+
+  OnChannelAckReceived(*channel, header);
+
+  auto seq_iter = header.find(kChannelSeqHeaderField);
+  if (seq_iter == header.end()) {
+    // Only an ack.
+    return;
+  }
+
+  uint32_t seq = static_cast<uint32_t>(strtoul(seq_iter->second.c_str(), NULL, 10));
+  auto result = channel->Receive(seq, header, body);
+
+  if (channel->HasAckToSend()) {
+    // The ack is sent in the next send cycle.
+    FunapiSendFlagManager::Get().WakeUp();
+  }
+
+  if (result != FunapiUdpChannel::ReceiveResult::kDeliver) {
+    return;
+  }
+
+  FunapiTransport::OnReceived(protocol, encoding, header, body);
+
+  while (channel->PopReceived(received_)) {
+    FunapiTransport::OnReceived(protocol, encoding, received_.header, received_.body);
+  }
+}
+
+
+void FunapiUdpTransport::OnEmptyMessageReceived(const HeaderFields &header) {
+  if (header.find(kChannelHeaderField) == header.end()) {
+    return;
+  }
+
+  if (FunapiUdpChannel *channel = GetChannel(header)) {
+    OnChannelAckReceived(*channel, header);
+  }
+}
+
+
+void FunapiUdpTransport::OnChannelAckReceived(FunapiUdpChannel &channel, const HeaderFields &header) {
+  auto ack_iter = header.find(kChannelAckHeaderField);
+  if (ack_iter == header.end() || !channel.IsReliable()) {
+    return;
+  }
+
+  uint32_t next_seq = static_cast<uint32_t>(strtoul(ack_iter->second.c_str(), NULL, 10));
+  uint32_t bits = 0;
+
+  auto bits_iter = header.find(kChannelAckBitsHeaderField);
+  if (bits_iter != header.end()) {
+    bits = static_cast<uint32_t>(strtoul(bits_iter->second.c_str(), NULL, 10));
+  }
+
+  channel.OnAck(next_seq, bits, FunapiTimerWheel::NowMillisecond(), rtt_);
+}
+
+
+// Returns false if a reliable datagram could not be delivered.
+bool FunapiUdpTransport::SendChannels(bool send_all) {
+  int64_t now = FunapiTimerWheel::NowMillisecond();
+
+  for (auto &iter : channels_) {
+    FunapiUdpChannel &channel = *iter.second;
+
+    if (channel.IsReliable()) {
+      retransmits_.clear();
+      if (!channel.GetRetransmits(now, rtt_.GetRto(), retransmits_)) {
+        return false;
+      }
+
+      for (auto datagram : retransmits_) {
+        udp_->PushSend(*datagram);
+      }
+    }
+
+    size_t send_count = 0;
+    auto &queue = channel.GetSendQueue();
+    while (!queue.empty() && channel.CanSend()) {
+      auto msg = queue.front();
+
+      // The sequence number is used only when the message is sent.
+      msg->SetChannelSeq(channel.GetSendSeq());
+      if (!FunapiTransport::EncodeThenSendMessage(msg)) {
+        break;
+      }
+
+      queue.pop_front();
+
+      ++send_count;
+      if (send_count >= kMaxSend && send_all == false) {
+        FunapiSendFlagManager::Get().WakeUp();
+        break;
+      }
+    }
+
+    if (channel.HasAckToSend()) {
+      SendChannelAck(iter.first);
+    }
+  }
+
+  return true;
+}
+
+
+void FunapiUdpTransport::SendChannelAck(const int channel) {
+  auto message = FunapiMessage::Create(GetEncoding(), EncryptionType::kDefaultEncryption);
+  message->SetUseSeq(false);
+  message->SetChannel(channel);
+
+  FunapiTransport::EncodeThenSendMessage(message);
+}
+
+
+void FunapiUdpTransport::UpdateRetransmitTimer() {
+  int64_t next_time = 0;
+  int64_t rto = rtt_.GetRto();
+
+  for (auto &iter : channels_) {
+    if (iter.second->IsReliable()) {
+      int64_t t = iter.second->GetNextRetransmitTime(rto);
+      if (t != 0 && (next_time == 0 || t < next_time)) {
+        next_time = t;
+      }
+    }
+  }
+
+  if (retransmit_timer_ != FunapiTimerWheel::kInvalidTimerId &&
+      retransmit_timer_time_ == next_time) {
+    return;
+  }
+
+  CancelRetransmitTimer();
+
+  if (next_time == 0) {
+    return;
+  }
+
+  int64_t delay = std::max<int64_t>(1, next_time - FunapiTimerWheel::NowMillisecond());
+
+  std::weak_ptr<FunapiTransport> weak = shared_from_this();
+  retransmit_timer_ = FunapiSessionImpl::GetTimerWheel()->Schedule(delay, [weak, this]() {
+    if (auto t = weak.lock()) {
+      retransmit_timer_ = FunapiTimerWheel::kInvalidTimerId;
+      retransmit_timer_time_ = 0;
+      FunapiSendFlagManager::Get().WakeUp();
+    }
+  });
+  retransmit_timer_time_ = next_time;
+}
+
+
+void FunapiUdpTransport::CancelRetransmitTimer() {
+  if (retransmit_timer_ != FunapiTimerWheel::kInvalidTimerId) {
+    FunapiSessionImpl::GetTimerWheel()->Cancel(retransmit_timer_);
+    retransmit_timer_ = FunapiTimerWheel::kInvalidTimerId;
+  }
+
+  retransmit_timer_time_ = 0;
+}
+
+
+void FunapiUdpTransport::SchedulePing(const int64_t millisecond) {
+  CancelPing();
+
+  std::weak_ptr<FunapiTransport> weak = shared_from_this();
+  ping_send_timer_ = FunapiSessionImpl::GetTimerWheel()->Schedule(millisecond, [weak, this]() {
+    if (auto t = weak.lock()) {
+      ping_send_timer_ = FunapiTimerWheel::kInvalidTimerId;
+      OnPingSendTimer();
+    }
+  });
+}
+
+
+void FunapiUdpTransport::CancelPing() {
+  if (ping_send_timer_ != FunapiTimerWheel::kInvalidTimerId) {
+    FunapiSessionImpl::GetTimerWheel()->Cancel(ping_send_timer_);
+    ping_send_timer_ = FunapiTimerWheel::kInvalidTimerId;
+  }
+}
+
+
+void FunapiUdpTransport::OnPingSendTimer() {
+  if (GetState() != TransportState::kConnected)
+    return;
+
+  SchedulePing(rtt_estimator_.GetPingInterval(kMaxPingIntervalMillisecond));
+
+  if (auto s = session_impl_.lock()) {
+    s->SendClientPingMessage(GetProtocol());
+  }
+}
+
+
+void FunapiUdpTransport::FlushSend() {
+  if (!udp_) {
+    return;
+  }
 
   std::weak_ptr<FunapiTransport> weak = shared_from_this();
-  udp_->Send
-  (body,
-   [weak, this, &bRet]
+  udp_->FlushSend
+  ([weak, this]
    (const bool is_failed,
     const int error_code,
     const fun::string &error_string,
@@ -2808,13 +4907,10 @@ bool FunapiUdpTransport::EncodeThenSendMessage(std::shared_ptr<FunapiMessage> me
         Stop(true, FunapiError::Create(FunapiError::ErrorType::kSocket, error_code, error_string));
       }
       else {
-        bRet = true;
         // DebugUtils::Log("Sent %d bytes", sent_length);
       }
     }
   });
-
-  return bRet;
 }
 
 
@@ -2830,11 +4926,13 @@ void FunapiUdpTransport::Send(bool send_all) {
       send_handshake_queue_->PopFront();
     }
     else {
+      FlushSend();
       return;
     }
   }
 
   if (GetSessionId().empty()) {
+    FlushSend();
     return;
   }
 
@@ -2844,6 +4942,19 @@ void FunapiUdpTransport::Send(bool send_all) {
   {
     msg = send_queue_->Front();
 
+    // Channel messages wait in the queue of their channel.
+    if (msg->GetChannel() != 0) {
+      send_queue_->PopFront();
+      if (auto channel = GetChannel(msg->GetChannel())) {
+        channel->GetSendQueue().push_back(msg);
+      }
+      else {
+        DebugUtils::Log("UDP channel %d is not added. '%s' message dropped.",
+                        msg->GetChannel(), msg->GetMsgType().c_str());
+      }
+      continue;
+    }
+
     if (FunapiTransport::EncodeThenSendMessage(msg)) {
       send_queue_->PopFront();
     }
@@ -2856,6 +4967,17 @@ void FunapiUdpTransport::Send(bool send_all) {
       break;
   }
 
+  if (!channels_.empty() && udp_) {
+    if (!SendChannels(send_all)) {
+      Stop(true, FunapiError::Create(FunapiError::ErrorType::kRetransmit, 0,
+                                     "A reliable UDP channel message was not acked. Stopping the transport."));
+      return;
+    }
+  }
+
+  FlushSend();
+  UpdateRetransmitTimer();
+
   if (GetState() == TransportState::kDisconnecting) {
     if (send_queue_->Empty()) {
       OnDisconnecting();
@@ -2881,9 +5003,11 @@ class FunapiHttpTransport : public FunapiTransport {
   void Start();
 
   void Update();
+  bool NeedsUpdate();
 
   void SetSequenceNumberValidation(const bool validation);
   void SetCACertFilePath(const fun::string &path);
+  void SetMaxInflightRequests(const int max_requests);
 
   void Send(bool send_all = false);
 
@@ -2904,7 +5028,14 @@ class FunapiHttpTransport : public FunapiTransport {
   std::shared_ptr<FunapiHttp> http_ = nullptr;
   fun::string cert_file_path_;
 
-  std::shared_ptr<FunapiThread> http_thread_ = nullptr;
+  // The requests are sent and answered on the network thread.
+  int max_inflight_requests_ = 1;
+  int inflight_requests_ = 0;
+
+  // Messages of the failed requests. They are sent first on the next start.
+  fun::deque<std::shared_ptr<FunapiMessage>> unsent_messages_;
+
+  std::atomic<bool> send_requested_{ false };
 };
 
 
@@ -2917,8 +5048,6 @@ FunapiHttpTransport::FunapiHttpTransport(std::weak_ptr<FunapiSessionImpl> sessio
   host_url_ = ss_url.str();
 
   // DebugUtils::Log("Host url : %s", host_url_.c_str());
-
-  http_thread_ = FunapiThread::Get("_http");
 }
 
 
@@ -2945,21 +5074,21 @@ void FunapiHttpTransport::Start() {
 
   SetState(TransportState::kConnecting);
 
-  if (http_thread_) {
-    std::weak_ptr<FunapiTransport> weak = shared_from_this();
-    http_thread_->Push([weak, this]()->bool {
-      if (auto t = weak.lock()) {
-        http_ = FunapiHttp::Create(cert_file_path_);
-        http_->SetTimeout(static_cast<long>(connect_timeout_seconds_));
+  PushNetworkThreadTask([this]()->bool {
+    if (http_ == nullptr) {
+      http_ = FunapiHttp::Create(cert_file_path_);
+    }
+    http_->SetTimeout(static_cast<long>(connect_timeout_seconds_));
 
-        SetState(TransportState::kConnected);
+    SetState(TransportState::kConnected);
 
-        OnTransportStarted(TransportProtocol::kHttp);
-      }
+    OnTransportStarted(TransportProtocol::kHttp);
 
-      return true;
-    });
-  }
+    // Resends the messages of the failed requests, if any.
+    Send();
+
+    return true;
+  });
 
   FunapiTransport::Start();
 }
@@ -2973,11 +5102,17 @@ void FunapiHttpTransport::OnDisconnecting(std::shared_ptr<FunapiError> error,
 
 
 void FunapiHttpTransport::Send(bool send_all) {
-  std::shared_ptr<FunapiMessage> msg;
+  if (GetState() == TransportState::kDisconnected || http_ == nullptr) {
+    return;
+  }
 
   if (!send_handshake_queue_->Empty()) {
-    msg = send_handshake_queue_->Front();
+    // The session id and the cookie come with the reply of the handshake.
+    if (inflight_requests_ > 0) {
+      return;
+    }
 
+    std::shared_ptr<FunapiMessage> msg = send_handshake_queue_->Front();
     if (FunapiTransport::EncodeThenSendMessage(msg)) {
       send_handshake_queue_->PopFront();
     }
@@ -2987,18 +5122,29 @@ void FunapiHttpTransport::Send(bool send_all) {
       return;
     }
 
-    if (send_queue_->Empty()) {
-      return;
-    }
-    else {
-      msg = send_queue_->Front();
-      if (FunapiTransport::EncodeThenSendMessage(msg)) {
+    while (inflight_requests_ < max_inflight_requests_) {
+      std::shared_ptr<FunapiMessage> msg;
+      if (!unsent_messages_.empty()) {
+        msg = unsent_messages_.front();
+        unsent_messages_.pop_front();
+      }
+      else if (!send_queue_->Empty()) {
+        msg = send_queue_->Front();
         send_queue_->PopFront();
       }
+      else {
+        break;
+      }
+
+      if (!FunapiTransport::EncodeThenSendMessage(msg)) {
+        unsent_messages_.push_front(msg);
+        break;
+      }
     }
   }
 
-  if (GetState() == TransportState::kDisconnecting && send_queue_->Empty()) {
+  if (GetState() == TransportState::kDisconnecting &&
+      send_queue_->Empty() && inflight_requests_ == 0) {
     OnDisconnecting();
   }
 }
@@ -3010,13 +5156,25 @@ bool FunapiHttpTransport::EncodeThenSendMessage(std::shared_ptr<FunapiMessage> m
   if (GetState() == TransportState::kDisconnected) return false;
 
   HeaderFields header_fields_for_send;
-  MakeHeaderFields(header_fields_for_send, body);
+  {
+    FunapiStats::ScopedTimer encode_timer(FunapiStats::Counter::kEncodeNanoseconds);
+    MakeHeaderFields(header_fields_for_send, body);
+
+    {
+      FunapiStats::ScopedTimer compress_timer(FunapiStats::Counter::kCompressNanoseconds);
+      compression_->Compress(header_fields_for_send, body);
+      compression_->SetHeaderFieldsForHttpSend(header_fields_for_send);
+    }
 
-  compression_->Compress(header_fields_for_send, body);
-  compression_->SetHeaderFieldsForHttpSend(header_fields_for_send);
+    {
+      FunapiStats::ScopedTimer encrypt_timer(FunapiStats::Counter::kEncryptNanoseconds);
+      encrytion_->Encrypt(header_fields_for_send, body, encryption_type);
+      encrytion_->SetHeaderFieldsForHttpSend(header_fields_for_send);
+    }
+  }
 
-  encrytion_->Encrypt(header_fields_for_send, body, encryption_type);
-  encrytion_->SetHeaderFieldsForHttpSend(header_fields_for_send);
+  FunapiStats::Add(GetProtocol(), FunapiStats::TransportCounter::kMessagesSent, 1);
+  FunapiStats::Add(GetProtocol(), FunapiStats::TransportCounter::kBytesSent, body.size());
 
   if (!cookie_.empty()) {
     header_fields_for_send[kCookieRequestHeaderField] = cookie_;
@@ -3050,22 +5208,26 @@ bool FunapiHttpTransport::EncodeThenSendMessage(std::shared_ptr<FunapiMessage> m
   }
 #endif
 
-  bool is_ok = true;
+  ++inflight_requests_;
+
   std::weak_ptr<FunapiTransport> weak = shared_from_this();
-  http_->PostRequest(host_url_,
-                     header_fields_for_send,
-                     body,
-                     [weak, this, &is_ok](int code,
-                                          const fun::string error_string)
+  http_->PostRequestAsync(host_url_,
+                          header_fields_for_send,
+                          body,
+                          [weak, this, message](int code,
+                                                const fun::string error_string)
   {
     if (auto t = weak.lock()) {
       // DebugUtils::Log("Error from cURL: %d, %s", code, error_string.c_str());
 
-      is_ok = false;
+      --inflight_requests_;
 
       if (GetSessionId().empty()) {
         send_handshake_queue_ = FunapiQueue::Create();
       }
+      else {
+        unsent_messages_.push_back(message);
+      }
 
       Stop(true, FunapiError::Create(FunapiError::ErrorType::kCurl, code, error_string));
     }
@@ -3073,9 +5235,16 @@ bool FunapiHttpTransport::EncodeThenSendMessage(std::shared_ptr<FunapiMessage> m
                   const fun::vector<uint8_t> &v_body)
   {
     if (auto t = weak.lock()) {
+      --inflight_requests_;
+
+      if (GetState() == TransportState::kDisconnected) {
+        return;
+      }
+
+      // The response belongs to the finished request and is not used again.
       HeaderFields header_fields;
-      auto temp_header = const_cast<fun::vector<fun::string>&>(v_header);
-      auto temp_body = const_cast<fun::vector<uint8_t>&>(v_body);
+      auto &temp_header = const_cast<fun::vector<fun::string>&>(v_header);
+      auto &temp_body = const_cast<fun::vector<uint8_t>&>(v_body);
 
       for (size_t i=1;i<temp_header.size();++i) {
         WebResponseHeaderCb(temp_header[i].c_str(), static_cast<int>(temp_header[i].length()), header_fields);
@@ -3102,10 +5271,12 @@ bool FunapiHttpTransport::EncodeThenSendMessage(std::shared_ptr<FunapiMessage> m
       bool header_decoded = true;
       int next_decoding_offset = 0;
       TryToDecodeBody(temp_body, next_decoding_offset, header_decoded, header_fields);
+
+      Send();
     }
   });
 
-  return is_ok;
+  return true;
 }
 
 
@@ -3157,24 +5328,21 @@ void FunapiHttpTransport::WebResponseBodyCb(const void *data, int len, fun::vect
 
 
 void FunapiHttpTransport::Update() {
-  if (false == send_queue_->Empty()) {
-    if (http_thread_)
-    {
-      std::weak_ptr<FunapiTransport> weak = shared_from_this();
-      http_thread_->Push([weak, this]()->bool {
-        if (auto t = weak.lock()) {
-          if (GetState() != TransportState::kDisconnected) {
-            Send();
-          }
-        }
-
-        return true;
-      });
-    }
+  if (false == send_queue_->Empty() && !send_requested_.exchange(true)) {
+    PushNetworkThreadTask([this]()->bool {
+      send_requested_ = false;
+      Send();
+      return true;
+    });
   }
 }
 
 
+bool FunapiHttpTransport::NeedsUpdate() {
+  return !send_queue_->Empty();
+}
+
+
 void FunapiHttpTransport::SetSequenceNumberValidation(const bool validation) {
   sequence_number_validation_ = validation;
 }
@@ -3185,6 +5353,11 @@ void FunapiHttpTransport::SetCACertFilePath(const fun::string &path) {
 }
 
 
+void FunapiHttpTransport::SetMaxInflightRequests(const int max_requests) {
+  max_inflight_requests_ = std::max(1, max_requests);
+}
+
+
 ////////////////////////////////////////////////////////////////////////////////
 // FunapiWebsocketTransport implementation.
 
@@ -3202,10 +5375,15 @@ class FunapiWebsocketTransport : public FunapiTransport {
 
   void Start();
 
-  void Update();
-
   void Send(bool send_all = false);
 
+  // Negotiates permessage-deflate with the server. It is used when the
+  // deflate compression is set in the transport option.
+  void SetUsePerMessageDeflate(const bool use_deflate);
+
+  // Encodes the queued messages into one frame instead of one per frame.
+  void SetUseMessageBatching(const bool use_batching);
+
  protected:
   bool EncodeThenSendMessage(std::shared_ptr<FunapiMessage> message,
                              fun::vector<uint8_t> &body,
@@ -3214,11 +5392,17 @@ class FunapiWebsocketTransport : public FunapiTransport {
                        bool user_did = false);
 
  private:
+  // With message batching, the messages encoded in one send cycle are sent
+  // in one frame, up to this size.
+  static const size_t kMaxSendBufferSize = 65536;
+
   fun::vector<uint8_t> receiving_vector_;
+  fun::vector<uint8_t> send_buffer_;
   bool use_wss_ = false;
+  bool use_deflate_ = false;
+  bool use_batching_ = false;
 
   std::shared_ptr<FunapiWebsocket> websocket_ = nullptr;
-  std::shared_ptr<FunapiThread> websocket_thread_ = nullptr;
 };
 
 
@@ -3230,7 +5414,6 @@ FunapiWebsocketTransport::FunapiWebsocketTransport(std::weak_ptr<FunapiSessionIm
 #else
 : FunapiTransport(session, TransportProtocol::kDefault, hostname_or_ip, port, encoding) {
 #endif
-  websocket_thread_ = FunapiThread::Get("_websocket");
 }
 
 
@@ -3262,123 +5445,142 @@ void FunapiWebsocketTransport::Start() {
     return;
 
   SetState(TransportState::kConnecting);
+  compression_->ResetStream();
 
-  if (websocket_thread_) {
-    std::weak_ptr<FunapiTransport> weak = shared_from_this();
-    websocket_thread_->Push([weak, this]()->bool {
+  // The connection is serviced by FunapiSocket::Poll on the network thread.
+  std::weak_ptr<FunapiTransport> weak = shared_from_this();
+  PushNetworkThreadTask([weak, this]()->bool {
+    websocket_ = FunapiWebsocket::Create();
+    websocket_->SetUsePerMessageDeflate(use_deflate_);
+    websocket_->Connect
+    (hostname_or_ip_.c_str(),
+     port_,
+     false,
+     "",
+     [weak, this]
+     (const bool is_failed,
+      const int error_code,
+      const fun::string &error_string)
+    {
       if (auto t = weak.lock()) {
-        websocket_ = FunapiWebsocket::Create();
-        websocket_->Connect
-        (hostname_or_ip_.c_str(),
-         port_,
-         false,
-         "",
-         [weak, this]
-         (const bool is_failed,
-          const int error_code,
-          const fun::string &error_string)
-        {
-          if (auto t2 = weak.lock()) {
-            if (is_failed) {
-              SetState(fun::TransportState::kDisconnected);
-              OnTransportConnectFailed(GetProtocol(),
-                                       FunapiError::Create(FunapiError::ErrorType::kWebsocket, error_code, error_string));
-            }
-            else {
-              SetState(TransportState::kConnected);
-              OnTransportStarted(GetProtocol());
-            }
-          }
-        },
-         [weak, this]
-         (const int error_code,
-          const fun::string &error_string)
-        {
-          // close
-          if (auto t2 = weak.lock()) {
-            SetState(fun::TransportState::kDisconnecting);
-            if (send_queue_->Empty()) {
-              OnDisconnecting(FunapiError::Create(FunapiError::ErrorType::kWebsocket, error_code, error_string));
-            }
-          }
-        },
-         [weak, this]()
-        {
-          // send
-          if (auto t2 = weak.lock()) {
-            Send();
-          }
-        },
-         [weak, this]
-         (const int read_length,
-          fun::vector<uint8_t> &receiving)
-        {
-          if (auto t2 = weak.lock()) {
-            receiving_vector_.insert(receiving_vector_.end(), receiving.cbegin(), receiving.cbegin() + read_length);
-            DecodeMessage(read_length, receiving_vector_, next_decoding_offset_, header_decoded_, header_fields_);
-          }
-        });
+        if (is_failed) {
+          SetState(fun::TransportState::kDisconnected);
+          OnTransportConnectFailed(GetProtocol(),
+                                   FunapiError::Create(FunapiError::ErrorType::kWebsocket, error_code, error_string));
+        }
+        else {
+          SetState(TransportState::kConnected);
+          OnTransportStarted(GetProtocol());
+        }
+      }
+    },
+     [weak, this]
+     (const int error_code,
+      const fun::string &error_string)
+    {
+      // close
+      if (auto t = weak.lock()) {
+        SetState(fun::TransportState::kDisconnecting);
+        if (send_queue_->Empty()) {
+          OnDisconnecting(FunapiError::Create(FunapiError::ErrorType::kWebsocket, error_code, error_string));
+        }
+      }
+    },
+     [weak, this]()
+    {
+      // send
+      if (auto t = weak.lock()) {
+        Send();
+      }
+    },
+     [weak, this]
+     (const int read_length,
+      fun::vector<uint8_t> &receiving)
+    {
+      if (auto t = weak.lock()) {
+        receiving_vector_.insert(receiving_vector_.end(), receiving.cbegin(), receiving.cbegin() + read_length);
+        DecodeMessage(read_length, receiving_vector_, next_decoding_offset_, header_decoded_, header_fields_);
       }
-
-      return true;
     });
-  }
+
+    return true;
+  });
+}
+
+
+void FunapiWebsocketTransport::SetUsePerMessageDeflate(const bool use_deflate) {
+  use_deflate_ = use_deflate;
+}
+
+
+void FunapiWebsocketTransport::SetUseMessageBatching(const bool use_batching) {
+  use_batching_ = use_batching;
 }
 
 
 void FunapiWebsocketTransport::OnDisconnecting(std::shared_ptr<FunapiError> error,
                                                bool user_did)
 {
+  // Closes the connection. The close handler is not called.
+  websocket_ = nullptr;
+
   FunapiTransport::OnDisconnecting(error, user_did);
 }
 
 
+// Called when the previous frame is sent. A frame carries one message.
+// With message batching, the queued messages are encoded into one frame,
+// like the TCP transport does into one write.
 void FunapiWebsocketTransport::Send(bool send_all) {
+  send_buffer_.resize(0);
   std::shared_ptr<FunapiMessage> msg;
 
   if (!send_handshake_queue_->Empty()) {
-    msg = send_handshake_queue_->Front();
+    while (!send_handshake_queue_->Empty()) {
+      msg = send_handshake_queue_->Front();
+      if (!FunapiTransport::EncodeThenSendMessage(msg)) {
+        break;
+      }
 
-    if (FunapiTransport::EncodeThenSendMessage(msg)) {
       send_handshake_queue_->PopFront();
-    }
-  }
-  else {
-    if (GetSessionId().empty()) {
-      return;
-    }
 
-    if (send_queue_->Empty()) {
-      return;
-    }
-    else {
-      msg = send_queue_->Front();
-      if (FunapiTransport::EncodeThenSendMessage(msg)) {
-        send_queue_->PopFront();
+      if (!use_batching_) {
+        if (!send_handshake_queue_->Empty()) {
+          FunapiSendFlagManager::Get().WakeUp();
+        }
+        break;
       }
     }
   }
+  else if (!GetSessionId().empty()) {
+    size_t send_count = 0;
 
-  if (GetState() == TransportState::kDisconnecting && send_queue_->Empty()) {
-    OnDisconnecting();
-  }
-}
-
+    while (!send_queue_->Empty()) {
+      msg = send_queue_->Front();
+      if (!FunapiTransport::EncodeThenSendMessage(msg)) {
+        break;
+      }
 
-bool FunapiWebsocketTransport::EncodeThenSendMessage(std::shared_ptr<FunapiMessage> message,
-                                                     fun::vector<uint8_t> &body,
-                                                     const EncryptionType encryption_type) {
-  if (GetState() == TransportState::kDisconnected) return false;
+      send_queue_->PopFront();
 
-  if (!EncodeMessage(message, body, encryption_type)) {
-    return false;
+      ++send_count;
+      if (!use_batching_ ||
+          (send_count >= kMaxSend && send_all == false) ||
+          send_buffer_.size() >= kMaxSendBufferSize) {
+        // The rest are sent in the next send cycle.
+        if (!send_queue_->Empty()) {
+          FunapiSendFlagManager::Get().WakeUp();
+        }
+        break;
+      }
+    }
   }
 
-  if (!body.empty()) {
+  if (!send_buffer_.empty() && websocket_) {
     bool is_protobuf = GetEncoding() == FunEncoding::kProtobuf ? true : false;
 
     std::weak_ptr<FunapiTransport> weak = shared_from_this();
-    websocket_->Send(body, is_protobuf,
+    websocket_->Send(send_buffer_, is_protobuf,
                      [weak, this]
                      (const bool is_failed,
                       const int error_code,
@@ -3395,21 +5597,23 @@ bool FunapiWebsocketTransport::EncodeThenSendMessage(std::shared_ptr<FunapiMessa
     });
   }
 
-  return true;
+  if (GetState() == TransportState::kDisconnecting && send_queue_->Empty()) {
+    OnDisconnecting();
+  }
 }
 
 
-void FunapiWebsocketTransport::Update() {
-  if (websocket_ && websocket_thread_) {
-    std::weak_ptr<FunapiTransport> weak = shared_from_this();
-    websocket_thread_->Push([weak, this]()->bool {
-      if (auto t = weak.lock()) {
-        websocket_->Update();
-      }
+bool FunapiWebsocketTransport::EncodeThenSendMessage(std::shared_ptr<FunapiMessage> message,
+                                                     fun::vector<uint8_t> &body,
+                                                     const EncryptionType encryption_type) {
+  if (GetState() == TransportState::kDisconnected) return false;
 
-      return true;
-    });
+  if (!EncodeMessage(message, body, encryption_type)) {
+    return false;
   }
+
+  send_buffer_.insert(send_buffer_.end(), body.cbegin(), body.cend());
+  return true;
 }
 
 
@@ -3418,6 +5622,8 @@ void FunapiWebsocketTransport::Update() {
 
 fun::vector<std::weak_ptr<FunapiSessionImpl>> FunapiSessionImpl::vec_sessions_;
 std::mutex FunapiSessionImpl::vec_sessions_mutex_;
+fun::vector<std::weak_ptr<FunapiSessionImpl>> FunapiSessionImpl::ready_sessions_;
+std::mutex FunapiSessionImpl::ready_sessions_mutex_;
 
 
 fun::vector<std::shared_ptr<FunapiSessionImpl>> FunapiSessionImpl::GetSessionImpls() {
@@ -3442,8 +5648,43 @@ fun::vector<std::shared_ptr<FunapiSessionImpl>> FunapiSessionImpl::GetSessionImp
 
 
 void FunapiSessionImpl::Add(std::shared_ptr<FunapiSessionImpl> s) {
-  std::unique_lock<std::mutex> lock(vec_sessions_mutex_);
-  vec_sessions_.push_back(s);
+  {
+    std::unique_lock<std::mutex> lock(vec_sessions_mutex_);
+    vec_sessions_.push_back(s);
+  }
+
+  s->weak_self_ = s;
+  s->MarkReady();
+}
+
+
+std::shared_ptr<FunapiTimerWheel> FunapiSessionImpl::GetTimerWheel() {
+  static std::shared_ptr<FunapiTimerWheel> wheel = FunapiTimerWheel::Create();
+  return wheel;
+}
+
+
+void FunapiSessionImpl::MarkReady() {
+  if (weak_self_.expired() || ready_.exchange(true))
+    return;
+
+  std::unique_lock<std::mutex> lock(ready_sessions_mutex_);
+  ready_sessions_.push_back(weak_self_);
+}
+
+
+bool FunapiSessionImpl::NeedsUpdate() {
+  if (tasks_ && tasks_->Size() > 0)
+    return true;
+
+  for (auto p : v_protocols_) {
+    if (auto t = GetTransport(p)) {
+      if (t->NeedsUpdate())
+        return true;
+    }
+  }
+
+  return false;
 }
 
 
@@ -3484,58 +5725,60 @@ void FunapiSessionImpl::Initialize()
 
     // Installs event handlers.
     // session
-    message_handlers_[kSessionOpenedMessageType] =
+    RegisterHandler(kSessionOpenedMessageType,
     [this](const TransportProtocol &p,
            const fun::string &s,
            const fun::vector<uint8_t> &v,
            const std::shared_ptr<FunapiMessage> m)
     {
         OnSessionOpen(p, s, v, m);
-    };
-    message_handlers_[kSessionClosedMessageType] =
+    });
+    RegisterHandler(kSessionClosedMessageType,
     [this](const TransportProtocol &p,
            const fun::string &s,
            const fun::vector<uint8_t> &v,
            const std::shared_ptr<FunapiMessage> m)
     {
         OnSessionClose(p, s, v, m);
-    };
+    });
 
     // ping
-    message_handlers_[kServerPingMessageType] =
+    RegisterHandler(kServerPingMessageType,
     [this](const TransportProtocol &p,
            const fun::string &s,
            const fun::vector<uint8_t> &v,
            const std::shared_ptr<FunapiMessage> m)
     {
         OnServerPingMessage(p, s, v, m);
-    };
-    message_handlers_[kClientPingMessageType] =
+    });
+    RegisterHandler(kClientPingMessageType,
     [this](const TransportProtocol &p,
            const fun::string &s,
            const fun::vector<uint8_t> &v,
            const std::shared_ptr<FunapiMessage> m)
     {
         OnClientPingMessage(p, s, v, m);
-    };
+    });
 
     // redirect
-    message_handlers_[kRedirectMessageType] =
+    // The pings share one extension for both directions, so only the
+    // redirect message is known by its msgtype2 (the extension number).
+    RegisterHandler(kRedirectMessageType,
     [this](const TransportProtocol &p,
            const fun::string &s,
            const fun::vector<uint8_t> &v,
            const std::shared_ptr<FunapiMessage> m)
     {
         OnRedirectMessage(p, s, v, m);
-    };
-    message_handlers_[kRedirectConnectMessageType] =
+    }, kScRedirectFieldNumber);
+    RegisterHandler(kRedirectConnectMessageType,
     [this](const TransportProtocol &p,
            const fun::string &s,
            const fun::vector<uint8_t> &v,
            const std::shared_ptr<FunapiMessage> m)
     {
         OnRedirectConnectMessage(p, s, v, m);
-    };
+    });
 
     tasks_ = FunapiTasks::Create();
 
@@ -3597,6 +5840,7 @@ void FunapiSessionImpl::Connect(const std::weak_ptr<FunapiSession>& session, con
         tcp_transport->SetConnectTimeout(tcp_option_->GetConnectTimeout());
         tcp_transport->SetSequenceNumberValidation(tcp_option_->GetSequenceNumberValidation());
         tcp_transport->SetUseTLS(tcp_option_->GetUseTLS());
+        tcp_transport->SetUseTLSSessionResumption(tcp_option_->GetUseTLSSessionResumption());
         tcp_transport->SetCACertFilePath(tcp_option_->GetCACertFilePath());
         auto encryption_types = tcp_option_->GetEncryptionTypes();
         for (auto type : encryption_types) {
@@ -3609,6 +5853,7 @@ void FunapiSessionImpl::Connect(const std::weak_ptr<FunapiSession>& session, con
 
 #if FUNAPI_HAVE_ZSTD
         tcp_transport->SetZstdDictBase64String(tcp_option_->GetZstdDictBase64String());
+        tcp_transport->SetUseZstdStream(tcp_option_->GetUseZstdStream());
 #endif
       }
     }
@@ -3631,6 +5876,13 @@ void FunapiSessionImpl::Connect(const std::weak_ptr<FunapiSession>& session, con
 #if FUNAPI_HAVE_ZSTD
         udp_transport->SetZstdDictBase64String(udp_option_->GetZstdDictBase64String());
 #endif
+
+        udp_transport->SetSegmentOffload(udp_option_->GetSegmentOffload());
+        udp_transport->SetEnablePing(udp_option_->GetEnablePing());
+
+        for (const auto &iter : udp_option_->GetChannels()) {
+          udp_transport->AddChannel(iter.first, iter.second);
+        }
       }
     }
     else if (protocol == fun::TransportProtocol::kHttp) {
@@ -3649,6 +5901,7 @@ void FunapiSessionImpl::Connect(const std::weak_ptr<FunapiSession>& session, con
         http_transport->SetEncryptionType(http_option_->GetEncryptionType());
         http_transport->SetCACertFilePath(http_option_->GetCACertFilePath());
         http_transport->SetConnectTimeout(http_option_->GetConnectTimeout());
+        http_transport->SetMaxInflightRequests(http_option_->GetMaxInflightRequests());
 
         auto compression_types = http_option_->GetCompressionTypes();
         for (auto type : compression_types) {
@@ -3673,18 +5926,34 @@ void FunapiSessionImpl::Connect(const std::weak_ptr<FunapiSession>& session, con
         websocket_option_ = std::static_pointer_cast<FunapiWebsocketTransportOption>(option);
         auto websocket_transport = std::static_pointer_cast<FunapiWebsocketTransport>(transport);
 
+        // permessage-deflate takes the place of the message level deflate.
+        const bool use_per_message_deflate = websocket_option_->GetUsePerMessageDeflate();
+        websocket_transport->SetUsePerMessageDeflate(use_per_message_deflate);
+        websocket_transport->SetUseMessageBatching(websocket_option_->GetUseMessageBatching());
+
         auto compression_types = websocket_option_->GetCompressionTypes();
         for (auto type : compression_types) {
+#if FUNAPI_HAVE_ZLIB
+          if (use_per_message_deflate && type == CompressionType::kDeflate) {
+            continue;
+          }
+#endif
           websocket_transport->SetCompressionType(type);
         }
 
 #if FUNAPI_HAVE_ZSTD
         websocket_transport->SetZstdDictBase64String(websocket_option_->GetZstdDictBase64String());
+        websocket_transport->SetUseZstdStream(websocket_option_->GetUseZstdStream());
 #endif
       }
     }
 #endif
 
+    transport->SetJsonInsituParsing(session_option_->GetJsonInsituParsing());
+    transport->SetRetransmitQueueLimit(session_option_->GetRetransmitQueueMaxMessages(),
+                                       session_option_->GetRetransmitQueueMaxBytes(),
+                                       session_option_->GetRetransmitOverflowPolicy());
+
     AttachTransport(transport);
 
     PushTaskQueue([this]()->bool {
@@ -3737,9 +6006,15 @@ void FunapiSessionImpl::Connect(const TransportProtocol protocol) {
 
 
 void FunapiSessionImpl::RegisterHandler(const fun::string &msg_type,
-                                        const MessageEventHandler &handler) {
+                                        const MessageEventHandler &handler,
+                                        const int32_t msg_type2) {
   // DebugUtils::Log("New handler for message type %s", msg_type.c_str());
-  message_handlers_[msg_type] = handler;
+  auto id = message_types_.Intern(msg_type);
+  message_types_.Alias(id, msg_type2);
+  if (message_handlers_.size() <= id)
+    message_handlers_.resize(id + 1);
+
+  message_handlers_[id] = handler;
 }
 
 
@@ -3768,6 +6043,10 @@ void FunapiSessionImpl::Start() {
 
 
 void FunapiSessionImpl::OnClose() {
+  if (auto preconnect = GetPreconnectSession()) {
+    CancelPreconnect(preconnect, protocol_redirect_, nullptr);
+  }
+
   for (auto protocol : v_protocols_) {
     OnClose(protocol);
   }
@@ -3863,17 +6142,18 @@ void FunapiSessionImpl::SendMessage(const fun::string &msg_type,
                                     const fun::string &json_string,
                                     const TransportProtocol protocol,
                                     const EncryptionType encryption_type) {
-  rapidjson::Document body;
-  body.Parse<0>(json_string.c_str());
+  // Parses into the pooled document directly instead of copying it.
+  auto message = FunapiMessage::Create(FunEncoding::kJson, encryption_type);
+  auto body = message->GetJsonDocumenet();
+  body->Parse<0>(json_string.c_str());
 
   // Encodes a messsage type.
   if (msg_type.length() > 0) {
     rapidjson::Value msg_type_node;
-    msg_type_node.SetString(rapidjson::StringRef(msg_type.c_str()), body.GetAllocator());
-    body.AddMember(rapidjson::StringRef(kMessageTypeAttributeName), msg_type_node, body.GetAllocator());
+    msg_type_node.SetString(rapidjson::StringRef(msg_type.c_str()), body->GetAllocator());
+    body->AddMember(rapidjson::StringRef(kMessageTypeAttributeName), msg_type_node, body->GetAllocator());
   }
 
-  auto message = FunapiMessage::Create(body, encryption_type);
   message->SetUseSeq(true);
   message->SetUseSentQueue(IsReliableSession());
 
@@ -3892,11 +6172,55 @@ void FunapiSessionImpl::SendMessage(const FunMessage& temp_message,
 }
 
 
+void FunapiSessionImpl::SendChannelMessage(const int channel,
+                                           const fun::string &msg_type,
+                                           const fun::string &json_string,
+                                           const EncryptionType encryption_type) {
+  auto message = FunapiMessage::Create(FunEncoding::kJson, encryption_type);
+  auto body = message->GetJsonDocumenet();
+  body->Parse<0>(json_string.c_str());
+
+  if (msg_type.length() > 0) {
+    rapidjson::Value msg_type_node;
+    msg_type_node.SetString(rapidjson::StringRef(msg_type.c_str()), body->GetAllocator());
+    body->AddMember(rapidjson::StringRef(kMessageTypeAttributeName), msg_type_node, body->GetAllocator());
+  }
+
+  message->SetUseSeq(true);
+  message->SetChannel(channel);
+
+  SendMessage(message, TransportProtocol::kUdp);
+}
+
+
+void FunapiSessionImpl::SendChannelMessage(const int channel,
+                                           const FunMessage& temp_message,
+                                           const EncryptionType encryption_type) {
+  auto message = FunapiMessage::Create(temp_message, encryption_type);
+  message->SetUseSeq(true);
+  message->SetChannel(channel);
+
+  SendMessage(message, TransportProtocol::kUdp);
+}
+
+
 bool FunapiSessionImpl::IsRedirecting() const {
   return (funapi_message_redirect_ != nullptr);
 }
 
 
+bool FunapiSessionImpl::HasJsonValueRecvCallback() {
+  // Messages to a pre-connecting session go to the session being redirected.
+  if (IsRedirecting()) {
+    if (auto parent = redirect_parent_.lock()) {
+      return !parent->on_json_value_recv_.empty();
+    }
+  }
+
+  return !on_json_value_recv_.empty();
+}
+
+
 bool FunapiSessionImpl::UseRedirectQueue() const
 {
     return session_option_->GetUseRedirectQueue();
@@ -3931,17 +6255,21 @@ void FunapiSessionImpl::OnTransportReceived(const TransportProtocol protocol,
                                             const HeaderFields &header,
                                             const fun::vector<uint8_t> &body,
                                             const std::shared_ptr<FunapiMessage> message) {
-  fun::string msg_type;
+  // Points into the message. A string is made only when it is needed.
+  const char *msg_type_data = "";
+  size_t msg_type_length = 0;
   fun::string session_id;
   int32_t msg_type2 = 0;
 
   if (encoding == FunEncoding::kJson) {
     auto json = message->GetJsonDocumenet();
 
-    if (json->HasMember(kMessageTypeAttributeName)) {
-      const rapidjson::Value &msg_type_node = (*json)[kMessageTypeAttributeName];
+    auto msg_type_iter = json->FindMember(kMessageTypeAttributeName);
+    if (msg_type_iter != json->MemberEnd()) {
+      const rapidjson::Value &msg_type_node = msg_type_iter->value;
       assert(msg_type_node.IsString());
-      msg_type = msg_type_node.GetString();
+      msg_type_data = msg_type_node.GetString();
+      msg_type_length = msg_type_node.GetStringLength();
     }
 
     if (json->HasMember(kSessionIdAttributeName)) {
@@ -3953,7 +6281,8 @@ void FunapiSessionImpl::OnTransportReceived(const TransportProtocol protocol,
     auto proto = message->GetProtobufMessage();
 
     if (proto->has_msgtype()) {
-      msg_type = proto->msgtype();
+      msg_type_data = proto->msgtype().data();
+      msg_type_length = proto->msgtype().length();
     }
 
     if (proto->has_sid()) {
@@ -3993,6 +6322,20 @@ void FunapiSessionImpl::OnTransportReceived(const TransportProtocol protocol,
   }
 #endif
 
+  {
+    std::unique_lock<std::mutex> lock(recv_capture_handler_mutex_);
+    if (recv_capture_handler_) {
+      if (auto s = session_.lock()) {
+        // NOTE: 수신한 body 의 마지막에는 파싱을 위해 '\0' 이 붙어 있습니다.
+        fun::vector<uint8_t> captured(body.cbegin(), body.cend());
+        if (!captured.empty() && captured.back() == '\0') {
+          captured.pop_back();
+        }
+        recv_capture_handler_(s, protocol, encoding, captured);
+      }
+    }
+  }
+
   if (session_id.length() > 0) {
     if (protocol == TransportProtocol::kUdp) {
       if (auto t = GetTransport(TransportProtocol::kUdp)) {
@@ -4028,28 +6371,54 @@ void FunapiSessionImpl::OnTransportReceived(const TransportProtocol protocol,
   }
 
   if (session_option_->GetSessionReliability()) {
-    if (msg_type.empty() && 0 == msg_type2)
+    if (0 == msg_type_length && 0 == msg_type2)
       return;
   }
 
-  if (!msg_type.empty()) {
-    EraseRecvTimeout(msg_type);
+  // Messages to a pre-connecting session go to the callbacks of the
+  // session being redirected.
+  FunapiSessionImpl *receiver = this;
+  std::shared_ptr<FunapiSessionImpl> parent;
+  if (IsRedirecting()) {
+    if ((parent = redirect_parent_.lock())) {
+      receiver = parent.get();
+    }
+    else if (GetPreconnectSession()) {
+      redirect_last_received_time_ = FunapiTimerWheel::NowMillisecond();
+    }
   }
-  else if (msg_type2 != 0) {
-    EraseRecvTimeout(msg_type2);
+
+  // Skips the lock and the string key while no receive timeout is set.
+  if (receiver->recv_timeout_count_.load(std::memory_order_acquire) > 0) {
+    if (msg_type_length > 0) {
+      receiver->EraseRecvTimeout(fun::string(msg_type_data, msg_type_length));
+    }
+    else if (msg_type2 != 0) {
+      receiver->EraseRecvTimeout(msg_type2);
+    }
   }
 
-  MessageHandlerMap::iterator it = message_handlers_.find(msg_type);
-  if (it != message_handlers_.end()) {
-    it->second(protocol, msg_type, body, message);
+  // A protobuf message without msgtype is known by its msgtype2.
+  auto type_id = (msg_type_length > 0 || msg_type2 == 0)
+                 ? message_types_.Find(msg_type_data, msg_type_length)
+                 : message_types_.Find(msg_type2);
+  if (type_id < message_handlers_.size() && message_handlers_[type_id]) {
+    message_handlers_[type_id](protocol, message_types_.GetName(type_id), body, message);
     return;
   }
 
   if (encoding == FunEncoding::kJson) {
-    OnJsonRecv(protocol, msg_type, fun::string(body.begin(), body.end()));
+    if (!receiver->on_json_value_recv_.empty()) {
+      receiver->OnJsonValueRecv(protocol, message);
+    }
+
+    // The string copy is made only for the string handlers.
+    if (!receiver->on_json_recv_.empty()) {
+      receiver->OnJsonRecv(protocol, fun::string(msg_type_data, msg_type_length), fun::string(body.begin(), body.end()));
+    }
   }
   else if (encoding == FunEncoding::kProtobuf) {
-    OnProtobufRecv(protocol, *(message->GetProtobufMessage()));
+    receiver->OnProtobufRecv(protocol, *(message->GetProtobufMessage()));
   }
 }
 
@@ -4144,20 +6513,34 @@ void FunapiSessionImpl::OnClientPingMessage(const TransportProtocol protocol,
     timestamp_ms = ping_message.timestamp();
   }
 
-  auto now =
-      std::chrono::duration_cast<std::chrono::milliseconds>(
-          std::chrono::system_clock::now().time_since_epoch()
-      ).count();
+  auto transport = GetTransport(protocol);
+  if (transport == nullptr)
+    return;
+
+  int64_t now = FunapiTimerWheel::NowMillisecond();
+  if (!transport->GetRttEstimator().OnPingReceived(timestamp_ms, now))
+    return;
 
   ping_time_ms = now - timestamp_ms;
 
   // DebugUtils::Log("Receive %s ping - timestamp:%lld time=%lld ms", "Tcp", timestamp_ms, ping_time_ms);
+
+  if (!on_rtt_stats_.empty()) {
+    FunapiRttStats stats = transport->GetRttEstimator().GetStats();
+    PushTaskQueue([this, protocol, stats]()->bool {
+      if (auto s = session_.lock()) {
+        on_rtt_stats_(s, protocol, stats);
+      }
+      return true;
+    });
+  }
 }
 
 
 void FunapiSessionImpl::CheckRedirect()
 {
-    if (IsRedirecting())
+    // A pre-connecting redirect does not wait for the current transports.
+    if (IsRedirecting() && redirect_parent_.expired() && !GetPreconnectSession())
     {
         for (auto p : v_protocols_)
         {
@@ -4177,7 +6560,8 @@ void FunapiSessionImpl::CheckRedirect()
 }
 
 
-void FunapiSessionImpl::OnRedirect()
+void FunapiSessionImpl::ParseRedirectMessage(fun::string &flavor,
+                                             fun::vector<RedirectServerPortInfo> &server_ports_info)
 {
     assert(funapi_message_redirect_);
     std::shared_ptr<FunapiMessage> message = funapi_message_redirect_;
@@ -4185,9 +6569,6 @@ void FunapiSessionImpl::OnRedirect()
     fun::FunEncoding encoding = message->GetEncoding();
     assert(encoding!=FunEncoding::kNone);
 
-    fun::string flavor;
-    fun::vector<RedirectServerPortInfo> server_ports_info;
-
     redirect_cur_tags_.clear();
     redirect_target_tags_.clear();
     redirect_encodings_.clear();
@@ -4324,21 +6705,13 @@ void FunapiSessionImpl::OnRedirect()
           redirect_target_tags_.push_back(redirect_message->target_tags(i));
         }
     }
+}
 
-    fun::string old_session_id = GetSessionId(FunEncoding::kJson);
-
-    // NOTE(sungjin) : 이전 서버와 통신에 사용되었지만 남아있는
-    // transports, send_queues, tasks, session_id_를 제거 하고 재생성 합니다.
-    ResetSession();
-
-    if (session_option_handler_) {
-      auto new_session_option = session_option_handler_(flavor);
-      // 옵션의 재설정이 필요없다면 nullptr 이다.
-      if (new_session_option) {
-        session_option_ = new_session_option;
-      }
-    }
 
+void FunapiSessionImpl::ConnectRedirectPorts(const std::shared_ptr<FunapiSessionImpl> &target,
+                                             const fun::string &flavor,
+                                             const fun::vector<RedirectServerPortInfo> &server_ports_info)
+{
     fun::vector<std::shared_ptr<FunapiTransportOption>> v_option(FunRedirectMessage_Protocol_Protocol_MAX + 1);
     v_option[FunRedirectMessage_Protocol_PROTO_TCP] = tcp_option_;
     v_option[FunRedirectMessage_Protocol_PROTO_UDP] = udp_option_;
@@ -4400,9 +6773,34 @@ void FunapiSessionImpl::OnRedirect()
 
         redirect_encodings_[connect_protocol] = connect_encoding;
 
-        Connect(session_, connect_protocol, port, connect_encoding, option);
+        target->Connect(session_, connect_protocol, port, connect_encoding, option);
+    }
+}
+
+
+void FunapiSessionImpl::OnRedirect()
+{
+    fun::string flavor;
+    fun::vector<RedirectServerPortInfo> server_ports_info;
+    ParseRedirectMessage(flavor, server_ports_info);
+
+    fun::string old_session_id = GetSessionId(FunEncoding::kJson);
+
+    // NOTE(sungjin) : 이전 서버와 통신에 사용되었지만 남아있는
+    // transports, send_queues, tasks, session_id_를 제거 하고 재생성 합니다.
+    ResetSession();
+
+    if (session_option_handler_) {
+      auto new_session_option = session_option_handler_(flavor);
+      // 옵션의 재설정이 필요없다면 nullptr 이다.
+      if (new_session_option) {
+        session_option_ = new_session_option;
+      }
     }
 
+    ConnectRedirectPorts(shared_from_this(), flavor, server_ports_info);
+    FunapiStats::Add(FunapiStats::Counter::kRedirects, 1);
+
     OnSessionEvent(protocol_redirect_,
                    GetEncoding(protocol_redirect_),
                    SessionEventType::kRedirectStarted,
@@ -4419,98 +6817,362 @@ void FunapiSessionImpl::OnRedirectMessage(const TransportProtocol protocol,
     funapi_message_redirect_ = message;
     protocol_redirect_ = protocol;
 
-    for (auto i : v_protocols_)
+    redirect_started_time_ = FunapiTimerWheel::NowMillisecond();
+    redirect_last_received_time_ = 0;
+
+    if (session_option_->GetUseRedirectPreconnect() && StartPreconnect())
+    {
+        return;
+    }
+
+    for (auto i : v_protocols_)
+    {
+        if (auto transport = GetTransport(i))
+        {
+            transport->SetReceivedRedirectionEvent(true);
+            transport->Stop(true);
+        }
+    }
+}
+
+
+void FunapiSessionImpl::OnRedirectConnectMessage(const TransportProtocol protocol,
+                                                 const fun::string &msg_type,
+                                                 const fun::vector<uint8_t>&v_body,
+                                                 const std::shared_ptr<FunapiMessage> message)
+{
+    fun::FunEncoding encoding = GetEncoding(protocol);
+    assert(encoding!=FunEncoding::kNone);
+
+    FunRedirectConnectMessage_Result result =
+        FunRedirectConnectMessage_Result::FunRedirectConnectMessage_Result_AUTH_FAILED;
+    if (encoding == FunEncoding::kJson)
+    {
+        // log
+        // fun::string temp_string(v_body.begin(), v_body.end());
+        // DebugUtils::Log("json fun::string = %s", temp_string.c_str());
+        // //
+
+        auto document = message->GetJsonDocumenet();
+
+        if (document->HasMember("result"))
+        {
+          result = static_cast<FunRedirectConnectMessage_Result>((*document)["result"].GetInt());
+        }
+    }
+
+    if (encoding == FunEncoding::kProtobuf)
+    {
+        auto msg = message->GetProtobufMessage();
+        FunRedirectConnectMessage* redirect_connect_msg = msg->MutableExtension(_cs_redirect_connect);
+        result = redirect_connect_msg->result();
+    }
+
+    FunapiError::ErrorCode code = FunapiError::ErrorCode::kNone;
+    if (result == FunRedirectConnectMessage_Result_EXPIRED)
+    {
+        code = FunapiError::ErrorCode::kRedirectConnectExpired;
+    }
+    else if (result == FunRedirectConnectMessage_Result_INVALID_TOKEN)
+    {
+        code = FunapiError::ErrorCode::kRedirectConnectInvalidToken;
+    }
+    else if (result == FunRedirectConnectMessage_Result_AUTH_FAILED)
+    {
+        code = FunapiError::ErrorCode::kRedirectConnectAuthFailed;
+    }
+
+    // NOTE: 미리 연결 중인 세션은 결과를 원래 세션에 넘깁니다.
+    if (auto parent = redirect_parent_.lock())
+    {
+        if (result == FunRedirectConnectMessage_Result_OK)
+        {
+            redirect_connect_protocol_ = protocol;
+            redirect_connect_acked_ = true;
+            parent->CheckPreconnect(shared_from_this());
+        }
+        else
+        {
+            parent->CancelPreconnect(shared_from_this(), protocol,
+                                     fun::FunapiError::Create(FunapiError::ErrorType::kRedirect, code));
+        }
+        return;
+    }
+
+    if (result == FunRedirectConnectMessage_Result_OK)
+    {
+        SendUnsentQueueMessages();
+
+        token_ = "";
+        funapi_message_redirect_ = nullptr;
+
+        UpdateRedirectGapTime(false);
+
+        OnSessionEvent(protocol,
+                       GetEncoding(protocol),
+                       SessionEventType::kRedirectSucceeded,
+                       GetSessionId(FunEncoding::kJson),
+                       nullptr /*error*/);
+    }
+    else
+    {
+        token_ = "";
+        funapi_message_redirect_ = nullptr;
+
+        OnSessionEvent(protocol,
+                       GetEncoding(protocol),
+                       SessionEventType::kRedirectFailed,
+                       GetSessionId(FunEncoding::kJson),
+                       fun::FunapiError::Create(FunapiError::ErrorType::kRedirect, code));
+    }
+}
+
+
+bool FunapiSessionImpl::StartPreconnect()
+{
+    fun::string hostname_or_ip = hostname_or_ip_;
+
+    fun::string flavor;
+    fun::vector<RedirectServerPortInfo> server_ports_info;
+    ParseRedirectMessage(flavor, server_ports_info);
+
+    // HTTP transports are updated on the game thread, and neither they nor
+    // WebSocket transports can be moved between sessions.
+    for (auto &info : server_ports_info)
+    {
+        if (info.protocol != FunRedirectMessage_Protocol_PROTO_TCP &&
+            info.protocol != FunRedirectMessage_Protocol_PROTO_UDP)
+        {
+            DebugUtils::Log("Redirect pre-connect supports only TCP and UDP. Reconnects after closing the current transports.");
+            hostname_or_ip_ = hostname_or_ip;
+            return false;
+        }
+    }
+
+    auto option = session_option_;
+    if (session_option_handler_) {
+      if (auto new_session_option = session_option_handler_(flavor)) {
+        option = new_session_option;
+      }
+    }
+
+    auto preconnect = std::make_shared<FunapiSessionImpl>(hostname_or_ip_.c_str(), option);
+    preconnect->weak_self_ = preconnect;
+    preconnect->redirect_parent_ = shared_from_this();
+    preconnect->token_ = token_;
+    preconnect->funapi_message_redirect_ = funapi_message_redirect_;
+
+    {
+      std::unique_lock<std::mutex> lock(preconnect_mutex_);
+      preconnect_session_ = preconnect;
+      preconnect_hostname_or_ip_ = hostname_or_ip;
+    }
+
+    // The current server keeps delivering, but is not reconnected to.
+    for (auto p : v_protocols_)
+    {
+        if (auto transport = GetTransport(p))
+        {
+            transport->SetReceivedRedirectionEvent(true);
+        }
+    }
+
+    ConnectRedirectPorts(preconnect, flavor, server_ports_info);
+    FunapiStats::Add(FunapiStats::Counter::kRedirects, 1);
+
+    OnSessionEvent(protocol_redirect_,
+                   GetEncoding(protocol_redirect_),
+                   SessionEventType::kRedirectStarted,
+                   GetSessionId(FunEncoding::kJson),
+                   nullptr /*error*/);
+
+    return true;
+}
+
+
+std::shared_ptr<FunapiSessionImpl> FunapiSessionImpl::GetPreconnectSession()
+{
+    std::unique_lock<std::mutex> lock(preconnect_mutex_);
+    return preconnect_session_;
+}
+
+
+void FunapiSessionImpl::CheckPreconnect(const std::shared_ptr<FunapiSessionImpl> &preconnect)
+{
+    if (preconnect != GetPreconnectSession() || !preconnect->redirect_connect_acked_)
+    {
+        return;
+    }
+
+    for (auto p : v_protocols_)
+    {
+        if (auto transport = preconnect->GetTransport(p))
+        {
+            if (!transport->IsStarted())
+            {
+                return;
+            }
+        }
+    }
+
+    OnPreconnected(preconnect);
+}
+
+
+void FunapiSessionImpl::OnPreconnected(const std::shared_ptr<FunapiSessionImpl> &preconnect)
+{
+    {
+      std::unique_lock<std::mutex> lock(preconnect_mutex_);
+      if (preconnect_session_ != preconnect)
+          return;
+
+      preconnect_session_ = nullptr;
+    }
+
+    // The transports of the current server stop without reporting to this session.
+    for (auto p : v_protocols_)
+    {
+        if (auto transport = GetTransport(p))
+        {
+            transport->Detach();
+            transport->Stop(true);
+        }
+    }
+
+    fun::vector<std::shared_ptr<FunapiTransport>> transports(transports_.size());
+    for (auto p : v_protocols_)
+    {
+        if (auto transport = preconnect->GetTransport(p))
+        {
+            transport->SetSessionImpl(shared_from_this());
+            transports[static_cast<int>(p)] = transport;
+        }
+    }
+
+    {
+      std::unique_lock<std::mutex> lock(preconnect->transports_mutex_);
+      for (auto &t : preconnect->transports_)
+          t = nullptr;
+    }
+
+    {
+      std::unique_lock<std::mutex> lock(transports_mutex_);
+      transports_.swap(transports);
+    }
+
+    send_queues_ = preconnect->send_queues_;
+    session_id_ = preconnect->session_id_;
+    session_option_ = preconnect->session_option_;
+
+    if (preconnect->tcp_option_)
+        tcp_option_ = preconnect->tcp_option_;
+    if (preconnect->udp_option_)
+        udp_option_ = preconnect->udp_option_;
+
+    // Released on the network thread after the current callback returns.
+    preconnect->redirect_parent_.reset();
+    preconnect->funapi_message_redirect_ = nullptr;
+    PushNetworkThreadTask([preconnect]()->bool
+    {
+        return true;
+    });
+
+    const TransportProtocol protocol = preconnect->redirect_connect_protocol_;
+
+    SendUnsentQueueMessages();
+
+    token_ = "";
+    funapi_message_redirect_ = nullptr;
+
+    UpdateRedirectGapTime(true);
+
+    OnSessionEvent(protocol,
+                   GetEncoding(protocol),
+                   SessionEventType::kRedirectSucceeded,
+                   GetSessionId(FunEncoding::kJson),
+                   nullptr /*error*/);
+}
+
+
+void FunapiSessionImpl::CancelPreconnect(const std::shared_ptr<FunapiSessionImpl> &preconnect,
+                                         const TransportProtocol protocol,
+                                         std::shared_ptr<FunapiError> error)
+{
+    {
+      std::unique_lock<std::mutex> lock(preconnect_mutex_);
+      if (preconnect == nullptr || preconnect_session_ != preconnect)
+          return;
+
+      preconnect_session_ = nullptr;
+      hostname_or_ip_ = preconnect_hostname_or_ip_;
+    }
+
+    preconnect->redirect_parent_.reset();
+    preconnect->funapi_message_redirect_ = nullptr;
+    for (auto p : v_protocols_)
     {
-        if (auto transport = GetTransport(i))
+        if (auto transport = preconnect->GetTransport(p))
         {
             transport->SetReceivedRedirectionEvent(true);
             transport->Stop(true);
         }
     }
-}
-
-
-void FunapiSessionImpl::OnRedirectConnectMessage(const TransportProtocol protocol,
-                                                 const fun::string &msg_type,
-                                                 const fun::vector<uint8_t>&v_body,
-                                                 const std::shared_ptr<FunapiMessage> message)
-{
-    fun::FunEncoding encoding = GetEncoding(protocol);
-    assert(encoding!=FunEncoding::kNone);
 
-    FunRedirectConnectMessage_Result result =
-        FunRedirectConnectMessage_Result::FunRedirectConnectMessage_Result_AUTH_FAILED;
-    if (encoding == FunEncoding::kJson)
+    PushNetworkThreadTask([preconnect]()->bool
     {
-        // log
-        // fun::string temp_string(v_body.begin(), v_body.end());
-        // DebugUtils::Log("json fun::string = %s", temp_string.c_str());
-        // //
-
-        auto document = message->GetJsonDocumenet();
+        return true;
+    });
 
-        if (document->HasMember("result"))
+    // NOTE: 현재 서버와의 연결은 그대로 사용합니다.
+    // 쌓아 둔 메시지도 현재 서버로 보냅니다.
+    for (auto p : v_protocols_)
+    {
+        if (auto transport = GetTransport(p))
         {
-          result = static_cast<FunRedirectConnectMessage_Result>((*document)["result"].GetInt());
+            transport->SetReceivedRedirectionEvent(false);
         }
     }
 
-    if (encoding == FunEncoding::kProtobuf)
+    SendUnsentQueueMessages();
+
+    token_ = "";
+    funapi_message_redirect_ = nullptr;
+
+    if (error == nullptr)
     {
-        auto msg = message->GetProtobufMessage();
-        FunRedirectConnectMessage* redirect_connect_msg = msg->MutableExtension(_cs_redirect_connect);
-        result = redirect_connect_msg->result();
+        error = FunapiError::Create(FunapiError::ErrorType::kRedirect, FunapiError::ErrorCode::kNone);
     }
 
-    if (result == FunRedirectConnectMessage_Result_OK)
-    {
-        SendUnsentQueueMessages();
+    OnSessionEvent(protocol,
+                   GetEncoding(protocol),
+                   SessionEventType::kRedirectFailed,
+                   GetSessionId(FunEncoding::kJson),
+                   error);
+}
 
-        token_ = "";
-        funapi_message_redirect_ = nullptr;
 
-        OnSessionEvent(protocol,
-                       GetEncoding(protocol),
-                       SessionEventType::kRedirectSucceeded,
-                       GetSessionId(FunEncoding::kJson),
-                       nullptr /*error*/);
-    }
-    else
-    {
-        token_ = "";
-        funapi_message_redirect_ = nullptr;
+void FunapiSessionImpl::UpdateRedirectGapTime(const bool preconnected)
+{
+    int64_t from = std::max(redirect_started_time_, redirect_last_received_time_.load());
+    redirect_gap_time_ = FunapiTimerWheel::NowMillisecond() - from;
 
-        FunapiError::ErrorCode code = FunapiError::ErrorCode::kNone;
-        if (result == FunRedirectConnectMessage_Result_EXPIRED)
-        {
-            code = FunapiError::ErrorCode::kRedirectConnectExpired;
-        }
-        else if (result == FunRedirectConnectMessage_Result_INVALID_TOKEN)
-        {
-            code = FunapiError::ErrorCode::kRedirectConnectInvalidToken;
-        }
-        else if (result == FunRedirectConnectMessage_Result_AUTH_FAILED)
-        {
-            code = FunapiError::ErrorCode::kRedirectConnectAuthFailed;
-        }
+    DebugUtils::Log("Redirect gap: %lld ms (%s)",
+                    static_cast<long long>(redirect_gap_time_.load()),
+                    preconnected ? "pre-connected" : "reconnected");
+}
 
-        OnSessionEvent(protocol,
-                       GetEncoding(protocol),
-                       SessionEventType::kRedirectFailed,
-                       GetSessionId(FunEncoding::kJson),
-                       fun::FunapiError::Create(FunapiError::ErrorType::kRedirect, code));
-    }
+
+int64_t FunapiSessionImpl::GetRedirectGapTime()
+{
+    return redirect_gap_time_;
 }
 
 
 void FunapiSessionImpl::UpdateTasks() {
   if (tasks_) {
+    tasks_->SetTimeBudgetMicrosecond(session_option_->GetTaskTimeBudgetMicrosecond());
     tasks_->Update();
   }
-
-  if (false == IsRedirecting()) {
-    CheckRecvTimeout();
-  }
 }
 
 
@@ -4528,6 +7190,10 @@ void FunapiSessionImpl::Update() {
 
   UpdateTasks();
   UpdateTrasnports();
+
+  if (auto preconnect = GetPreconnectSession()) {
+    preconnect->Update();
+  }
 }
 
 
@@ -4589,7 +7255,8 @@ void FunapiSessionImpl::SetSessionId(const fun::string &session_id, const FunEnc
 }
 
 
-void FunapiSessionImpl::PushTaskQueue(const std::function<bool()> &task)
+template <typename F>
+void FunapiSessionImpl::PushTaskQueue(const F &task)
 {
   if (tasks_) {
     std::weak_ptr<FunapiSessionImpl> weak = shared_from_this();
@@ -4600,6 +7267,8 @@ void FunapiSessionImpl::PushTaskQueue(const std::function<bool()> &task)
 
       return true;
     });
+
+    MarkReady();
   }
 }
 
@@ -4627,6 +7296,12 @@ void FunapiSessionImpl::AddJsonRecvCallback(const JsonRecvHandler &handler)
   on_json_recv_ += handler;
 }
 
+
+void FunapiSessionImpl::AddJsonValueRecvCallback(const JsonValueRecvHandler &handler)
+{
+  on_json_value_recv_ += handler;
+}
+
 void FunapiSessionImpl::AddRecvTimeoutCallback(const RecvTimeoutHandler &handler)
 {
   on_recv_timeout_ += handler;
@@ -4639,6 +7314,12 @@ void FunapiSessionImpl::AddRecvTimeoutCallback(const RecvTimeoutIntHandler &hand
 }
 
 
+void FunapiSessionImpl::AddRttStatsCallback(const RttStatsHandler &handler)
+{
+  on_rtt_stats_ += handler;
+}
+
+
 void FunapiSessionImpl::SetSessionOptionCallback(const SessionOptionHandler &handler)
 {
   session_option_handler_ = handler;
@@ -4658,6 +7339,13 @@ void FunapiSessionImpl::SetRedirectQueueCallback(const RedirectQueueHandler &han
 }
 
 
+void FunapiSessionImpl::SetRecvCaptureCallback(const RecvCaptureHandler &handler)
+{
+  std::unique_lock<std::mutex> lock(recv_capture_handler_mutex_);
+  recv_capture_handler_ = handler;
+}
+
+
 void FunapiSessionImpl::RemoveSessionEventCallback()
 {
   on_session_event_.clear();
@@ -4682,6 +7370,12 @@ void FunapiSessionImpl::RemoveJsonRecvCallback()
 }
 
 
+void FunapiSessionImpl::RemoveJsonValueRecvCallback()
+{
+  on_json_value_recv_.clear();
+}
+
+
 void FunapiSessionImpl::RemoveRecvTimeoutCallback()
 {
   on_recv_timeout_.clear();
@@ -4694,6 +7388,12 @@ void FunapiSessionImpl::RemoveRecvTimeoutIntCallback()
 }
 
 
+void FunapiSessionImpl::RemoveRttStatsCallback()
+{
+  on_rtt_stats_.clear();
+}
+
+
 void FunapiSessionImpl::RemoveSessionOptionCallback()
 {
   session_option_handler_ = nullptr;
@@ -4713,17 +7413,27 @@ void FunapiSessionImpl::RemoveRedirectQueueCallback()
 }
 
 
+void FunapiSessionImpl::RemoveRecvCaptureCallback()
+{
+  std::unique_lock<std::mutex> lock(recv_capture_handler_mutex_);
+  recv_capture_handler_ = nullptr;
+}
+
+
 void FunapiSessionImpl::RemoveAllCallbacks()
 {
   RemoveSessionEventCallback();
   RemoveTransportEventCallback();
   RemoveProtobufRecvCallback();
   RemoveJsonRecvCallback();
+  RemoveJsonValueRecvCallback();
   RemoveRecvTimeoutCallback();
   RemoveRecvTimeoutIntCallback();
+  RemoveRttStatsCallback();
   RemoveSessionOptionCallback();
   RemoveTransportOptionCallback();
   RemoveRedirectQueueCallback();
+  RemoveRecvCaptureCallback();
 }
 
 
@@ -4747,6 +7457,25 @@ void FunapiSessionImpl::OnJsonRecv(const TransportProtocol protocol, const fun::
 }
 
 
+void FunapiSessionImpl::OnJsonValueRecv(const TransportProtocol protocol,
+                                        const std::shared_ptr<FunapiMessage> &message) {
+  // The message keeps the document and the body alive until the task runs.
+  PushTaskQueue([this, protocol, message]()->bool {
+    if (auto s = session_.lock()) {
+      const auto &body = message->GetReceivedBody();
+      size_t length = body.size();
+      if (length > 0 && body.back() == '\0') {
+        --length;
+      }
+
+      const char *data = reinterpret_cast<const char*>(body.data());
+      on_json_value_recv_(s, protocol, message->GetMsgType(), *message->GetJsonDocumenet(), data, length);
+    }
+    return true;
+  });
+}
+
+
 void FunapiSessionImpl::OnSessionEvent(const TransportProtocol protocol,
                                        const FunEncoding encoding,
                                        const SessionEventType type,
@@ -4824,6 +7553,17 @@ void FunapiSessionImpl::OnTransportEvent(const TransportProtocol protocol,
   }
   // //
 
+  // NOTE: 미리 연결 중인 세션의 이벤트는 사용자에게 보내지 않습니다.
+  if (auto parent = redirect_parent_.lock()) {
+    if (type == TransportEventType::kStarted) {
+      parent->CheckPreconnect(shared_from_this());
+    }
+    else if (type != TransportEventType::kReconnecting) {
+      parent->CancelPreconnect(shared_from_this(), protocol, error);
+    }
+    return;
+  }
+
   if (IsRedirecting() == false ||
       type == TransportEventType::kConnectionFailed ||
       type == TransportEventType::kConnectionTimedOut) {
@@ -4853,6 +7593,7 @@ void FunapiSessionImpl::OnTransportDisconnected(const TransportProtocol protocol
 
 
 void FunapiSessionImpl::OnTransportReconnecting(const TransportProtocol protocol, std::shared_ptr<FunapiError> error) {
+  FunapiStats::Add(FunapiStats::Counter::kReconnects, 1);
   OnTransportEvent(protocol, GetEncoding(protocol), TransportEventType::kReconnecting, error);
 }
 
@@ -4904,6 +7645,46 @@ int64_t FunapiSessionImpl::GetPingTime()
   return ping_time_ms;
 }
 
+
+FunapiRttStats FunapiSessionImpl::GetRttStats(const TransportProtocol protocol)
+{
+  if (auto transport = GetTransport(protocol)) {
+    return transport->GetRttEstimator().GetStats();
+  }
+
+  return FunapiRttStats();
+}
+
+
+bool FunapiSessionImpl::IsTLSSessionResumed()
+{
+  if (auto transport = GetTransport(TransportProtocol::kTcp)) {
+    return std::static_pointer_cast<FunapiTcpTransport>(transport)->IsTLSSessionResumed();
+  }
+
+  return false;
+}
+
+
+int64_t FunapiSessionImpl::GetTLSHandshakeTime()
+{
+  if (auto transport = GetTransport(TransportProtocol::kTcp)) {
+    return std::static_pointer_cast<FunapiTcpTransport>(transport)->GetTLSHandshakeTime();
+  }
+
+  return 0;
+}
+
+
+float FunapiSessionImpl::GetTLSResumptionRate()
+{
+  if (auto transport = GetTransport(TransportProtocol::kTcp)) {
+    return std::static_pointer_cast<FunapiTcpTransport>(transport)->GetTLSResumptionRate();
+  }
+
+  return 0;
+}
+
 void FunapiSessionImpl::SendEmptyMessage(const TransportProtocol protocol,
                                          const EncryptionType encryption_type) {
   std::shared_ptr<FunapiTransport> transport = GetTransport(protocol);
@@ -4911,18 +7692,7 @@ void FunapiSessionImpl::SendEmptyMessage(const TransportProtocol protocol,
 
   assert(encoding!=FunEncoding::kNone);
 
-  std::shared_ptr<FunapiMessage> message;
-
-  if (encoding == FunEncoding::kJson) {
-    rapidjson::Document d;
-    d.SetObject();
-
-    message = FunapiMessage::Create(d, encryption_type);
-  }
-  else if (encoding == FunEncoding::kProtobuf) {
-    FunMessage msg;
-    message = FunapiMessage::Create(msg, encryption_type);
-  }
+  auto message = FunapiMessage::Create(encoding, encryption_type);
 
   message->SetUseSentQueue(false);
   message->SetUseSeq(false);
@@ -4933,18 +7703,20 @@ void FunapiSessionImpl::SendEmptyMessage(const TransportProtocol protocol,
 
 bool FunapiSessionImpl::SendClientPingMessage(const TransportProtocol protocol,
                                               const EncryptionType encryption_type) {
-  assert(protocol==TransportProtocol::kTcp);
+  assert(protocol==TransportProtocol::kTcp || protocol==TransportProtocol::kUdp);
 
   if (GetSessionId(FunEncoding::kJson).empty())
     return false;
 
-  FunEncoding encoding = GetEncoding(protocol);
+  auto transport = GetTransport(protocol);
+  if (transport == nullptr)
+    return false;
+
+  FunEncoding encoding = transport->GetEncoding();
   assert(encoding!=FunEncoding::kNone);
 
-  int64_t timestamp =
-      std::chrono::duration_cast<std::chrono::milliseconds>(
-          std::chrono::system_clock::now().time_since_epoch()
-      ).count();
+  // The server sends the timestamp back as it is, so the monotonic clock is used.
+  int64_t timestamp = FunapiTimerWheel::NowMillisecond();
   // DebugUtils::Log("Send Tcp ping - timestamp: %lld", timestamp);
 
   std::shared_ptr<FunapiMessage> message;
@@ -4977,6 +7749,7 @@ bool FunapiSessionImpl::SendClientPingMessage(const TransportProtocol protocol,
   message->SetUseSentQueue(false);
   message->SetUseSeq(false);
 
+  transport->GetRttEstimator().OnPingSent(timestamp);
   SendMessage(message, protocol);
 
   return true;
@@ -4991,23 +7764,17 @@ void FunapiSessionImpl::SendAck(const TransportProtocol protocol,
 
   // DebugUtils::Log("Tcp send ack message - ack:%d", ack);
 
-  std::shared_ptr<FunapiMessage> message;
+  FunEncoding encoding = transport->GetEncoding();
+  auto message = FunapiMessage::Create(encoding, encryption_type);
 
-  if (transport->GetEncoding() == FunEncoding::kJson) {
-    rapidjson::Document msg;
-    msg.SetObject();
-    rapidjson::Value key(kAckNumAttributeName, msg.GetAllocator());
+  if (encoding == FunEncoding::kJson) {
+    auto msg = message->GetJsonDocumenet();
     rapidjson::Value ack_node(rapidjson::kNumberType);
     ack_node.SetUint(ack);
-    msg.AddMember(key, ack_node, msg.GetAllocator());
-
-    message = FunapiMessage::Create(msg, encryption_type);
+    msg->AddMember(rapidjson::StringRef(kAckNumAttributeName), ack_node, msg->GetAllocator());
   }
-  else if (transport->GetEncoding() == FunEncoding::kProtobuf) {
-    FunMessage msg;
-    msg.set_ack(ack);
-
-    message = FunapiMessage::Create(msg, encryption_type);
+  else if (encoding == FunEncoding::kProtobuf) {
+    message->GetProtobufMessage()->set_ack(ack);
   }
 
   message->SetUseSentQueue(false);
@@ -5062,85 +7829,119 @@ bool FunapiSessionImpl::IsReliableSession() const {
 
 void FunapiSessionImpl::SetRecvTimeout(const fun::string &msg_type, const int seconds) {
   std::unique_lock<std::mutex> lock(m_recv_timeout_mutex_);
-  m_recv_timeout_[msg_type] = std::make_shared<FunapiTimer>(seconds);
+  ScheduleRecvTimeout(msg_type, static_cast<int64_t>(seconds) * 1000);
 }
 
 
 void FunapiSessionImpl::SetRecvTimeout(const int32_t msg_type, const int seconds) {
   std::unique_lock<std::mutex> lock(m_recv_timeout_mutex_);
-  m_recv_timeout_int_[msg_type] = std::make_shared<FunapiTimer>(seconds);
+  ScheduleRecvTimeout(msg_type, static_cast<int64_t>(seconds) * 1000);
 }
 
 
 void FunapiSessionImpl::EraseRecvTimeout(const fun::string &msg_type) {
   std::unique_lock<std::mutex> lock(m_recv_timeout_mutex_);
-  m_recv_timeout_.erase(msg_type);
+  CancelRecvTimeout(msg_type);
 }
 
 
 void FunapiSessionImpl::EraseRecvTimeout(const int32_t msg_type) {
   std::unique_lock<std::mutex> lock(m_recv_timeout_mutex_);
-  m_recv_timeout_int_.erase(msg_type);
+  CancelRecvTimeout(msg_type);
 }
 
 
-void FunapiSessionImpl::CheckRecvTimeout() {
-  fun::vector<fun::string> msg_types;
-  fun::vector<int32_t> msg_types2;
+fun::unordered_map<fun::string, FunapiSessionImpl::RecvTimeoutTimer>&
+FunapiSessionImpl::GetRecvTimeouts(const fun::string &msg_type) {
+  return m_recv_timeout_;
+}
 
-  {
-    std::unique_lock<std::mutex> lock(m_recv_timeout_mutex_);
-    for (auto i : m_recv_timeout_) {
-      if (i.second->IsExpired()) {
-        msg_types.push_back(i.first);
-      }
-    }
 
-    for (auto t : msg_types) {
-      m_recv_timeout_.erase(t);
+fun::unordered_map<int32_t, FunapiSessionImpl::RecvTimeoutTimer>&
+FunapiSessionImpl::GetRecvTimeouts(const int32_t msg_type) {
+  return m_recv_timeout_int_;
+}
+
+
+// Called with m_recv_timeout_mutex_ locked.
+template <typename K>
+void FunapiSessionImpl::ScheduleRecvTimeout(const K &msg_type, const int64_t millisecond) {
+  auto wheel = GetTimerWheel();
+  auto &timer = GetRecvTimeouts(msg_type)[msg_type];
+  wheel->Cancel(timer.id);
+
+  uint64_t serial = ++recv_timeout_serial_;
+  std::weak_ptr<FunapiSessionImpl> weak = weak_self_;
+
+  recv_timeout_count_.store(m_recv_timeout_.size() + m_recv_timeout_int_.size(),
+                            std::memory_order_release);
+
+  timer.serial = serial;
+  timer.id = wheel->Schedule(millisecond, [weak, msg_type, serial]() {
+    // Runs on the network thread. The rest is done on the game thread.
+    if (auto s = weak.lock()) {
+      s->PushTaskQueue([weak, msg_type, serial]()->bool {
+        if (auto s = weak.lock()) {
+          s->OnRecvTimeoutExpired(msg_type, serial);
+        }
+        return true;
+      });
     }
-  }
+  });
+}
+
 
-  for (auto t : msg_types) {
-    OnRecvTimeout(t);
+// Called with m_recv_timeout_mutex_ locked.
+template <typename K>
+void FunapiSessionImpl::CancelRecvTimeout(const K &msg_type) {
+  auto &timers = GetRecvTimeouts(msg_type);
+  auto iter = timers.find(msg_type);
+  if (iter != timers.end()) {
+    GetTimerWheel()->Cancel(iter->second.id);
+    timers.erase(iter);
+    recv_timeout_count_.store(m_recv_timeout_.size() + m_recv_timeout_int_.size(),
+                              std::memory_order_release);
   }
+}
+
 
+template <typename K>
+void FunapiSessionImpl::OnRecvTimeoutExpired(const K &msg_type, const uint64_t serial) {
   {
     std::unique_lock<std::mutex> lock(m_recv_timeout_mutex_);
-    for (auto i : m_recv_timeout_int_) {
-      if (i.second->IsExpired()) {
-        msg_types2.push_back(i.first);
-      }
-    }
+    auto &timers = GetRecvTimeouts(msg_type);
+    auto iter = timers.find(msg_type);
 
-    for (auto t : msg_types2) {
-      m_recv_timeout_int_.erase(t);
+    // Erased or set again after the timer fired.
+    if (iter == timers.end() || iter->second.serial != serial)
+      return;
+
+    // Receive timeouts are not reported while redirecting.
+    if (IsRedirecting()) {
+      ScheduleRecvTimeout(msg_type, kRecvTimeoutRedirectWaitMillisecond);
+      return;
     }
-  }
 
-  for (auto t : msg_types2) {
-    OnRecvTimeout(t);
+    timers.erase(iter);
+    recv_timeout_count_.store(m_recv_timeout_.size() + m_recv_timeout_int_.size(),
+                              std::memory_order_release);
   }
+
+  OnRecvTimeout(msg_type);
 }
 
 
 void FunapiSessionImpl::OnRecvTimeout(const fun::string &msg_type) {
-  PushTaskQueue([this, msg_type]()->bool {
-    if (auto s = session_.lock()) {
-      on_recv_timeout_(s, msg_type);
-    }
-    return true;
-  });
+  if (auto s = session_.lock()) {
+    on_recv_timeout_(s, msg_type);
+  }
 }
 
 
 void FunapiSessionImpl::OnRecvTimeout(const int32_t msg_type) {
-  PushTaskQueue([this, msg_type]()->bool {
-    if (auto s = session_.lock()) {
-      on_recv_timeout_int_(s, msg_type);
-    }
-    return true;
-  });
+  if (auto s = session_.lock()) {
+    on_recv_timeout_int_(s, msg_type);
+  }
 }
 
 
@@ -5155,18 +7956,36 @@ bool FunapiSessionImpl::UseSodium(const TransportProtocol protocol) {
 
 
 void FunapiSessionImpl::UpdateAll() {
-  auto v_sessions = FunapiSessionImpl::GetSessionImpls();
+  // Called only from the game thread. Keeps the capacity between frames.
+  static fun::vector<std::weak_ptr<FunapiSessionImpl>> v_ready;
+  v_ready.clear();
+  {
+    std::unique_lock<std::mutex> lock(ready_sessions_mutex_);
+    if (ready_sessions_.empty())
+      return;
+
+    v_ready.swap(ready_sessions_);
+  }
+
+  for (auto &i : v_ready) {
+    if (auto s = i.lock()) {
+      // Cleared before updating so that work pushed during the update
+      // puts the session on the list again.
+      s->ready_ = false;
 
-  if (!v_sessions.empty()) {
-    for (auto s : v_sessions) {
       s->UpdateTasks();
       s->UpdateTrasnports();
+
+      if (s->NeedsUpdate()) {
+        s->MarkReady();
+      }
     }
   }
 }
 
 
-void FunapiSessionImpl::PushNetworkThreadTask(const FunapiThread::TaskHandler &handler) {
+template <typename F>
+void FunapiSessionImpl::PushNetworkThreadTask(const F &handler) {
   if (network_thread_) {
     network_thread_->Push(handler);
   }
@@ -5282,17 +8101,8 @@ void FunapiSessionImpl::SendUnsentQueueMessages()
 
 void OnSessionTicked()
 {
-  fun::vector<std::shared_ptr<FunapiSessionImpl>> impls =
-      FunapiSessionImpl::GetSessionImpls();
-  for (std::shared_ptr<FunapiSessionImpl> impl : impls)
-  {
-    std::shared_ptr<FunapiTransport> tcp_transport =
-        impl->GetTransport(TransportProtocol::kTcp);
-    if (tcp_transport != nullptr)
-    {
-      tcp_transport->Update();
-    }
-  }
+  // Returns right away when no timer is due.
+  FunapiSessionImpl::GetTimerWheel()->Advance();
 }
 
 
@@ -5365,6 +8175,21 @@ void FunapiSession::SendMessage(const FunMessage& message,
 }
 
 
+void FunapiSession::SendChannelMessage(const int channel,
+                                       const fun::string &msg_type,
+                                       const fun::string &json_string,
+                                       const EncryptionType encryption_type) {
+  impl_->SendChannelMessage(channel, msg_type, json_string, encryption_type);
+}
+
+
+void FunapiSession::SendChannelMessage(const int channel,
+                                       const FunMessage& message,
+                                       const EncryptionType encryption_type) {
+  impl_->SendChannelMessage(channel, message, encryption_type);
+}
+
+
 bool FunapiSession::IsConnected(const TransportProtocol protocol) const {
   return impl_->IsConnected(protocol);
 }
@@ -5404,6 +8229,12 @@ void FunapiSession::AddJsonRecvCallback(const JsonRecvHandler &handler)
 }
 
 
+void FunapiSession::AddJsonValueRecvCallback(const JsonValueRecvHandler &handler)
+{
+  impl_->AddJsonValueRecvCallback(handler);
+}
+
+
 void FunapiSession::SetSessionOptionCallback(const SessionOptionHandler &handler)
 {
   impl_->SetSessionOptionCallback(handler);
@@ -5422,6 +8253,12 @@ void FunapiSession::SetRedirectQueueCallback(const RedirectQueueHandler &handler
 }
 
 
+void FunapiSession::SetRecvCaptureCallback(const RecvCaptureHandler &handler)
+{
+  impl_->SetRecvCaptureCallback(handler);
+}
+
+
 void FunapiSession::RemoveProtobufRecvCallback()
 {
   impl_->RemoveProtobufRecvCallback();
@@ -5434,6 +8271,12 @@ void FunapiSession::RemoveJsonRecvCallback()
 }
 
 
+void FunapiSession::RemoveJsonValueRecvCallback()
+{
+  impl_->RemoveJsonValueRecvCallback();
+}
+
+
 void FunapiSession::RemoveSessionEventCallback()
 {
   impl_->RemoveSessionEventCallback();
@@ -5458,6 +8301,12 @@ void FunapiSession::RemoveRecvTimeoutIntCallback()
 }
 
 
+void FunapiSession::RemoveRttStatsCallback()
+{
+  impl_->RemoveRttStatsCallback();
+}
+
+
 void FunapiSession::RemoveSessionOptionCallback()
 {
   impl_->RemoveSessionOptionCallback();
@@ -5476,6 +8325,12 @@ void FunapiSession::RemoveRedirectQueueCallback()
 }
 
 
+void FunapiSession::RemoveRecvCaptureCallback()
+{
+  impl_->RemoveRecvCaptureCallback();
+}
+
+
 void FunapiSession::RemoveAllCallbacks()
 {
   impl_->RemoveAllCallbacks();
@@ -5506,6 +8361,31 @@ int64_t FunapiSession::GetPingTime() {
 }
 
 
+bool FunapiSession::IsTLSSessionResumed() {
+  return impl_->IsTLSSessionResumed();
+}
+
+
+int64_t FunapiSession::GetTLSHandshakeTime() {
+  return impl_->GetTLSHandshakeTime();
+}
+
+
+float FunapiSession::GetTLSResumptionRate() {
+  return impl_->GetTLSResumptionRate();
+}
+
+
+FunapiRttStats FunapiSession::GetRttStats(const TransportProtocol protocol) {
+  return impl_->GetRttStats(protocol);
+}
+
+
+int64_t FunapiSession::GetRedirectGapTime() {
+  return impl_->GetRedirectGapTime();
+}
+
+
 TransportProtocol FunapiSession::GetDefaultProtocol() const {
   return impl_->GetDefaultProtocol();
 }
@@ -5531,6 +8411,11 @@ void FunapiSession::AddRecvTimeoutCallback(const RecvTimeoutIntHandler &handler)
 }
 
 
+void FunapiSession::AddRttStatsCallback(const RttStatsHandler &handler) {
+  impl_->AddRttStatsCallback(handler);
+}
+
+
 void FunapiSession::SetRecvTimeout(const int32_t msg_type, const int seconds) {
   impl_->SetRecvTimeout(msg_type, seconds);
 }
@@ -14,6 +14,8 @@
 
 #include "funapi_send_flag_manager.h"
 #include "funapi_utils.h"
+#include "funapi_tasks.h"
+#include "funapi_stats.h"
 
 #ifdef FUNAPI_UE4
 #ifdef FUNAPI_PLATFORM_WINDOWS
@@ -37,8 +39,277 @@ THIRD_PARTY_INCLUDES_END
 #include "openssl/err.h"
 #endif // FUNAPI_UE4
 
+#if FUNAPI_HAVE_UDP_MMSG
+#include <sys/uio.h>
+#include <netinet/udp.h>
+
+// Not defined by older C libraries.
+#ifndef UDP_SEGMENT
+#define UDP_SEGMENT 103
+#endif
+#ifndef UDP_GRO
+#define UDP_GRO 104
+#endif
+#endif // FUNAPI_HAVE_UDP_MMSG
+
 namespace fun {
 
+////////////////////////////////////////////////////////////////////////////////
+// FunapiResolverImpl implementation.
+
+class FunapiResolverImpl {
+ public:
+  typedef FunapiResolver::ResolveHandler ResolveHandler;
+
+  struct Address
+  {
+    int family = 0;
+    int socktype = 0;
+    int protocol = 0;
+    struct sockaddr_storage addr;
+    socklen_t addrlen = 0;
+  };
+
+  static FunapiResolverImpl& Get();
+
+  void Resolve(const fun::string &hostname_or_ip,
+               const int port,
+               const int socktype,
+               const ResolveHandler &handler);
+
+  // Returns false if the host is not cached.
+  bool Lookup(const fun::string &hostname_or_ip,
+              const int port,
+              const int socktype,
+              fun::vector<Address> &addresses,
+              int &error_code,
+              fun::string &error_string);
+
+  // Calls getaddrinfo() on the calling thread and caches the result.
+  void Query(const fun::string &hostname_or_ip,
+             const int port,
+             const int socktype,
+             fun::vector<Address> &addresses,
+             int &error_code,
+             fun::string &error_string);
+
+  void Invalidate(const fun::string &hostname_or_ip, const int port, const int socktype);
+  void Clear();
+
+ private:
+  // getaddrinfo() does not tell the TTL of the records, so addresses are
+  // kept for a fixed time. Failures are kept shortly so that a reconnect
+  // loop does not query the resolver again and again.
+  static const int64_t kCacheMillisecond = 60 * 1000;
+  static const int64_t kNegativeCacheMillisecond = 5 * 1000;
+
+  struct Entry
+  {
+    fun::vector<Address> addresses;
+    int error_code = 0;
+    fun::string error_string;
+    int64_t expire_time = 0;
+    bool resolving = false;
+    fun::vector<ResolveHandler> handlers;
+  };
+
+  static fun::string MakeKey(const fun::string &hostname_or_ip, const int port, const int socktype);
+
+  std::mutex mutex_;
+  fun::unordered_map<fun::string, Entry> entries_;
+};
+
+
+FunapiResolverImpl& FunapiResolverImpl::Get() {
+  static FunapiResolverImpl instance;
+  return instance;
+}
+
+
+fun::string FunapiResolverImpl::MakeKey(const fun::string &hostname_or_ip,
+                                        const int port,
+                                        const int socktype) {
+  fun::stringstream ss;
+  ss << hostname_or_ip << ":" << port << "/" << socktype;
+  return ss.str();
+}
+
+
+void FunapiResolverImpl::Resolve(const fun::string &hostname_or_ip,
+                                 const int port,
+                                 const int socktype,
+                                 const ResolveHandler &handler) {
+  fun::string key = MakeKey(hostname_or_ip, port, socktype);
+
+  {
+    std::unique_lock<std::mutex> lock(mutex_);
+    Entry &entry = entries_[key];
+
+    if (!entry.resolving && entry.expire_time > FunapiTimerWheel::NowMillisecond()) {
+      lock.unlock();
+      handler();
+      return;
+    }
+
+    entry.handlers.push_back(handler);
+
+    // Another lookup of the same host is on the way.
+    if (entry.resolving) {
+      return;
+    }
+
+    entry.resolving = true;
+  }
+
+  FunapiThread::Get("_resolver")->Push([this, hostname_or_ip, port, socktype, key]()->bool {
+    fun::vector<Address> addresses;
+    int error_code = 0;
+    fun::string error_string;
+
+    Query(hostname_or_ip, port, socktype, addresses, error_code, error_string);
+
+    fun::vector<ResolveHandler> handlers;
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      Entry &entry = entries_[key];
+      entry.resolving = false;
+      handlers.swap(entry.handlers);
+    }
+
+    for (auto &h : handlers) {
+      h();
+    }
+
+    return true;
+  });
+}
+
+
+bool FunapiResolverImpl::Lookup(const fun::string &hostname_or_ip,
+                                const int port,
+                                const int socktype,
+                                fun::vector<Address> &addresses,
+                                int &error_code,
+                                fun::string &error_string) {
+  std::unique_lock<std::mutex> lock(mutex_);
+
+  auto iter = entries_.find(MakeKey(hostname_or_ip, port, socktype));
+  if (iter == entries_.end() ||
+      iter->second.expire_time <= FunapiTimerWheel::NowMillisecond()) {
+    return false;
+  }
+
+  addresses = iter->second.addresses;
+  error_code = iter->second.error_code;
+  error_string = iter->second.error_string;
+
+  return true;
+}
+
+
+void FunapiResolverImpl::Query(const fun::string &hostname_or_ip,
+                               const int port,
+                               const int socktype,
+                               fun::vector<Address> &addresses,
+                               int &error_code,
+                               fun::string &error_string) {
+#ifdef FUNAPI_COCOS2D_PLATFORM_WINDOWS
+  static auto wsa_init = FunapiInit::Create([](){
+    WSADATA wsaData;
+    WSAStartup(MAKEWORD(2, 2), &wsaData);
+  }, [](){
+    WSACleanup();
+  });
+#endif
+
+  struct addrinfo hints;
+  struct addrinfo *res = nullptr;
+
+  fun::stringstream ss_port;
+  ss_port << static_cast<int>(port);
+
+  memset(&hints, 0, sizeof(hints));
+  hints.ai_family = AF_UNSPEC;
+  hints.ai_socktype = socktype;
+
+  addresses.clear();
+  error_string.clear();
+  error_code = getaddrinfo(hostname_or_ip.c_str(), ss_port.str().c_str(), &hints, &res);
+
+  if (error_code) {
+    error_string = (char*)gai_strerror(error_code);
+  }
+  else {
+    // Interleaves the address families, starting with the one the system
+    // prefers (RFC 8305, section 4), so that a connect can try both soon.
+    fun::vector<Address> first, second;
+    for (auto info = res; info; info = info->ai_next) {
+      if (info->ai_addrlen > sizeof(struct sockaddr_storage)) {
+        continue;
+      }
+
+      Address a;
+      a.family = info->ai_family;
+      a.socktype = info->ai_socktype;
+      a.protocol = info->ai_protocol;
+      memset(&a.addr, 0, sizeof(a.addr));
+      memcpy(&a.addr, info->ai_addr, info->ai_addrlen);
+      a.addrlen = static_cast<socklen_t>(info->ai_addrlen);
+
+      if (first.empty() || first.front().family == a.family) {
+        first.push_back(a);
+      }
+      else {
+        second.push_back(a);
+      }
+    }
+
+    freeaddrinfo(res);
+
+    for (size_t i = 0; i < first.size() || i < second.size(); ++i) {
+      if (i < first.size()) addresses.push_back(first[i]);
+      if (i < second.size()) addresses.push_back(second[i]);
+    }
+  }
+
+  std::unique_lock<std::mutex> lock(mutex_);
+  Entry &entry = entries_[MakeKey(hostname_or_ip, port, socktype)];
+  entry.addresses = addresses;
+  entry.error_code = error_code;
+  entry.error_string = error_string;
+  entry.expire_time = FunapiTimerWheel::NowMillisecond() +
+      (error_code ? kNegativeCacheMillisecond : kCacheMillisecond);
+}
+
+
+void FunapiResolverImpl::Invalidate(const fun::string &hostname_or_ip,
+                                    const int port,
+                                    const int socktype) {
+  std::unique_lock<std::mutex> lock(mutex_);
+
+  auto iter = entries_.find(MakeKey(hostname_or_ip, port, socktype));
+  if (iter != entries_.end()) {
+    iter->second.expire_time = 0;
+  }
+}
+
+
+void FunapiResolverImpl::Clear() {
+  std::unique_lock<std::mutex> lock(mutex_);
+
+  for (auto iter = entries_.begin(); iter != entries_.end();) {
+    // Keeps the lookups on the way; they have handlers to call.
+    if (iter->second.resolving) {
+      iter->second.expire_time = 0;
+      ++iter;
+    }
+    else {
+      iter = entries_.erase(iter);
+    }
+  }
+}
+
+
 ////////////////////////////////////////////////////////////////////////////////
 // FunapiAddrInfoImpl implementation.
 
@@ -136,6 +407,7 @@ class FunapiSocketImpl : public std::enable_shared_from_this<FunapiSocketImpl> {
                   fun::string &error_string);
 
   bool InitNonblockingSocket(int &error_code, fun::string &error_string);
+  static bool InitNonblockingSocket(int fd, int &error_code, fun::string &error_string);
 
   void CloseSocket();
 
@@ -153,12 +425,23 @@ class FunapiSocketImpl : public std::enable_shared_from_this<FunapiSocketImpl> {
 
   virtual bool IsReadyToPoll();
 
+  // Non-blocking connects in progress. Poll() waits on their sockets and
+  // calls OnConnectPoll() every time around so they can finish.
+#ifndef FUNAPI_PLATFORM_WINDOWS
+  virtual int GetConnectPollFds(struct pollfd *pollfds, const int max_pollfds);
+#endif // FUNAPI_PLATFORM_WINDOWS
+  virtual void OnConnectPoll();
+
  protected:
   static const int kBufferSize = 65536;
 
   int socket_ = -1;
   struct addrinfo *addrinfo_ = nullptr;
   struct addrinfo *addrinfo_res_ = nullptr;
+
+  // Storage of addrinfo_, copied from the resolver cache.
+  fun::vector<struct addrinfo> addrinfo_list_;
+  fun::vector<struct sockaddr_storage> addrinfo_addrs_;
 #ifdef FUNAPI_PLATFORM_WINDOWS
   HANDLE event_handle_ = nullptr;
 #endif // FUNAPI_PLATFORM_WINDOWS
@@ -223,14 +506,28 @@ fun::vector<std::shared_ptr<FunapiSocketImpl>> FunapiSocketImpl::GetSocketImpls(
 
 // extern function in funapi_session.cpp
 void OnSessionTicked();
+
+// extern functions in funapi_http.cpp
+#ifdef FUNAPI_PLATFORM_WINDOWS
+void OnHttpTicked();
+#else // FUNAPI_PLATFORM_WINDOWS
+int GetHttpPollFds(struct pollfd *pollfds, const int max_pollfds);
+void OnHttpPolled(const struct pollfd *pollfds, const int num_pollfds);
+#endif // FUNAPI_PLATFORM_WINDOWS
+
+// extern functions in funapi_websocket.cpp
+void OnWebsocketSend();
+#ifdef FUNAPI_PLATFORM_WINDOWS
+void OnWebsocketTicked();
+#else // FUNAPI_PLATFORM_WINDOWS
+int GetWebsocketPollFds(struct pollfd *pollfds, const int max_pollfds);
+void OnWebsocketPolled(const struct pollfd *pollfds, const int num_pollfds);
+#endif // FUNAPI_PLATFORM_WINDOWS
+
 bool FunapiSocketImpl::Poll()
 {
-  static FunapiTimer session_tick_timer;
-  if (session_tick_timer.IsExpired())
-  {
-    OnSessionTicked();
-    session_tick_timer.SetTimer(1);
-  }
+  // Runs the session timers that are due.
+  OnSessionTicked();
 
   fun::vector<std::shared_ptr<FunapiSocketImpl>> socket_impls =
       GetSocketImpls();
@@ -273,11 +570,25 @@ bool FunapiSocketImpl::Poll()
     return false;
   }
 
+  // Runs the HTTP transfers.
+  OnHttpTicked();
+
+  // Services the WebSocket connections.
+  OnWebsocketTicked();
+
+  // Finishes the pending connects.
+  for (auto &s : socket_impls)
+  {
+    s->OnConnectPoll();
+  }
+
   if (ret == WSA_WAIT_TIMEOUT)
   {
     return true;
   }
 
+  FunapiStats::Add(FunapiStats::Counter::kPollWakeups, 1);
+
   FunapiUtil::Assert(ret >= WSA_WAIT_EVENT_0 &&
                      ret < WSA_WAIT_EVENT_0 + num_handles);
 
@@ -289,6 +600,7 @@ bool FunapiSocketImpl::Poll()
     {
       s->OnSend();
     }
+    OnWebsocketSend();
   }
 
   for (auto &s : socket_impls)
@@ -342,6 +654,20 @@ bool FunapiSocketImpl::Poll()
     }
   }
 
+  // Sockets of the pending connects.
+  for (auto &s : socket_impls)
+  {
+    num_pollfds += s->GetConnectPollFds(&pollfds[num_pollfds], MAX_POLLFDS - num_pollfds);
+  }
+
+  // Sockets of the HTTP transfers.
+  int http_pollfds_begin = num_pollfds;
+  num_pollfds += GetHttpPollFds(&pollfds[num_pollfds], MAX_POLLFDS - num_pollfds);
+
+  // Sockets of the WebSocket connections.
+  int websocket_pollfds_begin = num_pollfds;
+  num_pollfds += GetWebsocketPollFds(&pollfds[num_pollfds], MAX_POLLFDS - num_pollfds);
+
   int ret = poll(pollfds, num_pollfds, 1);
 
   if (ret < 0)
@@ -354,12 +680,23 @@ bool FunapiSocketImpl::Poll()
     return false;
   }
 
+  OnHttpPolled(&pollfds[http_pollfds_begin], websocket_pollfds_begin - http_pollfds_begin);
+  OnWebsocketPolled(&pollfds[websocket_pollfds_begin], num_pollfds - websocket_pollfds_begin);
+
+  // Finishes the pending connects.
+  for (auto &s : socket_impls)
+  {
+    s->OnConnectPoll();
+  }
+
   // TIME OUT
   if (ret == 0)
   {
     return true;
   }
 
+  FunapiStats::Add(FunapiStats::Counter::kPollWakeups, 1);
+
   // SEND
   if ((pollfds[0].revents & POLLIN))
   {
@@ -368,6 +705,7 @@ bool FunapiSocketImpl::Poll()
     {
       s->OnSend();
     }
+    OnWebsocketSend();
     return true;
   }
 
@@ -418,10 +756,22 @@ bool FunapiSocketImpl::IsReadyToPoll() {
 }
 
 
+#ifndef FUNAPI_PLATFORM_WINDOWS
+int FunapiSocketImpl::GetConnectPollFds(struct pollfd *pollfds, const int max_pollfds) {
+  return 0;
+}
+#endif // FUNAPI_PLATFORM_WINDOWS
+
+
+void FunapiSocketImpl::OnConnectPoll() {
+}
+
+
 void FunapiSocketImpl::FreeAddrInfo() {
-  if (addrinfo_) {
-    freeaddrinfo(addrinfo_);
-  }
+  addrinfo_ = nullptr;
+  addrinfo_res_ = nullptr;
+  addrinfo_list_.clear();
+  addrinfo_addrs_.clear();
 }
 
 
@@ -430,29 +780,46 @@ bool FunapiSocketImpl::InitAddrInfo(int socktype,
                                     const int port,
                                     int &error_code,
                                     fun::string &error_string) {
-#ifdef FUNAPI_COCOS2D_PLATFORM_WINDOWS
-  static auto wsa_init = FunapiInit::Create([](){
-    WSADATA wsaData;
-    WSAStartup(MAKEWORD(2, 2), &wsaData);
-  }, [](){
-    WSACleanup();
-  });
-#endif
-
-  struct addrinfo hints;
+  fun::vector<FunapiResolverImpl::Address> addresses;
 
-  fun::stringstream ss_port;
-  ss_port << static_cast<int>(port);
+  // Resolves here only if FunapiResolver::Resolve() has not been called
+  // or the cache has expired since.
+  auto &resolver = FunapiResolverImpl::Get();
+  if (!resolver.Lookup(hostname_or_ip, port, socktype, addresses, error_code, error_string)) {
+    resolver.Query(hostname_or_ip, port, socktype, addresses, error_code, error_string);
+  }
 
-  memset(&hints, 0, sizeof(hints));
-  hints.ai_family = AF_UNSPEC;
-  hints.ai_socktype = socktype;
-  error_code = getaddrinfo(hostname_or_ip, ss_port.str().c_str(), &hints, &addrinfo_);
   if (error_code) {
-    error_string = (char*)gai_strerror(error_code);
     return false;
   }
 
+  if (addresses.empty()) {
+    error_string = "No address to connect";
+    return false;
+  }
+
+  FreeAddrInfo();
+
+  size_t count = addresses.size();
+  addrinfo_list_.resize(count);
+  addrinfo_addrs_.resize(count);
+
+  for (size_t i = 0; i < count; ++i) {
+    const auto &a = addresses[i];
+    struct addrinfo &info = addrinfo_list_[i];
+
+    memset(&info, 0, sizeof(info));
+    info.ai_family = a.family;
+    info.ai_socktype = a.socktype;
+    info.ai_protocol = a.protocol;
+    memcpy(&addrinfo_addrs_[i], &a.addr, sizeof(a.addr));
+    info.ai_addr = reinterpret_cast<struct sockaddr*>(&addrinfo_addrs_[i]);
+    info.ai_addrlen = a.addrlen;
+    info.ai_next = (i + 1 < count) ? &addrinfo_list_[i + 1] : nullptr;
+  }
+
+  addrinfo_ = &addrinfo_list_[0];
+
   return true;
 }
 
@@ -520,19 +887,27 @@ bool FunapiSocketImpl::InitSocket(struct addrinfo *info,
 
 bool FunapiSocketImpl::InitNonblockingSocket(int &error_code,
                                              fun::string &error_string)
+{
+  return InitNonblockingSocket(socket_, error_code, error_string);
+}
+
+
+bool FunapiSocketImpl::InitNonblockingSocket(int fd,
+                                             int &error_code,
+                                             fun::string &error_string)
 {
   do {
 #ifdef FUNAPI_PLATFORM_WINDOWS
     u_long argp = 1;
-    if (ioctlsocket(socket_, FIONBIO, &argp) == 0) {
+    if (ioctlsocket(fd, FIONBIO, &argp) == 0) {
       return true;
     }
 #else // FUNAPI_PLATFORM_WINDOWS
-    int flag = fcntl(socket_, F_GETFL);
+    int flag = fcntl(fd, F_GETFL);
     if (flag < 0)
       break;
 
-    if (fcntl(socket_, F_SETFL, O_NONBLOCK | flag) == 0) {
+    if (fcntl(fd, F_SETFL, O_NONBLOCK | flag) == 0) {
       return true;
     }
 #endif // FUNAPI_PLATFORM_WINDOWS
@@ -584,6 +959,99 @@ HANDLE FunapiSocketImpl::GetEventHandle() {
 #endif // FUNAPI_PLATFORM_WINDOWS
 
 
+////////////////////////////////////////////////////////////////////////////////
+// FunapiTlsSessionCache implementation.
+
+// Keeps the last TLS session (a session id or a TLS 1.3 ticket) of each
+// host and port, so that a reconnect resumes it instead of doing a full
+// handshake. OpenSSL hands over new sessions through the new session
+// callback, also after the handshake for TLS 1.3 tickets.
+class FunapiTlsSessionCache {
+ public:
+  static FunapiTlsSessionCache& Get();
+
+  ~FunapiTlsSessionCache();
+
+  // Takes the reference of the session.
+  void Put(const fun::string &key, SSL_SESSION *session);
+
+  // Returns false if there is no session to resume.
+  bool SetSession(const fun::string &key, SSL *ssl);
+
+  void Remove(const fun::string &key);
+
+ private:
+  static const size_t kMaxSessions = 64;
+
+  std::mutex mutex_;
+  fun::unordered_map<fun::string, SSL_SESSION*> sessions_;
+};
+
+
+FunapiTlsSessionCache& FunapiTlsSessionCache::Get() {
+  static FunapiTlsSessionCache instance;
+  return instance;
+}
+
+
+FunapiTlsSessionCache::~FunapiTlsSessionCache() {
+  for (auto &iter : sessions_) {
+    SSL_SESSION_free(iter.second);
+  }
+}
+
+
+void FunapiTlsSessionCache::Put(const fun::string &key, SSL_SESSION *session) {
+  std::unique_lock<std::mutex> lock(mutex_);
+
+  auto iter = sessions_.find(key);
+  if (iter != sessions_.end()) {
+    SSL_SESSION_free(iter->second);
+    iter->second = session;
+    return;
+  }
+
+  if (sessions_.size() >= kMaxSessions) {
+    SSL_SESSION_free(sessions_.begin()->second);
+    sessions_.erase(sessions_.begin());
+  }
+
+  sessions_[key] = session;
+}
+
+
+bool FunapiTlsSessionCache::SetSession(const fun::string &key, SSL *ssl) {
+  std::unique_lock<std::mutex> lock(mutex_);
+
+  auto iter = sessions_.find(key);
+  if (iter == sessions_.end()) {
+    return false;
+  }
+
+#if OPENSSL_VERSION_NUMBER >= 0x10101000L
+  if (!SSL_SESSION_is_resumable(iter->second)) {
+    SSL_SESSION_free(iter->second);
+    sessions_.erase(iter);
+    return false;
+  }
+#endif
+
+  // SSL_set_session() takes its own reference.
+  return SSL_set_session(ssl, iter->second) == 1;
+}
+
+
+void FunapiTlsSessionCache::Remove(const fun::string &key) {
+  std::unique_lock<std::mutex> lock(mutex_);
+
+  auto iter = sessions_.find(key);
+  if (iter != sessions_.end()) {
+    SSL_SESSION_free(iter->second);
+    sessions_.erase(iter);
+  }
+}
+
+
 ////////////////////////////////////////////////////////////////////////////////
 // FunapiTcpImpl implementation.
 
@@ -628,10 +1096,30 @@ class FunapiTcpImpl : public FunapiSocketImpl {
 
   bool IsReadyPoll();
 
+  void SetUseTLSSessionResumption(const bool use);
+  bool IsTLSSessionResumed() const;
+  int64_t GetTLSHandshakeTime() const;
+
  protected:
   bool InitTcpSocketOption(bool disable_nagle,
                            int &error_code,
                            fun::string &error_string);
+  static bool InitTcpSocketOption(int fd,
+                                  bool disable_nagle,
+                                  int &error_code,
+                                  fun::string &error_string);
+
+  void ConnectAddresses(const bool disable_nagle);
+  bool StartConnectAttempt();
+  bool UpdateConnectAttempts(int &winner, bool &is_timed_out);
+  void FinishConnectAddresses(const bool is_connected, const bool is_timed_out);
+  void CloseConnectAttempts(const int except);
+  bool IsConnecting();
+
+#ifndef FUNAPI_PLATFORM_WINDOWS
+  int GetConnectPollFds(struct pollfd *pollfds, const int max_pollfds);
+#endif // FUNAPI_PLATFORM_WINDOWS
+  void OnConnectPoll();
 
   void SocketPoll(short poll_revents);
 
@@ -645,6 +1133,8 @@ class FunapiTcpImpl : public FunapiSocketImpl {
 
   bool ConnectTLS();
   void CleanupSSL();
+  fun::string GetTLSSessionKey() const;
+  static int OnNewTLSSession(SSL *ssl, SSL_SESSION *session);
 
   void OnSend();
   void OnRecv();
@@ -665,14 +1155,40 @@ class FunapiTcpImpl : public FunapiSocketImpl {
   int offset_ = 0;
   time_t connect_timeout_seconds_ = 5;
 
+  // Reused by every OnRecv(). The recv handlers copy what they keep.
+  fun::vector<uint8_t> recv_buffer_;
+
+  // Delay before trying the next address of the host.
+  static const int64_t kConnectAttemptDelay = 250;
+
+  // State of ConnectAddresses() while the connects are in progress.
+  std::mutex connect_mutex_;
+  struct ConnectAttempt {
+    int fd;
+    struct addrinfo *info;
+  };
+  fun::vector<ConnectAttempt> connect_attempts_;
+  struct addrinfo *connect_next_ = nullptr;
+  int64_t connect_next_attempt_time_ = 0;
+  int64_t connect_deadline_ = 0;
+  bool connect_disable_nagle_ = false;
+  bool is_connecting_ = false;
+  int connect_error_code_ = 0;
+  fun::string connect_error_string_;
+
   // https://curl.haxx.se/docs/caextract.html
   // https://curl.haxx.se/ca/cacert.pem
   fun::string cert_file_path_;
   bool use_tls_ = false;
   fun::string hostname_or_ip_;
+  int port_ = 0;
 
   SSL_CTX *ctx_ = nullptr;
   SSL *ssl_ = nullptr;
+
+  bool use_tls_session_resumption_ = true;
+  bool tls_session_resumed_ = false;
+  int64_t tls_handshake_time_ = 0;
 };
 
 
@@ -682,6 +1198,7 @@ FunapiTcpImpl::FunapiTcpImpl() {
 
 FunapiTcpImpl::~FunapiTcpImpl() {
   // DebugUtils::Log("%s", __FUNCTION__);
+  CloseConnectAttempts(-1);
   CleanupSSL();
 }
 
@@ -908,7 +1425,7 @@ void FunapiTcpImpl::Connect(const char* hostname_or_ip,
                             const RecvHandler &recv_handler) {
   completion_handler_ = connect_completion_handler;
 
-  if (socket_ != -1) {
+  if (socket_ != -1 || IsConnecting()) {
     OnConnectCompletion(true, false, 0, "");
     return;
   }
@@ -916,6 +1433,7 @@ void FunapiTcpImpl::Connect(const char* hostname_or_ip,
   use_tls_ = use_tls;
   cert_file_path_ = cert_file_path;
   hostname_or_ip_ = hostname_or_ip;
+  port_ = port;
 
   send_handler_ = send_handler;
   recv_handler_ = recv_handler;
@@ -931,37 +1449,287 @@ void FunapiTcpImpl::Connect(const char* hostname_or_ip,
 
   addrinfo_res_ = addrinfo_;
 
-  if (!InitSocket(addrinfo_res_, error_code, error_string)) {
-    OnConnectCompletion(true, false, error_code, error_string);
-    return;
-  }
+  ConnectAddresses(disable_nagle);
+}
 
-  if (!InitNonblockingSocket(error_code, error_string)) {
-    OnConnectCompletion(true, false, error_code, error_string);
-    return;
-  }
 
-  if (!InitTcpSocketOption(disable_nagle, error_code, error_string)) {
-    OnConnectCompletion(true, false, error_code, error_string);
+// Connects to the addresses of the host in parallel (RFC 8305). The next
+// address is tried when the previous ones have not connected in
+// kConnectAttemptDelay or have failed, and the first one to connect wins.
+// The other attempts are closed.
+//
+// Only starts the race. The sockets of the attempts are polled by
+// FunapiSocketImpl::Poll() and OnConnectPoll() finishes the race, so the
+// network thread is never blocked while connecting. It may be called from
+// another thread (FunapiRpc connects on the _connect thread), so the state
+// of the race is guarded by connect_mutex_.
+void FunapiTcpImpl::ConnectAddresses(const bool disable_nagle) {
+  {
+    std::unique_lock<std::mutex> lock(connect_mutex_);
+    int64_t now = FunapiTimerWheel::NowMillisecond();
+
+    connect_attempts_.clear();
+    connect_next_ = addrinfo_;
+    connect_next_attempt_time_ = now;
+    connect_deadline_ = now + static_cast<int64_t>(connect_timeout_seconds_) * 1000;
+    connect_disable_nagle_ = disable_nagle;
+    connect_error_code_ = 0;
+    connect_error_string_.clear();
+    is_connecting_ = true;
+  }
+
+  OnConnectPoll();
+}
+
+
+// Starts a connect to the next address. Returns true if it has connected
+// at once.
+bool FunapiTcpImpl::StartConnectAttempt() {
+  struct addrinfo *info = connect_next_;
+  connect_next_ = connect_next_->ai_next;
+
+  int fd = static_cast<int>(socket(info->ai_family, info->ai_socktype, info->ai_protocol));
+  if (fd < 0) {
+    connect_error_code_ = FunapiUtil::GetSocketErrorCode();
+    connect_error_string_ = FunapiUtil::GetSocketErrorString(connect_error_code_);
+    return false;
+  }
+
+  if (!InitNonblockingSocket(fd, connect_error_code_, connect_error_string_) ||
+      !InitTcpSocketOption(fd, connect_disable_nagle_, connect_error_code_, connect_error_string_)) {
+#ifdef FUNAPI_PLATFORM_WINDOWS
+    closesocket(fd);
+#else // FUNAPI_PLATFORM_WINDOWS
+    close(fd);
+#endif // FUNAPI_PLATFORM_WINDOWS
+    return false;
+  }
+
+  int rc = connect(fd, info->ai_addr, static_cast<int>(info->ai_addrlen));
+  if (rc == 0) {
+    connect_attempts_.push_back({ fd, info });
+    return true;
+  }
+
+  int last_error = FunapiUtil::GetSocketErrorCode();
+#ifdef FUNAPI_PLATFORM_WINDOWS
+  bool in_progress = (last_error == WSAEWOULDBLOCK);
+#else // FUNAPI_PLATFORM_WINDOWS
+  bool in_progress = (last_error == EINPROGRESS);
+#endif // FUNAPI_PLATFORM_WINDOWS
+  if (!in_progress) {
+    // Tries the next address at once.
+    connect_error_code_ = last_error;
+    connect_error_string_ = FunapiUtil::GetSocketErrorString(connect_error_code_);
+#ifdef FUNAPI_PLATFORM_WINDOWS
+    closesocket(fd);
+#else // FUNAPI_PLATFORM_WINDOWS
+    close(fd);
+#endif // FUNAPI_PLATFORM_WINDOWS
+    return false;
+  }
+
+  connect_attempts_.push_back({ fd, info });
+  connect_next_attempt_time_ = FunapiTimerWheel::NowMillisecond() + kConnectAttemptDelay;
+  return false;
+}
+
+
+#ifndef FUNAPI_PLATFORM_WINDOWS
+int FunapiTcpImpl::GetConnectPollFds(struct pollfd *pollfds, const int max_pollfds) {
+  std::unique_lock<std::mutex> lock(connect_mutex_);
+  if (!is_connecting_) {
+    return 0;
+  }
+
+  int num_pollfds = 0;
+  for (auto &a : connect_attempts_) {
+    if (num_pollfds >= max_pollfds) {
+      break;
+    }
+
+    pollfds[num_pollfds].fd = a.fd;
+    pollfds[num_pollfds].events = POLLOUT;
+    pollfds[num_pollfds].revents = 0;
+    ++num_pollfds;
+  }
+
+  return num_pollfds;
+}
+#endif // FUNAPI_PLATFORM_WINDOWS
+
+
+void FunapiTcpImpl::OnConnectPoll() {
+  int winner = -1;
+  bool is_timed_out = false;
+  {
+    std::unique_lock<std::mutex> lock(connect_mutex_);
+    if (!is_connecting_ || !UpdateConnectAttempts(winner, is_timed_out)) {
+      return;
+    }
+
+    is_connecting_ = false;
+    CloseConnectAttempts(winner);
+
+    if (winner >= 0) {
+      socket_ = connect_attempts_[winner].fd;
+      addrinfo_res_ = connect_attempts_[winner].info;
+      socket_poll_state_ = SocketPollState::kNone;
+    }
+
+    connect_attempts_.clear();
+  }
+
+  FinishConnectAddresses(winner >= 0, is_timed_out);
+}
+
+
+// Checks the attempts without blocking and starts the next one when it is
+// due. Returns true when the race is over: an attempt has connected
+// (winner), every address has failed or the connect timeout has passed.
+bool FunapiTcpImpl::UpdateConnectAttempts(int &winner, bool &is_timed_out) {
+  for (;;) {
+    int64_t now = FunapiTimerWheel::NowMillisecond();
+
+    if (connect_next_ && now >= connect_next_attempt_time_) {
+      if (StartConnectAttempt()) {
+        winner = static_cast<int>(connect_attempts_.size()) - 1;
+        return true;
+      }
+    }
+
+    if (connect_attempts_.empty()) {
+      if (connect_next_) {
+        continue;
+      }
+
+      // Every address has failed.
+      return true;
+    }
+
+    fd_set write_fds;
+    fd_set except_fds;
+    FD_ZERO(&write_fds);
+    FD_ZERO(&except_fds);
+
+    int max_fd = 0;
+    for (auto &a : connect_attempts_) {
+      FD_SET(a.fd, &write_fds);
+      FD_SET(a.fd, &except_fds);
+      max_fd = std::max(max_fd, a.fd);
+    }
+
+    struct timeval timeout = { 0, 0 };
+    int rc = select(max_fd + 1, NULL, &write_fds, &except_fds, &timeout);
+    if (rc < 0) {
+      connect_error_code_ = FunapiUtil::GetSocketErrorCode();
+      connect_error_string_ = FunapiUtil::GetSocketErrorString(connect_error_code_);
+      return true;
+    }
+
+    for (size_t i = 0; rc > 0 && i < connect_attempts_.size();) {
+      int fd = connect_attempts_[i].fd;
+      if (!FD_ISSET(fd, &write_fds) && !FD_ISSET(fd, &except_fds)) {
+        ++i;
+        continue;
+      }
+
+      int so_error = 0;
+      socklen_t so_error_len = sizeof(so_error);
+      if (getsockopt(fd, SOL_SOCKET, SO_ERROR, (char*)&so_error, &so_error_len) < 0) {
+        so_error = FunapiUtil::GetSocketErrorCode();
+      }
+
+      if (so_error == 0) {
+        winner = static_cast<int>(i);
+        return true;
+      }
+
+      connect_error_code_ = so_error;
+      connect_error_string_ = FunapiUtil::GetSocketErrorString(connect_error_code_);
+#ifdef FUNAPI_PLATFORM_WINDOWS
+      closesocket(fd);
+#else // FUNAPI_PLATFORM_WINDOWS
+      close(fd);
+#endif // FUNAPI_PLATFORM_WINDOWS
+      connect_attempts_.erase(connect_attempts_.begin() + i);
+
+      // Does not wait for the delay after a failure.
+      connect_next_attempt_time_ = now;
+    }
+
+    if (FunapiTimerWheel::NowMillisecond() >= connect_deadline_) {
+      connect_error_code_ = 0;
+      connect_error_string_ = "Failed to connect due to the connection timeout";
+      is_timed_out = true;
+      return true;
+    }
+
+    // Waits for the next poll unless an attempt is due.
+    if (!connect_attempts_.empty() &&
+        (!connect_next_ || FunapiTimerWheel::NowMillisecond() < connect_next_attempt_time_)) {
+      return false;
+    }
+  }
+}
+
+
+bool FunapiTcpImpl::IsConnecting() {
+  std::unique_lock<std::mutex> lock(connect_mutex_);
+  return is_connecting_;
+}
+
+
+void FunapiTcpImpl::CloseConnectAttempts(const int except) {
+  for (int i = 0; i < static_cast<int>(connect_attempts_.size()); ++i) {
+    if (i != except) {
+#ifdef FUNAPI_PLATFORM_WINDOWS
+      closesocket(connect_attempts_[i].fd);
+#else // FUNAPI_PLATFORM_WINDOWS
+      close(connect_attempts_[i].fd);
+#endif // FUNAPI_PLATFORM_WINDOWS
+    }
+  }
+}
+
+
+void FunapiTcpImpl::FinishConnectAddresses(const bool is_connected, const bool is_timed_out) {
+  if (!is_connected) {
+    // Resolves the host again next time, the addresses may have changed.
+    FunapiResolverImpl::Get().Invalidate(hostname_or_ip_, port_, SOCK_STREAM);
+    OnConnectCompletion(true, is_timed_out, connect_error_code_, connect_error_string_);
     return;
   }
 
   // log
+  fun::string hostname = FunapiSocketImpl::GetStringFromAddrInfo(addrinfo_res_);
+  DebugUtils::Log("Address Info: %s -> %s", hostname_or_ip_.c_str(), hostname.c_str());
+  // //
+
+#ifdef FUNAPI_PLATFORM_WINDOWS
+  event_handle_ = WSACreateEvent();
+  if (WSAEventSelect(socket_, event_handle_, FD_READ | FD_CONNECT | FD_CLOSE) != 0)
   {
-    fun::string hostname = FunapiSocketImpl::GetStringFromAddrInfo(addrinfo_res_);
-    DebugUtils::Log("Address Info: %s -> %s", hostname_or_ip, hostname.c_str());
+    int error_code = FunapiUtil::GetSocketErrorCode();
+    OnConnectCompletion(true, false, error_code, FunapiUtil::GetSocketErrorString(error_code));
+    return;
   }
-  // //
+#endif // FUNAPI_PLATFORM_WINDOWS
 
-  Connect(addrinfo_res_);
+  OnConnectCompletion(false, false);
 }
 
 
 bool FunapiTcpImpl::InitTcpSocketOption(bool disable_nagle, int &error_code, fun::string &error_string) {
+  return InitTcpSocketOption(socket_, disable_nagle, error_code, error_string);
+}
+
+
+bool FunapiTcpImpl::InitTcpSocketOption(int fd, bool disable_nagle, int &error_code, fun::string &error_string) {
   // Disable nagle
   if (disable_nagle) {
     int nagle_flag = 1;
-    int result = setsockopt(socket_,
+    int result = setsockopt(fd,
                             IPPROTO_TCP,
                             TCP_NODELAY,
                             reinterpret_cast<char*>(&nagle_flag),
@@ -1037,6 +1805,11 @@ bool FunapiTcpImpl::ConnectTLS() {
   DebugUtils::Log(ss.str().c_str());
 #endif // FUNAPI_TLS_VERIFY_SERVER_CERTIFICATE
 
+  if (use_tls_session_resumption_) {
+    SSL_CTX_set_session_cache_mode(ctx_, SSL_SESS_CACHE_CLIENT | SSL_SESS_CACHE_NO_INTERNAL_STORE);
+    SSL_CTX_sess_set_new_cb(ctx_, &FunapiTcpImpl::OnNewTLSSession);
+  }
+
   ssl_ = SSL_new(ctx_);
 
   if (!ssl_) {
@@ -1050,6 +1823,15 @@ bool FunapiTcpImpl::ConnectTLS() {
     return false;
   }
 
+  bool has_session = false;
+  if (use_tls_session_resumption_) {
+    SSL_set_app_data(ssl_, this);
+    has_session = FunapiTlsSessionCache::Get().SetSession(GetTLSSessionKey(), ssl_);
+  }
+
+  tls_session_resumed_ = false;
+  int64_t handshake_start = FunapiTimerWheel::NowMillisecond();
+
 #if FUNAPI_TLS_VERIFY_SERVER_CERTIFICATE
   auto param = SSL_get0_param(ssl_);
   X509_VERIFY_PARAM_set_hostflags(param, X509_CHECK_FLAG_NO_PARTIAL_WILDCARDS);
@@ -1071,6 +1853,11 @@ bool FunapiTcpImpl::ConnectTLS() {
         continue;
       }
       else {
+        // The cached session may be the cause.
+        if (has_session) {
+          FunapiTlsSessionCache::Get().Remove(GetTLSSessionKey());
+        }
+
         on_ssl_error_completion();
         return false;
       }
@@ -1080,10 +1867,48 @@ bool FunapiTcpImpl::ConnectTLS() {
     }
   }
 
+  tls_handshake_time_ = FunapiTimerWheel::NowMillisecond() - handshake_start;
+  tls_session_resumed_ = (SSL_session_reused(ssl_) == 1);
+
   return true;
 }
 
 
+fun::string FunapiTcpImpl::GetTLSSessionKey() const {
+  fun::stringstream ss;
+  ss << hostname_or_ip_ << ":" << port_;
+  return ss.str();
+}
+
+
+int FunapiTcpImpl::OnNewTLSSession(SSL *ssl, SSL_SESSION *session) {
+  auto impl = static_cast<FunapiTcpImpl*>(SSL_get_app_data(ssl));
+  if (!impl) {
+    return 0;
+  }
+
+  FunapiTlsSessionCache::Get().Put(impl->GetTLSSessionKey(), session);
+
+  // The cache has taken the reference.
+  return 1;
+}
+
+
+void FunapiTcpImpl::SetUseTLSSessionResumption(const bool use) {
+  use_tls_session_resumption_ = use;
+}
+
+
+bool FunapiTcpImpl::IsTLSSessionResumed() const {
+  return tls_session_resumed_;
+}
+
+
+int64_t FunapiTcpImpl::GetTLSHandshakeTime() const {
+  return tls_handshake_time_;
+}
+
+
 void FunapiTcpImpl::OnConnectCompletion(const bool is_failed,
                                         const bool is_timed_out) {
   int error_code = FunapiUtil::GetSocketErrorCode();
@@ -1168,7 +1993,9 @@ void FunapiTcpImpl::OnSend() {
 
 
 void FunapiTcpImpl::OnRecv() {
-  fun::vector<uint8_t> buffer(kBufferSize);
+  fun::vector<uint8_t> &buffer = recv_buffer_;
+  if (buffer.size() != kBufferSize)
+    buffer.resize(kBufferSize);
 
   int nRead = 0;
 
@@ -1246,13 +2073,64 @@ class FunapiUdpImpl : public FunapiSocketImpl {
 #endif //FUNAPI_PLATFORM_WINDOWS
   bool Send(const fun::vector<uint8_t> &body, const SendCompletionHandler &send_handler);
 
+  void PushSend(const fun::vector<uint8_t> &body);
+  bool FlushSend(const SendCompletionHandler &send_completion_handler);
+
+  void SetSegmentOffload(const bool enable);
+
  private:
   void Finalize();
   void OnSend();
   void OnRecv();
 
+  void OnSendFailed(const SendCompletionHandler &send_completion_handler);
+  void OnRecvFailed(const int error_code, const fun::string &error_string);
+  bool OnRecvDatagram(const uint8_t *data, const size_t length);
+
   SendHandler send_handler_;
   RecvHandler recv_handler_;
+
+  // Datagrams queued by PushSend(), back to back.
+  fun::vector<uint8_t> send_buffer_;
+  fun::vector<size_t> send_lengths_;
+
+  // Datagrams are received into the slab and handed over one at a time in
+  // receiving_, so no buffer is allocated per datagram.
+  fun::vector<uint8_t> recv_slab_;
+  fun::vector<uint8_t> receiving_;
+
+#if FUNAPI_HAVE_UDP_MMSG
+  static const int kSendBatch = 64;
+  static const int kRecvBatch = 8;
+  static const size_t kMaxGsoSegments = 64;
+  static const size_t kMaxGsoBytes = 65535 - 8 - 40;  // udp and ipv6 header
+
+  union GsoControl {
+    char buf[CMSG_SPACE(sizeof(uint16_t))];
+    struct cmsghdr align;
+  };
+
+  union GroControl {
+    char buf[CMSG_SPACE(sizeof(int))];
+    struct cmsghdr align;
+  };
+
+  // Fills send_msgs_ from the datagram at index. Returns the number of messages.
+  int BuildSendMessages(const size_t index, size_t *offset);
+
+  bool use_gso_ = false;
+  bool use_gro_ = false;
+
+  struct mmsghdr send_msgs_[kSendBatch];
+  struct iovec send_iovs_[kSendBatch];
+  GsoControl send_controls_[kSendBatch];
+  size_t send_msg_datagrams_[kSendBatch];  // Datagrams in each message.
+
+  struct mmsghdr recv_msgs_[kRecvBatch];
+  struct iovec recv_iovs_[kRecvBatch];
+  GroControl recv_controls_[kRecvBatch];
+  struct sockaddr_storage recv_addrs_[kRecvBatch];
+#endif // FUNAPI_HAVE_UDP_MMSG
 };
 
 
@@ -1316,36 +2194,128 @@ void FunapiUdpImpl::OnSend() {
 }
 
 
+#if FUNAPI_HAVE_UDP_MMSG
 void FunapiUdpImpl::OnRecv() {
-  fun::vector<uint8_t> receiving_vector(kBufferSize);
+  if (recv_slab_.empty()) {
+    recv_slab_.resize(kRecvBatch * kBufferSize);
+  }
+
+  for (int i = 0; i < kRecvBatch; ++i) {
+    recv_iovs_[i].iov_base = recv_slab_.data() + i * kBufferSize;
+    recv_iovs_[i].iov_len = kBufferSize;
+
+    struct msghdr &hdr = recv_msgs_[i].msg_hdr;
+    memset(&hdr, 0, sizeof(hdr));
+    hdr.msg_name = &recv_addrs_[i];
+    hdr.msg_namelen = sizeof(recv_addrs_[i]);
+    hdr.msg_iov = &recv_iovs_[i];
+    hdr.msg_iovlen = 1;
+    if (use_gro_) {
+      hdr.msg_control = recv_controls_[i].buf;
+      hdr.msg_controllen = sizeof(recv_controls_[i].buf);
+    }
+    recv_msgs_[i].msg_len = 0;
+  }
+
+  int count = recvmmsg(socket_, recv_msgs_, kRecvBatch, MSG_DONTWAIT, nullptr);
+  if (count < 0) {
+    int error_code = FunapiUtil::GetSocketErrorCode();
+    if (error_code == EAGAIN || error_code == EWOULDBLOCK || error_code == EINTR) {
+      return;
+    }
+
+    OnRecvFailed(error_code, FunapiUtil::GetSocketErrorString(error_code));
+    return;
+  }
+
+  if (count > 0) {
+    // Keeps the peer address like recvfrom() did.
+    const struct msghdr &last = recv_msgs_[count - 1].msg_hdr;
+    if (last.msg_namelen > 0 && last.msg_namelen <= addrinfo_res_->ai_addrlen) {
+      memcpy(addrinfo_res_->ai_addr, last.msg_name, last.msg_namelen);
+    }
+  }
+
+  for (int i = 0; i < count; ++i) {
+    const uint8_t *data = static_cast<const uint8_t*>(recv_iovs_[i].iov_base);
+    size_t length = recv_msgs_[i].msg_len;
+
+    // With GRO, several datagrams of the same size come in one buffer.
+    size_t segment_size = length;
+    struct msghdr &hdr = recv_msgs_[i].msg_hdr;
+    if (use_gro_ && hdr.msg_controllen > 0) {
+      for (struct cmsghdr *cmsg = CMSG_FIRSTHDR(&hdr); cmsg; cmsg = CMSG_NXTHDR(&hdr, cmsg)) {
+        if (cmsg->cmsg_level == IPPROTO_UDP && cmsg->cmsg_type == UDP_GRO) {
+          int gso_size = 0;
+          memcpy(&gso_size, CMSG_DATA(cmsg), sizeof(gso_size));
+          if (gso_size > 0) {
+            segment_size = static_cast<size_t>(gso_size);
+          }
+          break;
+        }
+      }
+    }
+
+    if (length == 0) {
+      if (!OnRecvDatagram(data, 0))
+        return;
+      continue;
+    }
+
+    for (size_t offset = 0; offset < length; offset += segment_size) {
+      if (!OnRecvDatagram(data + offset, std::min(segment_size, length - offset)))
+        return;
+    }
+  }
+}
+#else // FUNAPI_HAVE_UDP_MMSG
+void FunapiUdpImpl::OnRecv() {
+  if (recv_slab_.empty()) {
+    recv_slab_.resize(kBufferSize);
+  }
 
 #ifdef FUNAPI_PLATFORM_WINDOWS
   int nRead = static_cast<int>(recvfrom(socket_,
-                                        reinterpret_cast<char*>(receiving_vector.data()),
-                                        receiving_vector.size(), 0, addrinfo_res_->ai_addr,
+                                        reinterpret_cast<char*>(recv_slab_.data()),
+                                        static_cast<int>(recv_slab_.size()), 0, addrinfo_res_->ai_addr,
                                         reinterpret_cast<int*>(&addrinfo_res_->ai_addrlen)));
 #else
   int nRead = static_cast<int>(recvfrom(socket_,
-                                        reinterpret_cast<char*>(receiving_vector.data()),
-                                        receiving_vector.size(), 0, addrinfo_res_->ai_addr,
+                                        reinterpret_cast<char*>(recv_slab_.data()),
+                                        recv_slab_.size(), 0, addrinfo_res_->ai_addr,
                                         (&addrinfo_res_->ai_addrlen)));
 #endif // FUNAPI_PLATFORM_WINDOWS
 
-  if (nRead == 0) {
-    recv_handler_(true, 0, "Peer closed the TCP transport", nRead, receiving_vector);
-    CloseSocket();
+  if (nRead < 0) {
+    int error_code = FunapiUtil::GetSocketErrorCode();
+    OnRecvFailed(error_code, FunapiUtil::GetSocketErrorString(error_code));
     return;
   }
 
-  if (nRead < 0) {
-    int error_code = FunapiUtil::GetSocketErrorCode();
-    fun::string error_string = FunapiUtil::GetSocketErrorString(error_code);
-    recv_handler_(true, error_code, error_string, nRead, receiving_vector);
+  OnRecvDatagram(recv_slab_.data(), nRead);
+}
+#endif // FUNAPI_HAVE_UDP_MMSG
+
+
+// Returns false if the socket has been closed.
+bool FunapiUdpImpl::OnRecvDatagram(const uint8_t *data, const size_t length) {
+  receiving_.assign(data, data + length);
+
+  if (length == 0) {
+    recv_handler_(true, 0, "Peer closed the UDP transport", 0, receiving_);
     CloseSocket();
-    return;
+    return false;
   }
 
-  recv_handler_(false, 0, "", nRead, receiving_vector);
+  recv_handler_(false, 0, "", static_cast<int>(length), receiving_);
+  return socket_ >= 0;
+}
+
+
+void FunapiUdpImpl::OnRecvFailed(const int error_code, const fun::string &error_string) {
+  receiving_.clear();
+  recv_handler_(true, error_code, error_string, -1, receiving_);
+  CloseSocket();
 }
 
 
@@ -1368,6 +2338,196 @@ bool FunapiUdpImpl::Send(const fun::vector<uint8_t> &body, const SendCompletionH
 }
 
 
+void FunapiUdpImpl::PushSend(const fun::vector<uint8_t> &body) {
+  send_buffer_.insert(send_buffer_.end(), body.cbegin(), body.cend());
+  send_lengths_.push_back(body.size());
+}
+
+
+void FunapiUdpImpl::OnSendFailed(const SendCompletionHandler &send_completion_handler) {
+  int error_code = FunapiUtil::GetSocketErrorCode();
+  fun::string error_string = FunapiUtil::GetSocketErrorString(error_code);
+
+  send_buffer_.clear();
+  send_lengths_.clear();
+
+  send_completion_handler(true, error_code, error_string, -1);
+  CloseSocket();
+}
+
+
+#if FUNAPI_HAVE_UDP_MMSG
+int FunapiUdpImpl::BuildSendMessages(const size_t index, size_t *offset) {
+  int num_msgs = 0;
+  size_t i = index;
+  size_t pos = *offset;
+
+  while (i < send_lengths_.size() && num_msgs < kSendBatch) {
+    size_t segment_size = send_lengths_[i];
+    size_t bytes = segment_size;
+    size_t count = 1;
+
+    if (use_gso_ && segment_size > 0) {
+      // Datagrams of the same size go in one message. Only the last one
+      // may be smaller than the others.
+      while (i + count < send_lengths_.size() &&
+             count < kMaxGsoSegments &&
+             bytes + send_lengths_[i + count] <= kMaxGsoBytes) {
+        size_t next = send_lengths_[i + count];
+        if (next > segment_size || next == 0)
+          break;
+
+        bytes += next;
+        ++count;
+
+        if (next < segment_size)
+          break;
+      }
+    }
+
+    send_iovs_[num_msgs].iov_base = send_buffer_.data() + pos;
+    send_iovs_[num_msgs].iov_len = bytes;
+
+    struct msghdr &hdr = send_msgs_[num_msgs].msg_hdr;
+    memset(&hdr, 0, sizeof(hdr));
+    hdr.msg_name = addrinfo_res_->ai_addr;
+    hdr.msg_namelen = static_cast<socklen_t>(addrinfo_res_->ai_addrlen);
+    hdr.msg_iov = &send_iovs_[num_msgs];
+    hdr.msg_iovlen = 1;
+
+    if (count > 1) {
+      GsoControl &control = send_controls_[num_msgs];
+      memset(control.buf, 0, sizeof(control.buf));
+      hdr.msg_control = control.buf;
+      hdr.msg_controllen = sizeof(control.buf);
+
+      struct cmsghdr *cmsg = CMSG_FIRSTHDR(&hdr);
+      cmsg->cmsg_level = IPPROTO_UDP;
+      cmsg->cmsg_type = UDP_SEGMENT;
+      cmsg->cmsg_len = CMSG_LEN(sizeof(uint16_t));
+      uint16_t gso_size = static_cast<uint16_t>(segment_size);
+      memcpy(CMSG_DATA(cmsg), &gso_size, sizeof(gso_size));
+    }
+
+    send_msgs_[num_msgs].msg_len = 0;
+    send_msg_datagrams_[num_msgs] = count;
+    ++num_msgs;
+
+    i += count;
+    pos += bytes;
+  }
+
+  return num_msgs;
+}
+
+
+bool FunapiUdpImpl::FlushSend(const SendCompletionHandler &send_completion_handler) {
+  if (send_lengths_.empty()) {
+    return true;
+  }
+
+  size_t index = 0;
+  size_t offset = 0;
+  int sent_length = 0;
+
+  while (index < send_lengths_.size()) {
+    size_t msg_offset = offset;
+    int num_msgs = BuildSendMessages(index, &msg_offset);
+
+    int sent = sendmmsg(socket_, send_msgs_, num_msgs, 0);
+    if (sent < 0) {
+      int error_code = FunapiUtil::GetSocketErrorCode();
+      if (error_code == EINTR) {
+        continue;
+      }
+
+      if (use_gso_ && (error_code == EIO || error_code == EINVAL)) {
+        // GSO is not supported by the device. Sends them one by one.
+        DebugUtils::Log("UDP GSO is not available: (%d)", error_code);
+        use_gso_ = false;
+        continue;
+      }
+
+      OnSendFailed(send_completion_handler);
+      return true;
+    }
+
+    if (sent == 0) {
+      break;
+    }
+
+    // sendmmsg() may send fewer messages than given. Sends the rest again.
+    for (int i = 0; i < sent; ++i) {
+      index += send_msg_datagrams_[i];
+      offset += send_iovs_[i].iov_len;
+      sent_length += static_cast<int>(send_msgs_[i].msg_len);
+    }
+  }
+
+  send_buffer_.clear();
+  send_lengths_.clear();
+
+  send_completion_handler(false, 0, "", sent_length);
+
+  return true;
+}
+
+
+void FunapiUdpImpl::SetSegmentOffload(const bool enable) {
+  use_gso_ = false;
+  use_gro_ = false;
+
+  if (!enable || socket_ < 0) {
+    return;
+  }
+
+  // Checks that the kernel knows the options. 0 means no default segment size.
+  int gso_size = 0;
+  use_gso_ = (setsockopt(socket_, IPPROTO_UDP, UDP_SEGMENT, &gso_size, sizeof(gso_size)) == 0);
+
+  int on = 1;
+  use_gro_ = (setsockopt(socket_, IPPROTO_UDP, UDP_GRO, &on, sizeof(on)) == 0);
+
+  DebugUtils::Log("UDP segment offload: gso=%d gro=%d", use_gso_, use_gro_);
+}
+#else // FUNAPI_HAVE_UDP_MMSG
+bool FunapiUdpImpl::FlushSend(const SendCompletionHandler &send_completion_handler) {
+  if (send_lengths_.empty()) {
+    return true;
+  }
+
+  size_t offset = 0;
+  int sent_length = 0;
+
+  for (size_t length : send_lengths_) {
+    const char *buf = reinterpret_cast<const char*>(send_buffer_.data() + offset);
+    int nSent = static_cast<int>(sendto(socket_, buf, static_cast<int>(length), 0,
+                                        addrinfo_res_->ai_addr,
+                                        static_cast<int>(addrinfo_res_->ai_addrlen)));
+    if (nSent < 0) {
+      OnSendFailed(send_completion_handler);
+      return true;
+    }
+
+    offset += length;
+    sent_length += nSent;
+  }
+
+  send_buffer_.clear();
+  send_lengths_.clear();
+
+  send_completion_handler(false, 0, "", sent_length);
+
+  return true;
+}
+
+
+void FunapiUdpImpl::SetSegmentOffload(const bool enable) {
+  // Segment offload is only for Linux.
+}
+#endif // FUNAPI_HAVE_UDP_MMSG
+
+
 ////////////////////////////////////////////////////////////////////////////////
 // FunapiSocket implementation.
 
@@ -1404,6 +2564,29 @@ std::shared_ptr<FunapiAddrInfoImpl> FunapiAddrInfo::GetImpl() {
 }
 
 
+////////////////////////////////////////////////////////////////////////////////
+// FunapiResolver implementation.
+
+void FunapiResolver::Resolve(const fun::string &hostname_or_ip,
+                             const int port,
+                             const int socktype,
+                             const ResolveHandler &handler) {
+  FunapiResolverImpl::Get().Resolve(hostname_or_ip, port, socktype, handler);
+}
+
+
+void FunapiResolver::Invalidate(const fun::string &hostname_or_ip,
+                                const int port,
+                                const int socktype) {
+  FunapiResolverImpl::Get().Invalidate(hostname_or_ip, port, socktype);
+}
+
+
+void FunapiResolver::Clear() {
+  FunapiResolverImpl::Get().Clear();
+}
+
+
 ////////////////////////////////////////////////////////////////////////////////
 // FunapiTcp implementation.
 
@@ -1475,6 +2658,21 @@ bool FunapiTcp::Send(const fun::vector<uint8_t> &body, const SendCompletionHandl
 }
 
 
+void FunapiTcp::SetUseTLSSessionResumption(const bool use) {
+  impl_->SetUseTLSSessionResumption(use);
+}
+
+
+bool FunapiTcp::IsTLSSessionResumed() const {
+  return impl_->IsTLSSessionResumed();
+}
+
+
+int64_t FunapiTcp::GetTLSHandshakeTime() const {
+  return impl_->GetTLSHandshakeTime();
+}
+
+
 int FunapiTcp::GetSocket() {
   return impl_->GetSocket();
 }
@@ -1529,6 +2727,21 @@ bool FunapiUdp::Send(const fun::vector<uint8_t> &body, const SendCompletionHandl
 }
 
 
+void FunapiUdp::PushSend(const fun::vector<uint8_t> &body) {
+  impl_->PushSend(body);
+}
+
+
+bool FunapiUdp::FlushSend(const SendCompletionHandler &send_completion_handler) {
+  return impl_->FlushSend(send_completion_handler);
+}
+
+
+void FunapiUdp::SetSegmentOffload(const bool enable) {
+  impl_->SetSegmentOffload(enable);
+}
+
+
 int FunapiUdp::GetSocket() {
   return impl_->GetSocket();
 }
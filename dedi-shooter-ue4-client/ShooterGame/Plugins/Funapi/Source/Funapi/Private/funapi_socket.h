@@ -17,6 +17,27 @@ class FunapiSocket {
 };
 
 
+// Resolves host names on a resolver thread and caches the addresses.
+// The cache is shared by every TCP and UDP socket, so a connect whose host
+// has been resolved does not call getaddrinfo() again until it expires.
+class FunapiResolver {
+ public:
+  typedef std::function<void()> ResolveHandler;
+
+  // Calls the handler at once if the host is cached. Otherwise resolves
+  // the host on the resolver thread and calls the handler there.
+  static void Resolve(const fun::string &hostname_or_ip,
+                      const int port,
+                      const int socktype,
+                      const ResolveHandler &handler);
+
+  static void Invalidate(const fun::string &hostname_or_ip,
+                         const int port,
+                         const int socktype);
+  static void Clear();
+};
+
+
 class FunapiAddrInfoImpl;
 class FunapiAddrInfo : public std::enable_shared_from_this<FunapiAddrInfo> {
  public:
@@ -84,6 +105,13 @@ class FunapiTcp : public std::enable_shared_from_this<FunapiTcp> {
   bool Send(const fun::vector<uint8_t> &body,
             const SendCompletionHandler &send_completion_handler);
 
+  // Resumes the last TLS session with the same host and port. Set before Connect().
+  void SetUseTLSSessionResumption(const bool use);
+
+  // Results of the last TLS handshake.
+  bool IsTLSSessionResumed() const;
+  int64_t GetTLSHandshakeTime() const;
+
   int GetSocket();
 
 #ifdef FUNAPI_PLATFORM_WINDOWS
@@ -133,6 +161,14 @@ class FunapiUdp : public std::enable_shared_from_this<FunapiUdp> {
 
   bool Send(const fun::vector<uint8_t> &body, const SendCompletionHandler &send_completion_handler);
 
+  // Queues a datagram. Queued datagrams are sent together by FlushSend(),
+  // with one sendmmsg() call where it is available.
+  void PushSend(const fun::vector<uint8_t> &body);
+  bool FlushSend(const SendCompletionHandler &send_completion_handler);
+
+  // Uses UDP GSO/GRO on Linux if the kernel supports it.
+  void SetSegmentOffload(const bool enable);
+
   int GetSocket();
 #ifdef FUNAPI_PLATFORM_WINDOWS
   void OnPoll(HANDLE handle);
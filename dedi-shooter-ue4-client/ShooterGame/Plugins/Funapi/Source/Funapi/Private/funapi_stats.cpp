@@ -0,0 +1,250 @@
+// Copyright (C) 2013-2019 iFunFactory Inc. All Rights Reserved.
+//
+// This work is confidential and proprietary to iFunFactory Inc. and
+// must not be used, disclosed, copied, or distributed without the prior
+// consent of iFunFactory Inc.
+
+#include "funapi_stats.h"
+
+#ifdef FUNAPI_UE4
+#include "FunapiPrivatePCH.h"
+#endif
+
+#include "funapi_utils.h"
+
+namespace fun {
+
+////////////////////////////////////////////////////////////////////////////////
+// FunapiStatsImpl implementation.
+
+class FunapiStatsImpl {
+ public:
+  static const int kShards = 16;
+
+  static FunapiStatsImpl& Get();
+
+  void Add(const int index, const int64_t value);
+  FunapiStats::Values Snapshot();
+
+  void SetDump(const int interval_seconds, const fun::string &path);
+  void Update();
+
+  static const int kTransportBegin = 0;
+  static const int kCounterBegin =
+    FunapiStats::kProtocolCount * FunapiStats::kTransportCounterCount;
+  static const int kSlots = kCounterBegin + FunapiStats::kCounterCount;
+
+ private:
+  FunapiStatsImpl() = default;
+
+  // A cache line of its own for each shard.
+  struct alignas(64) Shard {
+    std::atomic<int64_t> slots[kSlots];
+  };
+
+  void Dump();
+
+  Shard shards_[kShards];
+
+  int64_t dump_interval_millisecond_ = 0;
+  int64_t next_dump_millisecond_ = 0;
+  fun::string dump_path_;
+  std::mutex dump_mutex_;
+};
+
+
+FunapiStatsImpl& FunapiStatsImpl::Get() {
+  static FunapiStatsImpl instance;
+  return instance;
+}
+
+
+void FunapiStatsImpl::Add(const int index, const int64_t value) {
+  // Threads are spread over the shards by their ids.
+  static std::hash<std::thread::id> hasher;
+  size_t shard = hasher(std::this_thread::get_id()) % kShards;
+
+  shards_[shard].slots[index].fetch_add(value, std::memory_order_relaxed);
+}
+
+
+FunapiStats::Values FunapiStatsImpl::Snapshot() {
+  int64_t sums[kSlots] = {};
+  for (auto &shard : shards_) {
+    for (int i = 0; i < kSlots; ++i) {
+      sums[i] += shard.slots[i].load(std::memory_order_relaxed);
+    }
+  }
+
+  FunapiStats::Values values;
+  values.time_millisecond = std::chrono::duration_cast<std::chrono::milliseconds>(
+    std::chrono::system_clock::now().time_since_epoch()).count();
+
+  for (int p = 0; p < FunapiStats::kProtocolCount; ++p) {
+    for (int c = 0; c < FunapiStats::kTransportCounterCount; ++c) {
+      values.transports[p][c] = sums[kTransportBegin + p * FunapiStats::kTransportCounterCount + c];
+    }
+  }
+
+  for (int c = 0; c < FunapiStats::kCounterCount; ++c) {
+    values.counters[c] = sums[kCounterBegin + c];
+  }
+
+  return values;
+}
+
+
+void FunapiStatsImpl::SetDump(const int interval_seconds, const fun::string &path) {
+  std::unique_lock<std::mutex> lock(dump_mutex_);
+  dump_interval_millisecond_ = static_cast<int64_t>(interval_seconds) * 1000;
+  next_dump_millisecond_ = FunapiTimerWheel::NowMillisecond() + dump_interval_millisecond_;
+  dump_path_ = path;
+}
+
+
+void FunapiStatsImpl::Update() {
+  {
+    std::unique_lock<std::mutex> lock(dump_mutex_);
+    if (dump_interval_millisecond_ <= 0) {
+      return;
+    }
+
+    int64_t now = FunapiTimerWheel::NowMillisecond();
+    if (now < next_dump_millisecond_) {
+      return;
+    }
+
+    next_dump_millisecond_ = now + dump_interval_millisecond_;
+  }
+
+  Dump();
+}
+
+
+void FunapiStatsImpl::Dump() {
+  fun::string json_string = Snapshot().ToJson();
+
+  fun::string path;
+  {
+    std::unique_lock<std::mutex> lock(dump_mutex_);
+    path = dump_path_;
+  }
+
+  // Logged even without DEBUG_LOG, since DebugUtils::Log() is a no-op
+  // there.
+  if (path.empty()) {
+#ifdef FUNAPI_COCOS2D
+    CCLOG("[Stats] %s", json_string.c_str());
+#endif
+
+#ifdef FUNAPI_UE4
+    UE_LOG(LogFunapi, Log, TEXT("[Stats] %s"), *FString(json_string.c_str()));
+#endif
+    return;
+  }
+
+  FILE *fp = fopen(path.c_str(), "a");
+  if (fp == NULL) {
+    DebugUtils::Log("Failed to open the stats file: %s", path.c_str());
+    return;
+  }
+
+  fprintf(fp, "%s\n", json_string.c_str());
+  fclose(fp);
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+// FunapiStats::Values implementation.
+
+int64_t FunapiStats::Values::Get(const TransportProtocol protocol,
+                                 const TransportCounter counter) const {
+  return transports[static_cast<int>(protocol)][static_cast<int>(counter)];
+}
+
+
+int64_t FunapiStats::Values::Get(const Counter counter) const {
+  return counters[static_cast<int>(counter)];
+}
+
+
+fun::string FunapiStats::Values::ToJson() const {
+  static const char* kProtocolNames[] = { "tcp", "udp", "http", "websocket" };
+  static const char* kTransportCounterNames[] = {
+    "bytes_sent", "bytes_received", "messages_sent", "messages_received"
+  };
+  static const char* kCounterNames[] = {
+    "encode_ns", "compress_ns", "encrypt_ns", "decode_ns",
+    "reconnects", "redirects", "poll_wakeups",
+    "send_queue_depth", "sent_queue_depth", "task_queue_depth"
+  };
+  static_assert(sizeof(kTransportCounterNames) / sizeof(kTransportCounterNames[0]) == kTransportCounterCount,
+                "A transport counter has no name.");
+  static_assert(sizeof(kCounterNames) / sizeof(kCounterNames[0]) == kCounterCount,
+                "A counter has no name.");
+
+  rapidjson::StringBuffer buffer;
+  rapidjson::Writer<rapidjson::StringBuffer> writer(buffer);
+
+  writer.StartObject();
+  writer.Key("time");
+  writer.Int64(time_millisecond);
+
+  for (int p = 0; p < kProtocolCount; ++p) {
+    writer.Key(kProtocolNames[p]);
+    writer.StartObject();
+    for (int c = 0; c < kTransportCounterCount; ++c) {
+      writer.Key(kTransportCounterNames[c]);
+      writer.Int64(transports[p][c]);
+    }
+    writer.EndObject();
+  }
+
+  for (int c = 0; c < kCounterCount; ++c) {
+    writer.Key(kCounterNames[c]);
+    writer.Int64(counters[c]);
+  }
+
+  writer.EndObject();
+
+  return buffer.GetString();
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+// FunapiStats implementation.
+
+void FunapiStats::Add(const Counter counter, const int64_t value) {
+  FunapiStatsImpl::Get().Add(FunapiStatsImpl::kCounterBegin + static_cast<int>(counter), value);
+}
+
+
+void FunapiStats::Add(const TransportProtocol protocol,
+                      const TransportCounter counter,
+                      const int64_t value) {
+  int p = static_cast<int>(protocol);
+  if (p < 0 || p >= kProtocolCount) {
+    return;
+  }
+
+  FunapiStatsImpl::Get().Add(FunapiStatsImpl::kTransportBegin +
+                             p * kTransportCounterCount +
+                             static_cast<int>(counter), value);
+}
+
+
+FunapiStats::Values FunapiStats::Snapshot() {
+  return FunapiStatsImpl::Get().Snapshot();
+}
+
+
+void FunapiStats::SetDump(const int interval_seconds, const fun::string &path) {
+  FunapiStatsImpl::Get().SetDump(interval_seconds, path);
+}
+
+
+void FunapiStats::Update() {
+  FunapiStatsImpl::Get().Update();
+}
+
+}  // namespace fun
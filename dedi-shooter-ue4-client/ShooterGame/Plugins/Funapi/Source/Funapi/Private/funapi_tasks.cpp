@@ -15,6 +15,8 @@
 #include "funapi_socket.h"
 #include "funapi_announcement.h"
 #include "funapi_downloader.h"
+#include "funapi_multicasting.h"
+#include "funapi_stats.h"
 
 namespace fun {
 
@@ -29,12 +31,14 @@ class FunapiTasksImpl : public std::enable_shared_from_this<FunapiTasksImpl> {
   virtual ~FunapiTasksImpl();
 
   void Update();
-  virtual void Push(const TaskHandler &task);
+  virtual void Push(FunapiTask &&task);
   virtual int Size();
 
+  void SetTimeBudgetMicrosecond(const int64_t microsecond);
+
  protected:
-  fun::queue<std::shared_ptr<std::function<bool()>>> queue_;
-  std::mutex mutex_;
+  FunapiMpscQueue<FunapiTask> queue_;
+  int64_t time_budget_microsecond_ = 0;
 };
 
 
@@ -44,59 +48,68 @@ FunapiTasksImpl::FunapiTasksImpl() {
 
 FunapiTasksImpl::~FunapiTasksImpl() {
   // DebugUtils::Log("%s", __FUNCTION__);
+  FunapiStats::Add(FunapiStats::Counter::kTaskQueueDepth, -static_cast<int64_t>(queue_.Size()));
 }
 
 
 void FunapiTasksImpl::Update()
 {
-  std::shared_ptr<std::function<bool()>> task = nullptr;
-  fun::queue<std::shared_ptr<std::function<bool()>>> update_queue;
+  // Runs only the tasks pushed before this update.
+  size_t count = queue_.Size();
+  if (count == 0)
+    return;
+
+  const bool use_budget = time_budget_microsecond_ > 0;
+  std::chrono::steady_clock::time_point deadline;
+  if (use_budget)
   {
-    std::unique_lock<std::mutex> lock(mutex_);
-    queue_.swap(update_queue);
+    deadline = std::chrono::steady_clock::now() +
+               std::chrono::microseconds(time_budget_microsecond_);
   }
 
-  while (true)
+  size_t popped = count;
+
+  FunapiTask task;
+  while (count > 0 && queue_.Pop(task))
   {
-    {
-      if (update_queue.empty())
-      {
-        break;
-      }
-      else
-      {
-        task = update_queue.front();
-        update_queue.pop();
-      }
-    }
+    --count;
 
-    if (task)
-    {
-      if ((*task)() == false) break;
-    }
-    else
+    if (task() == false)
     {
+      // Drops the rest of this batch.
+      while (count > 0 && queue_.Pop(task))
+        --count;
+
       break;
     }
+
+    if (use_budget && std::chrono::steady_clock::now() >= deadline)
+      break;
   }
+
+  popped -= count;
+  FunapiStats::Add(FunapiStats::Counter::kTaskQueueDepth, -static_cast<int64_t>(popped));
 }
 
 
-void FunapiTasksImpl::Push(const TaskHandler &task)
+void FunapiTasksImpl::Push(FunapiTask &&task)
 {
-  std::unique_lock<std::mutex> lock(mutex_);
-
   if (task) {
-    auto h = std::make_shared<TaskHandler>(task);
-    queue_.push(h);
+    queue_.Push(std::move(task));
+    FunapiStats::Add(FunapiStats::Counter::kTaskQueueDepth, 1);
   }
 }
 
 
 int FunapiTasksImpl::Size()
 {
-  std::unique_lock<std::mutex> lock(mutex_);
-  return static_cast<int>(queue_.size());
+  return static_cast<int>(queue_.Size());
+}
+
+
+void FunapiTasksImpl::SetTimeBudgetMicrosecond(const int64_t microsecond)
+{
+  time_budget_microsecond_ = microsecond;
 }
 
 
@@ -118,7 +131,12 @@ std::shared_ptr<FunapiTasks> FunapiTasks::Create() {
 
 
 void FunapiTasks::Push(const TaskHandler &task) {
-  impl_->Push(task);
+  impl_->Push(FunapiTask(task));
+}
+
+
+void FunapiTasks::Push(FunapiTask &&task) {
+  impl_->Push(std::move(task));
 }
 
 
@@ -132,10 +150,17 @@ void FunapiTasks::Update() {
 }
 
 
+void FunapiTasks::SetTimeBudgetMicrosecond(const int64_t microsecond) {
+  impl_->SetTimeBudgetMicrosecond(microsecond);
+}
+
+
 void FunapiTasks::UpdateAll() {
+  FunapiMulticast::UpdateAll();
   FunapiSession::UpdateAll();
   FunapiAnnouncement::UpdateAll();
   FunapiHttpDownloader::UpdateAll();
+  FunapiStats::Update();
 }
 
 
@@ -148,7 +173,7 @@ class FunapiThreadImpl : public FunapiTasksImpl {
   FunapiThreadImpl(const fun::string &thread_id);
   virtual ~FunapiThreadImpl();
 
-  void Push(const TaskHandler &task);
+  void Push(FunapiTask &&task);
   void Join();
 
   fun::string GetThreadId();
@@ -161,12 +186,15 @@ class FunapiThreadImpl : public FunapiTasksImpl {
 
   std::thread thread_;
   bool run_ = false;
+  std::mutex mutex_;
   std::condition_variable_any condition_;
   fun::string thread_id_;
+  bool is_network_ = false;
 };
 
 
-FunapiThreadImpl::FunapiThreadImpl(const fun::string &thread_id) : thread_id_(thread_id) {
+FunapiThreadImpl::FunapiThreadImpl(const fun::string &thread_id)
+    : thread_id_(thread_id), is_network_(thread_id.compare("_network") == 0) {
   Initialize();
 }
 
@@ -188,9 +216,16 @@ void FunapiThreadImpl::Finalize() {
 }
 
 
-void FunapiThreadImpl::Push(const TaskHandler &task)
+void FunapiThreadImpl::Push(FunapiTask &&task)
 {
-  FunapiTasksImpl::Push(task);
+  FunapiTasksImpl::Push(std::move(task));
+
+  // The network thread is woken up by FunapiSocket::Poll.
+  if (!is_network_)
+  {
+    // Pairs with the empty check in Thread() so that the wake up is not lost.
+    std::unique_lock<std::mutex> lock(mutex_);
+  }
   condition_.notify_one();
 }
 
@@ -206,22 +241,16 @@ void FunapiThreadImpl::JoinThread() {
 
 
 void FunapiThreadImpl::Thread() {
-  bool is_network = false;
-  if (thread_id_.compare("_network") == 0)
-  {
-    is_network = true;
-  }
-
   while (run_)
   {
-    if (is_network)
+    if (is_network_)
     {
       FunapiSocket::Poll();
     }
     else
     {
       std::unique_lock<std::mutex> lock(mutex_);
-      if (queue_.empty()) {
+      if (queue_.Empty()) {
         condition_.wait(mutex_);
       }
     }
@@ -264,7 +293,12 @@ std::shared_ptr<FunapiThread> FunapiThread::Create(const fun::string &thread_id)
 
 
 void FunapiThread::Push(const TaskHandler &task) {
-  impl_->Push(task);
+  impl_->Push(FunapiTask(task));
+}
+
+
+void FunapiThread::Push(FunapiTask &&task) {
+  impl_->Push(std::move(task));
 }
 
 
@@ -11,6 +11,12 @@
 #endif
 
 #include <iomanip>
+#include <limits>
+#include <sys/stat.h>
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
 
 #ifdef FUNAPI_COCOS2D
 #include <assert.h>
@@ -26,34 +32,65 @@
 namespace fun {
 
 ////////////////////////////////////////////////////////////////////////////////
-// FunapiUtil implementation.
+// FunapiMD5 implementation.
 
 #ifdef FUNAPI_COCOS2D
-fun::string FunapiUtil::MD5String(const fun::string &file_name, bool use_front) {
-  const size_t read_buffer_size = 1048576; // 1024*1024
-  const size_t md5_buffer_size = 16;
-  fun::vector<unsigned char> buffer(read_buffer_size);
-  fun::vector<unsigned char> md5(md5_buffer_size);
-  size_t length;
+class FunapiMD5Impl {
+ public:
+  FunapiMD5Impl() { md5_init(&ctx_); }
 
-  FILE *fp = fopen(file_name.c_str(), "rb");
-  if (!fp) {
-    return fun::string("");
+  void Update(const void *data, const size_t length) {
+    md5_append(&ctx_, static_cast<const md5_byte_t*>(data), static_cast<int>(length));
   }
 
-  md5_state_t ctx;
-  md5_init(&ctx);
-  if (use_front) {
-    length = fread(buffer.data(), 1, read_buffer_size, fp);
-    md5_append(&ctx, buffer.data(), static_cast<int>(length));
-  }
-  else {
-    while ((length = fread(buffer.data(), 1, read_buffer_size, fp)) != 0) {
-      md5_append(&ctx, buffer.data(), static_cast<int>(length));
-    }
+  void Final(unsigned char *digest) { md5_finish(&ctx_, digest); }
+
+ private:
+  md5_state_t ctx_;
+};
+#endif // FUNAPI_COCOS2D
+
+
+#ifdef FUNAPI_UE4
+class FunapiMD5Impl {
+ public:
+  void Update(const void *data, const size_t length) {
+    md5_.Update(static_cast<const uint8*>(data), length);
   }
-  md5_finish(&ctx, md5.data());
-  fclose(fp);
+
+  void Final(unsigned char *digest) { md5_.Final(digest); }
+
+ private:
+  FMD5 md5_;
+};
+#endif // FUNAPI_UE4
+
+
+FunapiMD5::FunapiMD5()
+: impl_(std::make_shared<FunapiMD5Impl>())
+{
+}
+
+
+FunapiMD5::~FunapiMD5()
+{
+}
+
+
+void FunapiMD5::Update(const void *data, const size_t length)
+{
+  impl_->Update(data, length);
+}
+
+
+fun::string FunapiMD5::GetHexDigest() const
+{
+  const size_t md5_buffer_size = 16;
+  unsigned char md5[md5_buffer_size];
+
+  // Finishes a copy, so that more bytes can be added.
+  FunapiMD5Impl impl(*impl_);
+  impl.Final(md5);
 
   fun::string ret(md5_buffer_size*2, 0);
   char* c = const_cast<char*>(ret.data());
@@ -63,46 +100,52 @@ fun::string FunapiUtil::MD5String(const fun::string &file_name, bool use_front)
 
   return ret;
 }
-#endif // FUNAPI_COCOS2D
 
 
-#ifdef FUNAPI_UE4
+////////////////////////////////////////////////////////////////////////////////
+// FunapiUtil implementation.
+
 fun::string FunapiUtil::MD5String(const fun::string &file_name, bool use_front) {
-  const size_t read_buffer_size = 1048576; // 1024*1024
-  const size_t md5_buffer_size = 16;
+  fun::string md5;
+  fun::string md5_front;
+
+  if (!MD5File(file_name, use_front ? nullptr : &md5, &md5_front)) {
+    return fun::string("");
+  }
+
+  return use_front ? md5_front : md5;
+}
+
+
+bool FunapiUtil::MD5File(const fun::string &file_name, fun::string *md5, fun::string *md5_front) {
+  const size_t read_buffer_size = FunapiMD5::kFrontSize;
   fun::vector<unsigned char> buffer(read_buffer_size);
-  fun::vector<unsigned char> md5_buffer(read_buffer_size);
   size_t length;
-  FMD5 md5;
+  FunapiMD5 ctx;
 
   FILE *fp = fopen(file_name.c_str(), "rb");
   if (!fp) {
-    return fun::string("");
+    return false;
   }
 
-  if (use_front) {
-    length = fread(buffer.data(), 1, read_buffer_size, fp);
-    md5.Update(buffer.data(), length);
+  // The front hash covers the first read buffer.
+  length = fread(buffer.data(), 1, read_buffer_size, fp);
+  ctx.Update(buffer.data(), length);
+  if (md5_front) {
+    *md5_front = ctx.GetHexDigest();
   }
-  else {
+
+  if (md5) {
     while ((length = fread(buffer.data(), 1, read_buffer_size, fp)) != 0) {
-      md5.Update(buffer.data(), length);
+      ctx.Update(buffer.data(), length);
     }
+    *md5 = ctx.GetHexDigest();
   }
 
-  md5.Final(md5_buffer.data());
-
   fclose(fp);
 
-  fun::string ret(md5_buffer_size*2, 0);
-  char* c = const_cast<char*>(ret.data());
-  for (int i = 0; i<md5_buffer_size; ++i, c+=2) {
-    sprintf(c, "%02x", md5_buffer[i]);
-  }
-
-  return ret;
+  return true;
 }
-#endif // FUNAPI_UE4
 
 #ifdef FUNAPI_COCOS2D
 bool FunapiUtil::DecodeBase64(const fun::string &in, fun::vector<uint8_t> &out) {
@@ -269,7 +312,7 @@ bool FunapiUtil::IsFileExists(const fun::string &file_name)
 }
 
 
-long FunapiUtil::GetFileSize(const fun::string &file_name)
+int64_t FunapiUtil::GetFileSize(const fun::string &file_name)
 {
 #ifdef FUNAPI_COCOS2D
   return cocos2d::FileUtils::getInstance()->getFileSize(file_name.c_str());
@@ -285,6 +328,37 @@ long FunapiUtil::GetFileSize(const fun::string &file_name)
 
 
 
+int FunapiUtil::SeekFile(FILE *fp, const uint64_t offset)
+{
+#ifdef FUNAPI_PLATFORM_WINDOWS
+  return _fseeki64(fp, static_cast<__int64>(offset), SEEK_SET);
+#else // FUNAPI_PLATFORM_WINDOWS
+  return fseeko(fp, static_cast<off_t>(offset), SEEK_SET);
+#endif // FUNAPI_PLATFORM_WINDOWS
+}
+
+
+bool FunapiUtil::GetFileStat(const fun::string &file_name, uint64_t &size, int64_t &mtime, uint64_t &inode)
+{
+#ifdef FUNAPI_PLATFORM_WINDOWS
+  struct _stat64 st;
+  if (_stat64(file_name.c_str(), &st) != 0) {
+    return false;
+  }
+#else // FUNAPI_PLATFORM_WINDOWS
+  struct stat st;
+  if (stat(file_name.c_str(), &st) != 0) {
+    return false;
+  }
+#endif // FUNAPI_PLATFORM_WINDOWS
+
+  size = static_cast<uint64_t>(st.st_size);
+  mtime = static_cast<int64_t>(st.st_mtime);
+  inode = static_cast<uint64_t>(st.st_ino);
+  return true;
+}
+
+
 bool FunapiUtil::IsDirectoryExists(const fun::string &dir_name)
 {
 #ifdef FUNAPI_COCOS2D
@@ -352,6 +426,259 @@ void FunapiTimer::SetTimer(const time_t seconds) {
 };
 
 
+////////////////////////////////////////////////////////////////////////////////
+// FunapiTimerWheel implementation.
+
+namespace {
+
+const int64_t kTimerWheelNever = std::numeric_limits<int64_t>::max();
+
+
+// Index of the lowest set bit. value must not be 0.
+int LowestBit(uint64_t value) {
+#if defined(_MSC_VER)
+  unsigned long index = 0;
+  _BitScanForward64(&index, value);
+  return static_cast<int>(index);
+#else
+  return __builtin_ctzll(value);
+#endif
+}
+
+}  // namespace
+
+
+FunapiTimerWheel::FunapiTimerWheel() {
+  for (int level = 0; level < kLevels; ++level) {
+    occupied_[level] = 0;
+    for (int slot = 0; slot < kSlots; ++slot) {
+      heads_[level][slot] = -1;
+    }
+  }
+
+  current_ = NowMillisecond();
+  next_due_ = kTimerWheelNever;
+}
+
+
+std::shared_ptr<FunapiTimerWheel> FunapiTimerWheel::Create() {
+  return std::make_shared<FunapiTimerWheel>();
+}
+
+
+int64_t FunapiTimerWheel::NowMillisecond() {
+  return std::chrono::duration_cast<std::chrono::milliseconds>(
+      std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+
+FunapiTimerWheel::TimerId FunapiTimerWheel::Schedule(const int64_t delay_millisecond,
+                                                     const TimerHandler &handler) {
+  int64_t now = NowMillisecond();
+
+  std::unique_lock<std::mutex> lock(mutex_);
+
+  // An empty wheel is not advanced. Catches up without walking the slots.
+  if (size_ == 0 && now > current_)
+    current_ = now;
+
+  int32_t index;
+  if (free_nodes_.empty()) {
+    index = static_cast<int32_t>(nodes_.size());
+    nodes_.push_back(Node());
+  }
+  else {
+    index = free_nodes_.back();
+    free_nodes_.pop_back();
+  }
+
+  // Slots up to current_ have already been processed.
+  Node &node = nodes_[index];
+  node.deadline = std::max(now + std::max<int64_t>(delay_millisecond, 0), current_ + 1);
+  node.handler = handler;
+
+  Link(index);
+  ++size_;
+
+  int64_t due = SlotTime(node.level, node.slot);
+  if (due < next_due_.load(std::memory_order_relaxed))
+    next_due_.store(due, std::memory_order_release);
+
+  return (static_cast<TimerId>(node.generation) << 32) | static_cast<TimerId>(index + 1);
+}
+
+
+bool FunapiTimerWheel::Cancel(const TimerId id) {
+  if (id == kInvalidTimerId)
+    return false;
+
+  int32_t index = static_cast<int32_t>(id & 0xffffffff) - 1;
+  uint32_t generation = static_cast<uint32_t>(id >> 32);
+
+  std::unique_lock<std::mutex> lock(mutex_);
+
+  if (index < 0 || index >= static_cast<int32_t>(nodes_.size()))
+    return false;
+
+  Node &node = nodes_[index];
+  if (node.generation != generation || node.level < 0)
+    return false;
+
+  Unlink(index);
+  Free(index);
+  return true;
+}
+
+
+void FunapiTimerWheel::Advance() {
+  Advance(NowMillisecond());
+}
+
+
+void FunapiTimerWheel::Advance(const int64_t now_millisecond) {
+  if (now_millisecond < next_due_.load(std::memory_order_acquire))
+    return;
+
+  std::unique_lock<std::mutex> lock(mutex_);
+
+  while (true) {
+    int64_t t = NextEventTime();
+    if (t > now_millisecond)
+      break;
+
+    current_ = t;
+
+    // Moves timers of higher levels down when their block starts.
+    for (int level = kLevels - 1; level > 0; --level) {
+      int64_t mask = (static_cast<int64_t>(1) << (kSlotBits * level)) - 1;
+      if ((t & mask) != 0)
+        continue;
+
+      int slot = static_cast<int>((t >> (kSlotBits * level)) & (kSlots - 1));
+      int32_t index = heads_[level][slot];
+      heads_[level][slot] = -1;
+      occupied_[level] &= ~(static_cast<uint64_t>(1) << slot);
+
+      while (index >= 0) {
+        int32_t next = nodes_[index].next;
+        Link(index);
+        index = next;
+      }
+    }
+
+    // Runs expired timers one by one so that handlers can cancel others.
+    int slot = static_cast<int>(t & (kSlots - 1));
+    while (heads_[0][slot] >= 0) {
+      int32_t index = heads_[0][slot];
+      TimerHandler handler = std::move(nodes_[index].handler);
+      Unlink(index);
+      Free(index);
+
+      lock.unlock();
+      if (handler) handler();
+      lock.lock();
+    }
+  }
+
+  if (now_millisecond > current_)
+    current_ = now_millisecond;
+
+  next_due_.store(NextEventTime(), std::memory_order_release);
+}
+
+
+size_t FunapiTimerWheel::Size() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  return size_;
+}
+
+
+void FunapiTimerWheel::Link(const int32_t index) {
+  Node &node = nodes_[index];
+
+  int64_t delta = node.deadline - current_;
+  int level = 0;
+  while (level < kLevels - 1 && delta >= (static_cast<int64_t>(1) << (kSlotBits * (level + 1))))
+    ++level;
+
+  // Timers beyond the wheel wait in the last slot of the top level
+  // and are moved again when it is cascaded.
+  int64_t t = std::min(node.deadline,
+                       current_ + (static_cast<int64_t>(1) << (kSlotBits * kLevels)) - 1);
+  int slot = static_cast<int>((t >> (kSlotBits * level)) & (kSlots - 1));
+
+  node.level = level;
+  node.slot = slot;
+  node.prev = -1;
+  node.next = heads_[level][slot];
+  if (node.next >= 0)
+    nodes_[node.next].prev = index;
+
+  heads_[level][slot] = index;
+  occupied_[level] |= static_cast<uint64_t>(1) << slot;
+}
+
+
+void FunapiTimerWheel::Unlink(const int32_t index) {
+  Node &node = nodes_[index];
+
+  if (node.prev >= 0)
+    nodes_[node.prev].next = node.next;
+  else
+    heads_[node.level][node.slot] = node.next;
+
+  if (node.next >= 0)
+    nodes_[node.next].prev = node.prev;
+
+  if (heads_[node.level][node.slot] < 0)
+    occupied_[node.level] &= ~(static_cast<uint64_t>(1) << node.slot);
+
+  node.prev = node.next = -1;
+  node.level = node.slot = -1;
+}
+
+
+void FunapiTimerWheel::Free(const int32_t index) {
+  Node &node = nodes_[index];
+  node.handler = nullptr;
+  ++node.generation;
+  free_nodes_.push_back(index);
+  --size_;
+}
+
+
+// The next time after current_ at which the slot is processed.
+int64_t FunapiTimerWheel::SlotTime(const int level, const int slot) const {
+  int shift = kSlotBits * level;
+  int64_t block = current_ >> shift;
+  int64_t k = (slot - (block & (kSlots - 1))) & (kSlots - 1);
+  if (k == 0)
+    k = kSlots;
+
+  return (block + k) << shift;
+}
+
+
+int64_t FunapiTimerWheel::NextEventTime() const {
+  int64_t next = kTimerWheelNever;
+
+  for (int level = 0; level < kLevels; ++level) {
+    uint64_t occupied = occupied_[level];
+    if (occupied == 0)
+      continue;
+
+    // Finds the first occupied slot after the current one.
+    int start = static_cast<int>(((current_ >> (kSlotBits * level)) + 1) & (kSlots - 1));
+    uint64_t rotated = (occupied >> start) | (start ? (occupied << (kSlots - start)) : 0);
+    int slot = (start + LowestBit(rotated)) & (kSlots - 1);
+
+    next = std::min(next, SlotTime(level, slot));
+  }
+
+  return next;
+}
+
+
 ////////////////////////////////////////////////////////////////////////////////
 // DebugUtils implementation.
 
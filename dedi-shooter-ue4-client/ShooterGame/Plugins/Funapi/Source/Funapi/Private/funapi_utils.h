@@ -52,6 +52,230 @@ template <typename T> class FunapiEvent
 };
 
 
+// Multi-producer, single-consumer queue.
+// Push() and Size()/Empty() can be called from any thread, the other
+// functions only from the consumer thread.
+//
+// Items are pushed into a bounded lock-free ring. When the ring is full they
+// spill into a locked overflow list, so Push() never fails or blocks on the
+// consumer. The consumer moves up to kBatchSize items at a time into a local
+// buffer, so Front()/PopFront() do not touch shared state per item.
+template <typename T> class FunapiMpscQueue
+{
+ public:
+  static const size_t kBatchSize = 64;
+
+  explicit FunapiMpscQueue(const size_t capacity = 256)
+  {
+    size_t n = 2;
+    while (n < capacity) n <<= 1;
+
+    mask_ = n - 1;
+    cells_.reset(new Cell[n]);
+    for (size_t i = 0; i < n; ++i)
+      cells_[i].sequence.store(i, std::memory_order_relaxed);
+
+    pending_.reserve(kBatchSize);
+  }
+
+  FunapiMpscQueue(const FunapiMpscQueue&) = delete;
+  FunapiMpscQueue& operator= (const FunapiMpscQueue&) = delete;
+
+  void Push(T value)
+  {
+    // Counted before the item is visible, so the consumer never pops an
+    // item it has not counted and the size never goes below 0. Push()
+    // cannot fail, so the count is never rolled back. Refill() waits for
+    // an item that is counted but not written yet.
+    size_.fetch_add(1, std::memory_order_acq_rel);
+
+    if (overflow_size_.load(std::memory_order_acquire) > 0 || !TryPush(value))
+    {
+      std::unique_lock<std::mutex> lock(overflow_mutex_);
+      overflow_.push_back(std::move(value));
+      overflow_size_.fetch_add(1, std::memory_order_release);
+    }
+  }
+
+  size_t Size() const
+  {
+    return size_.load(std::memory_order_acquire);
+  }
+
+  bool Empty() const
+  {
+    return Size() == 0;
+  }
+
+  // Consumer only. Returns a default value if the queue is empty.
+  T Front()
+  {
+    if (PendingEmpty() && !Refill())
+      return T();
+
+    return pending_[pending_head_];
+  }
+
+  // Consumer only.
+  void PopFront()
+  {
+    if (PendingEmpty() && !Refill())
+      return;
+
+    pending_[pending_head_] = T();
+    PopPending();
+  }
+
+  // Consumer only. Moves the first item into value.
+  bool Pop(T &value)
+  {
+    if (PendingEmpty() && !Refill())
+      return false;
+
+    value = std::move(pending_[pending_head_]);
+    PopPending();
+    return true;
+  }
+
+  // Consumer only. Moves every item to the back of out.
+  template <typename Container>
+  void Drain(Container &out)
+  {
+    T value;
+    while (!Empty() && Pop(value))
+      out.push_back(std::move(value));
+  }
+
+  // Consumer only.
+  void Clear()
+  {
+    T value;
+    while (!Empty() && Pop(value))
+      value = T();
+  }
+
+ private:
+  struct Cell
+  {
+    std::atomic<size_t> sequence;
+    T value;
+  };
+
+  bool PendingEmpty() const
+  {
+    return pending_head_ == pending_.size();
+  }
+
+  void PopPending()
+  {
+    if (++pending_head_ == pending_.size())
+    {
+      // Keeps the capacity for the next batch.
+      pending_.clear();
+      pending_head_ = 0;
+    }
+
+    size_.fetch_sub(1, std::memory_order_release);
+  }
+
+  bool TryPush(T &value)
+  {
+    size_t pos = enqueue_pos_.load(std::memory_order_relaxed);
+    Cell *cell = nullptr;
+
+    while (true)
+    {
+      cell = &cells_[pos & mask_];
+      size_t seq = cell->sequence.load(std::memory_order_acquire);
+      intptr_t diff = static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos);
+
+      if (diff == 0)
+      {
+        if (enqueue_pos_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+          break;
+      }
+      else if (diff < 0)
+      {
+        return false;  // full
+      }
+      else
+      {
+        pos = enqueue_pos_.load(std::memory_order_relaxed);
+      }
+    }
+
+    cell->value = std::move(value);
+    cell->sequence.store(pos + 1, std::memory_order_release);
+    return true;
+  }
+
+  // Moves up to kBatchSize items into the empty pending_ buffer.
+  bool Refill()
+  {
+    while (Size() > 0)
+    {
+      size_t count = 0;
+      while (count < kBatchSize)
+      {
+        Cell *cell = &cells_[dequeue_pos_ & mask_];
+        if (cell->sequence.load(std::memory_order_acquire) != dequeue_pos_ + 1)
+          break;
+
+        pending_.push_back(std::move(cell->value));
+        cell->value = T();
+        cell->sequence.store(dequeue_pos_ + mask_ + 1, std::memory_order_release);
+        ++dequeue_pos_;
+        ++count;
+      }
+
+      if (count > 0)
+        return true;
+
+      // A producer has reserved a slot but has not written it yet.
+      // Takes nothing from the overflow list to keep the push order.
+      if (enqueue_pos_.load(std::memory_order_acquire) != dequeue_pos_)
+      {
+        std::this_thread::yield();
+        continue;
+      }
+
+      if (overflow_size_.load(std::memory_order_acquire) > 0)
+      {
+        std::unique_lock<std::mutex> lock(overflow_mutex_);
+        while (count < kBatchSize && !overflow_.empty())
+        {
+          pending_.push_back(std::move(overflow_.front()));
+          overflow_.pop_front();
+          ++count;
+        }
+        overflow_size_.fetch_sub(count, std::memory_order_release);
+      }
+
+      if (count > 0)
+        return true;
+
+      std::this_thread::yield();
+    }
+
+    return false;
+  }
+
+  std::unique_ptr<Cell[]> cells_;
+  size_t mask_ = 0;
+  std::atomic<size_t> enqueue_pos_{0};
+  std::atomic<size_t> size_{0};
+
+  std::mutex overflow_mutex_;
+  fun::deque<T> overflow_;
+  std::atomic<size_t> overflow_size_{0};
+
+  // Consumer only.
+  size_t dequeue_pos_ = 0;
+  fun::vector<T> pending_;
+  size_t pending_head_ = 0;
+};
+
+
 class FunapiTimer
 {
  public:
@@ -64,6 +288,65 @@ class FunapiTimer
 };
 
 
+// Hierarchical timer wheel with millisecond resolution.
+// Schedule() and Cancel() can be called from any thread, Advance() only from
+// the thread that owns the wheel. Handlers run in Advance() without the lock.
+// Advance() returns right away when no timer is due.
+class FunapiTimerWheel : public std::enable_shared_from_this<FunapiTimerWheel>
+{
+ public:
+  typedef uint64_t TimerId;
+  typedef std::function<void()> TimerHandler;
+
+  static const TimerId kInvalidTimerId = 0;
+
+  FunapiTimerWheel();
+  virtual ~FunapiTimerWheel() = default;
+
+  static std::shared_ptr<FunapiTimerWheel> Create();
+  static int64_t NowMillisecond();
+
+  TimerId Schedule(const int64_t delay_millisecond, const TimerHandler &handler);
+  bool Cancel(const TimerId id);
+
+  void Advance();
+  void Advance(const int64_t now_millisecond);
+
+  size_t Size();
+
+ private:
+  static const int kLevels = 4;
+  static const int kSlotBits = 6;
+  static const int kSlots = 1 << kSlotBits;
+
+  struct Node
+  {
+    int64_t deadline = 0;
+    TimerHandler handler;
+    uint32_t generation = 0;
+    int32_t prev = -1;
+    int32_t next = -1;
+    int level = -1;
+    int slot = -1;
+  };
+
+  void Link(const int32_t index);
+  void Unlink(const int32_t index);
+  void Free(const int32_t index);
+  int64_t SlotTime(const int level, const int slot) const;
+  int64_t NextEventTime() const;
+
+  std::mutex mutex_;
+  fun::vector<Node> nodes_;
+  fun::vector<int32_t> free_nodes_;
+  int32_t heads_[kLevels][kSlots];
+  uint64_t occupied_[kLevels];
+  int64_t current_ = 0;
+  std::atomic<int64_t> next_due_{0};  // Read without the lock by Advance().
+  size_t size_ = 0;
+};
+
+
 class DebugUtils
 {
  public:
@@ -71,16 +354,44 @@ class DebugUtils
 };
 
 
+// Incremental MD5 hash.
+class FunapiMD5Impl;
+class FunapiMD5
+{
+ public:
+  FunapiMD5();
+  virtual ~FunapiMD5();
+
+  void Update(const void *data, const size_t length);
+
+  // Returns the hash of the bytes so far. Update() can be called after it.
+  fun::string GetHexDigest() const;
+
+  // The md5_front of the downloader manifest covers this many bytes.
+  static const size_t kFrontSize = 1048576;
+
+ private:
+  std::shared_ptr<FunapiMD5Impl> impl_;
+};
+
+
 class FunapiUtil
 {
  public:
   static bool SeqLess(const uint32_t x, const uint32_t y);
   static bool IsFileExists(const fun::string &file_name);
-  static long GetFileSize(const fun::string &file_name);
+  static int64_t GetFileSize(const fun::string &file_name);
+  // fseek() with a 64-bit offset from the beginning of the file.
+  static int SeekFile(FILE *fp, const uint64_t offset);
+  // inode is always 0 on Windows.
+  static bool GetFileStat(const fun::string &file_name, uint64_t &size, int64_t &mtime, uint64_t &inode);
   static bool IsDirectoryExists(const fun::string &dir_name);
   static bool CreateDirectory(const fun::string &dir_name);
 
   static fun::string MD5String(const fun::string &file_name, bool use_front);
+  // Reads the file once for both hashes. Pass nullptr to skip md5, which
+  // reads only the front.
+  static bool MD5File(const fun::string &file_name, fun::string *md5, fun::string *md5_front);
 
   static fun::string StringFromBytes(const fun::string &uuid_str);
   static fun::string BytesFromString(const fun::string &uuid);
@@ -12,6 +12,10 @@
 
 #include "funapi_utils.h"
 
+#ifndef FUNAPI_PLATFORM_WINDOWS
+#include <poll.h>
+#endif // FUNAPI_PLATFORM_WINDOWS
+
 #if FUNAPI_HAVE_WEBSOCKET
 #ifdef FUNAPI_UE4
 #if PLATFORM_WINDOWS
@@ -33,11 +37,12 @@ THIRD_PARTY_INCLUDES_END
 
 namespace fun {
 
-#define FUNAPI_WEBSOCKET_MAX_SEND_BUFFER 65536
-
 ////////////////////////////////////////////////////////////////////////////////
 // FunapiWebsocketImpl implementation.
 
+// libwebsockets is driven by FunapiSocket::Poll on the network thread. The
+// context reports its sockets through the external poll callbacks, and they
+// are polled with the TCP and UDP sockets.
 class FunapiWebsocketImpl : public std::enable_shared_from_this<FunapiWebsocketImpl> {
  public:
   typedef FunapiWebsocket::ConnectCompletionHandler ConnectCompletionHandler;
@@ -62,7 +67,18 @@ class FunapiWebsocketImpl : public std::enable_shared_from_this<FunapiWebsocketI
             const bool is_binary,
             const SendCompletionHandler &send_completion_handler);
 
-  void Update();
+  void SetUsePerMessageDeflate(const bool use_deflate);
+
+  // Asks for a writable callback, in which the send handler is called.
+  void RequestSend();
+
+#ifdef FUNAPI_PLATFORM_WINDOWS
+  void OnTick();
+#else // FUNAPI_PLATFORM_WINDOWS
+  int GetPollFds(struct pollfd *pollfds, const int max_pollfds);
+  void OnPoll(const struct pollfd *pollfds, const int num_pollfds);
+#endif // FUNAPI_PLATFORM_WINDOWS
+
 #if FUNAPI_HAVE_WEBSOCKET
   int OnCallback(struct lws *wsi, enum lws_callback_reasons reason, void *user, void *in, size_t len);
 #endif
@@ -72,11 +88,15 @@ class FunapiWebsocketImpl : public std::enable_shared_from_this<FunapiWebsocketI
   static int Callback(struct lws *wsi, enum lws_callback_reasons reason, void *user, void *in, size_t len);
 #endif
 
+  static fun::vector<std::shared_ptr<FunapiWebsocketImpl>> GetWebsocketImpls();
+
  protected:
   void Init();
   void Cleanup();
   void OnSend();
 
+  static void Add(std::shared_ptr<FunapiWebsocketImpl> impl);
+
   ConnectCompletionHandler connect_completion_handler_;
   CloseHandler close_handler_;
   SendHandler send_handler_;
@@ -89,13 +109,55 @@ class FunapiWebsocketImpl : public std::enable_shared_from_this<FunapiWebsocketI
   struct lws_protocols *protocols_ = nullptr;
 #endif
 
-  uint8_t send_buffer_[FUNAPI_WEBSOCKET_MAX_SEND_BUFFER];
+  // LWS_PRE bytes of the frame header followed by the body.
+  fun::vector<uint8_t> send_buffer_;
   size_t send_buffer_length_ = 0;
   size_t offset_ = 0;
-  bool is_binary_;
+  bool is_binary_ = false;
+  bool is_established_ = false;
+  bool use_deflate_ = false;
+
+#ifndef FUNAPI_PLATFORM_WINDOWS
+  // Sockets of the context and the poll events they wait for.
+  fun::map<int, short> sockets_;
+#endif // FUNAPI_PLATFORM_WINDOWS
+
+  static fun::vector<std::weak_ptr<FunapiWebsocketImpl>> vec_websockets_;
+  static std::mutex vec_websockets_mutex_;
 };
 
 
+fun::vector<std::weak_ptr<FunapiWebsocketImpl>> FunapiWebsocketImpl::vec_websockets_;
+std::mutex FunapiWebsocketImpl::vec_websockets_mutex_;
+
+
+fun::vector<std::shared_ptr<FunapiWebsocketImpl>> FunapiWebsocketImpl::GetWebsocketImpls() {
+  fun::vector<std::shared_ptr<FunapiWebsocketImpl>> v_websockets;
+  fun::vector<std::weak_ptr<FunapiWebsocketImpl>> v_weak_websockets;
+  {
+    std::unique_lock<std::mutex> lock(vec_websockets_mutex_);
+    if (!vec_websockets_.empty()) {
+      for (auto i : vec_websockets_) {
+        if (auto w = i.lock()) {
+          v_websockets.push_back(w);
+          v_weak_websockets.push_back(i);
+        }
+      }
+
+      vec_websockets_.swap(v_weak_websockets);
+    }
+  }
+
+  return v_websockets;
+}
+
+
+void FunapiWebsocketImpl::Add(std::shared_ptr<FunapiWebsocketImpl> impl) {
+  std::unique_lock<std::mutex> lock(vec_websockets_mutex_);
+  vec_websockets_.push_back(impl);
+}
+
+
 FunapiWebsocketImpl::FunapiWebsocketImpl() {
   Init();
 }
@@ -115,8 +177,12 @@ void FunapiWebsocketImpl::Log(int level, const char *line) {
 #if FUNAPI_HAVE_WEBSOCKET
 int FunapiWebsocketImpl::Callback(struct lws *wsi, enum lws_callback_reasons reason, void *user, void *in, size_t len) {
   int ret = 0;
+  if (wsi == nullptr) {
+    return ret;
+  }
 
-  FunapiWebsocketImpl* impl = (FunapiWebsocketImpl*)lws_wsi_user(wsi);
+  // The poll callbacks may come before the connection has the user data.
+  FunapiWebsocketImpl* impl = (FunapiWebsocketImpl*)lws_context_user(lws_get_context(wsi));
   if (impl) {
     ret = impl->OnCallback(wsi, reason, user, in, len);
   }
@@ -131,24 +197,55 @@ int FunapiWebsocketImpl::OnCallback(struct lws *wsi, enum lws_callback_reasons r
   switch (reason)
   {
     case LWS_CALLBACK_CLIENT_ESTABLISHED:
-      connect_completion_handler_(false, 0, "LWS_CALLBACK_CLIENT_ESTABLISHED");
+      web_socket_ = wsi;
+      is_established_ = true;
+      if (connect_completion_handler_) {
+        connect_completion_handler_(false, 0, "LWS_CALLBACK_CLIENT_ESTABLISHED");
+      }
+      // Sends the messages queued while connecting.
+      RequestSend();
       break;
 
     case LWS_CALLBACK_CLIENT_CONNECTION_ERROR:
-      connect_completion_handler_(true, static_cast<int>(reason), "LWS_CALLBACK_CLIENT_CONNECTION_ERROR");
+      if (connect_completion_handler_) {
+        connect_completion_handler_(true, static_cast<int>(reason), "LWS_CALLBACK_CLIENT_CONNECTION_ERROR");
+      }
       break;
 
     case LWS_CALLBACK_WSI_DESTROY:
-      close_handler_(static_cast<int>(reason), "LWS_CALLBACK_WSI_DESTROY");
+      if (wsi == web_socket_) {
+        web_socket_ = nullptr;
+        is_established_ = false;
+      }
+      if (close_handler_) {
+        close_handler_(static_cast<int>(reason), "LWS_CALLBACK_WSI_DESTROY");
+      }
       break;
 
-    case LWS_CALLBACK_CLIENT_RECEIVE:
+#ifndef FUNAPI_PLATFORM_WINDOWS
+    case LWS_CALLBACK_ADD_POLL_FD:
+    case LWS_CALLBACK_CHANGE_MODE_POLL_FD:
+    {
+      struct lws_pollargs *args = static_cast<struct lws_pollargs*>(in);
+      sockets_[args->fd] = static_cast<short>(args->events);
+    }
+      break;
+
+    case LWS_CALLBACK_DEL_POLL_FD:
     {
-      fun::vector<uint8_t> receiving(len);
-      memcpy (receiving.data(), in, len);
-      recv_handler_(static_cast<int>(len), receiving);
+      struct lws_pollargs *args = static_cast<struct lws_pollargs*>(in);
+      sockets_.erase(args->fd);
     }
       break;
+#endif // FUNAPI_PLATFORM_WINDOWS
+
+    case LWS_CALLBACK_CLIENT_RECEIVE:
+      if (recv_handler_) {
+        fun::vector<uint8_t> receiving(len);
+        memcpy (receiving.data(), in, len);
+        recv_handler_(static_cast<int>(len), receiving);
+      }
+      break;
 
     case LWS_CALLBACK_CLIENT_WRITEABLE:
       web_socket_ = wsi;
@@ -192,6 +289,12 @@ void FunapiWebsocketImpl::Init() {
 
 void FunapiWebsocketImpl::Cleanup() {
 #if FUNAPI_HAVE_WEBSOCKET
+  // The owner is gone, so nothing is called back while closing.
+  connect_completion_handler_ = nullptr;
+  close_handler_ = nullptr;
+  send_handler_ = nullptr;
+  recv_handler_ = nullptr;
+
   if (context_) {
     lws_context_destroy(context_);
     context_ = nullptr;
@@ -200,14 +303,71 @@ void FunapiWebsocketImpl::Cleanup() {
 }
 
 
-void FunapiWebsocketImpl::Update() {
+void FunapiWebsocketImpl::SetUsePerMessageDeflate(const bool use_deflate) {
+  use_deflate_ = use_deflate;
+}
+
+
+void FunapiWebsocketImpl::RequestSend() {
+#if FUNAPI_HAVE_WEBSOCKET
+  if (is_established_ && web_socket_) {
+    lws_callback_on_writable(web_socket_);
+  }
+#endif
+}
+
+
+#ifdef FUNAPI_PLATFORM_WINDOWS
+void FunapiWebsocketImpl::OnTick() {
+#if FUNAPI_HAVE_WEBSOCKET
+  if (context_) {
+    lws_service(context_, 0);
+  }
+#endif
+}
+#else // FUNAPI_PLATFORM_WINDOWS
+int FunapiWebsocketImpl::GetPollFds(struct pollfd *pollfds, const int max_pollfds) {
+  int num_pollfds = 0;
+
+  for (const auto &it : sockets_) {
+    if (num_pollfds >= max_pollfds) {
+      break;
+    }
+
+    pollfds[num_pollfds].fd = it.first;
+    pollfds[num_pollfds].events = it.second;
+    pollfds[num_pollfds].revents = 0;
+    ++num_pollfds;
+  }
+
+  return num_pollfds;
+}
+
+
+void FunapiWebsocketImpl::OnPoll(const struct pollfd *pollfds, const int num_pollfds) {
 #if FUNAPI_HAVE_WEBSOCKET
+  if (context_ == nullptr) {
+    return;
+  }
+
+  for (int i = 0; i < num_pollfds && context_; ++i) {
+    if (pollfds[i].revents == 0 ||
+        sockets_.find(pollfds[i].fd) == sockets_.end()) {
+      continue;
+    }
+
+    // lws_service_fd clears revents it has handled.
+    struct lws_pollfd poll_fd = pollfds[i];
+    lws_service_fd(context_, &poll_fd);
+  }
+
+  // Checks the timeouts of the connection once a second.
   if (context_) {
-    lws_service(context_, 2);
-    lws_callback_on_writable_all_protocol(context_, protocols_);
+    lws_service_fd(context_, NULL);
   }
 #endif
 }
+#endif // FUNAPI_PLATFORM_WINDOWS
 
 
 void FunapiWebsocketImpl::Connect(const char* hostname_or_ip,
@@ -253,6 +413,23 @@ void FunapiWebsocketImpl::Connect(const char* hostname_or_ip,
   context_info.protocols = protocols;
   context_info.gid = -1;
   context_info.uid = -1;
+  context_info.user = this;
+
+#ifndef LWS_NO_EXTENSIONS
+  static const struct lws_extension extensions[] =
+  {
+    {
+      "permessage-deflate",
+      lws_extension_callback_pm_deflate,
+      "permessage-deflate; client_max_window_bits"
+    },
+    { NULL, NULL, NULL } /* terminator */
+  };
+
+  if (use_deflate_) {
+    context_info.extensions = extensions;
+  }
+#endif // LWS_NO_EXTENSIONS
 
 #ifdef FUNAPI_COCOS2D
   if (use_wss) {
@@ -273,6 +450,8 @@ void FunapiWebsocketImpl::Connect(const char* hostname_or_ip,
     return;
   }
 
+  Add(shared_from_this());
+
   struct lws_client_connect_info connect_info;
   memset(&connect_info, 0, sizeof(connect_info));
   connect_info.context = context_;
@@ -307,6 +486,7 @@ void FunapiWebsocketImpl::Connect(const char* hostname_or_ip,
 }
 
 
+// The body is sent as one frame in the next writable callback.
 bool FunapiWebsocketImpl::Send(const fun::vector<uint8_t> &body,
                                const bool is_binary,
                                const SendCompletionHandler &send_completion_handler) {
@@ -316,13 +496,12 @@ bool FunapiWebsocketImpl::Send(const fun::vector<uint8_t> &body,
     send_completion_handler_ = send_completion_handler;
 
     send_buffer_length_ = body.size();
-    if (send_buffer_length_ > FUNAPI_WEBSOCKET_MAX_SEND_BUFFER - LWS_PRE) {
-      send_buffer_length_ = FUNAPI_WEBSOCKET_MAX_SEND_BUFFER - LWS_PRE;
+    send_buffer_.resize(LWS_PRE + send_buffer_length_);
+    if (send_buffer_length_ > 0) {
+      memcpy(send_buffer_.data() + LWS_PRE, body.data(), send_buffer_length_);
     }
 
-    memset(send_buffer_, 0x00, LWS_PRE);
-    memcpy(send_buffer_ + LWS_PRE, body.data(), send_buffer_length_);
-
+    RequestSend();
     return true;
   }
 #endif
@@ -333,7 +512,7 @@ bool FunapiWebsocketImpl::Send(const fun::vector<uint8_t> &body,
 
 void FunapiWebsocketImpl::OnSend() {
 #if FUNAPI_HAVE_WEBSOCKET
-  if (send_buffer_length_ == 0 && offset_ == 0) {
+  if (send_buffer_length_ == 0 && offset_ == 0 && send_handler_) {
     send_handler_();
   }
 
@@ -350,15 +529,18 @@ void FunapiWebsocketImpl::OnSend() {
     }
 
     int sent_length = 0;
-    uint8_t *buf = send_buffer_ + LWS_PRE + offset_;
+    uint8_t *buf = send_buffer_.data() + LWS_PRE + offset_;
     sent_length = lws_write(web_socket_, (unsigned char*)buf, send_buffer_length_ - offset_, write_protocol);
 
     if (sent_length < 0) {
+      offset_ = 0;
+      send_buffer_length_ = 0;
+
       send_completion_handler_(true, -1, "lws_write failed", sent_length);
+      return;
     }
-    else {
-      offset_ += sent_length;
-    }
+
+    offset_ += sent_length;
 
     if (offset_ == send_buffer_length_) {
       offset_ = 0;
@@ -366,6 +548,9 @@ void FunapiWebsocketImpl::OnSend() {
 
       send_completion_handler_(false, 0, "", sent_length);
     }
+    else {
+      RequestSend();
+    }
   }
 #endif
 }
@@ -432,8 +617,44 @@ bool FunapiWebsocket::Send(const fun::vector<uint8_t> &body,
 }
 
 
-void FunapiWebsocket::Update() {
-  return impl_->Update();
+void FunapiWebsocket::SetUsePerMessageDeflate(const bool use_deflate) {
+  impl_->SetUsePerMessageDeflate(use_deflate);
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+// Called by FunapiSocket::Poll on the network thread.
+
+void OnWebsocketSend() {
+  for (auto &w : FunapiWebsocketImpl::GetWebsocketImpls()) {
+    w->RequestSend();
+  }
+}
+
+
+#ifdef FUNAPI_PLATFORM_WINDOWS
+void OnWebsocketTicked() {
+  for (auto &w : FunapiWebsocketImpl::GetWebsocketImpls()) {
+    w->OnTick();
+  }
+}
+#else // FUNAPI_PLATFORM_WINDOWS
+int GetWebsocketPollFds(struct pollfd *pollfds, const int max_pollfds) {
+  int num_pollfds = 0;
+
+  for (auto &w : FunapiWebsocketImpl::GetWebsocketImpls()) {
+    num_pollfds += w->GetPollFds(&pollfds[num_pollfds], max_pollfds - num_pollfds);
+  }
+
+  return num_pollfds;
+}
+
+
+void OnWebsocketPolled(const struct pollfd *pollfds, const int num_pollfds) {
+  for (auto &w : FunapiWebsocketImpl::GetWebsocketImpls()) {
+    w->OnPoll(pollfds, num_pollfds);
+  }
 }
+#endif // FUNAPI_PLATFORM_WINDOWS
 
 }  // namespace fun
@@ -52,11 +52,15 @@ class FunapiWebsocket : public std::enable_shared_from_this<FunapiWebsocket> {
                const SendHandler &send_handler,
                const RecvHandler &recv_handler);
 
+  // Sends the body as one frame. Returns false if the previous frame is
+  // not sent yet. The send handler is called when it can send the next one.
   bool Send(const fun::vector<uint8_t> &body,
             const bool is_binary,
             const SendCompletionHandler &send_completion_handler);
 
-  void Update();
+  // Offers permessage-deflate in the handshake. It has to be called before
+  // Connect.
+  void SetUsePerMessageDeflate(const bool use_deflate);
 
  private:
   std::shared_ptr<FunapiWebsocketImpl> impl_;
@@ -9,7 +9,12 @@
 
 #include "funapi_plugin.h"
 
+// "<original length>" or "<original length>:<zstd dictionary id>"
+// The client only sends the dictionary id after the server has sent one.
 #define kProtocolCompressionField "C"
+// Stream epoch of a message compressed in the zstd streaming mode.
+// A new epoch means the sender started a new frame.
+#define kProtocolCompressionStreamField "CS"
 
 namespace fun {
 
@@ -36,7 +41,11 @@ class FUNAPI_API FunapiCompression : public std::enable_shared_from_this<FunapiC
   void SetCompressionType(const CompressionType type);
   void SetThreshold(int threshold);
 #if FUNAPI_HAVE_ZSTD
+  // Replaces every registered dictionary.
+  // Several dictionary versions can be passed separated by ','. The last one is used to compress.
   void SetZstdDictBase64String(const fun::string &zstd_dict_base64string);
+  // Registers another dictionary version without dropping the current ones.
+  void AddZstdDictBase64String(const fun::string &zstd_dict_base64string);
 #endif
 
   bool Compress(HeaderFields &header_fields, fun::vector<uint8_t> &body);
@@ -47,6 +56,15 @@ class FUNAPI_API FunapiCompression : public std::enable_shared_from_this<FunapiC
 
   bool HasCompression(const CompressionType type);
 
+#if FUNAPI_HAVE_ZSTD
+  // Keeps one zstd stream across messages. Only for ordered transports (TCP, WebSocket).
+  void SetUseZstdStream(const bool use_stream);
+#endif
+  // Drops the stream history of both directions (e.g. on reconnect).
+  void ResetStream();
+  // Starts a new frame for the next message sent (e.g. before retransmitting).
+  void ResetSendStream();
+
  private:
   std::shared_ptr<FunapiCompressionImpl> impl_;
 };
@@ -47,6 +47,9 @@ class FUNAPI_API FunapiHttpDownloader : public std::enable_shared_from_this<Funa
   void SetTimeoutPerFile(long timeout_in_seconds);
   void SetCACertFilePath(const fun::string &path);
 
+  // Requests downloading at the same time. It is 4 by default. A large
+  // file is downloaded in ranges if the server supports them.
+  void SetMaxConcurrentDownloads(const int max_downloads);
 
   void Start();
   void Start(const fun::string &inclusive_path);
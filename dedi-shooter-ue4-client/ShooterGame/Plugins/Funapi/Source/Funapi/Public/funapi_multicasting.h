@@ -114,13 +114,25 @@ public:
   bool LeaveChannel(const fun::string &channel_id);
   bool LeaveAllChannels();
 
+  // The message is queued and sent with the other messages of the tick by
+  // Update() or UpdateAll().
   bool SendToChannel(const fun::string &channel_id, FunMessage &msg, const bool bounce = true);
   bool SendToChannel(const fun::string &channel_id, fun::string &json_string, const bool bounce = true);
 
   bool RequestChannelList();
 
+  // Limits the messages sent to each channel per second. Messages over the
+  // limit wait in the channel's queue, and the oldest ones are dropped when
+  // more than max_queued_messages are waiting. 0 means no limit, which is
+  // the default.
+  void SetChannelSendLimit(const int max_messages_per_second, const int max_queued_messages);
+
   void Update();
 
+  // Sends the queued messages of every multicast. It is called by
+  // FunapiTasks::UpdateAll.
+  static void UpdateAll();
+
   FunEncoding GetEncoding();
 
   void Connect();
@@ -14,6 +14,12 @@ namespace fun {
 enum class FUNAPI_API EncryptionType : int;
 enum class FUNAPI_API CompressionType : int;
 
+enum class FUNAPI_API UdpChannelType : int
+{
+  kReliableOrdered,      // Resent until acked and handed over in order.
+  kUnreliableSequenced,  // Never resent. Stale datagrams are dropped.
+};
+
 class FUNAPI_API FunapiTransportOption : public std::enable_shared_from_this<FunapiTransportOption> {
  public:
   FunapiTransportOption() = default;
@@ -61,6 +67,10 @@ class FUNAPI_API FunapiTcpTransportOption : public FunapiTransportOption {
 #if FUNAPI_HAVE_ZSTD
   // void SetZstdDictBase64String(const fun::string &zstd_dict_base64string);
   fun::string GetZstdDictBase64String();
+
+  // Compresses messages as one zstd stream. The server must support it.
+  void SetUseZstdStream(const bool use_stream);
+  bool GetUseZstdStream();
 #endif
 
   void SetEncryptionType(const EncryptionType type, const fun::string &public_key);
@@ -68,8 +78,13 @@ class FUNAPI_API FunapiTcpTransportOption : public FunapiTransportOption {
 
 #if FUNAPI_HAVE_TCP_TLS
   void SetUseTLS(const bool use_tls);
+
+  // Resumes the TLS session on a reconnect to the same host and port.
+  // It is on by default.
+  void SetUseTLSSessionResumption(const bool use);
 #endif
   bool GetUseTLS();
+  bool GetUseTLSSessionResumption();
 
 #ifdef FUNAPI_UE4_PLATFORM_PS4
   void SetCACert(const fun::string &cert);
@@ -102,6 +117,21 @@ class FUNAPI_API FunapiUdpTransportOption : public FunapiTransportOption {
   fun::string GetZstdDictBase64String();
 #endif
 
+  // Uses UDP GSO/GRO if the platform supports it. (Linux only)
+  void SetSegmentOffload(const bool enable);
+  bool GetSegmentOffload();
+
+  // Sends client pings for FunapiSession::GetRttStats. Lost pings give
+  // the loss rate. The server has to reply the pings on UDP.
+  void SetEnablePing(const bool enable_ping);
+  bool GetEnablePing();
+
+  // Adds a channel for FunapiSession::SendChannelMessage.
+  // The channel id has to be greater than 0. The server has to support
+  // the same channels.
+  void AddChannel(const int channel, const UdpChannelType type);
+  const fun::map<int, UdpChannelType>& GetChannels();
+
  private:
   std::shared_ptr<FunapiUdpTransportOptionImpl> impl_;
 };
@@ -124,6 +154,12 @@ class FUNAPI_API FunapiHttpTransportOption : public FunapiTransportOption {
   void SetUseHttps(const bool https);
   bool GetUseHttps();
 
+  // Requests sent at the same time. It is 1 by default. With more than 1,
+  // the server may receive the messages out of order. The requests share
+  // keep-alive connections (or one HTTP/2 connection over https).
+  void SetMaxInflightRequests(const int max_requests);
+  int GetMaxInflightRequests();
+
   void SetEncryptionType(const EncryptionType type);
   EncryptionType GetEncryptionType();
 
@@ -161,9 +197,25 @@ class FUNAPI_API FunapiWebsocketTransportOption : public FunapiTransportOption {
   void SetCompressionType(const CompressionType type);
   fun::vector<CompressionType> GetCompressionTypes();
 
+  // Offers the permessage-deflate extension in the handshake. It replaces
+  // kDeflate, which is not used for the messages while this is on, so the
+  // payloads are not compressed twice. The server must be set up the same.
+  void SetUsePerMessageDeflate(const bool use_deflate);
+  bool GetUsePerMessageDeflate();
+
+  // Sends the messages queued in one send cycle as one frame instead of
+  // one frame per message. It is off by default. The server must accept
+  // several messages in a frame.
+  void SetUseMessageBatching(const bool use_batching);
+  bool GetUseMessageBatching();
+
 #if FUNAPI_HAVE_ZSTD
   // void SetZstdDictBase64String(const fun::string &zstd_dict_base64string);
   fun::string GetZstdDictBase64String();
+
+  // Compresses messages as one zstd stream. The server must support it.
+  void SetUseZstdStream(const bool use_stream);
+  bool GetUseZstdStream();
 #endif
 
  private:
@@ -183,6 +235,7 @@ class FUNAPI_API FunapiError : public std::enable_shared_from_this<FunapiError>
     kSeq,
     kPing,
     kWebsocket,
+    kRetransmit,
   };
 
   // legacy
@@ -216,6 +269,12 @@ class FunapiSessionOptionImpl;
 class FUNAPI_API FunapiSessionOption : public std::enable_shared_from_this<FunapiSessionOption>
 {
 public:
+    // What a reliable session does when the retransmit queue is full.
+    enum class RetransmitOverflowPolicy : int {
+        kStopTransport,  // Stops the transport with an error. No auto reconnect.
+        kResync,         // Drops the queue and opens a new session on reconnect.
+    };
+
     FunapiSessionOption();
     virtual ~FunapiSessionOption() = default;
 
@@ -235,6 +294,31 @@ public:
     void SetUseRedirectQueue(const bool use);
     bool GetUseRedirectQueue();
 
+    // Limits the time spent on session callbacks per FunapiTasks::UpdateAll.
+    // The remaining callbacks run in the next update. 0 means no limit.
+    void SetTaskTimeBudgetMicrosecond(const int microsecond);
+    int GetTaskTimeBudgetMicrosecond();
+
+    // Parses received JSON messages in place (rapidjson ParseInsitu)
+    // instead of copying every string into the document.
+    void SetJsonInsituParsing(const bool insitu);
+    bool GetJsonInsituParsing();
+
+    // Limits the sent messages kept until acked in a reliable session.
+    // 0 means no limit.
+    void SetRetransmitQueueLimit(const int max_messages, const int max_bytes);
+    int GetRetransmitQueueMaxMessages();
+    int GetRetransmitQueueMaxBytes();
+
+    void SetRetransmitOverflowPolicy(const RetransmitOverflowPolicy policy);
+    RetransmitOverflowPolicy GetRetransmitOverflowPolicy();
+
+    // Connects to the redirect target while the current server keeps
+    // delivering messages and switches over once the target accepts the
+    // redirect token. Only TCP and UDP ports are connected in advance.
+    void SetUseRedirectPreconnect(const bool use);
+    bool GetUseRedirectPreconnect();
+
 private:
     std::shared_ptr<FunapiSessionOptionImpl> impl_;
 };
@@ -36,9 +36,11 @@
 #endif // FUNAPI_PLATFORM_WINDOWS
 
 #include <array>
+#include <atomic>
 #include <map>
 #include <string>
 #include <cstdlib>
+#include <cstddef>
 #include <vector>
 #include <list>
 #include <sstream>
@@ -46,6 +48,8 @@
 #include <queue>
 #include <mutex>
 #include <memory>
+#include <new>
+#include <type_traits>
 #include <condition_variable>
 #include <thread>
 #include <chrono>
@@ -35,6 +35,12 @@ class FUNAPI_API FunapiRpcOption : public std::enable_shared_from_this<FunapiRpc
   void SetTag(const fun::string &tag);
   fun::string GetTag();
 
+  // Connections opened to each server. Calls are spread over the
+  // connections of a server by the number of calls in flight. It is 1 by
+  // default.
+  void SetConnectionsPerPeer(const int connections);
+  int GetConnectionsPerPeer();
+
  private:
   std::shared_ptr<FunapiRpcOptionImpl> impl_;
 };
@@ -62,6 +68,20 @@ class FUNAPI_API FunapiRpc : public std::enable_shared_from_this<FunapiRpc> {
                              const FunDedicatedServerRpcMessage &request_message,
                              const ResponseHandler &response_handler)> RpcHandler;
 
+  enum class CallResult : int {
+    kSucceed,
+    kTimedOut,
+    kCanceled,
+    kDisconnected,
+    kNoPeer,
+  };
+
+  typedef uint64_t CallId;
+
+  // response_message is empty unless the result is kSucceed.
+  typedef std::function<void(const CallResult result,
+                             const FunDedicatedServerRpcMessage &response_message)> CallHandler;
+
   FunapiRpc();
   virtual ~FunapiRpc() = default;
 
@@ -72,6 +92,19 @@ class FUNAPI_API FunapiRpc : public std::enable_shared_from_this<FunapiRpc> {
   void SetHandler(const fun::string &type, const RpcHandler &handler);
   void Update();
 
+  // Sends a request to the server picked for the type by consistent
+  // hashing, without waiting for the calls already in flight. The type, xid
+  // and is_request fields of the request are set by the call. The handler
+  // is called once in Update(). A timeout of 0 means no deadline.
+  CallId Call(const fun::string &type,
+              const FunDedicatedServerRpcMessage &request_message,
+              const CallHandler &handler,
+              const int timeout_millisecond = 0);
+
+  // Calls the handler with kCanceled. Returns false if the call has
+  // already finished.
+  bool Cancel(const CallId id);
+
   // debug function // don't use
   // void DebugCall(const FunDedicatedServerRpcMessage &debug_request);
   // void DebugMasterCall(const FunDedicatedServerRpcMessage &debug_request);
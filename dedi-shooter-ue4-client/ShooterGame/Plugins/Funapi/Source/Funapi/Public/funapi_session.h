@@ -74,6 +74,26 @@ enum class FUNAPI_API TransportEventType : int
 extern FUNAPI_API fun::string TransportProtocolToString(TransportProtocol protocol);
 
 
+// Round trip times of the client pings of a transport, in milliseconds.
+struct FUNAPI_API FunapiRttStats
+{
+    int64_t rtt = 0;       // The last round trip time.
+    int64_t srtt = 0;      // Smoothed round trip time. (RFC 6298)
+    int64_t jitter = 0;    // Round trip time variation. (RTTVAR of RFC 6298)
+
+    // Of the last 128 round trips.
+    int64_t min_rtt = 0;
+    int64_t max_rtt = 0;
+    int64_t p50 = 0;
+    int64_t p90 = 0;
+    int64_t p99 = 0;
+    int samples = 0;
+
+    // Pings not replied in time / all pings, of the last 64 pings.
+    float loss_rate = 0;
+};
+
+
 class FunapiSessionOption;
 class FunapiSessionImpl;
 class FunapiUnsentMessage;
@@ -85,6 +105,16 @@ public:
                                const fun::string&,
                                const fun::string&)> JsonRecvHandler;
 
+    // Receives a JSON message without copying it. The parsed value and
+    // the body (not null-terminated) belong to the received message and
+    // are valid only during the call.
+    typedef std::function<void(const std::shared_ptr<FunapiSession>&,
+                               const TransportProtocol,
+                               const fun::string&,
+                               const rapidjson::Value&,
+                               const char*,
+                               const size_t)> JsonValueRecvHandler;
+
     typedef std::function<void(const std::shared_ptr<FunapiSession>&,
                                const TransportProtocol,
                                const FunMessage&)> ProtobufRecvHandler;
@@ -115,6 +145,19 @@ public:
                                const fun::vector<fun::string>&, const fun::vector<fun::string>&,
                                const fun::deque<std::shared_ptr<FunapiUnsentMessage>>&)> RedirectQueueHandler;
 
+    // Receives every decoded (decrypted and decompressed) message body.
+    // It is called on the network thread and meant for capturing samples,
+    // e.g. to train a zstd dictionary (Tools/zstd_dict).
+    typedef std::function<void(const std::shared_ptr<FunapiSession>&,
+                               const TransportProtocol,
+                               const FunEncoding,
+                               const fun::vector<uint8_t>&)> RecvCaptureHandler;
+
+    // Called on each ping reply, so at the ping interval of the transport.
+    typedef std::function<void(const std::shared_ptr<FunapiSession>&,
+                               const TransportProtocol,
+                               const FunapiRttStats&)> RttStatsHandler;
+
     FunapiSession() = delete;
     FunapiSession(const char* hostname_or_ip, std::shared_ptr<FunapiSessionOption> option);
     virtual ~FunapiSession();
@@ -142,6 +185,16 @@ public:
                      const TransportProtocol protocol = TransportProtocol::kDefault,
                      const EncryptionType encryption_type = EncryptionType::kDefaultEncryption);
 
+    // Sends a message on a UDP channel added with FunapiUdpTransportOption::AddChannel.
+    void SendChannelMessage(const int channel,
+                            const fun::string &msg_type,
+                            const fun::string &json_string,
+                            const EncryptionType encryption_type = EncryptionType::kDefaultEncryption);
+
+    void SendChannelMessage(const int channel,
+                            const FunMessage &message,
+                            const EncryptionType encryption_type = EncryptionType::kDefaultEncryption);
+
     bool IsConnected(const TransportProtocol protocol) const;
     bool IsConnected() const;
     bool IsReliableSession() const;
@@ -155,26 +208,47 @@ public:
 
     int64_t GetPingTime();
 
+    // Needs the ping enabled with the transport option.
+    FunapiRttStats GetRttStats(const TransportProtocol protocol);
+
+    // The last TLS handshake of the TCP transport. They are updated before
+    // TransportEventType::kStarted, so the handler can read them.
+    bool IsTLSSessionResumed();
+    int64_t GetTLSHandshakeTime();  // milliseconds
+    // Resumed handshakes / all TLS handshakes of the TCP transport.
+    float GetTLSResumptionRate();
+
+    // Milliseconds from the last message of the previous server (or the
+    // redirect message) to the last redirect success. See
+    // FunapiSessionOption::SetUseRedirectPreconnect.
+    int64_t GetRedirectGapTime();
+
     void AddSessionEventCallback(const SessionEventHandler &handler);
     void AddTransportEventCallback(const TransportEventHandler &handler);
     void AddProtobufRecvCallback(const ProtobufRecvHandler &handler);
     void AddJsonRecvCallback(const JsonRecvHandler &handler);
+    void AddJsonValueRecvCallback(const JsonValueRecvHandler &handler);
     void AddRecvTimeoutCallback(const RecvTimeoutHandler &handler);
     void AddRecvTimeoutCallback(const RecvTimeoutIntHandler &handler);
+    void AddRttStatsCallback(const RttStatsHandler &handler);
 
     void SetSessionOptionCallback(const SessionOptionHandler &handler);
     void SetTransportOptionCallback(const TransportOptionHandler &handler);
     void SetRedirectQueueCallback(const RedirectQueueHandler &handler);
+    void SetRecvCaptureCallback(const RecvCaptureHandler &handler);
 
     void RemoveSessionEventCallback();
     void RemoveTransportEventCallback();
     void RemoveProtobufRecvCallback();
     void RemoveJsonRecvCallback();
+    void RemoveJsonValueRecvCallback();
     void RemoveRecvTimeoutCallback();
     void RemoveRecvTimeoutIntCallback();
+    void RemoveRttStatsCallback();
     void RemoveSessionOptionCallback();
     void RemoveTransportOptionCallback();
     void RemoveRedirectQueueCallback();
+    void RemoveRecvCaptureCallback();
 
     void RemoveAllCallbacks();
 
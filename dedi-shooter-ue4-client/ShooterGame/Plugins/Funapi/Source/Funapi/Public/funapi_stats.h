@@ -0,0 +1,95 @@
+// Copyright (C) 2013-2019 iFunFactory Inc. All Rights Reserved.
+//
+// This work is confidential and proprietary to iFunFactory Inc. and
+// must not be used, disclosed, copied, or distributed without the prior
+// consent of iFunFactory Inc.
+
+#ifndef SRC_FUNAPI_STATS_H_
+#define SRC_FUNAPI_STATS_H_
+
+#include "funapi_plugin.h"
+#include "funapi_session.h"
+
+namespace fun {
+
+// Plugin-wide performance counters.
+// Counters are kept in shards picked by the calling thread, so counting is a
+// relaxed atomic add on a cache line the other threads rarely touch.
+// Snapshot() sums the shards.
+class FUNAPI_API FunapiStats {
+ public:
+  // Counted for each transport protocol.
+  enum class TransportCounter : int {
+    kBytesSent,          // Message bodies as sent, without the headers.
+    kBytesReceived,
+    kMessagesSent,
+    kMessagesReceived,
+    kCount
+  };
+
+  enum class Counter : int {
+    kEncodeNanoseconds,  // With compressing and encrypting.
+    kCompressNanoseconds,
+    kEncryptNanoseconds,
+    kDecodeNanoseconds,  // Decrypting and decompressing.
+    kReconnects,
+    kRedirects,
+    kPollWakeups,
+    // Depths of all the queues of the kind. They go up and down as
+    // messages and tasks are queued and taken out.
+    kSendQueueDepth,
+    kSentQueueDepth,
+    kTaskQueueDepth,
+    kCount
+  };
+
+  static const int kProtocolCount = static_cast<int>(TransportProtocol::kDefault);
+  static const int kTransportCounterCount = static_cast<int>(TransportCounter::kCount);
+  static const int kCounterCount = static_cast<int>(Counter::kCount);
+
+  struct FUNAPI_API Values {
+    int64_t time_millisecond = 0;  // Since the epoch.
+    int64_t transports[kProtocolCount][kTransportCounterCount] = {};
+    int64_t counters[kCounterCount] = {};
+
+    int64_t Get(const TransportProtocol protocol, const TransportCounter counter) const;
+    int64_t Get(const Counter counter) const;
+    fun::string ToJson() const;
+  };
+
+  // Adds the time from the construction to the destruction to the counter.
+  class ScopedTimer {
+   public:
+    ScopedTimer(const Counter counter)
+      : counter_(counter), start_(std::chrono::steady_clock::now()) {
+    }
+
+    ~ScopedTimer() {
+      Add(counter_, std::chrono::duration_cast<std::chrono::nanoseconds>(
+          std::chrono::steady_clock::now() - start_).count());
+    }
+
+   private:
+    Counter counter_;
+    std::chrono::steady_clock::time_point start_;
+  };
+
+  FunapiStats() = delete;
+
+  static void Add(const Counter counter, const int64_t value);
+  static void Add(const TransportProtocol protocol, const TransportCounter counter, const int64_t value);
+
+  static Values Snapshot();
+
+  // Writes the snapshot as a line of JSON every interval, appended to the
+  // file. If the path is empty it goes to the engine log (UE_LOG or CCLOG),
+  // also in builds without DEBUG_LOG. An interval of 0 stops it.
+  static void SetDump(const int interval_seconds, const fun::string &path = "");
+
+  // Dumps the snapshot when it is due. It is called by FunapiTasks::UpdateAll.
+  static void Update();
+};
+
+}  // namespace fun
+
+#endif  // SRC_FUNAPI_STATS_H_
@@ -11,6 +11,128 @@
 
 namespace fun {
 
+// Move-only task for FunapiTasks and FunapiThread.
+// Callables up to kInlineSize bytes are stored inline, so pushing a lambda
+// does not allocate. Larger callables are moved to the heap.
+class FunapiTask {
+ public:
+  static const size_t kInlineSize = 96;
+
+  FunapiTask() = default;
+
+  template <typename F,
+            typename = typename std::enable_if<
+                !std::is_same<typename std::decay<F>::type, FunapiTask>::value>::type>
+  FunapiTask(F &&f)
+  {
+    Assign(std::forward<F>(f));
+  }
+
+  FunapiTask(FunapiTask &&other)
+  {
+    MoveFrom(other);
+  }
+
+  FunapiTask& operator= (FunapiTask &&other)
+  {
+    if (this != &other)
+    {
+      Reset();
+      MoveFrom(other);
+    }
+    return *this;
+  }
+
+  FunapiTask(const FunapiTask&) = delete;
+  FunapiTask& operator= (const FunapiTask&) = delete;
+
+  ~FunapiTask()
+  {
+    Reset();
+  }
+
+  explicit operator bool() const { return ops_ != nullptr; }
+  bool operator() () { return ops_->invoke(storage_); }
+
+  void Reset()
+  {
+    if (ops_)
+    {
+      ops_->destroy(storage_);
+      ops_ = nullptr;
+    }
+  }
+
+ private:
+  struct Ops
+  {
+    bool (*invoke)(void*);
+    void (*move)(void*, void*);
+    void (*destroy)(void*);
+  };
+
+  template <typename F> struct InlineOps
+  {
+    static bool Invoke(void *p) { return (*static_cast<F*>(p))(); }
+    static void Move(void *dst, void *src)
+    {
+      new (dst) F(std::move(*static_cast<F*>(src)));
+      static_cast<F*>(src)->~F();
+    }
+    static void Destroy(void *p) { static_cast<F*>(p)->~F(); }
+    static const Ops* Get() { static const Ops ops = { Invoke, Move, Destroy }; return &ops; }
+  };
+
+  template <typename F> struct HeapOps
+  {
+    static bool Invoke(void *p) { return (**static_cast<F**>(p))(); }
+    static void Move(void *dst, void *src) { *static_cast<F**>(dst) = *static_cast<F**>(src); }
+    static void Destroy(void *p) { delete *static_cast<F**>(p); }
+    static const Ops* Get() { static const Ops ops = { Invoke, Move, Destroy }; return &ops; }
+  };
+
+  static bool IsEmpty(const std::function<bool()> &f) { return !f; }
+  template <typename F> static bool IsEmpty(const F&) { return false; }
+
+  template <typename F> void Assign(F &&f)
+  {
+    typedef typename std::decay<F>::type Fn;
+
+    if (IsEmpty(f))
+      return;
+
+    Store<Fn>(std::forward<F>(f),
+              std::integral_constant<bool, (sizeof(Fn) <= kInlineSize &&
+                                            alignof(Fn) <= alignof(std::max_align_t))>());
+  }
+
+  template <typename Fn, typename F> void Store(F &&f, std::true_type /*fits*/)
+  {
+    new (storage_) Fn(std::forward<F>(f));
+    ops_ = InlineOps<Fn>::Get();
+  }
+
+  template <typename Fn, typename F> void Store(F &&f, std::false_type /*fits*/)
+  {
+    *reinterpret_cast<Fn**>(storage_) = new Fn(std::forward<F>(f));
+    ops_ = HeapOps<Fn>::Get();
+  }
+
+  void MoveFrom(FunapiTask &other)
+  {
+    if (other.ops_)
+    {
+      other.ops_->move(storage_, other.storage_);
+      ops_ = other.ops_;
+      other.ops_ = nullptr;
+    }
+  }
+
+  alignas(std::max_align_t) unsigned char storage_[kInlineSize];
+  const Ops *ops_ = nullptr;
+};
+
+
 class FunapiTasksImpl;
 class FUNAPI_API FunapiTasks : public std::enable_shared_from_this<FunapiTasks> {
  public:
@@ -23,9 +145,15 @@ class FUNAPI_API FunapiTasks : public std::enable_shared_from_this<FunapiTasks>
   static void UpdateAll();
 
   void Push(const TaskHandler &task);
+  void Push(FunapiTask &&task);
+  template <typename F> void Push(F &&task) { Push(FunapiTask(std::forward<F>(task))); }
   int Size();
   void Update();
 
+  // Update() stops running tasks after this time and leaves the rest
+  // for the next Update(). 0 (default) runs every task pushed before Update().
+  void SetTimeBudgetMicrosecond(const int64_t microsecond);
+
  private:
   std::shared_ptr<FunapiTasksImpl> impl_;
 };
@@ -44,6 +172,8 @@ class FUNAPI_API FunapiThread : public std::enable_shared_from_this<FunapiThread
   static std::shared_ptr<FunapiThread> Get(const fun::string &thread_id);
 
   void Push(const TaskHandler &task);
+  void Push(FunapiTask &&task);
+  template <typename F> void Push(F &&task) { Push(FunapiTask(std::forward<F>(task))); }
   int Size();
   void Join();
 
@@ -0,0 +1,146 @@
+#!/bin/sh
+# Copyright (C) 2013-2019 iFunFactory Inc. All Rights Reserved.
+#
+# This work is confidential and proprietary to iFunFactory Inc. and
+# must not be used, disclosed, copied, or distributed without the prior
+# consent of iFunFactory Inc.
+
+# Builds a program under Tools/ together with the plugin sources, without
+# the engine. The engine headers the plugin needs come from ue_shim/.
+#
+# Usage:
+#
+#   Tools/bench_support/build.sh <output> <source.cpp>...
+#
+# Needs a C++14 compiler and the development files of libcurl, OpenSSL and
+# zlib (Linux or macOS). The defines follow Funapi.Build.cs for Linux:
+#
+#   FUNAPI_HAVE_ZSTD=1       if libzstd is found (set ZSTD=0 to turn off)
+#   FUNAPI_HAVE_WEBSOCKET=1  if libwebsockets is found (WEBSOCKET=0 to turn off)
+#   FUNAPI_HAVE_UDP_MMSG=1   on Linux (UDP_MMSG=0 to turn off)
+#   FUNAPI_HAVE_SODIUM=0, FUNAPI_HAVE_AES128=0
+#
+# Objects of the plugin are kept in $OUT (default /tmp/funapi_bench) and
+# rebuilt when the sources are newer.
+
+set -e
+
+if [ $# -lt 2 ]; then
+  echo "Usage: $0 <output> <source.cpp>..." >&2
+  exit 1
+fi
+
+output=$1
+shift
+
+here=$(cd "$(dirname "$0")" && pwd)
+plugin=$(cd "$here/../.." && pwd)
+src=$plugin/Source/Funapi
+out=${OUT:-/tmp/funapi_bench}
+cxx=${CXX:-c++}
+
+case $(uname) in
+  Darwin) platform_include=$plugin/ThirdParty/include/Mac ;;
+  *) platform_include= ;;
+esac
+
+if [ -z "$ZSTD" ]; then
+  if echo '#include <zstd.h>' | $cxx -x c++ -E - >/dev/null 2>&1 ||
+     [ -f /usr/lib/x86_64-linux-gnu/libzstd.so.1 ]; then
+    ZSTD=1
+  else
+    ZSTD=0
+  fi
+fi
+
+if [ -z "$UDP_MMSG" ]; then
+  case $(uname) in
+    Linux) UDP_MMSG=1 ;;
+    *) UDP_MMSG=0 ;;
+  esac
+fi
+
+if [ -z "$WEBSOCKET" ]; then
+  if echo '#include <libwebsockets.h>' | $cxx -x c++ -E - >/dev/null 2>&1; then
+    WEBSOCKET=1
+  else
+    WEBSOCKET=0
+  fi
+fi
+
+libs="-lcurl -lssl -lcrypto -lz -lpthread"
+zstd_include=
+if [ "$ZSTD" = 1 ]; then
+  if ! echo '#include <zstd.h>' | $cxx -x c++ -E - >/dev/null 2>&1; then
+    # Runtime library only, the header comes with the plugin.
+    zstd_include="-idirafter $plugin/ThirdParty/include/Mac"
+  fi
+  if [ -f /usr/lib/x86_64-linux-gnu/libzstd.so ] || [ "$(uname)" = Darwin ]; then
+    libs="$libs -lzstd"
+  else
+    libs="$libs /usr/lib/x86_64-linux-gnu/libzstd.so.1"
+  fi
+fi
+if [ "$WEBSOCKET" = 1 ]; then
+  libs="$libs -lwebsockets"
+fi
+
+defines="-DWITH_FUNAPI=1 -DFUNAPI_UE4=1 -DFUNAPI_API= \
+  -DFUNAPI_UE4_PLATFORM_LINUX=1 \
+  -DFUNAPI_HAVE_ZLIB=1 -DFUNAPI_HAVE_DELAYED_ACK=1 -DFUNAPI_HAVE_TCP_TLS=1 \
+  -DFUNAPI_HAVE_WEBSOCKET=$WEBSOCKET -DFUNAPI_HAVE_RPC=1 \
+  -DFUNAPI_HAVE_UDP_MMSG=$UDP_MMSG -DFUNAPI_HAVE_ZSTD=$ZSTD \
+  -DFUNAPI_HAVE_SODIUM=0 -DFUNAPI_HAVE_AES128=0 \
+  -DRAPIDJSON_HAS_STDSTRING=0 -DRAPIDJSON_HAS_CXX11_RVALUE_REFS=0 \
+  -DHAVE_PTHREAD"
+
+includes="-I$here/ue_shim -I$here -I$src/Public -I$src/Public/funapi/management \
+  -I$src/Public/funapi/network -I$src/Public/funapi/service -I$src/Private \
+  -I$plugin/ThirdParty/include $zstd_include"
+if [ -n "$platform_include" ]; then
+  includes="$includes -I$platform_include"
+fi
+
+cxxflags="-std=c++14 -O2 -g -w $CXXFLAGS"
+
+mkdir -p "$out"
+echo "$defines" > "$out/flags.new"
+if ! cmp -s "$out/flags.new" "$out/flags"; then
+  rm -f "$out"/*.o "$out/libfunapi.a"
+  mv "$out/flags.new" "$out/flags"
+fi
+
+objects=
+for f in $(cd "$src/Private" && find . -name '*.cpp' -o -name '*.cc' | sort); do
+  case $f in
+    ./FunapiPlugin.cpp|./editor/*) continue ;;
+    *atomicops_internals_x86_msvc.cc) continue ;;
+  esac
+
+  o=$out/$(echo "$f" | sed -e 's|^\./||' -e 's|/|_|g').o
+  if [ ! -f "$o" ] || [ "$src/Private/$f" -nt "$o" ] ||
+     [ -n "$(find "$src/Public" "$src/Private" -name '*.h' -newer "$o" | head -1)" ]; then
+    echo "  CXX $f"
+    rm -f "$o"
+    $cxx $cxxflags $defines $includes -c "$src/Private/$f" -o "$o" &
+    # Limits the parallel jobs.
+    while [ "$(jobs -p | wc -l)" -ge "${JOBS:-8}" ]; do
+      sleep 0.1
+    done
+  fi
+  objects="$objects $o"
+done
+wait
+
+for o in $objects; do
+  if [ ! -f "$o" ]; then
+    echo "Failed to build the plugin." >&2
+    exit 1
+  fi
+done
+
+rm -f "$out/libfunapi.a"
+ar rcs "$out/libfunapi.a" $objects
+
+echo "  LD $output"
+$cxx $cxxflags $defines $includes "$@" "$out/libfunapi.a" $libs -o "$output"
@@ -0,0 +1,33 @@
+// Copyright (C) 2013-2019 iFunFactory Inc. All Rights Reserved.
+//
+// This work is confidential and proprietary to iFunFactory Inc. and
+// must not be used, disclosed, copied, or distributed without the prior
+// consent of iFunFactory Inc.
+
+// What FFunapi::StartupModule and ShutdownModule (FunapiPlugin.cpp) do in
+// the engine. Programs under Tools/ call these first and last.
+
+#ifndef TOOLS_BENCH_SUPPORT_PLUGIN_MODULE_H_
+#define TOOLS_BENCH_SUPPORT_PLUGIN_MODULE_H_
+
+#include <google/protobuf/descriptor.h>
+#include <google/protobuf/stubs/common.h>
+
+#include "funapi_plugin.h"
+#include "funapi_send_flag_manager.h"
+
+namespace bench {
+
+inline void StartupPluginModule() {
+  google::protobuf::RunProtobufRegistration();
+  fun::FunapiSendFlagManager::Init();
+}
+
+
+inline void ShutdownPluginModule() {
+  google::protobuf::ShutdownProtobufLibrary();
+}
+
+}  // namespace bench
+
+#endif  // TOOLS_BENCH_SUPPORT_PLUGIN_MODULE_H_
@@ -0,0 +1,362 @@
+// Copyright (C) 2013-2019 iFunFactory Inc. All Rights Reserved.
+//
+// This work is confidential and proprietary to iFunFactory Inc. and
+// must not be used, disclosed, copied, or distributed without the prior
+// consent of iFunFactory Inc.
+
+// Stand-in HTTP/1.1 server for the programs under Tools/.
+//
+// Keeps connections alive and serves each connection on its own thread.
+// A POST is answered by the handler, by default the funapi HTTP transport
+// echo: a request without a session id gets a _session_opened reply and
+// every other JSON body is sent back. SetResponseDelay holds every
+// response back, like a server doing some work per request.
+//
+// With SetFileRoot, a GET is answered with the file under the root, or the
+// part asked by a Range header (bytes=<begin>-[<end>]) unless
+// SetRangeSupport(false). SetBytesPerSecond limits every connection like a
+// CDN does, and SetCutOff drops the connections once that many file bytes
+// have been sent in total and answers 503 from then on.
+
+#ifndef TOOLS_BENCH_SUPPORT_STAND_IN_HTTP_SERVER_H_
+#define TOOLS_BENCH_SUPPORT_STAND_IN_HTTP_SERVER_H_
+
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <strings.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <map>
+#include <string>
+#include <thread>
+
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0  // macOS sets SO_NOSIGPIPE on the socket instead.
+#endif
+
+namespace bench {
+
+class StandInHttpServer {
+ public:
+  struct Request {
+    std::string method;
+    std::string path;
+    std::map<std::string, std::string> headers;  // Lower-case names.
+    std::string body;
+  };
+
+  // Returns the response body of a POST.
+  typedef std::function<std::string(const Request &request)> PostHandler;
+
+  StandInHttpServer() {
+    post_handler_ = [this](const Request &request) { return Echo(request); };
+  }
+
+  // Listens on an ephemeral loopback port.
+  bool Start() {
+    listener_ = socket(AF_INET, SOCK_STREAM, 0);
+    if (listener_ < 0)
+      return false;
+
+    int one = 1;
+    setsockopt(listener_, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+
+    sockaddr_in addr = {};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+    if (bind(listener_, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0 ||
+        listen(listener_, 128) != 0) {
+      close(listener_);
+      listener_ = -1;
+      return false;
+    }
+
+    socklen_t addr_len = sizeof(addr);
+    getsockname(listener_, reinterpret_cast<sockaddr*>(&addr), &addr_len);
+    port_ = ntohs(addr.sin_port);
+
+    std::thread([this]() {
+      for (;;) {
+        int fd = accept(listener_, nullptr, nullptr);
+        if (fd < 0)
+          continue;
+
+        ++connections_;
+        int one = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+#ifdef SO_NOSIGPIPE
+        setsockopt(fd, SOL_SOCKET, SO_NOSIGPIPE, &one, sizeof(one));
+#endif
+        std::thread(&StandInHttpServer::Serve, this, fd).detach();
+      }
+    }).detach();
+
+    return true;
+  }
+
+  int port() const { return port_; }
+
+  // Call before Start().
+  void SetPostHandler(const PostHandler &handler) { post_handler_ = handler; }
+  void SetResponseDelay(const std::chrono::microseconds delay) { delay_ = delay; }
+  void SetFileRoot(const std::string &root) { root_ = root; }
+  void SetRangeSupport(const bool support) { range_support_ = support; }
+  void SetBytesPerSecond(const int64_t bytes_per_second) { bytes_per_second_ = bytes_per_second; }
+
+  // May be called while serving. 0 turns it off.
+  void SetCutOff(const int64_t bytes) { cut_off_ = bytes; }
+
+  // Connections accepted, requests answered and file bytes sent so far.
+  int connections() const { return connections_; }
+  int64_t requests() const { return requests_; }
+  int64_t file_bytes() const { return file_bytes_; }
+
+ private:
+  std::string Echo(const Request &request) {
+    if (request.body.find("\"_sid\"") == std::string::npos) {
+      char opened[128];
+      snprintf(opened, sizeof(opened),
+               "{\"_msgtype\":\"_session_opened\",\"_sid\":\"stand-in-%08d\"}",
+               ++next_session_id_);
+      return opened;
+    }
+
+    return request.body;
+  }
+
+  void Serve(const int fd) {
+    std::string in;
+    Request request;
+
+    while (ReadRequest(fd, in, request)) {
+      if (delay_.count() > 0)
+        std::this_thread::sleep_for(delay_);
+
+      bool ok = false;
+      if (request.method == "POST")
+        ok = Respond(fd, "200 OK", post_handler_(request));
+      else if (request.method == "GET" && !root_.empty())
+        ok = RespondFile(fd, request);
+      else
+        ok = Respond(fd, "405 Method Not Allowed", "");
+
+      ++requests_;
+      if (!ok)
+        break;
+    }
+
+    close(fd);
+  }
+
+  // Reads the next request of the connection. Bytes after it stay in in.
+  static bool ReadRequest(const int fd, std::string &in, Request &request) {
+    size_t header_end;
+    while ((header_end = in.find("\r\n\r\n")) == std::string::npos) {
+      if (!ReadMore(fd, in))
+        return false;
+    }
+
+    request = Request();
+
+    size_t line_end = in.find("\r\n");
+    std::string request_line = in.substr(0, line_end);
+    size_t space1 = request_line.find(' ');
+    size_t space2 = request_line.find(' ', space1 + 1);
+    if (space1 == std::string::npos || space2 == std::string::npos)
+      return false;
+    request.method = request_line.substr(0, space1);
+    request.path = request_line.substr(space1 + 1, space2 - space1 - 1);
+
+    size_t pos = line_end + 2;
+    while (pos < header_end) {
+      size_t end = in.find("\r\n", pos);
+      size_t colon = in.find(':', pos);
+      if (colon != std::string::npos && colon < end) {
+        std::string name = in.substr(pos, colon - pos);
+        for (auto &c : name)
+          c = static_cast<char>(tolower(c));
+        size_t value = colon + 1;
+        while (value < end && in[value] == ' ')
+          ++value;
+        request.headers[name] = in.substr(value, end - value);
+      }
+      pos = end + 2;
+    }
+
+    size_t length = 0;
+    auto it = request.headers.find("content-length");
+    if (it != request.headers.end())
+      length = strtoul(it->second.c_str(), nullptr, 10);
+
+    size_t body_begin = header_end + 4;
+    while (in.size() < body_begin + length) {
+      if (!ReadMore(fd, in))
+        return false;
+    }
+
+    request.body = in.substr(body_begin, length);
+    in.erase(0, body_begin + length);
+    return true;
+  }
+
+  static bool ReadMore(const int fd, std::string &in) {
+    char buffer[65536];
+    ssize_t n = read(fd, buffer, sizeof(buffer));
+    if (n <= 0)
+      return false;
+
+    in.append(buffer, n);
+    return true;
+  }
+
+  bool RespondFile(const int fd, const Request &request) {
+    if (request.path.find("..") != std::string::npos)
+      return Respond(fd, "404 Not Found", "");
+
+    if (CutOff())
+      return Respond(fd, "503 Service Unavailable", "");
+
+    int file = open((root_ + request.path).c_str(), O_RDONLY);
+    struct stat st;
+    if (file < 0 || fstat(file, &st) != 0 || !S_ISREG(st.st_mode)) {
+      if (file >= 0)
+        close(file);
+      return Respond(fd, "404 Not Found", "");
+    }
+
+    const int64_t size = st.st_size;
+    int64_t begin = 0;
+    int64_t end = size;  // Exclusive.
+    bool partial = false;
+
+    auto it = request.headers.find("range");
+    if (range_support_ && it != request.headers.end() &&
+        it->second.compare(0, 6, "bytes=") == 0) {
+      const char *spec = it->second.c_str() + 6;
+      char *dash = nullptr;
+      begin = strtoll(spec, &dash, 10);
+      if (*dash == '-' && isdigit(static_cast<unsigned char>(dash[1])))
+        end = std::min<int64_t>(size, strtoll(dash + 1, nullptr, 10) + 1);
+
+      if (begin >= size || begin >= end) {
+        close(file);
+        return Respond(fd, "416 Range Not Satisfiable", "");
+      }
+      partial = true;
+    }
+
+    char header[256];
+    int length;
+    if (partial) {
+      length = snprintf(header, sizeof(header),
+                        "HTTP/1.1 206 Partial Content\r\n"
+                        "Content-Length: %lld\r\n"
+                        "Content-Range: bytes %lld-%lld/%lld\r\n"
+                        "Content-Type: application/octet-stream\r\n"
+                        "\r\n",
+                        static_cast<long long>(end - begin), static_cast<long long>(begin),
+                        static_cast<long long>(end - 1), static_cast<long long>(size));
+    } else {
+      length = snprintf(header, sizeof(header),
+                        "HTTP/1.1 200 OK\r\n"
+                        "Content-Length: %lld\r\n"
+                        "Accept-Ranges: %s\r\n"
+                        "Content-Type: application/octet-stream\r\n"
+                        "\r\n",
+                        static_cast<long long>(size), range_support_ ? "bytes" : "none");
+    }
+
+    bool ok = WriteAll(fd, header, length);
+
+    // Paced from the start of the body.
+    const auto start = std::chrono::steady_clock::now();
+    char buffer[65536];
+    int64_t sent = 0;
+
+    while (ok && begin + sent < end) {
+      if (CutOff()) {
+        ok = false;
+        break;
+      }
+
+      ssize_t n = pread(file, buffer,
+                        static_cast<size_t>(std::min<int64_t>(sizeof(buffer), end - begin - sent)),
+                        begin + sent);
+      if (n <= 0 || !WriteAll(fd, buffer, n)) {
+        ok = false;
+        break;
+      }
+
+      sent += n;
+      file_bytes_ += n;
+
+      if (bytes_per_second_ > 0)
+        std::this_thread::sleep_until(start + std::chrono::microseconds(sent * 1000000 / bytes_per_second_));
+    }
+
+    close(file);
+    return ok;
+  }
+
+  bool CutOff() const {
+    const int64_t cut_off = cut_off_;
+    return cut_off > 0 && file_bytes_ >= cut_off;
+  }
+
+  static bool Respond(const int fd, const char *status, const std::string &body) {
+    char header[256];
+    int length = snprintf(header, sizeof(header),
+                          "HTTP/1.1 %s\r\n"
+                          "Content-Length: %zu\r\n"
+                          "Content-Type: application/octet-stream\r\n"
+                          "\r\n",
+                          status, body.size());
+
+    std::string response(header, length);
+    response += body;
+    return WriteAll(fd, response.data(), response.size());
+  }
+
+  static bool WriteAll(const int fd, const char *data, size_t size) {
+    while (size > 0) {
+      // A peer that went away must not raise SIGPIPE.
+      ssize_t n = send(fd, data, size, MSG_NOSIGNAL);
+      if (n <= 0)
+        return false;
+      data += n;
+      size -= n;
+    }
+
+    return true;
+  }
+
+  int listener_ = -1;
+  int port_ = 0;
+  PostHandler post_handler_;
+  std::chrono::microseconds delay_{0};
+  std::string root_;
+  bool range_support_ = true;
+  int64_t bytes_per_second_ = 0;
+  std::atomic<int64_t> cut_off_{0};
+  std::atomic<int> next_session_id_{0};
+  std::atomic<int> connections_{0};
+  std::atomic<int64_t> requests_{0};
+  std::atomic<int64_t> file_bytes_{0};
+};
+
+}  // namespace bench
+
+#endif  // TOOLS_BENCH_SUPPORT_STAND_IN_HTTP_SERVER_H_
@@ -0,0 +1,445 @@
+// Copyright (C) 2013-2019 iFunFactory Inc. All Rights Reserved.
+//
+// This work is confidential and proprietary to iFunFactory Inc. and
+// must not be used, disclosed, copied, or distributed without the prior
+// consent of iFunFactory Inc.
+
+// Stand-in funapi server for the programs under Tools/.
+//
+// Speaks the funapi TCP framing ("VER:1\nLEN:<n>\n\n<body>") with JSON or
+// protobuf (FunMessage) bodies. A connection starts with the encryption
+// handshake header without encryption, the message without a session id
+// that the client answers with gets a _session_opened reply, and every
+// message with a message type is echoed back. SetMessageHandler replaces
+// the echo.
+//
+// With SetUseWebsocket(true) the server accepts a WebSocket upgrade
+// (RFC 6455, no extensions) and carries the same framing in WebSocket
+// frames. The client starts a WebSocket session itself, so no handshake
+// header is sent.
+
+#ifndef TOOLS_BENCH_SUPPORT_STAND_IN_SERVER_H_
+#define TOOLS_BENCH_SUPPORT_STAND_IN_SERVER_H_
+
+#include <arpa/inet.h>
+#include <openssl/evp.h>
+#include <openssl/sha.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "funapi_plugin.h"
+#include "funapi_session.h"
+#include "funapi/network/fun_message.pb.h"
+
+namespace bench {
+
+class StandInServer {
+ public:
+  typedef std::map<std::string, std::string> Headers;
+
+  // Writes the replies for a message with Reply(). Runs on the thread of
+  // the connection.
+  typedef std::function<void(StandInServer &server,
+                             const int fd,
+                             const Headers &headers,
+                             const std::string &body)> MessageHandler;
+
+  explicit StandInServer(const fun::FunEncoding encoding)
+      : encoding_(encoding) {
+  }
+
+  // Listens on an ephemeral loopback port.
+  bool Start() {
+    listener_ = socket(AF_INET, SOCK_STREAM, 0);
+    if (listener_ < 0)
+      return false;
+
+    int one = 1;
+    setsockopt(listener_, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+
+    sockaddr_in addr = {};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+    if (bind(listener_, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0 ||
+        listen(listener_, 128) != 0) {
+      close(listener_);
+      listener_ = -1;
+      return false;
+    }
+
+    socklen_t addr_len = sizeof(addr);
+    getsockname(listener_, reinterpret_cast<sockaddr*>(&addr), &addr_len);
+    port_ = ntohs(addr.sin_port);
+
+    std::thread([this]() {
+      for (;;) {
+        int fd = accept(listener_, nullptr, nullptr);
+        if (fd < 0)
+          continue;
+
+        int one = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+        std::thread(&StandInServer::Serve, this, fd).detach();
+      }
+    }).detach();
+
+    return true;
+  }
+
+  int port() const { return port_; }
+
+  void SetMessageHandler(const MessageHandler &handler) { handler_ = handler; }
+
+  // Call before Start().
+  void SetUseWebsocket(const bool use_websocket) { use_websocket_ = use_websocket; }
+
+  // Bytes and messages received from the clients.
+  int64_t bytes_received() const { return bytes_received_; }
+  int64_t messages_received() const { return messages_received_; }
+
+  // Writes a message with the funapi framing.
+  bool Reply(const int fd, const std::string &body) {
+    char header[64];
+    int header_length = snprintf(header, sizeof(header), "VER:1\nLEN:%zu\n\n", body.size());
+
+    std::string frame;
+    if (use_websocket_) {
+      // One unmasked binary frame.
+      size_t length = header_length + body.size();
+      frame.push_back(static_cast<char>(0x82));
+      if (length < 126) {
+        frame.push_back(static_cast<char>(length));
+      }
+      else if (length <= 0xffff) {
+        frame.push_back(126);
+        frame.push_back(static_cast<char>(length >> 8));
+        frame.push_back(static_cast<char>(length));
+      }
+      else {
+        frame.push_back(127);
+        for (int shift = 56; shift >= 0; shift -= 8)
+          frame.push_back(static_cast<char>(static_cast<uint64_t>(length) >> shift));
+      }
+    }
+
+    frame.reserve(frame.size() + header_length + body.size());
+    frame.append(header, header_length);
+    frame.append(body);
+
+    return WriteAll(fd, frame.data(), frame.size());
+  }
+
+  // The default handler: opens a session and echoes.
+  void Echo(const int fd, const std::string &body) {
+    if (encoding_ == fun::FunEncoding::kJson) {
+      fun::string session_id;
+      fun::string msg_type;
+      rapidjson::Document document;
+      document.Parse<0>(body.c_str());
+      if (!document.HasParseError() && document.IsObject()) {
+        if (document.HasMember("_sid"))
+          session_id = document["_sid"].GetString();
+        if (document.HasMember("_msgtype"))
+          msg_type = document["_msgtype"].GetString();
+      }
+
+      if (session_id.empty()) {
+        char opened[128];
+        snprintf(opened, sizeof(opened),
+                 "{\"_msgtype\":\"_session_opened\",\"_sid\":\"%s\"}",
+                 NewSessionId().c_str());
+        Reply(fd, opened);
+      }
+
+      if (!msg_type.empty())
+        Reply(fd, body);
+    }
+    else {
+      FunMessage message;
+      message.ParseFromArray(body.data(), static_cast<int>(body.size()));
+
+      if (!message.has_sid()) {
+        FunMessage opened;
+        opened.set_msgtype("_session_opened");
+        opened.set_sid(NewSessionId().c_str());
+        fun::string s;
+        opened.SerializeToString(&s);
+        Reply(fd, std::string(s.data(), s.size()));
+      }
+
+      if (message.has_msgtype() || message.has_msgtype2())
+        Reply(fd, body);
+    }
+  }
+
+  static bool WriteAll(const int fd, const char *data, size_t size) {
+    while (size > 0) {
+      ssize_t n = write(fd, data, size);
+      if (n <= 0)
+        return false;
+      data += n;
+      size -= n;
+    }
+
+    return true;
+  }
+
+ private:
+  std::string NewSessionId() {
+    char sid[64];
+    snprintf(sid, sizeof(sid), "stand-in-%08d", ++next_session_id_);
+    return sid;
+  }
+
+  void Serve(const int fd) {
+    std::vector<char> in(1 << 20);
+    size_t have = 0;
+
+    // Bytes read but not unwrapped from the WebSocket frames yet.
+    std::string frames;
+    bool has_unread_frames = false;
+
+    if (use_websocket_) {
+      if (!AcceptWebsocket(fd, frames)) {
+        close(fd);
+        return;
+      }
+      has_unread_frames = !frames.empty();
+    }
+    else if (!WriteAll(fd, kHandshake, strlen(kHandshake))) {
+      // Starts the handshake, no encryption.
+      close(fd);
+      return;
+    }
+
+    for (;;) {
+      if (have == in.size())
+        in.resize(in.size() * 2);
+
+      if (use_websocket_) {
+        // The bytes after the upgrade request are unwrapped first.
+        if (!has_unread_frames) {
+          char buffer[65536];
+          ssize_t n = read(fd, buffer, sizeof(buffer));
+          if (n <= 0)
+            break;
+          frames.append(buffer, n);
+        }
+        has_unread_frames = false;
+
+        std::string payload;
+        if (!UnwrapFrames(fd, frames, payload))
+          break;
+
+        if (have + payload.size() > in.size())
+          in.resize(have + payload.size());
+        memcpy(in.data() + have, payload.data(), payload.size());
+        have += payload.size();
+      }
+      else {
+        ssize_t n = read(fd, in.data() + have, in.size() - have);
+        if (n <= 0)
+          break;
+        have += n;
+      }
+
+      size_t offset = 0;
+      for (;;) {
+        Headers headers;
+        size_t body_offset = 0;
+        if (!ParseHeader(in.data() + offset, have - offset, headers, body_offset))
+          break;
+
+        size_t length = strtoul(headers["LEN"].c_str(), nullptr, 10);
+        if (have - offset - body_offset < length)
+          break;
+
+        std::string body(in.data() + offset + body_offset, length);
+        offset += body_offset + length;
+
+        bytes_received_ += length;
+        ++messages_received_;
+
+        if (handler_)
+          handler_(*this, fd, headers, body);
+        else
+          Echo(fd, body);
+      }
+
+      memmove(in.data(), in.data() + offset, have - offset);
+      have -= offset;
+    }
+
+    close(fd);
+  }
+
+  // Reads the upgrade request and accepts it. The bytes after the request
+  // are left in rest.
+  static bool AcceptWebsocket(const int fd, std::string &rest) {
+    std::string request;
+    size_t end;
+    while ((end = request.find("\r\n\r\n")) == std::string::npos) {
+      char buffer[4096];
+      ssize_t n = read(fd, buffer, sizeof(buffer));
+      if (n <= 0)
+        return false;
+      request.append(buffer, n);
+    }
+
+    rest = request.substr(end + 4);
+    request.resize(end + 2);
+
+    std::string key;
+    size_t line_begin = 0;
+    for (size_t i; (i = request.find("\r\n", line_begin)) != std::string::npos; line_begin = i + 2) {
+      std::string line = request.substr(line_begin, i - line_begin);
+      size_t colon = line.find(':');
+      if (colon == std::string::npos)
+        continue;
+
+      std::string name = line.substr(0, colon);
+      for (auto &c : name)
+        c = static_cast<char>(tolower(c));
+      if (name == "sec-websocket-key") {
+        key = line.substr(colon + 1);
+        key.erase(0, key.find_first_not_of(' '));
+        key.erase(key.find_last_not_of(' ') + 1);
+      }
+    }
+
+    if (key.empty())
+      return false;
+
+    key += "258EAFA5-E914-47DA-95CA-C5AB0DC85B11";
+    unsigned char digest[SHA_DIGEST_LENGTH];
+    SHA1(reinterpret_cast<const unsigned char*>(key.data()), key.size(), digest);
+    unsigned char accept[64];
+    EVP_EncodeBlock(accept, digest, SHA_DIGEST_LENGTH);
+
+    std::string response =
+        "HTTP/1.1 101 Switching Protocols\r\n"
+        "Upgrade: websocket\r\n"
+        "Connection: Upgrade\r\n"
+        "Sec-WebSocket-Accept: " + std::string(reinterpret_cast<char*>(accept)) + "\r\n\r\n";
+
+    return WriteAll(fd, response.data(), response.size());
+  }
+
+  // Moves the payloads of the complete frames to payload and answers pings.
+  // Returns false on a close frame.
+  static bool UnwrapFrames(const int fd, std::string &frames, std::string &payload) {
+    size_t offset = 0;
+    for (;;) {
+      const size_t have = frames.size() - offset;
+      const unsigned char *p = reinterpret_cast<const unsigned char*>(frames.data()) + offset;
+      if (have < 2)
+        break;
+
+      const int opcode = p[0] & 0x0f;
+      const bool is_masked = (p[1] & 0x80) != 0;
+      uint64_t length = p[1] & 0x7f;
+      size_t header_length = 2;
+      if (length == 126) {
+        if (have < 4)
+          break;
+        length = (static_cast<uint64_t>(p[2]) << 8) | p[3];
+        header_length = 4;
+      }
+      else if (length == 127) {
+        if (have < 10)
+          break;
+        length = 0;
+        for (int i = 0; i < 8; ++i)
+          length = (length << 8) | p[2 + i];
+        header_length = 10;
+      }
+
+      const unsigned char *mask = p + header_length;
+      if (is_masked)
+        header_length += 4;
+
+      if (have < header_length + length)
+        break;
+
+      std::string data(reinterpret_cast<const char*>(p + header_length), length);
+      if (is_masked) {
+        for (size_t i = 0; i < data.size(); ++i)
+          data[i] ^= mask[i % 4];
+      }
+
+      offset += header_length + length;
+
+      if (opcode == 0x8)
+        return false;
+
+      if (opcode == 0x9) {
+        std::string pong;
+        pong.push_back(static_cast<char>(0x8a));
+        pong.push_back(static_cast<char>(data.size()));
+        pong.append(data);
+        WriteAll(fd, pong.data(), pong.size());
+        continue;
+      }
+
+      // Text, binary and continuation frames carry the stream.
+      if (opcode <= 0x2)
+        payload.append(data);
+    }
+
+    frames.erase(0, offset);
+    return true;
+  }
+
+  // Returns false if the header is not complete yet.
+  static bool ParseHeader(const char *data, const size_t size,
+                          Headers &headers, size_t &body_offset) {
+    size_t line_begin = 0;
+    for (size_t i = 0; i < size; ++i) {
+      if (data[i] != '\n')
+        continue;
+
+      if (i == line_begin) {
+        body_offset = i + 1;
+        return true;
+      }
+
+      std::string line(data + line_begin, i - line_begin);
+      size_t colon = line.find(':');
+      if (colon != std::string::npos)
+        headers[line.substr(0, colon)] = line.substr(colon + 1);
+
+      line_begin = i + 1;
+    }
+
+    return false;
+  }
+
+  static constexpr const char *kHandshake = "VER:1\nENC:HELLO!\nLEN:0\n\n";
+
+  fun::FunEncoding encoding_;
+  bool use_websocket_ = false;
+  int listener_ = -1;
+  int port_ = 0;
+  MessageHandler handler_;
+  std::atomic<int> next_session_id_{0};
+  std::atomic<int64_t> bytes_received_{0};
+  std::atomic<int64_t> messages_received_{0};
+};
+
+}  // namespace bench
+
+#endif  // TOOLS_BENCH_SUPPORT_STAND_IN_SERVER_H_
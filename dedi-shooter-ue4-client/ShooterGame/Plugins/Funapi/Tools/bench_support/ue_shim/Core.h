@@ -0,0 +1,109 @@
+// Copyright (C) 2013-2019 iFunFactory Inc. All Rights Reserved.
+//
+// This work is confidential and proprietary to iFunFactory Inc. and
+// must not be used, disclosed, copied, or distributed without the prior
+// consent of iFunFactory Inc.
+
+// Minimal stand-in for the engine headers the plugin includes, so the
+// plugin sources can be built into the programs under Tools/ without the
+// engine. Only what the plugin uses is here.
+
+#pragma once
+
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+typedef char TCHAR;
+typedef uint8_t uint8;
+typedef uint32_t uint32;
+typedef uint64_t uint64;
+typedef int64_t int64;
+
+#define TEXT(x) x
+#define ANSI_TO_TCHAR(x) (x)
+#define UTF8_TO_TCHAR(x) (x)
+
+#define THIRD_PARTY_INCLUDES_START
+#define THIRD_PARTY_INCLUDES_END
+
+#ifndef UE_BUILD_SHIPPING
+#define UE_BUILD_SHIPPING 0
+#endif
+
+
+class FString {
+ public:
+  FString() {}
+  FString(const TCHAR *s) : s_(s ? s : "") {}
+
+  const TCHAR* operator*() const { return s_.c_str(); }
+
+ private:
+  std::string s_;
+};
+
+
+template <typename T>
+class TArray {
+ public:
+  T* GetData() { return v_.data(); }
+  int Num() const { return static_cast<int>(v_.size()); }
+  void Add(const T &t) { v_.push_back(t); }
+
+ private:
+  std::vector<T> v_;
+};
+
+
+// Log categories have no state here.
+#define DECLARE_LOG_CATEGORY_EXTERN(name, verbosity, compile_time_verbosity) \
+  struct FLogCategory##name {}; static FLogCategory##name name;
+#define DEFINE_LOG_CATEGORY(name)
+
+#define UE_LOG(category, verbosity, format, ...) \
+  do { (void)category; fprintf(stderr, format "\n", ##__VA_ARGS__); } while (0)
+
+#define checkf(expr, format, ...) \
+  do { if (!(expr)) { fprintf(stderr, format "\n", ##__VA_ARGS__); abort(); } } while (0)
+
+
+class IPlatformFile {
+ public:
+  bool FileExists(const TCHAR *path) {
+    struct stat st;
+    return stat(path, &st) == 0 && S_ISREG(st.st_mode);
+  }
+
+  int64 FileSize(const TCHAR *path) {
+    struct stat st;
+    return stat(path, &st) == 0 ? static_cast<int64>(st.st_size) : -1;
+  }
+
+  bool DirectoryExists(const TCHAR *path) {
+    struct stat st;
+    return stat(path, &st) == 0 && S_ISDIR(st.st_mode);
+  }
+
+  bool CreateDirectory(const TCHAR *path) {
+    return mkdir(path, 0755) == 0 || DirectoryExists(path);
+  }
+};
+
+
+class FPlatformFileManager {
+ public:
+  static FPlatformFileManager& Get() {
+    static FPlatformFileManager manager;
+    return manager;
+  }
+
+  IPlatformFile& GetPlatformFile() { return file_; }
+
+ private:
+  IPlatformFile file_;
+};
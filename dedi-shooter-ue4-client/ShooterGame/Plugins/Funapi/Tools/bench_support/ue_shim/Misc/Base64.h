@@ -0,0 +1,37 @@
+// Copyright (C) 2013-2019 iFunFactory Inc. All Rights Reserved.
+//
+// This work is confidential and proprietary to iFunFactory Inc. and
+// must not be used, disclosed, copied, or distributed without the prior
+// consent of iFunFactory Inc.
+
+#pragma once
+
+#include <cstring>
+
+#include "Core.h"
+
+class FBase64 {
+ public:
+  static bool Decode(const FString &source, TArray<uint8> &dest) {
+    static const char kAlphabet[] =
+        "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+    uint32 bits = 0;
+    int num_bits = 0;
+    for (const char *c = *source; *c && *c != '='; ++c) {
+      const char *p = strchr(kAlphabet, *c);
+      if (!p) {
+        return false;
+      }
+
+      bits = (bits << 6) | static_cast<uint32>(p - kAlphabet);
+      num_bits += 6;
+      if (num_bits >= 8) {
+        num_bits -= 8;
+        dest.Add(static_cast<uint8>(bits >> num_bits));
+      }
+    }
+
+    return true;
+  }
+};
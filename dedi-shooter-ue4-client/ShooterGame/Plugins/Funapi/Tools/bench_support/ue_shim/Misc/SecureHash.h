@@ -0,0 +1,33 @@
+// Copyright (C) 2013-2019 iFunFactory Inc. All Rights Reserved.
+//
+// This work is confidential and proprietary to iFunFactory Inc. and
+// must not be used, disclosed, copied, or distributed without the prior
+// consent of iFunFactory Inc.
+
+#pragma once
+
+#include <openssl/evp.h>
+
+#include "Core.h"
+
+// FMD5 on top of OpenSSL.
+class FMD5 {
+ public:
+  FMD5() : ctx_(EVP_MD_CTX_new()) { EVP_DigestInit_ex(ctx_, EVP_md5(), nullptr); }
+  ~FMD5() { EVP_MD_CTX_free(ctx_); }
+
+  FMD5(const FMD5 &other) : ctx_(EVP_MD_CTX_new()) { EVP_MD_CTX_copy_ex(ctx_, other.ctx_); }
+  FMD5& operator=(const FMD5 &other) {
+    EVP_MD_CTX_copy_ex(ctx_, other.ctx_);
+    return *this;
+  }
+
+  void Update(const uint8 *input, uint64 input_length) {
+    EVP_DigestUpdate(ctx_, input, static_cast<size_t>(input_length));
+  }
+
+  void Final(uint8 *digest) { EVP_DigestFinal_ex(ctx_, digest, nullptr); }
+
+ private:
+  EVP_MD_CTX *ctx_;
+};
@@ -0,0 +1,15 @@
+// Copyright (C) 2013-2019 iFunFactory Inc. All Rights Reserved.
+//
+// This work is confidential and proprietary to iFunFactory Inc. and
+// must not be used, disclosed, copied, or distributed without the prior
+// consent of iFunFactory Inc.
+
+#pragma once
+
+#include "Core.h"
+
+struct FPlatformAtomics {
+  static int32_t InterlockedIncrement(volatile int32_t *value) {
+    return __sync_add_and_fetch(value, 1);
+  }
+};
@@ -0,0 +1,16 @@
+// Copyright (C) 2013-2019 iFunFactory Inc. All Rights Reserved.
+//
+// This work is confidential and proprietary to iFunFactory Inc. and
+// must not be used, disclosed, copied, or distributed without the prior
+// consent of iFunFactory Inc.
+
+#pragma once
+
+#include <cstdarg>
+
+#include "Core.h"
+
+struct FPlatformMisc {
+  static void LowLevelOutputDebugStringf(const TCHAR *format, ...) {
+  }
+};
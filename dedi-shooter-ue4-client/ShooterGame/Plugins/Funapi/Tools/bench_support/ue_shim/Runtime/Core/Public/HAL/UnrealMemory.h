@@ -0,0 +1,17 @@
+// Copyright (C) 2013-2019 iFunFactory Inc. All Rights Reserved.
+//
+// This work is confidential and proprietary to iFunFactory Inc. and
+// must not be used, disclosed, copied, or distributed without the prior
+// consent of iFunFactory Inc.
+
+#pragma once
+
+#include <cstdlib>
+#include <cstring>
+
+struct FMemory {
+  static void* Malloc(size_t count) { return malloc(count); }
+  static void* Realloc(void *original, size_t count) { return realloc(original, count); }
+  static void Free(void *original) { free(original); }
+  static void* Memcpy(void *dest, const void *src, size_t count) { return memcpy(dest, src, count); }
+};
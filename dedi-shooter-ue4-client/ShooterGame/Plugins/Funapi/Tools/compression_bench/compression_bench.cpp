@@ -0,0 +1,378 @@
+// Copyright (C) 2013-2019 iFunFactory Inc. All Rights Reserved.
+//
+// This work is confidential and proprietary to iFunFactory Inc. and
+// must not be used, disclosed, copied, or distributed without the prior
+// consent of iFunFactory Inc.
+
+
+// Compression microbenchmark of FunapiCompression.
+//
+// Compresses and decompresses JSON game messages of 100 to 4000 bytes
+// with zstd (with and without a dictionary) and deflate, two ways:
+//
+//   per-message  a context created and freed for every message, as the
+//                compressors did before they kept their contexts
+//   reused       FunapiCompression::Compress/Decompress, contexts kept
+//                across messages (including the header fields work)
+//
+// The dictionary is trained from other messages of the same generator.
+// Prints the time of one compress and decompress and the compressed size.
+//
+// Build (Linux or macOS, see Tools/bench_support/build.sh):
+//
+//   Tools/bench_support/build.sh compression_bench Tools/compression_bench/compression_bench.cpp
+//
+// Usage:
+//
+//   compression_bench [<messages per case>]
+
+#include <openssl/evp.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <zlib.h>
+
+#include "plugin_module.h"
+#include "funapi_compression.h"
+
+#if FUNAPI_HAVE_ZSTD
+#define ZSTD_STATIC_LINKING_ONLY
+#include <zstd.h>
+
+// zdict.h does not come with the plugin.
+extern "C" size_t ZDICT_trainFromBuffer(void *dict_buffer, size_t dict_buffer_capacity,
+                                        const void *samples_buffer,
+                                        const size_t *samples_sizes, unsigned nb_samples);
+extern "C" unsigned ZDICT_isError(size_t error_code);
+#endif
+
+namespace {
+
+typedef fun::vector<uint8_t> Bytes;
+
+const int kSizes[] = { 100, 250, 500, 1000, 4000 };
+const int kMessagesPerSize = 64;
+
+
+int64_t NowNanosecond() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+    std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+
+// A JSON message of the given size, like the state updates of a game.
+Bytes MakeMessage(std::mt19937 &random, const size_t size) {
+  static const char *kTypes[] = { "move", "attack", "chat", "state" };
+  static const char *kNames[] = { "warrior", "archer", "mage", "healer", "rogue" };
+
+  std::string s = "{\"_msgtype\":\"";
+  s += kTypes[random() % 4];
+  s += "\",\"entities\":[";
+
+  while (s.size() < size) {
+    char entity[160];
+    snprintf(entity, sizeof(entity),
+             "{\"id\":%u,\"class\":\"%s\",\"x\":%.2f,\"y\":%.2f,\"hp\":%u,\"state\":\"%s\"},",
+             static_cast<unsigned>(random() % 100000),
+             kNames[random() % 5],
+             (random() % 100000) / 100.0,
+             (random() % 100000) / 100.0,
+             static_cast<unsigned>(random() % 1000),
+             random() % 2 ? "idle" : "running");
+    s += entity;
+  }
+
+  s.resize(size - 2);
+  s += "]}";
+  return Bytes(s.begin(), s.end());
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+// Per-message contexts, as the compressors used to work.
+
+const int kZlibWindowBits = -15;
+
+
+bool ZlibCompressOnce(const Bytes &in, Bytes &out) {
+  const size_t max_size = 18 + in.size() + 5 * (in.size() / 16383 + 1);
+  out.resize(max_size);
+
+  z_stream zstr = {};
+  zstr.next_in = const_cast<uint8_t*>(in.data());
+  zstr.avail_in = static_cast<unsigned int>(in.size());
+  zstr.next_out = out.data();
+  zstr.avail_out = static_cast<unsigned int>(max_size);
+
+  if (deflateInit2(&zstr, 3, Z_DEFLATED, kZlibWindowBits, 9, Z_DEFAULT_STRATEGY) != Z_OK)
+    return false;
+
+  int result = deflate(&zstr, Z_FINISH);
+  deflateEnd(&zstr);
+  if (result != Z_STREAM_END)
+    return false;
+
+  out.resize(max_size - zstr.avail_out);
+  return true;
+}
+
+
+bool ZlibDecompressOnce(const Bytes &in, Bytes &out) {
+  z_stream zstr = {};
+  zstr.next_in = const_cast<uint8_t*>(in.data());
+  zstr.avail_in = static_cast<unsigned int>(in.size());
+  zstr.next_out = out.data();
+  zstr.avail_out = static_cast<unsigned int>(out.size());
+
+  if (inflateInit2(&zstr, kZlibWindowBits) != Z_OK)
+    return false;
+
+  int result = inflate(&zstr, Z_FINISH);
+  inflateEnd(&zstr);
+  return result == Z_STREAM_END && zstr.avail_out == 0;
+}
+
+
+#if FUNAPI_HAVE_ZSTD
+const int kZstdLevel = 1;
+
+
+// Messages are far smaller than a zstd block, so they are single blocks
+// without a frame header, as the plugin sends them.
+bool ZstdCompressOnce(const Bytes &in, Bytes &out, ZSTD_CDict *cdict) {
+  ZSTD_CCtx *ctx = ZSTD_createCCtx();
+  out.resize(ZSTD_compressBound(in.size()));
+
+  ZSTD_frameParameters frame = { 0, 0, 1 };
+  if (cdict) {
+    ZSTD_compressBegin_usingCDict_advanced(ctx, cdict, frame, in.size());
+  }
+  else {
+    ZSTD_parameters params = { ZSTD_getCParams(kZstdLevel, in.size(), 0), frame };
+    ZSTD_compressBegin_advanced(ctx, NULL, 0, params, in.size());
+  }
+
+  size_t size = ZSTD_compressBlock(ctx, out.data(), out.size(), in.data(), in.size());
+  ZSTD_freeCCtx(ctx);
+  if (ZSTD_isError(size) || size == 0)
+    return false;
+
+  out.resize(size);
+  return true;
+}
+
+
+bool ZstdDecompressOnce(const Bytes &in, Bytes &out, ZSTD_DDict *ddict) {
+  ZSTD_DCtx *ctx = ZSTD_createDCtx();
+  if (ddict)
+    ZSTD_decompressBegin_usingDDict(ctx, ddict);
+  else
+    ZSTD_decompressBegin(ctx);
+
+  size_t size = ZSTD_decompressBlock(ctx, out.data(), out.size(), in.data(), in.size());
+  ZSTD_freeDCtx(ctx);
+  return !ZSTD_isError(size) && size == out.size();
+}
+#endif  // FUNAPI_HAVE_ZSTD
+
+
+////////////////////////////////////////////////////////////////////////////////
+// Cases.
+
+struct Result {
+  double nanoseconds = 0;   // One compress and decompress.
+  double compressed = 0;    // Average compressed size.
+  bool ok = true;
+};
+
+
+Result RunPerMessage(const fun::CompressionType type, const std::vector<Bytes> &messages,
+                     const int count, const std::string &dict) {
+  Result result;
+  Bytes compressed;
+  Bytes decompressed;
+
+#if FUNAPI_HAVE_ZSTD
+  ZSTD_CDict *cdict = NULL;
+  ZSTD_DDict *ddict = NULL;
+  if (!dict.empty()) {
+    cdict = ZSTD_createCDict(dict.data(), dict.size(), kZstdLevel);
+    ddict = ZSTD_createDDict(dict.data(), dict.size());
+  }
+#endif
+
+  int64_t total_size = 0;
+  int64_t start = NowNanosecond();
+  for (int i = 0; i < count; ++i) {
+    const Bytes &m = messages[i % messages.size()];
+    bool ok = false;
+    decompressed.resize(m.size());
+
+#if FUNAPI_HAVE_ZSTD
+    if (type == fun::CompressionType::kZstd) {
+      ok = ZstdCompressOnce(m, compressed, cdict) &&
+           ZstdDecompressOnce(compressed, decompressed, ddict);
+    }
+#endif
+    if (type == fun::CompressionType::kDeflate) {
+      ok = ZlibCompressOnce(m, compressed) &&
+           ZlibDecompressOnce(compressed, decompressed);
+    }
+
+    if (!ok || decompressed != m)
+      result.ok = false;
+    total_size += compressed.size();
+  }
+  result.nanoseconds = static_cast<double>(NowNanosecond() - start) / count;
+  result.compressed = static_cast<double>(total_size) / count;
+
+#if FUNAPI_HAVE_ZSTD
+  if (cdict) {
+    ZSTD_freeCDict(cdict);
+    ZSTD_freeDDict(ddict);
+  }
+#endif
+
+  return result;
+}
+
+
+Result RunReused(const fun::CompressionType type, const std::vector<Bytes> &messages,
+                 const int count, const std::string &dict_base64) {
+  fun::FunapiCompression sender;
+  fun::FunapiCompression receiver;
+  for (auto c : { &sender, &receiver }) {
+    c->SetCompressionType(type);
+    c->SetThreshold(0);
+#if FUNAPI_HAVE_ZSTD
+    if (!dict_base64.empty())
+      c->SetZstdDictBase64String(dict_base64.c_str());
+#endif
+  }
+
+  Result result;
+  fun::FunapiCompression::HeaderFields header;
+  Bytes body;
+  char length[16];
+
+  int64_t total_size = 0;
+  int64_t start = NowNanosecond();
+  for (int i = 0; i < count; ++i) {
+    const Bytes &m = messages[i % messages.size()];
+    body.assign(m.begin(), m.end());
+
+    header.clear();
+    snprintf(length, sizeof(length), "%zu", m.size());
+    header["LEN"] = length;
+
+    if (!sender.Compress(header, body) || header.find("C") == header.end() ||
+        !receiver.Decompress(header, body) || body != m)
+      result.ok = false;
+
+    total_size += atoi(header["LEN"].c_str());
+  }
+  result.nanoseconds = static_cast<double>(NowNanosecond() - start) / count;
+  result.compressed = static_cast<double>(total_size) / count;
+
+  return result;
+}
+
+
+#if FUNAPI_HAVE_ZSTD
+std::string TrainDictionary() {
+  std::mt19937 random(2019);
+  std::string samples;
+  std::vector<size_t> sizes;
+  for (int i = 0; i < 2000; ++i) {
+    Bytes m = MakeMessage(random, kSizes[i % (sizeof(kSizes) / sizeof(kSizes[0]))]);
+    samples.append(m.begin(), m.end());
+    sizes.push_back(m.size());
+  }
+
+  std::string dict(16 * 1024, '\0');
+  size_t size = ZDICT_trainFromBuffer(&dict[0], dict.size(), samples.data(),
+                                      sizes.data(), static_cast<unsigned>(sizes.size()));
+  if (ZDICT_isError(size))
+    return "";
+
+  dict.resize(size);
+  return dict;
+}
+#endif
+
+}  // namespace
+
+
+int main(int argc, char *argv[]) {
+  const int count = argc > 1 ? atoi(argv[1]) : 50000;
+  if (argc > 2 || count <= 0) {
+    fprintf(stderr, "Usage: %s [<messages per case>]\n", argv[0]);
+    return 1;
+  }
+
+  bench::StartupPluginModule();
+
+  struct Case {
+    const char *name;
+    fun::CompressionType type;
+    bool use_dict;
+  };
+
+  std::vector<Case> cases;
+#if FUNAPI_HAVE_ZSTD
+  cases.push_back({ "zstd", fun::CompressionType::kZstd, false });
+  cases.push_back({ "zstd+dict", fun::CompressionType::kZstd, true });
+#endif
+  cases.push_back({ "deflate", fun::CompressionType::kDeflate, false });
+
+  std::string dict;
+  std::string dict_base64;
+#if FUNAPI_HAVE_ZSTD
+  dict = TrainDictionary();
+  if (dict.empty()) {
+    fprintf(stderr, "Failed to train the dictionary.\n");
+    return 1;
+  }
+
+  dict_base64.resize(4 * ((dict.size() + 2) / 3) + 1);
+  int length = EVP_EncodeBlock(reinterpret_cast<unsigned char*>(&dict_base64[0]),
+                               reinterpret_cast<const unsigned char*>(dict.data()),
+                               static_cast<int>(dict.size()));
+  dict_base64.resize(length);
+  printf("zstd %s, dictionary %zu bytes\n", ZSTD_versionString(), dict.size());
+#endif
+
+  printf("%-10s %5s  %14s  %14s  %7s  %s\n",
+         "", "size", "per-message", "reused", "speedup", "compressed");
+
+  bool ok = true;
+  for (const auto &c : cases) {
+    for (int size : kSizes) {
+      std::mt19937 random(size);
+      std::vector<Bytes> messages;
+      for (int i = 0; i < kMessagesPerSize; ++i)
+        messages.push_back(MakeMessage(random, size));
+
+      Result before = RunPerMessage(c.type, messages, count, c.use_dict ? dict : "");
+      Result after = RunReused(c.type, messages, count, c.use_dict ? dict_base64 : "");
+
+      printf("%-10s %5d  %11.0f ns  %11.0f ns  %6.1fx  %6.0f B%s\n",
+             c.name, size, before.nanoseconds, after.nanoseconds,
+             before.nanoseconds / after.nanoseconds, after.compressed,
+             before.ok && after.ok ? "" : "  MISMATCH");
+      fflush(stdout);
+      ok = ok && before.ok && after.ok;
+    }
+  }
+
+  // The plugin threads are not joined on exit.
+  fflush(stdout);
+  _exit(ok ? 0 : 1);
+}
@@ -0,0 +1,337 @@
+// Copyright (C) 2013-2019 iFunFactory Inc. All Rights Reserved.
+//
+// This work is confidential and proprietary to iFunFactory Inc. and
+// must not be used, disclosed, copied, or distributed without the prior
+// consent of iFunFactory Inc.
+
+
+// Throughput and resume of FunapiHttpDownloader.
+//
+// The stand-in HTTP server (Tools/bench_support/stand_in_http_server.h)
+// serves three small files and one large file, every connection limited to
+// <MB/s per connection> like a CDN. The list the downloader asks for first
+// is answered by the POST handler. Runs:
+//
+//   x1, x4, x8  SetMaxConcurrentDownloads(N), ranges supported
+//   no range    x4 against a server that ignores Range, so the large file
+//               comes over one connection
+//   resume      x4, the server drops every connection after about half of
+//               the bytes and answers 503 from then on. A second
+//               downloader on the same target finishes the files, and the
+//               bytes it fetches again are reported.
+//
+// Every run starts from an empty target directory and checks the MD5 of
+// every downloaded file against the source, hashed here with OpenSSL.
+//
+// Build (Linux or macOS, see Tools/bench_support/build.sh):
+//
+//   Tools/bench_support/build.sh download_bench Tools/download_bench/download_bench.cpp
+//
+// Usage:
+//
+//   download_bench [<large file MB> [<MB/s per connection>]]
+
+#include <ftw.h>
+#include <openssl/md5.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "plugin_module.h"
+#include "stand_in_http_server.h"
+#include "funapi_downloader.h"
+
+namespace {
+
+struct SourceFile {
+  std::string path;  // Relative to the root.
+  int64_t size;
+  std::string md5;
+};
+
+struct Result {
+  fun::FunapiHttpDownloader::ResultCode code = fun::FunapiHttpDownloader::ResultCode::kNone;
+  double seconds = 0;
+};
+
+
+int64_t NowNanosecond() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+    std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+
+std::string HexDigest(MD5_CTX &ctx) {
+  unsigned char digest[MD5_DIGEST_LENGTH];
+  MD5_Final(digest, &ctx);
+
+  char hex[MD5_DIGEST_LENGTH * 2 + 1];
+  for (int i = 0; i < MD5_DIGEST_LENGTH; ++i)
+    snprintf(hex + i * 2, 3, "%02x", digest[i]);
+  return hex;
+}
+
+
+std::string MD5OfFile(const std::string &path) {
+  FILE *fp = fopen(path.c_str(), "rb");
+  if (fp == NULL)
+    return "";
+
+  MD5_CTX ctx;
+  MD5_Init(&ctx);
+
+  std::vector<char> buffer(1024 * 1024);
+  size_t length;
+  while ((length = fread(buffer.data(), 1, buffer.size(), fp)) != 0)
+    MD5_Update(&ctx, buffer.data(), length);
+
+  fclose(fp);
+  return HexDigest(ctx);
+}
+
+
+// Writes pseudo-random bytes, so nothing on the way can compress them.
+bool WriteSourceFile(const std::string &root, SourceFile &file) {
+  std::string path = root + "/" + file.path;
+  size_t slash = path.rfind('/');
+  mkdir(path.substr(0, slash).c_str(), 0755);
+
+  FILE *fp = fopen(path.c_str(), "wb");
+  if (fp == NULL)
+    return false;
+
+  MD5_CTX ctx;
+  MD5_Init(&ctx);
+
+  uint64_t state = 0x9e3779b97f4a7c15ULL ^ static_cast<uint64_t>(file.size);
+  std::vector<uint64_t> buffer(128 * 1024);
+  int64_t left = file.size;
+
+  while (left > 0) {
+    for (auto &word : buffer) {
+      state ^= state << 13;
+      state ^= state >> 7;
+      state ^= state << 17;
+      word = state;
+    }
+
+    size_t length = static_cast<size_t>(std::min<int64_t>(left, buffer.size() * sizeof(uint64_t)));
+    MD5_Update(&ctx, buffer.data(), length);
+    if (fwrite(buffer.data(), 1, length, fp) != length) {
+      fclose(fp);
+      return false;
+    }
+    left -= length;
+  }
+
+  file.md5 = HexDigest(ctx);
+  return fclose(fp) == 0;
+}
+
+
+std::string DownloadList(const std::vector<SourceFile> &files) {
+  std::string json = "{\"data\":[";
+  for (size_t i = 0; i < files.size(); ++i) {
+    char entry[256];
+    snprintf(entry, sizeof(entry), "%s{\"path\":\"%s\",\"size\":%lld,\"md5\":\"%s\"}",
+             i > 0 ? "," : "", files[i].path.c_str(),
+             static_cast<long long>(files[i].size), files[i].md5.c_str());
+    json += entry;
+  }
+  return json + "]}";
+}
+
+
+int RemoveEntry(const char *path, const struct stat *, int, struct FTW *) {
+  remove(path);
+  return 0;
+}
+
+
+void RemoveTree(const std::string &path) {
+  nftw(path.c_str(), RemoveEntry, 16, FTW_DEPTH | FTW_PHYS);
+}
+
+
+Result Download(const int port, const std::string &target, const int max_downloads) {
+  char url[64];
+  snprintf(url, sizeof(url), "http://127.0.0.1:%d", port);
+
+  // The downloader makes the directories under the target only.
+  mkdir(target.c_str(), 0755);
+
+  Result result;
+  auto downloader = fun::FunapiHttpDownloader::Create(url, fun::string(target.c_str()) + "/");
+  downloader->SetMaxConcurrentDownloads(max_downloads);
+  downloader->AddCompletionCallback(
+      [&result](const std::shared_ptr<fun::FunapiHttpDownloader> &,
+                const fun::vector<std::shared_ptr<fun::FunapiDownloadFileInfo>> &,
+                const fun::FunapiHttpDownloader::ResultCode code)
+  {
+    result.code = code;
+  });
+
+  int64_t start = NowNanosecond();
+  downloader->Start();
+
+  int64_t deadline = start + 600 * 1000000000LL;
+  while (result.code == fun::FunapiHttpDownloader::ResultCode::kNone &&
+         NowNanosecond() < deadline) {
+    fun::FunapiHttpDownloader::UpdateAll();
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+
+  result.seconds = (NowNanosecond() - start) / 1e9;
+  return result;
+}
+
+
+bool Verify(const char *name, const std::string &target, const std::vector<SourceFile> &files) {
+  for (auto &file : files) {
+    if (MD5OfFile(target + "/" + file.path) != file.md5) {
+      fprintf(stderr, "%s: the MD5 of %s is different\n", name, file.path.c_str());
+      return false;
+    }
+  }
+  return true;
+}
+
+
+bench::StandInHttpServer *StartServer(const std::string &root, const std::vector<SourceFile> &files,
+                                      const bool range_support, const int64_t bytes_per_second) {
+  // Never freed, the threads of its connections outlive the run.
+  auto server = new bench::StandInHttpServer();
+  const std::string list = DownloadList(files);
+  server->SetPostHandler([list](const bench::StandInHttpServer::Request &) { return list; });
+  server->SetFileRoot(root);
+  server->SetRangeSupport(range_support);
+  server->SetBytesPerSecond(bytes_per_second);
+  return server->Start() ? server : nullptr;
+}
+
+
+bool RunThroughput(const char *name, const std::string &root, const std::string &target,
+                   const std::vector<SourceFile> &files, const int64_t bytes_per_second,
+                   const int max_downloads, const bool range_support) {
+  auto server = StartServer(root, files, range_support, bytes_per_second);
+  if (server == nullptr)
+    return false;
+
+  Result result = Download(server->port(), target, max_downloads);
+  if (result.code != fun::FunapiHttpDownloader::ResultCode::kSucceed) {
+    fprintf(stderr, "%s: the download failed\n", name);
+    return false;
+  }
+
+  bool ok = Verify(name, target, files);
+  printf("%-9s %7.1f MB/s  %6.2f s  %3d connections  %s\n",
+         name, server->file_bytes() / result.seconds / 1e6, result.seconds,
+         server->connections(), ok ? "md5 ok" : "MD5 MISMATCH");
+  fflush(stdout);
+
+  RemoveTree(target);
+  return ok;
+}
+
+
+bool RunResume(const std::string &root, const std::string &target,
+               const std::vector<SourceFile> &files, const int64_t bytes_per_second) {
+  auto server = StartServer(root, files, true, bytes_per_second);
+  if (server == nullptr)
+    return false;
+
+  int64_t total = 0;
+  for (auto &file : files)
+    total += file.size;
+
+  server->SetCutOff(total / 2);
+  Result first = Download(server->port(), target, 4);
+  int64_t first_bytes = server->file_bytes();
+
+  if (first.code != fun::FunapiHttpDownloader::ResultCode::kFailed) {
+    fprintf(stderr, "resume: the interrupted download did not fail\n");
+    return false;
+  }
+
+  server->SetCutOff(0);
+  Result second = Download(server->port(), target, 4);
+  int64_t second_bytes = server->file_bytes() - first_bytes;
+
+  if (second.code != fun::FunapiHttpDownloader::ResultCode::kSucceed) {
+    fprintf(stderr, "resume: the resumed download failed\n");
+    return false;
+  }
+
+  bool ok = Verify("resume", target, files);
+  printf("resume    %.1f of %.1f MB before the cut, %.1f MB after, %.2f MB sent twice  %s\n",
+         first_bytes / 1e6, total / 1e6, second_bytes / 1e6,
+         (first_bytes + second_bytes - total) / 1e6, ok ? "md5 ok" : "MD5 MISMATCH");
+  fflush(stdout);
+
+  RemoveTree(target);
+  return ok;
+}
+
+}  // namespace
+
+
+int main(int argc, char *argv[]) {
+  const int large_mb = argc > 1 ? atoi(argv[1]) : 64;
+  const double mb_per_second = argc > 2 ? atof(argv[2]) : 4;
+  if (argc > 3 || large_mb <= 0 || mb_per_second <= 0) {
+    fprintf(stderr, "Usage: %s [<large file MB> [<MB/s per connection>]]\n", argv[0]);
+    return 1;
+  }
+
+  bench::StartupPluginModule();
+
+  char base[] = "/tmp/download_bench.XXXXXX";
+  if (mkdtemp(base) == nullptr) {
+    perror("mkdtemp");
+    return 1;
+  }
+
+  const std::string root = std::string(base) + "/root";
+  const std::string target = std::string(base) + "/target";
+  mkdir(root.c_str(), 0755);
+
+  std::vector<SourceFile> files = {
+    { "small/a.bin", 100 * 1000, "" },
+    { "small/b.bin", 700 * 1000, "" },
+    { "small/c.bin", 3 * 1000 * 1000, "" },
+    { "large.bin", static_cast<int64_t>(large_mb) * 1024 * 1024, "" },
+  };
+
+  bool ok = true;
+  for (auto &file : files)
+    ok = ok && WriteSourceFile(root, file);
+
+  if (!ok) {
+    fprintf(stderr, "Failed to write the files under %s\n", root.c_str());
+    RemoveTree(base);
+    return 1;
+  }
+
+  const int64_t bytes_per_second = static_cast<int64_t>(mb_per_second * 1e6);
+  printf("%d MB file + 3 small files, %.1f MB/s per connection\n", large_mb, mb_per_second);
+
+  for (int max_downloads : { 1, 4, 8 }) {
+    char name[16];
+    snprintf(name, sizeof(name), "x%d", max_downloads);
+    ok = RunThroughput(name, root, target, files, bytes_per_second, max_downloads, true) && ok;
+  }
+  ok = RunThroughput("no range", root, target, files, bytes_per_second, 4, false) && ok;
+  ok = RunResume(root, target, files, bytes_per_second) && ok;
+
+  RemoveTree(base);
+
+  // The plugin threads are not joined on exit.
+  fflush(stdout);
+  _exit(ok ? 0 : 1);
+}
@@ -0,0 +1,376 @@
+// Copyright (C) 2013-2019 iFunFactory Inc. All Rights Reserved.
+//
+// This work is confidential and proprietary to iFunFactory Inc. and
+// must not be used, disclosed, copied, or distributed without the prior
+// consent of iFunFactory Inc.
+
+
+// Start time of FunapiHttpDownloader over a full local directory.
+//
+// <files> files of <total MB> in total are already in the target, and the
+// stand-in HTTP server (Tools/bench_support/stand_in_http_server.h) lists
+// them, so a start downloads nothing unless a file has changed. Both ways
+// the list can check a file are run: md5 and md5_front, where the first
+// 1 MB is enough to accept a file, and md5 only. Runs of each:
+//
+//   cold           no .funapi_manifest, every file is hashed
+//   warm           the manifest of the previous run is there
+//   cold, evicted  like cold, with the files dropped from the page cache
+//                  first (fdatasync and POSIX_FADV_DONTNEED)
+//   warm, evicted  like warm, the same way
+//   changed        the first byte of one file is changed, so that file is
+//                  read and downloaded again
+//
+// The time is from Start() to the completion callback. The bytes read are
+// counted by the program's fread (glibc only), which the plugin's hashing
+// goes through. The program uses only Create, Start, UpdateAll and the
+// completion callback, so it also builds against older versions of the
+// plugin for comparison.
+//
+// Build (Linux with glibc, see Tools/bench_support/build.sh):
+//
+//   Tools/bench_support/build.sh manifest_start_bench Tools/download_bench/manifest_start_bench.cpp
+//
+// Usage:
+//
+//   manifest_start_bench [<files> [<total MB>]]
+
+#include <fcntl.h>
+#include <ftw.h>
+#include <openssl/md5.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "plugin_module.h"
+#include "stand_in_http_server.h"
+#include "funapi_downloader.h"
+
+namespace {
+
+std::atomic<int64_t> g_read_bytes(0);
+
+}  // namespace
+
+
+// Counts the bytes read through stdio on every thread.
+extern "C" {
+
+size_t _IO_fread(void *ptr, size_t size, size_t count, FILE *fp);
+
+
+size_t fread(void *ptr, size_t size, size_t count, FILE *fp) {
+  size_t n = _IO_fread(ptr, size, count, fp);
+  g_read_bytes.fetch_add(static_cast<int64_t>(n * size), std::memory_order_relaxed);
+  return n;
+}
+
+}  // extern "C"
+
+
+namespace {
+
+// Bytes of md5_front (FunapiMD5::kFrontSize).
+const int64_t kFrontSize = 1048576;
+
+struct SourceFile {
+  std::string path;  // Relative to the root and to the target.
+  int64_t size;
+  std::string md5;
+  std::string md5_front;
+};
+
+struct Result {
+  fun::FunapiHttpDownloader::ResultCode code = fun::FunapiHttpDownloader::ResultCode::kNone;
+  double milliseconds = 0;
+  int64_t read_bytes = 0;
+  int64_t downloaded_bytes = 0;
+};
+
+
+int64_t NowNanosecond() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+    std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+
+std::string HexDigest(MD5_CTX ctx) {
+  unsigned char digest[MD5_DIGEST_LENGTH];
+  MD5_Final(digest, &ctx);
+
+  char hex[MD5_DIGEST_LENGTH * 2 + 1];
+  for (int i = 0; i < MD5_DIGEST_LENGTH; ++i)
+    snprintf(hex + i * 2, 3, "%02x", digest[i]);
+  return hex;
+}
+
+
+std::string MD5OfFile(const std::string &path) {
+  int fd = open(path.c_str(), O_RDONLY);
+  if (fd < 0)
+    return "";
+
+  MD5_CTX ctx;
+  MD5_Init(&ctx);
+
+  // Not through fread, so that it is not counted.
+  std::vector<char> buffer(1024 * 1024);
+  ssize_t length;
+  while ((length = read(fd, buffer.data(), buffer.size())) > 0)
+    MD5_Update(&ctx, buffer.data(), length);
+
+  close(fd);
+  return HexDigest(ctx);
+}
+
+
+// Writes the same pseudo-random bytes to the root and to the target.
+bool WriteFile(const std::string &root, const std::string &target, SourceFile &file) {
+  const std::string dirs[] = { root, target };
+  FILE *fps[2] = { NULL, NULL };
+  for (int i = 0; i < 2; ++i) {
+    std::string path = dirs[i] + "/" + file.path;
+    mkdir(path.substr(0, path.rfind('/')).c_str(), 0755);
+    fps[i] = fopen(path.c_str(), "wb");
+  }
+
+  bool ok = fps[0] != NULL && fps[1] != NULL;
+
+  MD5_CTX ctx;
+  MD5_Init(&ctx);
+
+  uint64_t state = 0x9e3779b97f4a7c15ULL ^ static_cast<uint64_t>(file.size);
+  std::vector<uint64_t> buffer(kFrontSize / sizeof(uint64_t));
+  int64_t written = 0;
+
+  while (ok && written < file.size) {
+    for (auto &word : buffer) {
+      state ^= state << 13;
+      state ^= state >> 7;
+      state ^= state << 17;
+      word = state;
+    }
+
+    // One buffer is the front.
+    size_t length = static_cast<size_t>(std::min<int64_t>(file.size - written, kFrontSize));
+    MD5_Update(&ctx, buffer.data(), length);
+    if (written == 0)
+      file.md5_front = HexDigest(ctx);
+
+    for (auto fp : fps)
+      ok = ok && fwrite(buffer.data(), 1, length, fp) == length;
+    written += length;
+  }
+
+  file.md5 = HexDigest(ctx);
+
+  for (auto fp : fps) {
+    if (fp != NULL)
+      ok = (fclose(fp) == 0) && ok;
+  }
+  return ok;
+}
+
+
+std::string DownloadList(const std::vector<SourceFile> &files, const bool with_front) {
+  std::string json = "{\"data\":[";
+  for (size_t i = 0; i < files.size(); ++i) {
+    char entry[256];
+    snprintf(entry, sizeof(entry), "%s{\"path\":\"%s\",\"size\":%lld,\"md5\":\"%s\"",
+             i > 0 ? "," : "", files[i].path.c_str(),
+             static_cast<long long>(files[i].size), files[i].md5.c_str());
+    json += entry;
+    if (with_front)
+      json += ",\"md5_front\":\"" + files[i].md5_front + "\"";
+    json += "}";
+  }
+  return json + "]}";
+}
+
+
+int RemoveEntry(const char *path, const struct stat *, int, struct FTW *) {
+  remove(path);
+  return 0;
+}
+
+
+void RemoveTree(const std::string &path) {
+  nftw(path.c_str(), RemoveEntry, 16, FTW_DEPTH | FTW_PHYS);
+}
+
+
+void Evict(const std::string &target, const std::vector<SourceFile> &files) {
+  for (auto &file : files) {
+    int fd = open((target + "/" + file.path).c_str(), O_RDONLY);
+    if (fd < 0)
+      continue;
+
+    fdatasync(fd);
+    posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+    close(fd);
+  }
+}
+
+
+Result Start(bench::StandInHttpServer &server, const std::string &target) {
+  char url[64];
+  snprintf(url, sizeof(url), "http://127.0.0.1:%d", server.port());
+
+  Result result;
+  auto downloader = fun::FunapiHttpDownloader::Create(url, fun::string(target.c_str()) + "/");
+  downloader->AddCompletionCallback(
+      [&result](const std::shared_ptr<fun::FunapiHttpDownloader> &,
+                const fun::vector<std::shared_ptr<fun::FunapiDownloadFileInfo>> &,
+                const fun::FunapiHttpDownloader::ResultCode code)
+  {
+    result.code = code;
+  });
+
+  int64_t read_bytes = g_read_bytes;
+  int64_t file_bytes = server.file_bytes();
+  int64_t start = NowNanosecond();
+  downloader->Start();
+
+  int64_t deadline = start + 600 * 1000000000LL;
+  while (result.code == fun::FunapiHttpDownloader::ResultCode::kNone &&
+         NowNanosecond() < deadline) {
+    fun::FunapiHttpDownloader::UpdateAll();
+    std::this_thread::sleep_for(std::chrono::microseconds(100));
+  }
+
+  result.milliseconds = (NowNanosecond() - start) / 1e6;
+  result.read_bytes = g_read_bytes - read_bytes;
+  result.downloaded_bytes = server.file_bytes() - file_bytes;
+  return result;
+}
+
+
+bool Run(const char *name, bench::StandInHttpServer &server, const std::string &target,
+         const std::vector<SourceFile> &files) {
+  Result result = Start(server, target);
+  if (result.code != fun::FunapiHttpDownloader::ResultCode::kSucceed) {
+    fprintf(stderr, "%s: the start failed\n", name);
+    return false;
+  }
+
+  bool ok = true;
+  for (auto &file : files)
+    ok = ok && MD5OfFile(target + "/" + file.path) == file.md5;
+
+  printf("  %-14s %9.1f ms  %8.1f MB read  %6.1f MB downloaded  %s\n",
+         name, result.milliseconds, result.read_bytes / 1e6, result.downloaded_bytes / 1e6,
+         ok ? "md5 ok" : "MD5 MISMATCH");
+  fflush(stdout);
+  return ok;
+}
+
+
+bool RunSeries(const std::string &root, const std::string &target,
+               const std::vector<SourceFile> &files, const bool with_front,
+               const SourceFile &changed) {
+  // Never freed, the threads of its connections outlive the run.
+  auto &server = *new bench::StandInHttpServer();
+  const std::string list = DownloadList(files, with_front);
+  server.SetPostHandler([list](const bench::StandInHttpServer::Request &) { return list; });
+  server.SetFileRoot(root);
+  if (!server.Start())
+    return false;
+
+  printf("%s\n", with_front ? "md5 and md5_front" : "md5 only");
+
+  const std::string manifest = target + "/.funapi_manifest";
+  remove(manifest.c_str());
+
+  bool ok = Run("cold", server, target, files);
+  ok = Run("warm", server, target, files) && ok;
+
+  remove(manifest.c_str());
+  Evict(target, files);
+  ok = Run("cold, evicted", server, target, files) && ok;
+
+  Evict(target, files);
+  ok = Run("warm, evicted", server, target, files) && ok;
+
+  // Changes the front, so the md5_front check fails too.
+  int fd = open((target + "/" + changed.path).c_str(), O_RDWR);
+  char byte = 0;
+  ok = fd >= 0 && pread(fd, &byte, 1, 0) == 1 && ok;
+  byte = static_cast<char>(~byte);
+  ok = fd >= 0 && pwrite(fd, &byte, 1, 0) == 1 && ok;
+  if (fd >= 0)
+    close(fd);
+  ok = Run("changed", server, target, files) && ok;
+
+  return ok;
+}
+
+}  // namespace
+
+
+int main(int argc, char *argv[]) {
+  const int count = argc > 1 ? atoi(argv[1]) : 104;
+  const int total_mb = argc > 2 ? atoi(argv[2]) : 448;
+  if (argc > 3 || count <= 0 || total_mb <= 0) {
+    fprintf(stderr, "Usage: %s [<files> [<total MB>]]\n", argv[0]);
+    return 1;
+  }
+
+  bench::StartupPluginModule();
+
+  char base[] = "/tmp/manifest_start_bench.XXXXXX";
+  if (mkdtemp(base) == nullptr) {
+    perror("mkdtemp");
+    return 1;
+  }
+
+  const std::string root = std::string(base) + "/root";
+  const std::string target = std::string(base) + "/target";
+  mkdir(root.c_str(), 0755);
+  mkdir(target.c_str(), 0755);
+
+  // Sizes from 1 to 16 units, mixed like the resources of a game.
+  std::vector<int> weights;
+  int64_t weight_sum = 0;
+  for (int i = 0; i < count; ++i) {
+    weights.push_back(1 + (i * 7919) % 16);
+    weight_sum += weights.back();
+  }
+
+  std::vector<SourceFile> files;
+  bool ok = true;
+  for (int i = 0; ok && i < count; ++i) {
+    char path[64];
+    snprintf(path, sizeof(path), "pack%d/file%03d.bin", i % 8, i);
+
+    SourceFile file;
+    file.path = path;
+    file.size = static_cast<int64_t>(total_mb) * 1024 * 1024 * weights[i] / weight_sum;
+    ok = WriteFile(root, target, file);
+    files.push_back(file);
+  }
+
+  if (!ok) {
+    fprintf(stderr, "Failed to write the files under %s\n", base);
+    RemoveTree(base);
+    return 1;
+  }
+
+  printf("%d files, %d MB, %u hardware threads\n",
+         count, total_mb, std::thread::hardware_concurrency());
+
+  ok = RunSeries(root, target, files, true, files[count / 2]);
+  ok = RunSeries(root, target, files, false, files[count / 3]) && ok;
+
+  RemoveTree(base);
+
+  // The plugin threads are not joined on exit.
+  fflush(stdout);
+  _exit(ok ? 0 : 1);
+}
@@ -0,0 +1,203 @@
+// Copyright (C) 2013-2019 iFunFactory Inc. All Rights Reserved.
+//
+// This work is confidential and proprietary to iFunFactory Inc. and
+// must not be used, disclosed, copied, or distributed without the prior
+// consent of iFunFactory Inc.
+
+
+// Messages per second of the HTTP transport against a slow server.
+//
+// The stand-in HTTP server (Tools/bench_support/stand_in_http_server.h)
+// keeps connections alive and holds every response back by <delay> ms, so
+// the rate is bound by how many requests are in flight:
+//
+//   sync      FunapiHttp::PostRequest one after another, the blocking
+//             path the HTTP transport used before the curl multi engine
+//   async xN  a FunapiSession on the HTTP transport with
+//             FunapiHttpTransportOption::SetMaxInflightRequests(N), every
+//             message queued at once
+//
+// Build (Linux or macOS, see Tools/bench_support/build.sh):
+//
+//   Tools/bench_support/build.sh http_transport_bench Tools/http_bench/http_transport_bench.cpp
+//
+// Usage:
+//
+//   http_transport_bench [<messages> [<delay ms>]]
+
+#include <unistd.h>
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <thread>
+
+#include "plugin_module.h"
+#include "stand_in_http_server.h"
+#include "funapi_http.h"
+#include "funapi_option.h"
+#include "funapi_session.h"
+
+namespace {
+
+int64_t NowNanosecond() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+    std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+
+void Print(const char *name, const int messages, const double seconds,
+           const int connections) {
+  printf("%-9s %8.0f msg/s  (%d connections)\n", name, messages / seconds, connections);
+  fflush(stdout);
+}
+
+
+bool RunSync(const int messages, const int delay_ms) {
+  // Never freed, the threads of its connections outlive the run.
+  auto &server = *new bench::StandInHttpServer();
+  server.SetResponseDelay(std::chrono::milliseconds(delay_ms));
+  if (!server.Start())
+    return false;
+
+  char url[64];
+  snprintf(url, sizeof(url), "http://127.0.0.1:%d/v1/", server.port());
+
+  const fun::string json = "{\"_msgtype\":\"echo\",\"_sid\":\"bench\",\"data\":\"hello\"}";
+  const fun::vector<uint8_t> body(json.begin(), json.end());
+  fun::FunapiHttp::HeaderFields header;
+  header["VER"] = "1";
+
+  auto http = fun::FunapiHttp::Create();
+  int completed = 0;
+  int failed = 0;
+
+  int64_t start = NowNanosecond();
+  for (int i = 0; i < messages; ++i) {
+    http->PostRequest(url, header, body,
+                      [&failed](const int, const fun::string &) { ++failed; },
+                      [&completed](const fun::vector<fun::string> &,
+                                   const fun::vector<uint8_t> &) { ++completed; });
+  }
+  double seconds = (NowNanosecond() - start) / 1e9;
+
+  if (completed != messages || failed > 0) {
+    fprintf(stderr, "sync: %d of %d requests failed\n", messages - completed, messages);
+    return false;
+  }
+
+  Print("sync", messages, seconds, server.connections());
+  return true;
+}
+
+
+bool RunAsync(const int messages, const int delay_ms, const int max_inflight) {
+  // Never freed, the threads of its connections outlive the run.
+  auto &server = *new bench::StandInHttpServer();
+  server.SetResponseDelay(std::chrono::milliseconds(delay_ms));
+  if (!server.Start())
+    return false;
+
+  bool is_opened = false;
+  bool is_stopped = false;
+  int received = 0;
+
+  auto session = fun::FunapiSession::Create("127.0.0.1");
+  session->AddSessionEventCallback(
+      [&is_opened](const std::shared_ptr<fun::FunapiSession> &,
+                   const fun::TransportProtocol,
+                   const fun::SessionEventType type,
+                   const fun::string &,
+                   const std::shared_ptr<fun::FunapiError> &)
+  {
+    if (type == fun::SessionEventType::kOpened)
+      is_opened = true;
+  });
+  session->AddTransportEventCallback(
+      [&is_stopped](const std::shared_ptr<fun::FunapiSession> &,
+                    const fun::TransportProtocol,
+                    const fun::TransportEventType type,
+                    const std::shared_ptr<fun::FunapiError> &)
+  {
+    if (type == fun::TransportEventType::kStopped ||
+        type == fun::TransportEventType::kConnectionFailed)
+      is_stopped = true;
+  });
+  session->AddJsonRecvCallback(
+      [&received](const std::shared_ptr<fun::FunapiSession> &,
+                  const fun::TransportProtocol,
+                  const fun::string &msg_type,
+                  const fun::string &)
+  {
+    if (msg_type == "echo")
+      ++received;
+  });
+
+  auto option = fun::FunapiHttpTransportOption::Create();
+  option->SetMaxInflightRequests(max_inflight);
+  session->Connect(fun::TransportProtocol::kHttp, server.port(), fun::FunEncoding::kJson, option);
+
+  int64_t deadline = NowNanosecond() + 10 * 1000000000LL;
+  while (!is_opened && !is_stopped && NowNanosecond() < deadline) {
+    fun::FunapiSession::UpdateAll();
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+
+  if (!is_opened) {
+    fprintf(stderr, "async x%d: the session was not opened\n", max_inflight);
+    return false;
+  }
+
+  const fun::string body = "{\"data\":\"hello\"}";
+
+  int64_t start = NowNanosecond();
+  for (int i = 0; i < messages; ++i)
+    session->SendMessage("echo", body, fun::TransportProtocol::kHttp);
+
+  deadline = start + 120 * 1000000000LL;
+  while (received < messages && !is_stopped && NowNanosecond() < deadline) {
+    fun::FunapiSession::UpdateAll();
+    std::this_thread::sleep_for(std::chrono::microseconds(100));
+  }
+  double seconds = (NowNanosecond() - start) / 1e9;
+
+  if (received < messages) {
+    fprintf(stderr, "async x%d: %d of %d messages were not echoed\n",
+            max_inflight, messages - received, messages);
+    return false;
+  }
+
+  char name[16];
+  snprintf(name, sizeof(name), "async x%d", max_inflight);
+  Print(name, messages, seconds, server.connections());
+
+  session->Close();
+  for (int i = 0; i < 100; ++i) {
+    fun::FunapiSession::UpdateAll();
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+
+  return true;
+}
+
+}  // namespace
+
+
+int main(int argc, char *argv[]) {
+  const int messages = argc > 1 ? atoi(argv[1]) : 1000;
+  const int delay_ms = argc > 2 ? atoi(argv[2]) : 5;
+  if (argc > 3 || messages <= 0 || delay_ms < 0) {
+    fprintf(stderr, "Usage: %s [<messages> [<delay ms>]]\n", argv[0]);
+    return 1;
+  }
+
+  bench::StartupPluginModule();
+
+  bool ok = RunSync(messages, delay_ms);
+  for (int max_inflight : { 1, 4, 8 })
+    ok = RunAsync(messages, delay_ms, max_inflight) && ok;
+
+  // The plugin threads are not joined on exit.
+  fflush(stdout);
+  _exit(ok ? 0 : 1);
+}
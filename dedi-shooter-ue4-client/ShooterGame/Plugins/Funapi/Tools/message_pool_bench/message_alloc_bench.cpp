@@ -0,0 +1,251 @@
+// Copyright (C) 2013-2019 iFunFactory Inc. All Rights Reserved.
+//
+// This work is confidential and proprietary to iFunFactory Inc. and
+// must not be used, disclosed, copied, or distributed without the prior
+// consent of iFunFactory Inc.
+
+
+// Heap allocations per message of a FunapiSession.
+//
+// The stand-in server (Tools/bench_support/stand_in_server.h) runs in a
+// child process and echoes the messages of a TCP session with JSON or
+// protobuf encoding. malloc, calloc, realloc and free of this process are
+// counted, which covers operator new and the funapi allocator (FMemory).
+// Every thread of the plugin is counted, so the number is what one message
+// sent and its echo received cost, including the receive callback.
+//
+// The first 1000 messages warm the pools up and are not counted.
+//
+// Build (Linux with glibc, see Tools/bench_support/build.sh):
+//
+//   Tools/bench_support/build.sh message_alloc_bench Tools/message_pool_bench/message_alloc_bench.cpp
+//
+// Usage:
+//
+//   message_alloc_bench <json|protobuf> [<messages> [<payload bytes>]]
+
+#include <signal.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <thread>
+
+#include "plugin_module.h"
+#include "stand_in_server.h"
+#include "funapi_option.h"
+#include "funapi/network/ping_message.pb.h"
+
+namespace {
+
+std::atomic<int64_t> g_allocations(0);
+std::atomic<int64_t> g_allocated_bytes(0);
+
+}  // namespace
+
+
+// Counts the allocations of every thread. glibc exports the allocator
+// under these names, so the program's malloc only has to forward.
+extern "C" {
+
+void *__libc_malloc(size_t size);
+void *__libc_calloc(size_t count, size_t size);
+void *__libc_realloc(void *ptr, size_t size);
+void __libc_free(void *ptr);
+
+
+void *malloc(size_t size) {
+  g_allocations.fetch_add(1, std::memory_order_relaxed);
+  g_allocated_bytes.fetch_add(size, std::memory_order_relaxed);
+  return __libc_malloc(size);
+}
+
+
+void *calloc(size_t count, size_t size) {
+  g_allocations.fetch_add(1, std::memory_order_relaxed);
+  g_allocated_bytes.fetch_add(count * size, std::memory_order_relaxed);
+  return __libc_calloc(count, size);
+}
+
+
+void *realloc(void *ptr, size_t size) {
+  g_allocations.fetch_add(1, std::memory_order_relaxed);
+  g_allocated_bytes.fetch_add(size, std::memory_order_relaxed);
+  return __libc_realloc(ptr, size);
+}
+
+
+void free(void *ptr) {
+  __libc_free(ptr);
+}
+
+}  // extern "C"
+
+
+namespace {
+
+int64_t NowNanosecond() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+    std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+
+// Runs the stand-in server in a child process and returns its port.
+int StartServer(const fun::FunEncoding encoding, pid_t &pid) {
+  int fds[2];
+  if (pipe(fds) != 0)
+    return 0;
+
+  pid = fork();
+  if (pid == 0) {
+    close(fds[0]);
+
+    // The server parses FunMessage too.
+    bench::StartupPluginModule();
+
+    bench::StandInServer server(encoding);
+    int port = server.Start() ? server.port() : 0;
+    if (write(fds[1], &port, sizeof(port)) != sizeof(port))
+      _exit(1);
+
+    for (;;)
+      pause();
+  }
+
+  close(fds[1]);
+
+  int port = 0;
+  if (pid < 0 || read(fds[0], &port, sizeof(port)) != sizeof(port))
+    port = 0;
+  close(fds[0]);
+
+  return port;
+}
+
+}  // namespace
+
+
+int main(int argc, char *argv[]) {
+  if (argc < 2 || argc > 4 ||
+      (strcmp(argv[1], "json") != 0 && strcmp(argv[1], "protobuf") != 0)) {
+    fprintf(stderr, "Usage: %s <json|protobuf> [<messages> [<payload bytes>]]\n", argv[0]);
+    return 1;
+  }
+
+  const fun::FunEncoding encoding =
+      strcmp(argv[1], "json") == 0 ? fun::FunEncoding::kJson : fun::FunEncoding::kProtobuf;
+  const int messages = argc > 2 ? atoi(argv[2]) : 20000;
+  const int payload_size = argc > 3 ? atoi(argv[3]) : 100;
+  if (messages <= 0 || payload_size < 0) {
+    fprintf(stderr, "Invalid arguments.\n");
+    return 1;
+  }
+
+  // Forks before the plugin starts its threads.
+  pid_t server_pid = 0;
+  int port = StartServer(encoding, server_pid);
+  if (port == 0) {
+    fprintf(stderr, "Failed to start the stand-in server.\n");
+    return 1;
+  }
+
+  bench::StartupPluginModule();
+
+  bool is_opened = false;
+  int received = 0;
+
+  auto session = fun::FunapiSession::Create("127.0.0.1");
+  session->AddSessionEventCallback(
+      [&is_opened](const std::shared_ptr<fun::FunapiSession> &,
+                   const fun::TransportProtocol,
+                   const fun::SessionEventType type,
+                   const fun::string &,
+                   const std::shared_ptr<fun::FunapiError> &)
+  {
+    if (type == fun::SessionEventType::kOpened)
+      is_opened = true;
+  });
+  session->AddJsonRecvCallback(
+      [&received](const std::shared_ptr<fun::FunapiSession> &,
+                  const fun::TransportProtocol,
+                  const fun::string &msg_type,
+                  const fun::string &)
+  {
+    if (msg_type == "echo")
+      ++received;
+  });
+  session->AddProtobufRecvCallback(
+      [&received](const std::shared_ptr<fun::FunapiSession> &,
+                  const fun::TransportProtocol,
+                  const FunMessage &message)
+  {
+    if (message.msgtype() == "echo")
+      ++received;
+  });
+
+  auto option = fun::FunapiTcpTransportOption::Create();
+  option->SetDisableNagle(true);
+  session->Connect(fun::TransportProtocol::kTcp, port, encoding, option);
+
+  int64_t deadline = NowNanosecond() + 10 * 1000000000LL;
+  while (!is_opened) {
+    if (NowNanosecond() > deadline) {
+      fprintf(stderr, "The session was not opened.\n");
+      kill(server_pid, SIGKILL);
+      _exit(1);
+    }
+
+    fun::FunapiSession::UpdateAll();
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+
+  // Built once, so the loop below allocates only what the plugin does.
+  const fun::string json_body = "{\"data\":\"" + fun::string(payload_size, 'x') + "\"}";
+  FunMessage pbuf_body;
+  pbuf_body.set_msgtype("echo");
+  pbuf_body.MutableExtension(cs_ping)->set_timestamp(0);
+  pbuf_body.MutableExtension(cs_ping)->set_data(fun::string(payload_size, 'x'));
+
+  // One message in flight, so the session is in the same state every time.
+  auto echo = [&](const int count) {
+    for (int i = 0; i < count; ++i) {
+      int expected = received + 1;
+      if (encoding == fun::FunEncoding::kJson)
+        session->SendMessage("echo", json_body, fun::TransportProtocol::kTcp);
+      else
+        session->SendMessage(pbuf_body, fun::TransportProtocol::kTcp);
+
+      while (received < expected)
+        fun::FunapiSession::UpdateAll();
+    }
+  };
+
+  echo(1000);
+
+  int64_t allocations = g_allocations;
+  int64_t allocated_bytes = g_allocated_bytes;
+  int64_t start = NowNanosecond();
+
+  echo(messages);
+
+  double seconds = (NowNanosecond() - start) / 1e9;
+  allocations = g_allocations - allocations;
+  allocated_bytes = g_allocated_bytes - allocated_bytes;
+
+  printf("%-8s payload=%-5d %6.1f allocs/msg  %8.0f bytes/msg  %7.0f msg/s\n",
+         argv[1], payload_size,
+         static_cast<double>(allocations) / messages,
+         static_cast<double>(allocated_bytes) / messages,
+         messages / seconds);
+  fflush(stdout);
+
+  kill(server_pid, SIGKILL);
+  waitpid(server_pid, nullptr, 0);
+
+  // The plugin threads are not joined on exit.
+  _exit(0);
+}
@@ -0,0 +1,388 @@
+// Copyright (C) 2013-2019 iFunFactory Inc. All Rights Reserved.
+//
+// This work is confidential and proprietary to iFunFactory Inc. and
+// must not be used, disclosed, copied, or distributed without the prior
+// consent of iFunFactory Inc.
+
+
+// Messages per second and bytes per chat message of FunapiMulticast.
+//
+// A stand-in multicast server (Tools/bench_support/stand_in_server.h with
+// a handler) runs in a child process. It answers joins and leaves and sends
+// every chat message back, as a channel of one member does with bounce. A
+// multicast on a JSON TCP session joins <channels> channels. Runs:
+//
+//   tick x<N>  2000 ticks of 1 ms. Every tick sends N chat messages to
+//              the channels in turn and calls FunapiMulticast::Update().
+//              The client's send() calls and bytes are counted by wrapping
+//              send() in this program. "+40 B/send" adds the TCP/IPv4
+//              headers of one segment per send.
+//   burst      <messages> chat messages, 16 per Update() without waiting
+//              between ticks, at most 1024 in flight.
+//
+// The bounced messages are counted by the channel handlers and checked per
+// channel.
+//   receive    asked by a message with "flood", the server writes
+//              <messages> chat messages to the channels in turn, in 64 KB
+//              writes, and FunapiMulticast::Update() runs
+//              until the handlers have them all: parsing and dispatching
+//              received messages.
+//
+// The program uses only API that older versions of the plugin have too,
+// so it also builds against them for comparison.
+//
+// Build (Linux, see Tools/bench_support/build.sh):
+//
+//   Tools/bench_support/build.sh multicast_bench Tools/multicast_bench/multicast_bench.cpp
+//
+// Usage:
+//
+//   multicast_bench [<messages> [<channels>]]
+
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "plugin_module.h"
+#include "stand_in_server.h"
+#include "funapi_multicasting.h"
+
+namespace {
+
+std::atomic<int64_t> g_send_calls(0);
+std::atomic<int64_t> g_send_bytes(0);
+
+}  // namespace
+
+
+// Counts the TCP sends of the plugin, which is linked into this program.
+extern "C" {
+
+ssize_t send(int fd, const void *buf, size_t len, int flags) {
+  ssize_t n = syscall(SYS_sendto, fd, buf, len, flags, nullptr, 0);
+  ++g_send_calls;
+  if (n > 0)
+    g_send_bytes += n;
+  return n;
+}
+
+}  // extern "C"
+
+
+namespace {
+
+const char kChatText[] = "gg, regroup at the north gate after this round";
+
+int64_t NowNanosecond() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+    std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+
+std::string ChannelId(const int index) {
+  char id[16];
+  snprintf(id, sizeof(id), "ch%02d", index);
+  return id;
+}
+
+
+// Writes count chat messages to the channels in turn.
+void Flood(const int fd, const int count, const int channels) {
+  std::string out;
+  for (int i = 0; i < count; ++i) {
+    char body[256];
+    int length = snprintf(body, sizeof(body),
+                          "{\"message\":\"%s\",\"_channel\":\"%s\",\"_bounce\":true,"
+                          "\"_sender\":\"server\",\"_msgtype\":\"_multicast\"}",
+                          kChatText, ChannelId(i % channels).c_str());
+
+    char header[64];
+    int header_length = snprintf(header, sizeof(header), "VER:1\nLEN:%d\n\n", length);
+    out.append(header, header_length);
+    out.append(body, length);
+
+    if (out.size() >= 65536 || i + 1 == count) {
+      if (!bench::StandInServer::WriteAll(fd, out.data(), out.size()))
+        return;
+      out.clear();
+    }
+  }
+}
+
+
+// Runs the stand-in multicast server in a child process and returns its
+// port.
+int StartServer(pid_t &pid) {
+  int fds[2];
+  if (pipe(fds) != 0)
+    return 0;
+
+  pid = fork();
+  if (pid == 0) {
+    close(fds[0]);
+    bench::StartupPluginModule();
+
+    bench::StandInServer server(fun::FunEncoding::kJson);
+    server.SetMessageHandler([](bench::StandInServer &s, const int fd,
+                                const bench::StandInServer::Headers &,
+                                const std::string &body)
+    {
+      rapidjson::Document document;
+      document.Parse<0>(body.c_str());
+      if (document.HasParseError() || !document.IsObject() || !document.HasMember("_sid")) {
+        s.Echo(fd, body);
+        return;
+      }
+
+      fun::string msg_type = document.HasMember("_msgtype") ? document["_msgtype"].GetString() : "";
+      if (msg_type != "_multicast")
+        return;
+
+      if (document.HasMember("flood")) {
+        Flood(fd, document["flood"].GetInt(), document["channels"].GetInt());
+        return;
+      }
+
+      // Joins, leaves and bounced chat messages.
+      s.Reply(fd, body);
+    });
+
+    int port = server.Start() ? server.port() : 0;
+    if (write(fds[1], &port, sizeof(port)) != sizeof(port))
+      _exit(1);
+
+    for (;;)
+      pause();
+  }
+
+  close(fds[1]);
+
+  int port = 0;
+  if (pid < 0 || read(fds[0], &port, sizeof(port)) != sizeof(port))
+    port = 0;
+  close(fds[0]);
+
+  return port;
+}
+
+
+struct Client {
+  std::shared_ptr<fun::FunapiMulticast> multicast;
+  std::vector<int64_t> received;  // By channel.
+  int64_t total_received = 0;
+  bool is_opened = false;
+  bool is_stopped = false;
+  int joined = 0;
+};
+
+
+bool Connect(const int port, const int channels, Client &client) {
+  Client *p = &client;
+  client.multicast = fun::FunapiMulticast::Create("bench", "127.0.0.1", port, fun::FunEncoding::kJson);
+  client.multicast->AddSessionEventCallback(
+      [p](const std::shared_ptr<fun::FunapiMulticast> &,
+          const fun::SessionEventType type,
+          const fun::string &,
+          const std::shared_ptr<fun::FunapiError> &)
+  {
+    if (type == fun::SessionEventType::kOpened)
+      p->is_opened = true;
+  });
+  client.multicast->AddTransportEventCallback(
+      [p](const std::shared_ptr<fun::FunapiMulticast> &,
+          const fun::TransportEventType type,
+          const std::shared_ptr<fun::FunapiError> &)
+  {
+    if (type == fun::TransportEventType::kStopped ||
+        type == fun::TransportEventType::kConnectionFailed)
+      p->is_stopped = true;
+  });
+
+  client.multicast->Connect();
+
+  int64_t deadline = NowNanosecond() + 10 * 1000000000LL;
+  while (!client.is_opened && !client.is_stopped && NowNanosecond() < deadline) {
+    client.multicast->Update();
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+
+  if (!client.is_opened) {
+    fprintf(stderr, "The session was not opened.\n");
+    return false;
+  }
+
+  client.multicast->AddJoinedCallback(
+      [p](const std::shared_ptr<fun::FunapiMulticast> &, const fun::string &, const fun::string &)
+  {
+    ++p->joined;
+  });
+
+  client.received.assign(channels, 0);
+  for (int i = 0; i < channels; ++i) {
+    client.multicast->JoinChannel(ChannelId(i).c_str(),
+        [p, i](const std::shared_ptr<fun::FunapiMulticast> &,
+               const fun::string &, const fun::string &, const fun::string &)
+    {
+      ++p->received[i];
+      ++p->total_received;
+    });
+  }
+
+  deadline = NowNanosecond() + 10 * 1000000000LL;
+  while (client.joined < channels && NowNanosecond() < deadline) {
+    client.multicast->Update();
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+
+  if (client.joined < channels) {
+    fprintf(stderr, "%d of %d channels were not joined.\n", channels - client.joined, channels);
+    return false;
+  }
+
+  return true;
+}
+
+
+bool WaitReceived(Client &client, const int64_t count) {
+  int64_t deadline = NowNanosecond() + 120 * 1000000000LL;
+  while (client.total_received < count && NowNanosecond() < deadline) {
+    client.multicast->Update();
+    if (client.total_received < count)
+      std::this_thread::sleep_for(std::chrono::microseconds(50));
+  }
+
+  return client.total_received >= count;
+}
+
+
+// Ticks every tick_interval if it is not 0.
+bool RunSend(const char *name, Client &client, const int messages, const int channels,
+             const int per_tick, const std::chrono::microseconds tick_interval) {
+  client.received.assign(channels, 0);
+  client.total_received = 0;
+
+  int64_t send_calls = g_send_calls;
+  int64_t send_bytes = g_send_bytes;
+  int64_t start = NowNanosecond();
+
+  auto next_tick = std::chrono::steady_clock::now();
+  int sent = 0;
+  while (sent < messages) {
+    if (tick_interval.count() > 0) {
+      next_tick += tick_interval;
+      std::this_thread::sleep_until(next_tick);
+    }
+
+    for (int i = 0; i < per_tick && sent < messages; ++i, ++sent) {
+      fun::string chat = "{\"message\":\"";
+      chat += kChatText;
+      chat += "\"}";
+      client.multicast->SendToChannel(ChannelId(sent % channels).c_str(), chat);
+    }
+    client.multicast->Update();
+
+    // Keeps the messages in flight bounded.
+    if (sent - client.total_received > 1024 && !WaitReceived(client, sent - 512))
+      break;
+  }
+
+  bool ok = WaitReceived(client, messages);
+  double seconds = (NowNanosecond() - start) / 1e9;
+  send_calls = g_send_calls - send_calls;
+  send_bytes = g_send_bytes - send_bytes;
+
+  for (int i = 0; i < channels; ++i)
+    ok = ok && client.received[i] == messages / channels + (i < messages % channels ? 1 : 0);
+
+  printf("%-9s %9.0f msg/s  %5.3f sends/msg  %6.1f B/msg  %6.1f B/msg +40 B/send  %s\n",
+         name, messages / seconds,
+         static_cast<double>(send_calls) / messages,
+         static_cast<double>(send_bytes) / messages,
+         (send_bytes + 40.0 * send_calls) / messages,
+         ok ? "ok" : "LOST");
+  fflush(stdout);
+  return ok;
+}
+
+
+bool RunReceive(Client &client, const int messages, const int channels) {
+  client.received.assign(channels, 0);
+  client.total_received = 0;
+
+  char buffer[64];
+  snprintf(buffer, sizeof(buffer), "{\"flood\":%d,\"channels\":%d}", messages, channels);
+  fun::string request = buffer;
+
+  int64_t start = NowNanosecond();
+  client.multicast->SendToChannel(ChannelId(0).c_str(), request);
+
+  bool ok = WaitReceived(client, messages);
+  double seconds = (NowNanosecond() - start) / 1e9;
+
+  for (int i = 0; i < channels; ++i)
+    ok = ok && client.received[i] == messages / channels + (i < messages % channels ? 1 : 0);
+
+  printf("%-9s %9.0f msg/s  %s\n", "receive", messages / seconds, ok ? "ok" : "LOST");
+  fflush(stdout);
+  return ok;
+}
+
+}  // namespace
+
+
+int main(int argc, char *argv[]) {
+  const int messages = argc > 1 ? atoi(argv[1]) : 100000;
+  const int channels = argc > 2 ? atoi(argv[2]) : 48;
+  if (argc > 3 || messages <= 0 || channels <= 0 || channels > 100) {
+    fprintf(stderr, "Usage: %s [<messages> [<channels>]]\n", argv[0]);
+    return 1;
+  }
+
+  // Forked before the module starts, the child starts its own.
+  pid_t pid = -1;
+  int port = StartServer(pid);
+  if (port == 0) {
+    fprintf(stderr, "Failed to start the server.\n");
+    return 1;
+  }
+
+  bench::StartupPluginModule();
+
+  // Never freed, the network thread outlives the run.
+  auto &client = *new Client();
+  if (!Connect(port, channels, client)) {
+    kill(pid, SIGKILL);
+    waitpid(pid, nullptr, 0);
+    _exit(1);
+  }
+
+  printf("%d messages, %d channels, %u hardware threads\n",
+         messages, channels, std::thread::hardware_concurrency());
+
+  bool ok = true;
+  for (int per_tick : { 1, 8, 16 }) {
+    char name[16];
+    snprintf(name, sizeof(name), "tick x%d", per_tick);
+    ok = RunSend(name, client, 2000 * per_tick, channels, per_tick,
+                 std::chrono::milliseconds(1)) && ok;
+  }
+  ok = RunSend("burst", client, messages, channels, 16, std::chrono::microseconds(0)) && ok;
+  ok = RunReceive(client, messages, channels) && ok;
+
+  kill(pid, SIGKILL);
+  waitpid(pid, nullptr, 0);
+
+  // The plugin threads are not joined on exit.
+  fflush(stdout);
+  _exit(ok ? 0 : 1);
+}
@@ -0,0 +1,194 @@
+// Copyright (C) 2013-2019 iFunFactory Inc. All Rights Reserved.
+//
+// This work is confidential and proprietary to iFunFactory Inc. and
+// must not be used, disclosed, copied, or distributed without the prior
+// consent of iFunFactory Inc.
+
+
+// Contention benchmark of FunapiMpscQueue (funapi_utils.h).
+//
+// 1, 2, 4 and 8 producer threads push as fast as they can while one
+// consumer pops, the way the transports use their send queues. Compared
+// with a deque under a mutex taken by Empty(), Front() and PopFront(),
+// which is what FunapiQueue was before. Items are shared_ptrs like the
+// queued messages. The consumer checks that every producer's items come
+// out in order and none is lost.
+//
+// Build (Linux or macOS, see Tools/bench_support/build.sh):
+//
+//   Tools/bench_support/build.sh mpsc_queue_bench Tools/queue_bench/mpsc_queue_bench.cpp
+//
+// Usage:
+//
+//   mpsc_queue_bench [<items per producer>]
+
+#include <unistd.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "plugin_module.h"
+#include "funapi_utils.h"
+
+namespace {
+
+struct Item {
+  int producer;
+  int seq;
+};
+
+typedef std::shared_ptr<Item> ItemPtr;
+
+
+int64_t NowNanosecond() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+    std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+
+// FunapiQueue before FunapiMpscQueue.
+class LockedQueue {
+ public:
+  void Push(ItemPtr item) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    queue_.push_back(std::move(item));
+  }
+
+  bool Empty() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    return queue_.empty();
+  }
+
+  ItemPtr Front() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    return queue_.front();
+  }
+
+  void PopFront() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    queue_.pop_front();
+  }
+
+ private:
+  fun::deque<ItemPtr> queue_;
+  std::mutex mutex_;
+};
+
+
+class MpscQueue {
+ public:
+  void Push(ItemPtr item) { queue_.Push(std::move(item)); }
+  bool Empty() { return queue_.Empty(); }
+  ItemPtr Front() { return queue_.Front(); }
+  void PopFront() { queue_.PopFront(); }
+
+ private:
+  fun::FunapiMpscQueue<ItemPtr> queue_;
+};
+
+
+struct Result {
+  double items_per_second = 0;
+  bool ok = true;
+};
+
+
+template <typename Queue>
+Result Run(const int producers, const int items) {
+  Queue queue;
+  std::atomic<int> ready(0);
+  std::atomic<bool> go(false);
+
+  std::vector<std::thread> threads;
+  for (int p = 0; p < producers; ++p) {
+    threads.emplace_back([&queue, &ready, &go, p, items]() {
+      // Allocated up front, so the producers only push.
+      std::vector<ItemPtr> pushing;
+      pushing.reserve(items);
+      for (int i = 0; i < items; ++i)
+        pushing.push_back(std::make_shared<Item>(Item{ p, i }));
+
+      ++ready;
+      while (!go)
+        std::this_thread::yield();
+
+      for (auto &item : pushing)
+        queue.Push(std::move(item));
+    });
+  }
+
+  while (ready < producers)
+    std::this_thread::yield();
+
+  Result result;
+  std::vector<int> next(producers, 0);
+  const int64_t total = static_cast<int64_t>(producers) * items;
+  int64_t popped = 0;
+
+  int64_t start = NowNanosecond();
+  go = true;
+
+  // The loop of FunapiTransport::Send.
+  while (popped < total) {
+    if (queue.Empty()) {
+      std::this_thread::yield();
+      continue;
+    }
+
+    while (!queue.Empty()) {
+      ItemPtr item = queue.Front();
+      queue.PopFront();
+
+      if (!item || item->seq != next[item->producer]++)
+        result.ok = false;
+      ++popped;
+    }
+  }
+
+  result.items_per_second = total / ((NowNanosecond() - start) / 1e9);
+
+  for (auto &t : threads)
+    t.join();
+
+  return result;
+}
+
+}  // namespace
+
+
+int main(int argc, char *argv[]) {
+  const int items = argc > 1 ? atoi(argv[1]) : 500000;
+  if (argc > 2 || items <= 0) {
+    fprintf(stderr, "Usage: %s [<items per producer>]\n", argv[0]);
+    return 1;
+  }
+
+  bench::StartupPluginModule();
+
+  printf("hardware threads: %u\n", std::thread::hardware_concurrency());
+  printf("%9s  %14s  %14s  %7s\n", "producers", "mutex+deque", "mpsc", "speedup");
+
+  bool ok = true;
+  for (int producers : { 1, 2, 4, 8 }) {
+    Result before = Run<LockedQueue>(producers, items);
+    Result after = Run<MpscQueue>(producers, items);
+
+    printf("%9d  %9.2f M/s  %9.2f M/s  %6.2fx%s\n",
+           producers,
+           before.items_per_second / 1e6,
+           after.items_per_second / 1e6,
+           after.items_per_second / before.items_per_second,
+           before.ok && after.ok ? "" : "  LOST OR REORDERED");
+    fflush(stdout);
+    ok = ok && before.ok && after.ok;
+  }
+
+  fflush(stdout);
+  _exit(ok ? 0 : 1);
+}
@@ -0,0 +1,343 @@
+// Copyright (C) 2013-2019 iFunFactory Inc. All Rights Reserved.
+//
+// This work is confidential and proprietary to iFunFactory Inc. and
+// must not be used, disclosed, copied, or distributed without the prior
+// consent of iFunFactory Inc.
+
+
+// Loopback benchmark of FunapiRpc::Call with FunapiRpcOption::
+// SetConnectionsPerPeer.
+//
+// A stand-in dedicated server RPC peer listens on an ephemeral loopback
+// port. It speaks the FunapiRpcPeer framing (4-byte big-endian length and a
+// FunDedicatedServerRpcMessage), sends _sys_ds_info on every connection,
+// answers _sys_ds_master and echoes every other request as the response
+// with the same xid. The plugin is started with the peer as its initializer
+// and keeps up to <window> calls in flight through FunapiRpc::Call, calling
+// FunapiRpc::Update in a loop. Each request carries a 120-byte payload, the
+// size of a small RPC message.
+//
+// Build (Linux or macOS, see Tools/bench_support/build.sh):
+//
+//   Tools/bench_support/build.sh rpc_loopback_bench Tools/rpc_bench/rpc_loopback_bench.cpp
+//
+// Usage:
+//
+//   rpc_loopback_bench                              (runs the default table)
+//   rpc_loopback_bench <connections> <window> <calls>
+//
+// Prints calls per second and the p50/p99 round trip for each setting.
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "plugin_module.h"
+#include "funapi_rpc.h"
+
+namespace {
+
+const size_t kPayloadSize = 120;
+const char *kCallType = "bench_echo";
+
+int g_port = 0;
+// Connections the peer has introduced itself on, never decreases.
+std::atomic<int> g_peer_connections(0);
+
+
+int64_t NowNanosecond() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+    std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+
+bool WriteAll(const int fd, const uint8_t *data, const size_t size) {
+  size_t offset = 0;
+  while (offset < size) {
+    ssize_t n = write(fd, data + offset, size - offset);
+    if (n <= 0)
+      return false;
+    offset += n;
+  }
+
+  return true;
+}
+
+
+void AppendFrame(const FunDedicatedServerRpcMessage &message, std::vector<uint8_t> &out) {
+  fun::string s;
+  message.SerializeToString(&s);
+
+  uint32_t length = htonl(static_cast<uint32_t>(s.size()));
+  size_t offset = out.size();
+  out.resize(offset + 4 + s.size());
+  memcpy(&out[offset], &length, 4);
+  memcpy(&out[offset + 4], s.data(), s.size());
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+// Stand-in peer.
+
+void Serve(const int fd) {
+  std::vector<uint8_t> in(1 << 20);
+  std::vector<uint8_t> out;
+  size_t have = 0;
+
+  // A server introduces itself on every connection.
+  {
+    FunDedicatedServerRpcMessage info;
+    info.set_xid("stand-in-info");
+    info.set_type("_sys_ds_info");
+    info.set_is_request(true);
+    info.MutableExtension(ds_rpc_sys)->set_data("{ \"id\" : \"stand-in-peer\" }");
+    AppendFrame(info, out);
+    if (!WriteAll(fd, out.data(), out.size())) {
+      close(fd);
+      return;
+    }
+  }
+
+  ++g_peer_connections;
+
+  FunDedicatedServerRpcMessage message;
+  for (;;) {
+    ssize_t n = read(fd, in.data() + have, in.size() - have);
+    if (n <= 0)
+      break;
+    have += n;
+
+    size_t offset = 0;
+    out.clear();
+    while (have - offset >= 4) {
+      uint32_t length;
+      memcpy(&length, &in[offset], 4);
+      length = ntohl(length);
+      if (have - offset - 4 < length)
+        break;
+
+      message.Clear();
+      message.ParseFromArray(&in[offset + 4], length);
+      offset += 4 + length;
+
+      // Responses to _sys_ds_info.
+      if (!message.is_request())
+        continue;
+
+      if (message.type() == "_sys_ds_master") {
+        FunDedicatedServerRpcMessage response;
+        response.set_xid(message.xid());
+        response.set_type(message.type());
+        response.set_is_request(false);
+        AppendFrame(response, out);
+        continue;
+      }
+
+      message.set_is_request(false);
+      AppendFrame(message, out);
+    }
+
+    memmove(in.data(), in.data() + offset, have - offset);
+    have -= offset;
+
+    if (!out.empty() && !WriteAll(fd, out.data(), out.size()))
+      break;
+  }
+
+  close(fd);
+}
+
+
+bool StartPeer() {
+  int listener = socket(AF_INET, SOCK_STREAM, 0);
+  if (listener < 0)
+    return false;
+
+  int one = 1;
+  setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+
+  sockaddr_in addr = {};
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  addr.sin_port = 0;
+
+  if (bind(listener, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0 ||
+      listen(listener, 64) != 0) {
+    close(listener);
+    return false;
+  }
+
+  socklen_t addr_len = sizeof(addr);
+  getsockname(listener, reinterpret_cast<sockaddr*>(&addr), &addr_len);
+  g_port = ntohs(addr.sin_port);
+
+  std::thread([listener]() {
+    for (;;) {
+      int fd = accept(listener, nullptr, nullptr);
+      if (fd < 0)
+        continue;
+      int one = 1;
+      setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+      std::thread(Serve, fd).detach();
+    }
+  }).detach();
+
+  return true;
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+// Client.
+
+// Starts a FunapiRpc and waits until every connection of the pool is up.
+std::shared_ptr<fun::FunapiRpc> StartRpc(const int connections) {
+  auto option = fun::FunapiRpcOption::Create();
+  option->AddInitializer("127.0.0.1", g_port);
+  option->SetDisableNagle(true);
+  option->SetConnectionsPerPeer(connections);
+
+  int base = g_peer_connections;
+  auto rpc = fun::FunapiRpc::Create();
+  rpc->Start(option);
+
+  // The peer counts a connection once it has sent _sys_ds_info on it.
+  int64_t deadline = NowNanosecond() + 10 * 1000000000LL;
+  while (g_peer_connections - base < connections) {
+    if (NowNanosecond() > deadline)
+      return nullptr;
+
+    rpc->Update();
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+
+  // Lets the pool connections finish their completion tasks.
+  for (int i = 0; i < 100; ++i) {
+    rpc->Update();
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+
+  return rpc;
+}
+
+
+bool Run(const int connections, const int window, const int calls) {
+  auto rpc = StartRpc(connections);
+  if (!rpc) {
+    fprintf(stderr, "connections=%d: the stand-in peer did not get every connection\n", connections);
+    return false;
+  }
+
+  FunDedicatedServerRpcMessage request;
+  request.MutableExtension(ds_rpc_sys)->set_data(fun::string(kPayloadSize, 'x'));
+
+  std::vector<int64_t> latencies;
+  latencies.reserve(calls);
+  int sent = 0;
+  int in_flight = 0;
+  int failed = 0;
+
+  int64_t start = NowNanosecond();
+
+  while (static_cast<int>(latencies.size()) + failed < calls) {
+    while (in_flight < window && sent < calls) {
+      int64_t sent_time = NowNanosecond();
+      rpc->Call(kCallType, request,
+                [&latencies, &in_flight, &failed, sent_time]
+                (const fun::FunapiRpc::CallResult result,
+                 const FunDedicatedServerRpcMessage &response)
+      {
+        --in_flight;
+        if (result == fun::FunapiRpc::CallResult::kSucceed)
+          latencies.push_back(NowNanosecond() - sent_time);
+        else
+          ++failed;
+      });
+      ++in_flight;
+      ++sent;
+    }
+
+    rpc->Update();
+  }
+
+  double seconds = (NowNanosecond() - start) / 1e9;
+
+  if (failed > 0 || latencies.empty()) {
+    fprintf(stderr, "connections=%d window=%d: %d calls failed\n", connections, window, failed);
+    return false;
+  }
+
+  std::sort(latencies.begin(), latencies.end());
+  printf("connections=%-2d window=%-3d %10.0f rpc/s  p50=%7.1fus  p99=%7.1fus\n",
+         connections, window,
+         latencies.size() / seconds,
+         latencies[latencies.size() / 2] / 1e3,
+         latencies[latencies.size() * 99 / 100] / 1e3);
+  fflush(stdout);
+  return true;
+}
+
+}  // namespace
+
+
+int main(int argc, char *argv[]) {
+  if (argc != 1 && argc != 4) {
+    fprintf(stderr, "Usage: %s [<connections> <window> <calls>]\n", argv[0]);
+    return 1;
+  }
+
+  bench::StartupPluginModule();
+
+  if (!StartPeer()) {
+    fprintf(stderr, "Failed to start the stand-in peer.\n");
+    return 1;
+  }
+
+  bool ok = true;
+
+  if (argc == 4) {
+    int connections = atoi(argv[1]);
+    int window = atoi(argv[2]);
+    int calls = atoi(argv[3]);
+    if (connections <= 0 || window <= 0 || calls <= 0) {
+      fprintf(stderr, "Invalid arguments.\n");
+      return 1;
+    }
+
+    ok = Run(connections, window, calls);
+  }
+  else {
+    struct Setting {
+      int connections;
+      int window;
+      int calls;
+    };
+
+    const Setting settings[] = {
+      { 1, 1, 20000 },
+      { 1, 16, 200000 },
+      { 1, 64, 200000 },
+      { 4, 16, 200000 },
+      { 4, 64, 200000 },
+    };
+
+    for (const auto &s : settings)
+      ok = Run(s.connections, s.window, s.calls) && ok;
+  }
+
+  // The connections of FunapiRpc are not closed on exit.
+  fflush(stdout);
+  _exit(ok ? 0 : 1);
+}
@@ -0,0 +1,208 @@
+// Copyright (C) 2013-2019 iFunFactory Inc. All Rights Reserved.
+//
+// This work is confidential and proprietary to iFunFactory Inc. and
+// must not be used, disclosed, copied, or distributed without the prior
+// consent of iFunFactory Inc.
+
+
+// Throughput and heap allocations of FunapiTasks.
+//
+// The tasks capture what the session and transport wrappers do: a
+// weak_ptr, a raw pointer and a shared_ptr to a message (40 bytes). Two
+// cases are measured:
+//
+//   same thread   one thread pushes 64 tasks and calls Update(), like the
+//                 callbacks queued and run on the game thread
+//   cross thread  another thread pushes while the main thread calls
+//                 Update() in a loop, like the network thread handing
+//                 received messages to the game thread
+//
+// malloc/calloc/realloc are counted for the whole process (glibc only).
+// The program uses only Push(lambda), Update() and Size(), so it also
+// builds against older versions of the plugin for comparison.
+//
+// Build (Linux with glibc, see Tools/bench_support/build.sh):
+//
+//   Tools/bench_support/build.sh tasks_bench Tools/tasks_bench/tasks_bench.cpp
+//
+// Usage:
+//
+//   tasks_bench [<tasks>]
+
+#include <unistd.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <thread>
+
+#include "plugin_module.h"
+#include "funapi_tasks.h"
+
+namespace {
+
+std::atomic<int64_t> g_allocations(0);
+
+}  // namespace
+
+
+// Counts the allocations of every thread. glibc exports the allocator
+// under these names, so the program's malloc only has to forward.
+extern "C" {
+
+void *__libc_malloc(size_t size);
+void *__libc_calloc(size_t count, size_t size);
+void *__libc_realloc(void *ptr, size_t size);
+void __libc_free(void *ptr);
+
+
+void *malloc(size_t size) {
+  g_allocations.fetch_add(1, std::memory_order_relaxed);
+  return __libc_malloc(size);
+}
+
+
+void *calloc(size_t count, size_t size) {
+  g_allocations.fetch_add(1, std::memory_order_relaxed);
+  return __libc_calloc(count, size);
+}
+
+
+void *realloc(void *ptr, size_t size) {
+  g_allocations.fetch_add(1, std::memory_order_relaxed);
+  return __libc_realloc(ptr, size);
+}
+
+
+void free(void *ptr) {
+  __libc_free(ptr);
+}
+
+}  // extern "C"
+
+
+namespace {
+
+const int kBatch = 64;
+
+struct Owner {
+  int64_t handled = 0;
+};
+
+struct Message {
+  int64_t value = 1;
+};
+
+
+int64_t NowNanosecond() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+    std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+
+void Print(const char *name, const int tasks, const int64_t nanoseconds,
+           const int64_t allocations) {
+  printf("%-13s %8.2f M tasks/s  %5.2f allocs/task\n",
+         name, tasks / (nanoseconds / 1e3),
+         static_cast<double>(allocations) / tasks);
+  fflush(stdout);
+}
+
+
+template <typename Push>
+bool RunSameThread(const int tasks, Push push) {
+  auto queue = fun::FunapiTasks::Create();
+  auto owner = std::make_shared<Owner>();
+  auto message = std::make_shared<Message>();
+
+  // Lets the queue reach its working size first.
+  for (int i = 0; i < kBatch; ++i)
+    push(queue, owner, message);
+  queue->Update();
+  owner->handled = 0;
+
+  int64_t allocations = g_allocations;
+  int64_t start = NowNanosecond();
+
+  for (int i = 0; i < tasks; i += kBatch) {
+    for (int j = 0; j < kBatch; ++j)
+      push(queue, owner, message);
+    queue->Update();
+  }
+
+  int64_t elapsed = NowNanosecond() - start;
+  allocations = g_allocations - allocations;
+
+  int count = (tasks + kBatch - 1) / kBatch * kBatch;
+  Print("same thread", count, elapsed, allocations);
+  return owner->handled == count;
+}
+
+
+template <typename Push>
+bool RunCrossThread(const int tasks, Push push) {
+  auto queue = fun::FunapiTasks::Create();
+  auto owner = std::make_shared<Owner>();
+  auto message = std::make_shared<Message>();
+
+  int64_t allocations = g_allocations;
+  int64_t start = NowNanosecond();
+
+  std::thread producer([&]() {
+    for (int i = 0; i < tasks; ++i) {
+      push(queue, owner, message);
+      // Keeps the backlog bounded, as the network thread is by the socket.
+      while (queue->Size() > 4096)
+        std::this_thread::yield();
+    }
+  });
+
+  while (owner->handled < tasks) {
+    queue->Update();
+    if (queue->Size() == 0)
+      std::this_thread::yield();
+  }
+
+  int64_t elapsed = NowNanosecond() - start;
+  producer.join();
+  allocations = g_allocations - allocations;
+
+  Print("cross thread", tasks, elapsed, allocations);
+  return owner->handled == tasks;
+}
+
+}  // namespace
+
+
+int main(int argc, char *argv[]) {
+  const int tasks = argc > 1 ? atoi(argv[1]) : 2000000;
+  if (argc > 2 || tasks <= 0) {
+    fprintf(stderr, "Usage: %s [<tasks>]\n", argv[0]);
+    return 1;
+  }
+
+  bench::StartupPluginModule();
+
+  auto push = [](const std::shared_ptr<fun::FunapiTasks> &queue,
+                 const std::shared_ptr<Owner> &owner,
+                 const std::shared_ptr<Message> &message)
+  {
+    std::weak_ptr<Owner> weak = owner;
+    Owner *raw = owner.get();
+    queue->Push([weak, raw, message]() {
+      if (auto o = weak.lock())
+        raw->handled += message->value;
+      return true;
+    });
+  };
+
+  bool ok = RunSameThread(tasks, push);
+  ok = RunCrossThread(tasks, push) && ok;
+  if (!ok)
+    fprintf(stderr, "Tasks were lost.\n");
+
+  fflush(stdout);
+  _exit(ok ? 0 : 1);
+}
@@ -0,0 +1,258 @@
+// Copyright (C) 2013-2019 iFunFactory Inc. All Rights Reserved.
+//
+// This work is confidential and proprietary to iFunFactory Inc. and
+// must not be used, disclosed, copied, or distributed without the prior
+// consent of iFunFactory Inc.
+
+
+// Latency and CPU per message of a FunapiSession over TCP or WebSocket.
+//
+// The stand-in server (Tools/bench_support/stand_in_server.h) runs in a
+// child process and echoes JSON messages, so the CPU measured here is the
+// client's only. A session is opened on the transport and then:
+//
+//   latency     one message in flight, round trip p50/p99
+//   throughput  <window> messages in flight, messages per second
+//   idle        the session is kept open without messages for 2 seconds
+//
+// The main thread calls FunapiSession::UpdateAll in a loop. The CPU is
+// reported without the main thread, so it is the time the plugin threads
+// (the network thread above all) spend per message, or per second when
+// idle.
+//
+// Build (Linux or macOS, see Tools/bench_support/build.sh). The WebSocket
+// transport needs libwebsockets:
+//
+//   Tools/bench_support/build.sh transport_latency_bench Tools/transport_bench/transport_latency_bench.cpp
+//
+// Usage:
+//
+//   transport_latency_bench <tcp|websocket> [<messages> [<payload bytes> [<window>]]]
+
+#include <signal.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <time.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "plugin_module.h"
+#include "stand_in_server.h"
+#include "funapi_option.h"
+
+namespace {
+
+int64_t NowNanosecond() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+    std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+
+int64_t TimevalNanosecond(const timeval &tv) {
+  return static_cast<int64_t>(tv.tv_sec) * 1000000000LL + tv.tv_usec * 1000LL;
+}
+
+
+// CPU time of the process except the calling thread.
+int64_t OtherThreadsCpuNanosecond() {
+  rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+
+  timespec ts;
+  clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+
+  return TimevalNanosecond(usage.ru_utime) + TimevalNanosecond(usage.ru_stime) -
+         (static_cast<int64_t>(ts.tv_sec) * 1000000000LL + ts.tv_nsec);
+}
+
+
+// Runs the stand-in server in a child process and returns its port.
+int StartServer(const bool use_websocket, pid_t &pid) {
+  int fds[2];
+  if (pipe(fds) != 0)
+    return 0;
+
+  pid = fork();
+  if (pid == 0) {
+    close(fds[0]);
+
+    bench::StandInServer server(fun::FunEncoding::kJson);
+    server.SetUseWebsocket(use_websocket);
+    int port = server.Start() ? server.port() : 0;
+    if (write(fds[1], &port, sizeof(port)) != sizeof(port))
+      _exit(1);
+
+    for (;;)
+      pause();
+  }
+
+  close(fds[1]);
+
+  int port = 0;
+  if (pid < 0 || read(fds[0], &port, sizeof(port)) != sizeof(port))
+    port = 0;
+  close(fds[0]);
+
+  return port;
+}
+
+}  // namespace
+
+
+int main(int argc, char *argv[]) {
+  if (argc < 2 || argc > 5 ||
+      (strcmp(argv[1], "tcp") != 0 && strcmp(argv[1], "websocket") != 0)) {
+    fprintf(stderr, "Usage: %s <tcp|websocket> [<messages> [<payload bytes> [<window>]]]\n", argv[0]);
+    return 1;
+  }
+
+  const bool use_websocket = strcmp(argv[1], "websocket") == 0;
+  const int messages = argc > 2 ? atoi(argv[2]) : 20000;
+  const int payload_size = argc > 3 ? atoi(argv[3]) : 100;
+  const int window = argc > 4 ? atoi(argv[4]) : 32;
+  if (messages <= 0 || payload_size < 0 || window <= 0) {
+    fprintf(stderr, "Invalid arguments.\n");
+    return 1;
+  }
+
+#if FUNAPI_HAVE_WEBSOCKET
+  const fun::TransportProtocol protocol =
+      use_websocket ? fun::TransportProtocol::kWebsocket : fun::TransportProtocol::kTcp;
+#else // FUNAPI_HAVE_WEBSOCKET
+  if (use_websocket) {
+    fprintf(stderr, "Built without libwebsockets (FUNAPI_HAVE_WEBSOCKET=0).\n");
+    return 1;
+  }
+
+  const fun::TransportProtocol protocol = fun::TransportProtocol::kTcp;
+#endif // FUNAPI_HAVE_WEBSOCKET
+
+  // Forks before the plugin starts its threads.
+  pid_t server_pid = 0;
+  int port = StartServer(use_websocket, server_pid);
+  if (port == 0) {
+    fprintf(stderr, "Failed to start the stand-in server.\n");
+    return 1;
+  }
+
+  bench::StartupPluginModule();
+
+  bool is_opened = false;
+  int received = 0;
+  int64_t last_received_time = 0;
+
+  auto session = fun::FunapiSession::Create("127.0.0.1");
+  session->AddSessionEventCallback(
+      [&is_opened](const std::shared_ptr<fun::FunapiSession> &,
+                   const fun::TransportProtocol,
+                   const fun::SessionEventType type,
+                   const fun::string &,
+                   const std::shared_ptr<fun::FunapiError> &)
+  {
+    if (type == fun::SessionEventType::kOpened)
+      is_opened = true;
+  });
+  session->AddJsonRecvCallback(
+      [&received, &last_received_time](const std::shared_ptr<fun::FunapiSession> &,
+                                       const fun::TransportProtocol,
+                                       const fun::string &msg_type,
+                                       const fun::string &)
+  {
+    if (msg_type == "echo") {
+      ++received;
+      last_received_time = NowNanosecond();
+    }
+  });
+
+  if (use_websocket) {
+    auto option = fun::FunapiWebsocketTransportOption::Create();
+    session->Connect(protocol, port, fun::FunEncoding::kJson, option);
+  }
+  else {
+    auto option = fun::FunapiTcpTransportOption::Create();
+    option->SetDisableNagle(true);
+    session->Connect(protocol, port, fun::FunEncoding::kJson, option);
+  }
+
+  int64_t deadline = NowNanosecond() + 10 * 1000000000LL;
+  while (!is_opened) {
+    if (NowNanosecond() > deadline) {
+      fprintf(stderr, "The session was not opened.\n");
+      kill(server_pid, SIGKILL);
+      _exit(1);
+    }
+
+    fun::FunapiSession::UpdateAll();
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+
+  const fun::string body = "{\"data\":\"" + fun::string(payload_size, 'x') + "\"}";
+
+  // Latency: one message in flight.
+  std::vector<int64_t> latencies;
+  latencies.reserve(messages);
+
+  int64_t cpu_start = OtherThreadsCpuNanosecond();
+  for (int i = 0; i < messages; ++i) {
+    int expected = received + 1;
+    int64_t sent_time = NowNanosecond();
+    session->SendMessage("echo", body, protocol);
+    while (received < expected)
+      fun::FunapiSession::UpdateAll();
+    latencies.push_back(last_received_time - sent_time);
+  }
+  int64_t latency_cpu = OtherThreadsCpuNanosecond() - cpu_start;
+
+  std::sort(latencies.begin(), latencies.end());
+  printf("%-9s latency     p50=%6.1fus  p99=%7.1fus  cpu=%5.1fus/msg\n",
+         argv[1],
+         latencies[latencies.size() / 2] / 1e3,
+         latencies[latencies.size() * 99 / 100] / 1e3,
+         latency_cpu / 1e3 / messages);
+  fflush(stdout);
+
+  // Throughput: a window of messages in flight.
+  int base = received;
+  int sent = 0;
+  cpu_start = OtherThreadsCpuNanosecond();
+  int64_t start = NowNanosecond();
+  while (received - base < messages) {
+    while (sent - (received - base) < window && sent < messages) {
+      session->SendMessage("echo", body, protocol);
+      ++sent;
+    }
+    fun::FunapiSession::UpdateAll();
+  }
+  double seconds = (NowNanosecond() - start) / 1e9;
+  int64_t throughput_cpu = OtherThreadsCpuNanosecond() - cpu_start;
+
+  printf("%-9s throughput %8.0f msg/s (window %d)  cpu=%5.1fus/msg\n",
+         argv[1], messages / seconds, window, throughput_cpu / 1e3 / messages);
+  fflush(stdout);
+
+  // Idle: a game loop at about 1000 updates per second.
+  cpu_start = OtherThreadsCpuNanosecond();
+  start = NowNanosecond();
+  while (NowNanosecond() - start < 2 * 1000000000LL) {
+    fun::FunapiSession::UpdateAll();
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+  seconds = (NowNanosecond() - start) / 1e9;
+  int64_t idle_cpu = OtherThreadsCpuNanosecond() - cpu_start;
+
+  printf("%-9s idle       cpu=%.2fms/s\n", argv[1], idle_cpu / 1e6 / seconds);
+  fflush(stdout);
+
+  kill(server_pid, SIGKILL);
+  waitpid(server_pid, nullptr, 0);
+
+  // The plugin threads are not joined on exit.
+  _exit(0);
+}
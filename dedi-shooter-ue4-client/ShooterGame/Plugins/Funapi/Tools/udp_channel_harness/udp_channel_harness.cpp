@@ -0,0 +1,694 @@
+// Copyright (C) 2013-2019 iFunFactory Inc. All Rights Reserved.
+//
+// This work is confidential and proprietary to iFunFactory Inc. and
+// must not be used, disclosed, copied, or distributed without the prior
+// consent of iFunFactory Inc.
+
+
+// Lossy loopback harness of the UDP channels (FunapiUdpTransportOption::
+// AddChannel).
+//
+// A FunapiSession opens a UDP transport with a reliable-ordered channel (1)
+// and an unreliable-sequenced channel (2) to a stand-in peer in the same
+// process. The peer speaks the channel headers (CH, CSEQ, CACK, CACKB) and
+// puts every datagram in both directions through a lossy link. The link
+// drops datagrams, delays all of them and delays some more so that later
+// ones overtake them. The link is lossy once the session is opened.
+//
+// The peer sends on channel 1 one message per millisecond, then a burst
+// with a send window (320) wider than the receive window of the client
+// (256), and on channel 2 one state update per millisecond. The client
+// sends on channel 1 and replies to the pings with the ping enabled.
+//
+// Checks:
+//   reliable down   the client hands over every message once, in order
+//   reliable up     the peer receives every message, the acks of the
+//                   client's channel make it resend only what is missing
+//   sequenced down  the client hands over exactly the datagrams newer than
+//                   every datagram before them in the order the link
+//                   wrote them to the client's socket
+//   rtt             FunapiSession::GetRttStats gets 8 samples of the UDP
+//                   pings, none lower than the round trip delay of the link
+//
+// It also prints the delivery latency of the reliable channel (from the
+// first send to the handover, one message per millisecond) and the loss
+// rate of the pings seen by the client and by the peer.
+//
+// Build (Linux or macOS, see Tools/bench_support/build.sh):
+//
+//   Tools/bench_support/build.sh udp_channel_harness Tools/udp_channel_harness/udp_channel_harness.cpp
+//
+// Usage:
+//
+//   udp_channel_harness                 (1% and 5% loss)
+//   udp_channel_harness <loss percent>
+//
+// Exits with 1 if a check fails.
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cstdarg>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <mutex>
+#include <queue>
+#include <random>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "plugin_module.h"
+#include "funapi_option.h"
+#include "funapi_session.h"
+
+namespace {
+
+const int kReliableChannel = 1;
+const int kSequencedChannel = 2;
+
+const int kSteadyMessages = 2000;   // Reliable, one per millisecond.
+const int kBurstMessages = 1000;    // Reliable, as fast as the window allows.
+const int kStateUpdates = 2000;     // Sequenced, one per millisecond.
+const int kUpMessages = 1000;       // Reliable from the client.
+const int kPingSamples = 8;
+
+const uint32_t kPeerSendWindow = 320;
+const int64_t kPeerRto = 60000;     // microseconds
+
+const int64_t kLinkDelay = 2000;            // microseconds, each way
+const double kReorderRate = 0.1;
+const int64_t kReorderExtraDelay = 20000;   // microseconds, up to
+
+int g_failures = 0;
+
+
+int64_t NowMicrosecond() {
+  return std::chrono::duration_cast<std::chrono::microseconds>(
+    std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+
+void Check(const bool ok, const char *name, const std::string &detail) {
+  printf("  %-4s %-15s %s\n", ok ? "ok" : "FAIL", name, detail.c_str());
+  fflush(stdout);
+  if (!ok)
+    ++g_failures;
+}
+
+
+std::string Format(const char *format, ...) __attribute__((format(printf, 1, 2)));
+std::string Format(const char *format, ...) {
+  char buffer[512];
+  va_list args;
+  va_start(args, format);
+  vsnprintf(buffer, sizeof(buffer), format, args);
+  va_end(args);
+  return buffer;
+}
+
+
+int64_t Percentile(std::vector<int64_t> v, const double p) {
+  if (v.empty())
+    return 0;
+  std::sort(v.begin(), v.end());
+  return v[std::min(v.size() - 1, static_cast<size_t>(v.size() * p))];
+}
+
+
+// Reads "n" of a JSON body.
+int GetN(const char *body) {
+  const char *p = strstr(body, "\"n\":");
+  return p ? atoi(p + 4) : -1;
+}
+
+
+struct Datagram {
+  std::map<std::string, std::string> header;
+  std::string body;
+};
+
+
+bool ParseDatagram(const char *data, const size_t size, Datagram &datagram) {
+  size_t line_begin = 0;
+  for (size_t i = 0; i < size; ++i) {
+    if (data[i] != '\n')
+      continue;
+
+    if (i == line_begin) {
+      size_t length = strtoul(datagram.header["LEN"].c_str(), nullptr, 10);
+      if (size - i - 1 < length)
+        return false;
+      datagram.body.assign(data + i + 1, length);
+      return true;
+    }
+
+    std::string line(data + line_begin, i - line_begin);
+    size_t colon = line.find(':');
+    if (colon != std::string::npos)
+      datagram.header[line.substr(0, colon)] = line.substr(colon + 1);
+
+    line_begin = i + 1;
+  }
+
+  return false;
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+// Stand-in peer behind a lossy link.
+
+class LossyPeer {
+ public:
+  enum class Kind : int { kOther, kPing, kState };
+
+  explicit LossyPeer(const double loss, const uint32_t seed)
+      : loss_(loss), random_(seed) {
+  }
+
+  bool Start() {
+    fd_ = socket(AF_INET, SOCK_DGRAM, 0);
+    if (fd_ < 0)
+      return false;
+
+    sockaddr_in addr = {};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (bind(fd_, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0)
+      return false;
+
+    socklen_t addr_len = sizeof(addr);
+    getsockname(fd_, reinterpret_cast<sockaddr*>(&addr), &addr_len);
+    port_ = ntohs(addr.sin_port);
+
+    thread_ = std::thread(&LossyPeer::Run, this);
+    return true;
+  }
+
+  void Stop() {
+    stop_ = true;
+    thread_.join();
+    close(fd_);
+  }
+
+  int port() const { return port_; }
+
+  // Starts the traffic and makes the link lossy.
+  void StartTraffic() { start_traffic_ = true; }
+
+  // Every message has been sent and acked, and the link holds no message
+  // of the channels any more.
+  bool IsDone() const { return done_; }
+
+  // Read after IsDone() or Stop().
+  std::vector<int64_t> first_sent_times_;   // Reliable, by sequence number.
+  std::vector<int> released_states_;        // In the order written to the client.
+  int states_sent_ = 0;
+
+  std::set<uint32_t> up_received_;
+  int up_duplicates_ = 0;
+  int up_mismatches_ = 0;
+
+  int resent_ = 0;
+  int pings_ = 0;                   // Requests that reached the peer.
+  int ping_requests_dropped_ = 0;
+  int pings_lost_ = 0;              // Requests or replies dropped.
+
+  int dropped_[2] = { 0, 0 };     // To the client, to the peer.
+  int reordered_[2] = { 0, 0 };
+
+ private:
+  struct Pending {
+    int64_t due;
+    uint64_t order;
+    bool to_client;
+    Kind kind;
+    int state;
+    std::string data;
+
+    bool operator<(const Pending &other) const {
+      if (due != other.due)
+        return due > other.due;
+      return order > other.order;
+    }
+  };
+
+  struct OutMessage {
+    std::string datagram;
+    int64_t last_sent = 0;
+    bool acked = false;
+  };
+
+  void Run() {
+    std::vector<char> buffer(65536);
+
+    for (;;) {
+      int64_t now = NowMicrosecond();
+      if (stop_)
+        break;
+
+      pollfd pfd = { fd_, POLLIN, 0 };
+      poll(&pfd, 1, 1);
+
+      for (;;) {
+        sockaddr_in from = {};
+        socklen_t from_len = sizeof(from);
+        ssize_t n = recvfrom(fd_, buffer.data(), buffer.size(), MSG_DONTWAIT,
+                             reinterpret_cast<sockaddr*>(&from), &from_len);
+        if (n < 0)
+          break;
+
+        if (!has_client_) {
+          client_ = from;
+          has_client_ = true;
+        }
+
+        std::string data(buffer.data(), n);
+        Kind kind = data.find("\"_ping_c\"") != std::string::npos ? Kind::kPing : Kind::kOther;
+        Link(false, kind, -1, data);
+      }
+
+      now = NowMicrosecond();
+      while (!link_.empty() && link_.top().due <= now) {
+        Pending p = link_.top();
+        link_.pop();
+
+        if (p.to_client) {
+          sendto(fd_, p.data.data(), p.data.size(), 0,
+                 reinterpret_cast<sockaddr*>(&client_), sizeof(client_));
+          if (p.kind == Kind::kState)
+            released_states_.push_back(p.state);
+        }
+        else {
+          OnDatagram(p.data);
+        }
+      }
+
+      if (start_traffic_ && !done_)
+        Send(now);
+    }
+  }
+
+  // Puts a datagram through the link.
+  void Link(const bool to_client, const Kind kind, const int state, const std::string &data) {
+    int direction = to_client ? 0 : 1;
+    std::uniform_real_distribution<double> uniform(0.0, 1.0);
+
+    if (lossy_ && uniform(random_) < loss_) {
+      ++dropped_[direction];
+      if (kind == Kind::kPing) {
+        ++pings_lost_;
+        if (!to_client)
+          ++ping_requests_dropped_;
+      }
+      return;
+    }
+
+    int64_t due = NowMicrosecond() + kLinkDelay;
+    if (lossy_ && uniform(random_) < kReorderRate) {
+      due += static_cast<int64_t>(uniform(random_) * kReorderExtraDelay);
+      ++reordered_[direction];
+    }
+
+    link_.push(Pending{ due, next_order_++, to_client, kind, state, data });
+  }
+
+  static std::string MakeDatagram(const std::string &header, const std::string &body) {
+    return "VER:1\n" + header + "LEN:" + std::to_string(body.size()) + "\n\n" + body;
+  }
+
+  void OnDatagram(const std::string &data) {
+    Datagram d;
+    if (!ParseDatagram(data.data(), data.size(), d))
+      return;
+
+    auto ch = d.header.find("CH");
+    if (ch == d.header.end()) {
+      if (d.body.find("\"_ping_c\"") != std::string::npos) {
+        ++pings_;
+        Link(true, Kind::kPing, -1, MakeDatagram("", d.body));
+      }
+      else if (d.body.find("\"_sid\"") == std::string::npos) {
+        Link(true, Kind::kOther, -1, MakeDatagram("",
+             "{\"_msgtype\":\"_session_opened\",\"_sid\":\"" + sid_ + "\"}"));
+      }
+      return;
+    }
+
+    if (atoi(ch->second.c_str()) != kReliableChannel)
+      return;
+
+    auto ack = d.header.find("CACK");
+    if (ack != d.header.end()) {
+      uint32_t next_seq = static_cast<uint32_t>(strtoul(ack->second.c_str(), nullptr, 10));
+      uint32_t bits = static_cast<uint32_t>(strtoul(d.header["CACKB"].c_str(), nullptr, 10));
+      for (uint32_t seq = send_base_; seq < next_seq && seq < out_.size(); ++seq)
+        out_[seq].acked = true;
+      for (uint32_t i = 0; i < 32; ++i) {
+        uint32_t seq = next_seq + 1 + i;
+        if ((bits & (1u << i)) && seq < out_.size())
+          out_[seq].acked = true;
+      }
+      while (send_base_ < out_.size() && out_[send_base_].acked)
+        ++send_base_;
+    }
+
+    auto cseq = d.header.find("CSEQ");
+    if (cseq == d.header.end())
+      return;
+
+    uint32_t seq = static_cast<uint32_t>(strtoul(cseq->second.c_str(), nullptr, 10));
+    if (!up_received_.insert(seq).second)
+      ++up_duplicates_;
+    if (GetN(d.body.c_str()) != static_cast<int>(seq))
+      ++up_mismatches_;
+
+    while (up_received_.count(up_next_))
+      ++up_next_;
+
+    // Acks every datagram, also a duplicate, since the last ack may have
+    // been lost.
+    uint32_t bits = 0;
+    for (uint32_t i = 0; i < 32; ++i) {
+      if (up_received_.count(up_next_ + 1 + i))
+        bits |= (1u << i);
+    }
+    Link(true, Kind::kOther, -1, MakeDatagram(
+         "CH:" + std::to_string(kReliableChannel) + "\n" +
+         "CACK:" + std::to_string(up_next_) + "\n" +
+         "CACKB:" + std::to_string(bits) + "\n", ""));
+  }
+
+  void SendReliable(const int64_t now) {
+    uint32_t seq = static_cast<uint32_t>(out_.size());
+    std::string body = "{\"_msgtype\":\"rel\",\"_sid\":\"" + sid_ + "\",\"n\":" + std::to_string(seq) + "}";
+
+    out_.emplace_back();
+    out_.back().datagram = MakeDatagram(
+        "CH:" + std::to_string(kReliableChannel) + "\nCSEQ:" + std::to_string(seq) + "\n", body);
+    out_.back().last_sent = now;
+    first_sent_times_.push_back(now);
+    Link(true, Kind::kOther, -1, out_.back().datagram);
+  }
+
+  void Send(const int64_t now) {
+    if (!lossy_) {
+      lossy_ = true;
+      traffic_start_ = now;
+    }
+
+    int64_t elapsed_ms = (now - traffic_start_) / 1000;
+    const uint32_t total = kSteadyMessages + kBurstMessages;
+
+    // Reliable: one per millisecond, then the burst.
+    while (out_.size() < total && out_.size() - send_base_ < kPeerSendWindow &&
+           (out_.size() >= static_cast<size_t>(kSteadyMessages) ||
+            static_cast<int64_t>(out_.size()) <= elapsed_ms)) {
+      if (out_.size() >= static_cast<size_t>(kSteadyMessages) && !steady_done_) {
+        // The burst starts once the steady messages are acked.
+        if (send_base_ < static_cast<uint32_t>(kSteadyMessages))
+          break;
+        steady_done_ = true;
+      }
+      SendReliable(now);
+    }
+
+    for (uint32_t seq = send_base_; seq < out_.size(); ++seq) {
+      OutMessage &m = out_[seq];
+      if (!m.acked && now - m.last_sent >= kPeerRto) {
+        m.last_sent = now;
+        ++resent_;
+        Link(true, Kind::kOther, -1, m.datagram);
+      }
+    }
+
+    // Sequenced: one per millisecond.
+    while (states_sent_ < kStateUpdates && states_sent_ <= elapsed_ms) {
+      std::string body = "{\"_msgtype\":\"state\",\"_sid\":\"" + sid_ + "\",\"n\":" +
+                         std::to_string(states_sent_) + "}";
+      Link(true, Kind::kState, states_sent_, MakeDatagram(
+           "CH:" + std::to_string(kSequencedChannel) + "\nCSEQ:" +
+           std::to_string(states_sent_) + "\n", body));
+      ++states_sent_;
+    }
+
+    bool link_has_channel_messages = false;
+    {
+      // The queue cannot be iterated, so it is copied. It is short.
+      auto copy = link_;
+      while (!copy.empty()) {
+        if (copy.top().kind != Kind::kPing) {
+          link_has_channel_messages = true;
+          break;
+        }
+        copy.pop();
+      }
+    }
+
+    if (send_base_ == total && states_sent_ == kStateUpdates &&
+        up_received_.size() == static_cast<size_t>(kUpMessages) &&
+        !link_has_channel_messages) {
+      done_ = true;
+    }
+  }
+
+  double loss_;
+  std::mt19937 random_;
+  int fd_ = -1;
+  int port_ = 0;
+  std::thread thread_;
+  std::atomic<bool> stop_{false};
+  std::atomic<bool> start_traffic_{false};
+  std::atomic<bool> done_{false};
+
+  sockaddr_in client_ = {};
+  bool has_client_ = false;
+  const std::string sid_ = "lossy-peer-session";
+
+  bool lossy_ = false;
+  int64_t traffic_start_ = 0;
+  uint64_t next_order_ = 0;
+  std::priority_queue<Pending> link_;
+
+  std::vector<OutMessage> out_;
+  uint32_t send_base_ = 0;
+  bool steady_done_ = false;
+
+  uint32_t up_next_ = 0;
+};
+
+
+void Run(const double loss, const uint32_t seed) {
+  printf("loss %.0f%%, reorder %.0f%% (+0-%lldms), delay %lldms each way\n",
+         loss * 100, kReorderRate * 100,
+         static_cast<long long>(kReorderExtraDelay / 1000),
+         static_cast<long long>(kLinkDelay / 1000));
+  fflush(stdout);
+
+  LossyPeer peer(loss, seed);
+  if (!peer.Start()) {
+    Check(false, "start", "failed to start the peer");
+    return;
+  }
+
+  auto option = fun::FunapiUdpTransportOption::Create();
+  option->AddChannel(kReliableChannel, fun::UdpChannelType::kReliableOrdered);
+  option->AddChannel(kSequencedChannel, fun::UdpChannelType::kUnreliableSequenced);
+  option->SetEnablePing(true);
+
+  bool is_opened = false;
+  bool is_stopped = false;
+  std::vector<int> reliable;
+  std::vector<int64_t> reliable_times;
+  std::vector<int> states;
+
+  auto session = fun::FunapiSession::Create("127.0.0.1");
+  session->AddSessionEventCallback(
+      [&is_opened](const std::shared_ptr<fun::FunapiSession> &,
+                   const fun::TransportProtocol,
+                   const fun::SessionEventType type,
+                   const fun::string &,
+                   const std::shared_ptr<fun::FunapiError> &)
+  {
+    if (type == fun::SessionEventType::kOpened)
+      is_opened = true;
+  });
+  session->AddTransportEventCallback(
+      [&is_stopped](const std::shared_ptr<fun::FunapiSession> &,
+                    const fun::TransportProtocol,
+                    const fun::TransportEventType type,
+                    const std::shared_ptr<fun::FunapiError> &)
+  {
+    if (type == fun::TransportEventType::kStopped)
+      is_stopped = true;
+  });
+  session->AddJsonRecvCallback(
+      [&](const std::shared_ptr<fun::FunapiSession> &,
+          const fun::TransportProtocol,
+          const fun::string &msg_type,
+          const fun::string &body)
+  {
+    if (msg_type == "rel") {
+      reliable.push_back(GetN(body.c_str()));
+      reliable_times.push_back(NowMicrosecond());
+    }
+    else if (msg_type == "state") {
+      states.push_back(GetN(body.c_str()));
+    }
+  });
+
+  session->Connect(fun::TransportProtocol::kUdp, peer.port(), fun::FunEncoding::kJson, option);
+
+  int64_t deadline = NowMicrosecond() + 5 * 1000000LL;
+  while (!is_opened && NowMicrosecond() < deadline) {
+    fun::FunapiSession::UpdateAll();
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+
+  if (!is_opened) {
+    Check(false, "open", "the session was not opened");
+    peer.Stop();
+    return;
+  }
+
+  peer.StartTraffic();
+
+  int up_sent = 0;
+  int64_t start = NowMicrosecond();
+  deadline = start + 60 * 1000000LL;
+  while (!peer.IsDone() && !is_stopped && NowMicrosecond() < deadline) {
+    int64_t elapsed_ms = (NowMicrosecond() - start) / 1000;
+    while (up_sent < kUpMessages && up_sent <= elapsed_ms / 2) {
+      std::string body = "{\"n\":" + std::to_string(up_sent) + "}";
+      session->SendChannelMessage(kReliableChannel, "up", body.c_str());
+      ++up_sent;
+    }
+
+    fun::FunapiSession::UpdateAll();
+    std::this_thread::sleep_for(std::chrono::microseconds(200));
+  }
+
+  bool is_done = peer.IsDone();
+  double seconds = (NowMicrosecond() - start) / 1e6;
+
+  // Lets the last datagrams written to the client be handed over.
+  for (int i = 0; i < 200; ++i) {
+    fun::FunapiSession::UpdateAll();
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+
+  // The first ping goes 3 seconds after the start. The link stays lossy.
+  fun::FunapiRttStats rtt;
+  deadline = NowMicrosecond() + 15 * 1000000LL;
+  while (!is_stopped && NowMicrosecond() < deadline) {
+    rtt = session->GetRttStats(fun::TransportProtocol::kUdp);
+    if (rtt.samples >= kPingSamples)
+      break;
+
+    fun::FunapiSession::UpdateAll();
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+
+  peer.Stop();
+  session->Close();
+
+  Check(is_done && !is_stopped, "complete",
+        Format("%.1fs, transport %s", seconds, is_stopped ? "stopped" : "up"));
+
+  Check((loss == 0 || (peer.dropped_[0] > 0 && peer.dropped_[1] > 0)) &&
+        peer.reordered_[0] > 0 && peer.reordered_[1] > 0,
+        "link",
+        Format("dropped %d/%d, reordered %d/%d (to client/to peer)",
+               peer.dropped_[0], peer.dropped_[1], peer.reordered_[0], peer.reordered_[1]));
+
+  // Reliable down.
+  {
+    const int total = kSteadyMessages + kBurstMessages;
+    bool in_order = static_cast<int>(reliable.size()) == total;
+    for (int i = 0; in_order && i < total; ++i)
+      in_order = reliable[i] == i;
+
+    Check(in_order, "reliable down",
+          Format("%zu/%d handed over in order, %d resent by the peer", reliable.size(), total, peer.resent_));
+
+    std::vector<int64_t> latencies;
+    for (size_t i = 0; i < reliable.size(); ++i) {
+      int n = reliable[i];
+      if (n >= 0 && n < kSteadyMessages && n < static_cast<int>(peer.first_sent_times_.size()))
+        latencies.push_back(reliable_times[i] - peer.first_sent_times_[n]);
+    }
+    printf("       %-15s p50=%.1fms p99=%.1fms max=%.1fms (one way, link delay %lldms)\n",
+           "latency",
+           Percentile(latencies, 0.5) / 1e3,
+           Percentile(latencies, 0.99) / 1e3,
+           Percentile(latencies, 1.0) / 1e3,
+           static_cast<long long>(kLinkDelay / 1000));
+  }
+
+  // Reliable up.
+  Check(peer.up_received_.size() == static_cast<size_t>(kUpMessages) && peer.up_mismatches_ == 0,
+        "reliable up",
+        Format("%zu/%d received, %d duplicates, %d body mismatches",
+               peer.up_received_.size(), kUpMessages, peer.up_duplicates_, peer.up_mismatches_));
+
+  // Sequenced down. The socket keeps the order the link wrote in.
+  {
+    std::vector<int> expected;
+    for (int s : peer.released_states_) {
+      if (expected.empty() || s > expected.back())
+        expected.push_back(s);
+    }
+
+    Check(states == expected, "sequenced down",
+          Format("%zu handed over, %zu stale dropped, %zu lost of %d",
+                 states.size(),
+                 peer.released_states_.size() - expected.size(),
+                 kStateUpdates - peer.released_states_.size(),
+                 peer.states_sent_));
+  }
+
+  // UDP pings.
+  Check(rtt.samples >= kPingSamples && rtt.min_rtt >= 2 * kLinkDelay / 1000 - 1, "rtt",
+        Format("%d samples, srtt=%lldms min=%lldms p99=%lldms, loss %.0f%% (peer saw %d/%d lost)",
+               rtt.samples,
+               static_cast<long long>(rtt.srtt),
+               static_cast<long long>(rtt.min_rtt),
+               static_cast<long long>(rtt.p99),
+               rtt.loss_rate * 100,
+               peer.pings_lost_, peer.pings_ + peer.ping_requests_dropped_));
+}
+
+}  // namespace
+
+
+int main(int argc, char *argv[]) {
+  if (argc > 2) {
+    fprintf(stderr, "Usage: %s [<loss percent>]\n", argv[0]);
+    return 1;
+  }
+
+  bench::StartupPluginModule();
+
+  if (argc == 2) {
+    Run(atof(argv[1]) / 100, 38);
+  }
+  else {
+    Run(0.01, 38);
+    Run(0.05, 39);
+  }
+
+  printf("%s\n", g_failures == 0 ? "PASS" : "FAIL");
+  fflush(stdout);
+
+  // The plugin threads are not joined on exit.
+  _exit(g_failures == 0 ? 0 : 1);
+}
@@ -0,0 +1,393 @@
+// Copyright (C) 2013-2019 iFunFactory Inc. All Rights Reserved.
+//
+// This work is confidential and proprietary to iFunFactory Inc. and
+// must not be used, disclosed, copied, or distributed without the prior
+// consent of iFunFactory Inc.
+
+
+// Send path benchmark of the UDP transport on loopback.
+//
+// A sink thread counts the datagrams it receives. <batch> datagrams are
+// sent at a time, and the next batch waits until the sink has them all,
+// like the messages of one game frame. sendto() and sendmmsg() are counted
+// by wrapping them in this program.
+//
+//   raw     the datagrams of the plugin written straight to a socket with
+//           sendto() each, one sendmmsg() per batch, or one GSO message
+//           per batch: what the system calls cost at best
+//   plugin  JSON messages sent with FunapiSession::SendMessage on the UDP
+//           transport, calling FunapiSession::UpdateAll. With
+//           FUNAPI_HAVE_UDP_MMSG the transport uses sendmmsg, and GSO with
+//           FunapiUdpTransportOption::SetSegmentOffload. Built with
+//           UDP_MMSG=0 it uses the sendto() path of the other platforms.
+//
+// Build (Linux, see Tools/bench_support/build.sh):
+//
+//   Tools/bench_support/build.sh udp_send_bench Tools/udp_send_bench/udp_send_bench.cpp
+//   UDP_MMSG=0 OUT=/tmp/funapi_bench_sendto \
+//     Tools/bench_support/build.sh udp_send_bench_sendto Tools/udp_send_bench/udp_send_bench.cpp
+//
+// Usage:
+//
+//   udp_send_bench [<datagrams> [<payload bytes> [<batch>]]]
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/udp.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "plugin_module.h"
+#include "funapi_session.h"
+#include "funapi_option.h"
+
+namespace {
+
+std::atomic<int64_t> g_send_calls(0);
+
+}  // namespace
+
+
+// Counts the send calls of the plugin, which is linked into this program.
+extern "C" {
+
+ssize_t sendto(int fd, const void *buf, size_t len, int flags,
+               const struct sockaddr *addr, socklen_t addr_len) {
+  ++g_send_calls;
+  return syscall(SYS_sendto, fd, buf, len, flags, addr, addr_len);
+}
+
+
+int sendmmsg(int fd, struct mmsghdr *msgs, unsigned int count, int flags) {
+  ++g_send_calls;
+  return static_cast<int>(syscall(SYS_sendmmsg, fd, msgs, count, flags));
+}
+
+}  // extern "C"
+
+
+#ifndef UDP_SEGMENT
+#define UDP_SEGMENT 103
+#endif
+
+
+namespace {
+
+int64_t NowNanosecond() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+    std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+
+// Counts the datagrams received. With opens_session, the first datagram
+// is answered with _session_opened and not counted.
+class Sink {
+ public:
+  explicit Sink(const bool opens_session) : is_opened_(!opens_session) {
+  }
+
+  bool Start() {
+    fd_ = socket(AF_INET, SOCK_DGRAM, 0);
+    if (fd_ < 0)
+      return false;
+
+    int buffer_size = 16 * 1024 * 1024;
+    setsockopt(fd_, SOL_SOCKET, SO_RCVBUF, &buffer_size, sizeof(buffer_size));
+
+    timeval timeout = { 0, 100000 };
+    setsockopt(fd_, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+    sockaddr_in addr = {};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t addr_len = sizeof(addr);
+    if (bind(fd_, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0 ||
+        getsockname(fd_, reinterpret_cast<sockaddr*>(&addr), &addr_len) != 0)
+      return false;
+    port_ = ntohs(addr.sin_port);
+
+    thread_ = std::thread([this]() { Receive(); });
+    return true;
+  }
+
+  void Stop() {
+    is_running_ = false;
+    thread_.join();
+    close(fd_);
+  }
+
+  int port() const { return port_; }
+  int64_t received() const { return received_; }
+
+ private:
+  void Receive() {
+    const int kBatch = 64;
+    static char buffers[kBatch][2048];
+    mmsghdr msgs[kBatch];
+    iovec iovs[kBatch];
+    sockaddr_in from = {};
+
+    while (is_running_) {
+      if (!is_opened_) {
+        socklen_t from_len = sizeof(from);
+        ssize_t n = recvfrom(fd_, buffers[0], sizeof(buffers[0]), 0,
+                             reinterpret_cast<sockaddr*>(&from), &from_len);
+        if (n <= 0)
+          continue;
+
+        const std::string body =
+            "{\"_msgtype\":\"_session_opened\",\"_sid\":\"udp-send-bench\"}";
+        const std::string opened = "VER:1\nLEN:" + std::to_string(body.size()) + "\n\n" + body;
+        ::sendto(fd_, opened.data(), opened.size(), 0,
+                 reinterpret_cast<sockaddr*>(&from), sizeof(from));
+        is_opened_ = true;
+        continue;
+      }
+
+      for (int i = 0; i < kBatch; ++i) {
+        iovs[i].iov_base = buffers[i];
+        iovs[i].iov_len = sizeof(buffers[i]);
+        memset(&msgs[i], 0, sizeof(msgs[i]));
+        msgs[i].msg_hdr.msg_iov = &iovs[i];
+        msgs[i].msg_hdr.msg_iovlen = 1;
+      }
+
+      int n = recvmmsg(fd_, msgs, kBatch, MSG_WAITFORONE, nullptr);
+      if (n > 0)
+        received_ += n;
+    }
+  }
+
+  int fd_ = -1;
+  int port_ = 0;
+  std::thread thread_;
+  std::atomic<bool> is_running_{ true };
+  bool is_opened_;
+  std::atomic<int64_t> received_{ 0 };
+};
+
+
+// Waits until the sink has received count datagrams.
+template <typename Wait>
+bool WaitForSink(const Sink &sink, const int64_t count, Wait wait) {
+  int64_t deadline = NowNanosecond() + 1000000000LL;
+  while (sink.received() < count) {
+    if (NowNanosecond() > deadline)
+      return false;
+    wait();
+  }
+
+  return true;
+}
+
+
+void Print(const char *section, const char *name, const int64_t received,
+           const double seconds, const int64_t calls, const bool is_complete) {
+  printf("%-6s %-9s %9.0f datagrams/s  %5.3f send syscalls/datagram%s\n",
+         section, name, received / seconds,
+         received > 0 ? static_cast<double>(calls) / received : 0.0,
+         is_complete ? "" : "  (datagrams lost)");
+  fflush(stdout);
+}
+
+
+enum class RawMode { kSendto, kSendmmsg, kGso };
+
+
+bool RunRaw(const char *name, const RawMode mode, const int datagrams,
+            const std::string &datagram, const int batch) {
+  Sink sink(false);
+  if (!sink.Start()) {
+    fprintf(stderr, "Failed to start the sink.\n");
+    return false;
+  }
+
+  int fd = socket(AF_INET, SOCK_DGRAM, 0);
+  sockaddr_in addr = {};
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  addr.sin_port = htons(sink.port());
+  if (fd < 0 || connect(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0) {
+    fprintf(stderr, "Failed to connect to the sink.\n");
+    sink.Stop();
+    return false;
+  }
+
+  const size_t size = datagram.size();
+  if (mode == RawMode::kGso) {
+    int segment_size = static_cast<int>(size);
+    if (setsockopt(fd, IPPROTO_UDP, UDP_SEGMENT, &segment_size, sizeof(segment_size)) != 0) {
+      printf("raw    %-9s not supported by the kernel\n", name);
+      close(fd);
+      sink.Stop();
+      return true;
+    }
+  }
+
+  std::string buffer;
+  for (int i = 0; i < batch; ++i)
+    buffer += datagram;
+
+  std::vector<mmsghdr> msgs(batch);
+  std::vector<iovec> iovs(batch);
+
+  int64_t base_calls = g_send_calls;
+  int64_t start = NowNanosecond();
+  bool is_complete = true;
+
+  for (int sent = 0; sent < datagrams && is_complete; ) {
+    int count = std::min(batch, datagrams - sent);
+    char *data = &buffer[0];
+
+    if (mode == RawMode::kSendto) {
+      for (int i = 0; i < count; ++i)
+        sendto(fd, data + i * size, size, 0, nullptr, 0);
+    }
+    else {
+      // GSO sends the whole batch as one message of equal segments.
+      int num_msgs = mode == RawMode::kGso ? 1 : count;
+      for (int i = 0; i < num_msgs; ++i) {
+        iovs[i].iov_base = data + i * size;
+        iovs[i].iov_len = mode == RawMode::kGso ? size * count : size;
+        memset(&msgs[i], 0, sizeof(msgs[i]));
+        msgs[i].msg_hdr.msg_iov = &iovs[i];
+        msgs[i].msg_hdr.msg_iovlen = 1;
+      }
+
+      for (int done = 0; done < num_msgs; ) {
+        int n = sendmmsg(fd, msgs.data() + done, num_msgs - done, 0);
+        if (n <= 0)
+          break;
+        done += n;
+      }
+    }
+    sent += count;
+
+    is_complete = WaitForSink(sink, sent, []() { std::this_thread::yield(); });
+  }
+
+  double seconds = (NowNanosecond() - start) / 1e9;
+  Print("raw", name, sink.received(), seconds, g_send_calls - base_calls, is_complete);
+
+  close(fd);
+  sink.Stop();
+  return is_complete;
+}
+
+
+bool RunPlugin(const char *name, const bool segment_offload, const int datagrams,
+               const int payload_size, const int batch) {
+  Sink sink(true);
+  if (!sink.Start()) {
+    fprintf(stderr, "Failed to start the sink.\n");
+    return false;
+  }
+
+  bool is_opened = false;
+  auto session = fun::FunapiSession::Create("127.0.0.1");
+  session->AddSessionEventCallback(
+      [&is_opened](const std::shared_ptr<fun::FunapiSession> &,
+                   const fun::TransportProtocol,
+                   const fun::SessionEventType type,
+                   const fun::string &,
+                   const std::shared_ptr<fun::FunapiError> &)
+  {
+    if (type == fun::SessionEventType::kOpened)
+      is_opened = true;
+  });
+
+  auto option = fun::FunapiUdpTransportOption::Create();
+  option->SetSegmentOffload(segment_offload);
+  session->Connect(fun::TransportProtocol::kUdp, sink.port(), fun::FunEncoding::kJson, option);
+
+  int64_t deadline = NowNanosecond() + 5 * 1000000000LL;
+  while (!is_opened && NowNanosecond() < deadline) {
+    fun::FunapiSession::UpdateAll();
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+
+  if (!is_opened) {
+    fprintf(stderr, "%s: the session was not opened.\n", name);
+    sink.Stop();
+    return false;
+  }
+
+  // Same size for every message, so GSO can send a batch at once.
+  const fun::string body = "{\"data\":\"" + fun::string(payload_size, 'x') + "\"}";
+
+  int64_t base_received = sink.received();
+  int64_t base_calls = g_send_calls;
+  int64_t start = NowNanosecond();
+  bool is_complete = true;
+
+  for (int sent = 0; sent < datagrams && is_complete; ) {
+    int count = std::min(batch, datagrams - sent);
+    for (int i = 0; i < count; ++i)
+      session->SendMessage("echo", body, fun::TransportProtocol::kUdp);
+    sent += count;
+
+    is_complete = WaitForSink(sink, base_received + sent, []() {
+      fun::FunapiSession::UpdateAll();
+    });
+  }
+
+  double seconds = (NowNanosecond() - start) / 1e9;
+  Print("plugin", name, sink.received() - base_received, seconds,
+        g_send_calls - base_calls, is_complete);
+
+  session->Close();
+  for (int i = 0; i < 100; ++i) {
+    fun::FunapiSession::UpdateAll();
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+  sink.Stop();
+
+  return is_complete;
+}
+
+}  // namespace
+
+
+int main(int argc, char *argv[]) {
+  const int datagrams = argc > 1 ? atoi(argv[1]) : 50000;
+  const int payload_size = argc > 2 ? atoi(argv[2]) : 100;
+  const int batch = argc > 3 ? atoi(argv[3]) : 32;
+  if (argc > 4 || datagrams <= 0 || payload_size < 0 || batch <= 0) {
+    fprintf(stderr, "Usage: %s [<datagrams> [<payload bytes> [<batch>]]]\n", argv[0]);
+    return 1;
+  }
+
+  bench::StartupPluginModule();
+
+  // What the plugin sends for a message of the same payload.
+  const std::string body = "{\"data\":\"" + std::string(payload_size, 'x') +
+                           "\",\"_msgtype\":\"echo\",\"_sid\":\"udp-send-bench\"}";
+  const std::string datagram = "VER:1\nLEN:" + std::to_string(body.size()) + "\n\n" + body;
+
+  bool ok = true;
+  ok = RunRaw("sendto", RawMode::kSendto, datagrams, datagram, batch) && ok;
+  ok = RunRaw("sendmmsg", RawMode::kSendmmsg, datagrams, datagram, batch) && ok;
+  ok = RunRaw("gso", RawMode::kGso, datagrams, datagram, std::min(batch, 64)) && ok;
+
+#if FUNAPI_HAVE_UDP_MMSG
+  ok = RunPlugin("sendmmsg", false, datagrams, payload_size, batch) && ok;
+  ok = RunPlugin("gso", true, datagrams, payload_size, batch) && ok;
+#else
+  ok = RunPlugin("sendto", false, datagrams, payload_size, batch) && ok;
+#endif
+
+  // The plugin threads are not joined on exit.
+  fflush(stdout);
+  _exit(ok ? 0 : 1);
+}
@@ -0,0 +1,147 @@
+#!/usr/bin/env python3
+# vim: fileencoding=utf-8 tabstop=2 softtabstop=2 shiftwidth=2 expandtab
+# Copyright (C) 2013-2019 iFunFactory Inc. All Rights Reserved.
+#
+# This work is confidential and proprietary to iFunFactory Inc. and
+# must not be used, disclosed, copied, or distributed without the prior
+# consent of iFunFactory Inc.
+
+
+# Trains zstd dictionaries from message bodies captured with
+# FunapiSession::SetRecvCaptureCallback.
+#
+# Capture layout (one decoded message body per file):
+#
+#   <capture_dir>/json/*.bin
+#   <capture_dir>/protobuf/*.bin
+#
+# Usage:
+#
+#   train_zstd_dict.py --dict-id 3 <capture_dir> <output_dir>
+#
+# For each encoding it writes <encoding>.v<dict id>.dict and
+# <encoding>.v<dict id>.b64. The dictionary ID is stored in the dictionary
+# header and is sent in the compression header field ("C") so that the
+# client and server can switch dictionary versions at runtime. The client
+# only adds it after the server has sent one, so servers that read "C" as a
+# plain length keep working.
+# The .b64 content is the value for SetZstdDictBase64String
+# (several versions can be joined with ',').
+#
+# Requires the zstd command line tool in PATH.
+
+import argparse
+import base64
+import os
+import re
+import subprocess
+import sys
+
+
+ENCODINGS = ('json', 'protobuf')
+
+BENCH_RE = re.compile(
+    r'(\d+) ->\s+(\d+) \(x?([\d.]+)\),\s+([\d.]+) MB/s,\s+([\d.]+) MB/s')
+
+
+def ListSamples(path):
+  samples = []
+  for name in sorted(os.listdir(path)):
+    full_path = os.path.join(path, name)
+    if os.path.isfile(full_path) and os.path.getsize(full_path) > 0:
+      samples.append(full_path)
+  return samples
+
+
+def Train(samples, dict_path, dict_id, max_dict_size):
+  cmd = ['zstd', '-q', '-f', '--train'] + samples + [
+      '-o', dict_path,
+      '--dictID=%d' % dict_id,
+      '--maxdict=%d' % max_dict_size]
+  subprocess.check_call(cmd)
+
+
+def Bench(samples, dict_path, level):
+  cmd = ['zstd', '-b%d' % level, '-i1']
+  if dict_path:
+    cmd += ['-D', dict_path]
+  cmd += samples
+
+  output = subprocess.run(cmd, stdout=subprocess.PIPE, stderr=subprocess.STDOUT,
+                          check=True).stdout.decode('utf-8', 'replace')
+
+  # The progress line is rewritten with '\r'. The last match is the result.
+  matches = BENCH_RE.findall(output)
+  if not matches:
+    return None
+
+  src_size, dst_size, _, comp_speed, decomp_speed = matches[-1]
+  return (int(src_size), int(dst_size), float(comp_speed), float(decomp_speed))
+
+
+def Report(encoding, samples, dict_path, level):
+  avg_size = sum(os.path.getsize(s) for s in samples) / float(len(samples))
+  print('[%s] %d samples, %.1f bytes/message' % (encoding, len(samples), avg_size))
+
+  for label, path in (('no dict', None), ('dict', dict_path)):
+    result = Bench(samples, path, level)
+    if result is None:
+      print('  %-8s: failed to run benchmark' % label)
+      continue
+
+    src_size, dst_size, comp_speed, decomp_speed = result
+    # MB/s -> micro seconds per average message.
+    comp_us = avg_size / (comp_speed * 1000000.0) * 1000000.0
+    decomp_us = avg_size / (decomp_speed * 1000000.0) * 1000000.0
+    print('  %-8s: ratio x%.3f, compress %.2f us/msg, decompress %.2f us/msg' % (
+        label, float(src_size) / max(dst_size, 1), comp_us, decomp_us))
+
+
+def main():
+  parser = argparse.ArgumentParser(description='Trains versioned zstd dictionaries.')
+  parser.add_argument('capture_dir')
+  parser.add_argument('output_dir')
+  parser.add_argument('--dict-id', type=int, required=True,
+                      help='dictionary version id (1 ~ 2^31-1)')
+  parser.add_argument('--max-dict-size', type=int, default=16 * 1024)
+  parser.add_argument('--level', type=int, default=1,
+                      help='compression level used by the plugin (default: 1)')
+  args = parser.parse_args()
+
+  if args.dict_id <= 0 or args.dict_id >= (1 << 31):
+    # 0 means "no dictionary id" and ids over 2^31 are reserved by zstd.
+    sys.exit('--dict-id must be between 1 and 2^31-1')
+
+  if not os.path.isdir(args.output_dir):
+    os.makedirs(args.output_dir)
+
+  trained = 0
+  for encoding in ENCODINGS:
+    sample_dir = os.path.join(args.capture_dir, encoding)
+    if not os.path.isdir(sample_dir):
+      continue
+
+    samples = ListSamples(sample_dir)
+    if len(samples) < 10:
+      print('[%s] not enough samples (%d), skipped' % (encoding, len(samples)))
+      continue
+
+    base_name = os.path.join(args.output_dir, '%s.v%d' % (encoding, args.dict_id))
+    dict_path = base_name + '.dict'
+    Train(samples, dict_path, args.dict_id, args.max_dict_size)
+
+    with open(dict_path, 'rb') as f:
+      encoded = base64.b64encode(f.read())
+    with open(base_name + '.b64', 'wb') as f:
+      f.write(encoded)
+
+    Report(encoding, samples, dict_path, args.level)
+    print('  written: %s, %s' % (dict_path, base_name + '.b64'))
+    trained += 1
+
+  if trained == 0:
+    sys.exit('No dictionary was trained.')
+
+
+if __name__ == '__main__':
+  main()